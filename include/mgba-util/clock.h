@@ -0,0 +1,18 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <mgba-util/common.h>
+
+CXX_GUARD_START
+
+// Wall-clock time in microseconds since the epoch, or 0 if the clock can't be read
+uint64_t currentTimeUsec(void);
+
+CXX_GUARD_END
+
+#endif
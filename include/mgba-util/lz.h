@@ -0,0 +1,21 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#ifndef LZ_H
+#define LZ_H
+
+#include <mgba-util/common.h>
+
+CXX_GUARD_START
+
+// Byte-oriented LZ77 in the style of LZ4: fast to compress, and much faster to
+// decompress, at a moderate ratio. Intended for transient in-memory data.
+size_t lzCompressBound(size_t size);
+size_t lzCompress(const void* input, size_t inputSize, void* output, size_t outputSize);
+size_t lzDecompress(const void* input, size_t inputSize, void* output, size_t outputSize);
+
+CXX_GUARD_END
+
+#endif
@@ -55,6 +55,17 @@ static inline unsigned clz32(uint32_t bits) {
 #endif
 }
 
+static inline unsigned ctz32(uint32_t bits) {
+	if (!bits) {
+		return 32;
+	}
+#if defined(__GNUC__) || __clang__
+	return __builtin_ctz(bits);
+#else
+	return popcount32((bits & (~bits + 1)) - 1);
+#endif
+}
+
 static inline uint32_t toPow2(uint32_t bits) {
 	if (!bits) {
 		return 0;
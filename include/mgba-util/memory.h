@@ -13,6 +13,15 @@ CXX_GUARD_START
 void* anonymousMemoryMap(size_t size);
 void mappedMemoryFree(void* memory, size_t size);
 
+// Anonymous memory that can be mapped more than once. Copy-on-write mappings only get private
+// copies of the pages written through them, so many of them can share one image. Creation fails
+// on platforms that can't do this.
+struct SharedMemory;
+struct SharedMemory* sharedMemoryCreate(size_t size);
+void sharedMemoryDestroy(struct SharedMemory*);
+void* sharedMemoryMap(struct SharedMemory*, bool copyOnWrite);
+void sharedMemoryUnmap(struct SharedMemory*, void* memory);
+
 CXX_GUARD_END
 
 #endif
@@ -76,6 +76,12 @@ struct VFile* VFileMemChunk(const void* mem, size_t size);
 struct CircleBuffer;
 struct VFile* VFileFIFO(struct CircleBuffer* backing);
 
+// Keeps the contents of backing in memory and writes back only the sectors that changed,
+// off the calling thread, whenever it is synced or closed. If a journal directory is provided,
+// each writeback is first committed to journalName there, which is deleted once the write has
+// finished and replayed on open if it was interrupted. Takes ownership of backing and journalDir.
+struct VFile* VFileWriteback(struct VFile* backing, struct VDir* journalDir, const char* journalName);
+
 struct VDir* VDirOpen(const char* path);
 struct VDir* VDirOpenArchive(const char* path);
 
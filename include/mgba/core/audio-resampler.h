@@ -0,0 +1,63 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#ifndef M_AUDIO_RESAMPLER_H
+#define M_AUDIO_RESAMPLER_H
+
+#include <mgba-util/common.h>
+
+CXX_GUARD_START
+
+#include <mgba/core/interface.h>
+
+#define mAUDIO_RESAMPLER_PHASE_BITS 8
+#define mAUDIO_RESAMPLER_PHASES (1 << mAUDIO_RESAMPLER_PHASE_BITS)
+
+enum mAudioResamplerQuality {
+	mAUDIO_RESAMPLER_LINEAR = 0,
+	mAUDIO_RESAMPLER_FAST,
+	mAUDIO_RESAMPLER_GOOD,
+	mAUDIO_RESAMPLER_BEST,
+};
+
+// Stereo-interleaved polyphase resampler. The core writes native-rate frames
+// with mAudioResamplerWrite and the frontend reads output-rate frames with
+// mAudioResamplerRead. Both channels are filtered in a single pass.
+struct mAudioResampler {
+	enum mAudioResamplerQuality quality;
+	unsigned taps;
+	int16_t* kernel;
+	double cutoff;
+
+	double inputRate;
+	double outputRate;
+	uint64_t step;
+	uint64_t position;
+
+	struct mStereoSample* input;
+	size_t inputSize;
+	size_t inputCapacity;
+
+	struct mStereoSample* output;
+	size_t outputCapacity;
+	size_t outputRead;
+	size_t outputWrite;
+};
+
+void mAudioResamplerInit(struct mAudioResampler*, size_t capacity, enum mAudioResamplerQuality);
+void mAudioResamplerDeinit(struct mAudioResampler*);
+
+void mAudioResamplerSetQuality(struct mAudioResampler*, enum mAudioResamplerQuality);
+void mAudioResamplerSetInputRate(struct mAudioResampler*, double rate);
+void mAudioResamplerSetOutputRate(struct mAudioResampler*, double rate);
+void mAudioResamplerClear(struct mAudioResampler*);
+
+size_t mAudioResamplerWrite(struct mAudioResampler*, const struct mStereoSample* samples, size_t count);
+size_t mAudioResamplerAvailable(const struct mAudioResampler*);
+size_t mAudioResamplerRead(struct mAudioResampler*, int16_t* samples, size_t count);
+
+CXX_GUARD_END
+
+#endif
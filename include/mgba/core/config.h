@@ -33,6 +33,8 @@ struct mCoreOptions {
 	int frameskip;
 	bool rewindEnable;
 	int rewindBufferCapacity;
+	int rewindBufferBytes;
+	int runAhead;
 	float fpsTarget;
 	size_t audioBuffers;
 	unsigned sampleRate;
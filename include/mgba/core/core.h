@@ -32,6 +32,7 @@ enum mCoreChecksumType {
 	mCHECKSUM_CRC32,
 };
 
+struct mAudioResampler;
 struct mCoreConfig;
 struct mCoreSync;
 struct mDebuggerSymbols;
@@ -76,6 +77,7 @@ struct mCore {
 	struct blip_t* (*getAudioChannel)(struct mCore*, int ch);
 	void (*setAudioBufferSize)(struct mCore*, size_t samples);
 	size_t (*getAudioBufferSize)(struct mCore*);
+	void (*setAudioResampler)(struct mCore*, struct mAudioResampler*);
 
 	void (*addCoreCallbacks)(struct mCore*, struct mCoreCallbacks*);
 	void (*clearCoreCallbacks)(struct mCore*);
@@ -93,6 +95,7 @@ struct mCore {
 	bool (*selectBIOS)(struct mCore*, int biosID);
 
 	bool (*loadPatch)(struct mCore*, struct VFile* vf);
+	bool (*shareROM)(struct mCore*, struct mCore* source);
 
 	void (*reset)(struct mCore*);
 	void (*runFrame)(struct mCore*);
@@ -102,6 +105,15 @@ struct mCore {
 	size_t (*stateSize)(struct mCore*);
 	bool (*loadState)(struct mCore*, const void* state);
 	bool (*saveState)(struct mCore*, void* state);
+	// The sections of the state, in order and non-overlapping. Ids start at 1. Optional.
+	size_t (*listStateSections)(const struct mCore*, const struct mCoreStateSection**);
+
+	// Incremental snapshots: the image is paged in mSTATE_PAGE_SIZE units. With a NULL
+	// dirty bitmap the whole image is written; otherwise only pages that changed since
+	// the last snapshotSave/snapshotLoad are written and flagged. Optional.
+	size_t (*snapshotSize)(struct mCore*);
+	void (*snapshotSave)(struct mCore*, void* image, uint32_t* dirty);
+	bool (*snapshotLoad)(struct mCore*, const void* image, size_t size);
 
 	void (*setKeys)(struct mCore*, uint32_t keys);
 	void (*addKeys)(struct mCore*, uint32_t keys);
@@ -155,12 +167,17 @@ struct mCore {
 
 	size_t (*savedataClone)(struct mCore*, void** sram);
 	bool (*savedataRestore)(struct mCore*, const void* sram, size_t size, bool writeback);
+	// The live savedata, for callers that copy it themselves instead of cloning it. Optional.
+	size_t (*savedataRef)(struct mCore*, const void** sram);
 
 	size_t (*listVideoLayers)(const struct mCore*, const struct mCoreChannelInfo**);
 	size_t (*listAudioChannels)(const struct mCore*, const struct mCoreChannelInfo**);
 	void (*enableVideoLayer)(struct mCore*, size_t id, bool enable);
 	void (*enableAudioChannel)(struct mCore*, size_t id, bool enable);
 	void (*adjustVideoLayer)(struct mCore*, size_t id, int32_t x, int32_t y);
+	// Keep emulating but don't render or output the video frame and/or audio samples,
+	// e.g. for frames that will never be shown. Optional.
+	void (*suppressOutput)(struct mCore*, bool video, bool audio);
 
 #ifndef MINIMAL_CORE
 	void (*startVideoLog)(struct mCore*, struct mVideoLogContext*);
@@ -197,6 +214,14 @@ struct mCore* mCoreFindVF(struct VFile* vf);
 enum mPlatform mCoreIsCompatible(struct VFile* vf);
 struct mCore* mCoreCreate(enum mPlatform);
 
+// A fork is a new core of the same platform running from a copy of the source's state, including
+// its savedata, which is kept in memory. The ROM and BIOS are used in place instead of being loaded
+// again, so the source must outlive its forks and must not be patched or unloaded while they exist.
+// Each fork is otherwise independent and can run on its own thread. Returns NULL if the platform
+// can't share its ROM.
+struct mCore* mCoreFork(struct mCore* core);
+bool mCoreCompareMemory(struct mCore* core, struct mCore* other, uint32_t address, size_t size, uint32_t* mismatch);
+
 bool mCoreSaveStateNamed(struct mCore* core, struct VFile* vf, int flags);
 bool mCoreLoadStateNamed(struct mCore* core, struct VFile* vf, int flags);
 
@@ -144,6 +144,7 @@ ATTRIBUTE_UNUSED static unsigned mColorMix5Bit(int weightA, unsigned colorA, int
 #endif
 
 struct blip_t;
+struct mAudioResampler;
 
 enum mColorFormat {
 	mCOLOR_XBGR8  = 0x00001,
@@ -193,6 +194,7 @@ struct mAVStream {
 	void (*postVideoFrame)(struct mAVStream*, const color_t* buffer, size_t stride);
 	void (*postAudioFrame)(struct mAVStream*, int16_t left, int16_t right);
 	void (*postAudioBuffer)(struct mAVStream*, struct blip_t* left, struct blip_t* right);
+	void (*postAudioResampled)(struct mAVStream*, struct mAudioResampler*);
 };
 
 struct mStereoSample {
@@ -271,6 +273,14 @@ struct mCoreChannelInfo {
 	const char* visibleType;
 };
 
+// A contiguous range of the serialized state holding one part of the machine
+struct mCoreStateSection {
+	size_t id;
+	const char* internalName;
+	size_t offset;
+	size_t size;
+};
+
 enum mCoreMemoryBlockFlags {
 	mCORE_MEMORY_READ = 0x01,
 	mCORE_MEMORY_WRITE = 0x02,
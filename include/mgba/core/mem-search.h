@@ -53,10 +53,37 @@ struct mCoreMemorySearchResult {
 
 DECLARE_VECTOR(mCoreMemorySearchResults, struct mCoreMemorySearchResult);
 
+struct mCoreMemorySearchRegion {
+	size_t id;
+	uint32_t start;
+	size_t size;
+	size_t count;
+	uint8_t* snapshot;
+	uint32_t* bitmap;
+};
+
+DECLARE_VECTOR(mCoreMemorySearchRegions, struct mCoreMemorySearchRegion);
+
+// Integer searches can keep every match instead of a limited list. Each region stores one bit per
+// aligned value along with a copy of the memory from the last pass, so narrowing it down by value
+// or by how it changed is a single pass over memory that doesn't touch the core's bus.
+struct mCoreMemorySearchCandidates {
+	struct mCoreMemorySearchRegions regions;
+	int width;
+	size_t count;
+};
+
 struct mCore;
 void mCoreMemorySearch(struct mCore* core, const struct mCoreMemorySearchParams* params, struct mCoreMemorySearchResults* out, size_t limit);
 void mCoreMemorySearchRepeat(struct mCore* core, const struct mCoreMemorySearchParams* params, struct mCoreMemorySearchResults* inout);
 
+void mCoreMemorySearchCandidatesInit(struct mCoreMemorySearchCandidates*);
+void mCoreMemorySearchCandidatesDeinit(struct mCoreMemorySearchCandidates*);
+void mCoreMemorySearchCandidatesClear(struct mCoreMemorySearchCandidates*);
+bool mCoreMemorySearchCandidatesFind(struct mCore* core, const struct mCoreMemorySearchParams* params, struct mCoreMemorySearchCandidates* out);
+bool mCoreMemorySearchCandidatesNarrow(struct mCore* core, const struct mCoreMemorySearchParams* params, struct mCoreMemorySearchCandidates* inout);
+size_t mCoreMemorySearchCandidatesExport(const struct mCoreMemorySearchCandidates*, struct mCoreMemorySearchResults* out, size_t limit);
+
 CXX_GUARD_END
 
 #endif
@@ -0,0 +1,83 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#ifndef M_CORE_MOVIE_H
+#define M_CORE_MOVIE_H
+
+#include <mgba-util/common.h>
+
+CXX_GUARD_START
+
+#include <mgba/core/interface.h>
+
+#define mMOVIE_DEFAULT_CHECKSUM_INTERVAL 60
+
+enum mMovieMode {
+	mMOVIE_IDLE = 0,
+	mMOVIE_RECORDING,
+	mMOVIE_PLAYING,
+	mMOVIE_FINISHED,
+};
+
+// An input movie is a keyframe savestate followed by a stream of key runs: each run holds one set
+// of keys for some number of frames, so idle stretches cost a few bytes no matter how long they
+// are. When checksumInterval is nonzero the recorder also stores a CRC32 of the whole core state
+// every checksumInterval frames, which playback compares against to report desyncs.
+//
+// Frame boundaries are the ends of video frames: mMovieFrameEnded has to be called from the
+// videoFrameEnded core callback, and mMovieKeysRead from the keysRead callback. While recording,
+// the first read of a frame latches the keys recorded for it, and later reads in that frame see
+// the same keys; input that arrives in between is held back until the frame ends. Frames without
+// a read record the keys held when they end, so mMovieFrameEnded has to run before the frontend
+// updates the keys for the next one. While playing, mMovieFrameEnded applies the keys for the next
+// frame and mMovieKeysRead reapplies them so frontend input can't leak in. An active movie owns the
+// VFile it was started with and closes it when stopped.
+struct mCore;
+struct VFile;
+struct mMovie {
+	enum mMovieMode mode;
+	struct mCore* core;
+	struct VFile* vf;
+	uint32_t checksumInterval;
+	uint32_t frame;
+	uint32_t frames;
+
+	uint32_t keys;
+	uint32_t runLength;
+
+	uint32_t frameKeys;
+	uint32_t heldKeys;
+	bool keysLatched;
+	bool keysHeld;
+
+	uint8_t* stream;
+	size_t streamSize;
+	size_t streamCapacity;
+	size_t streamOffset;
+
+	void* state;
+	size_t stateSize;
+
+	uint32_t desyncs;
+	uint32_t firstDesync;
+
+	enum mRTCGenericType rtcOverride;
+	int64_t rtcValue;
+};
+
+void mMovieInit(struct mMovie*);
+void mMovieDeinit(struct mMovie*);
+
+bool mMovieRecord(struct mMovie*, struct mCore*, struct VFile*, unsigned checksumInterval);
+bool mMoviePlay(struct mMovie*, struct mCore*, struct VFile*);
+void mMovieStop(struct mMovie*);
+
+bool mMovieIsActive(const struct mMovie*);
+void mMovieFrameEnded(struct mMovie*);
+void mMovieKeysRead(struct mMovie*);
+
+CXX_GUARD_END
+
+#endif
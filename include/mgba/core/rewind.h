@@ -15,31 +15,80 @@ CXX_GUARD_START
 #include <mgba-util/threading.h>
 #endif
 
-DECLARE_VECTOR(mCoreRewindPatches, struct PatchFast);
+#define mCORE_REWIND_DEFAULT_BUDGET 0x2000000
+#define mCORE_REWIND_DEFAULT_KEYFRAME_INTERVAL 64
+
+// A compressed history entry in the arena. Delta entries hold the pages needed to step back to
+// the previous entry; keyframes hold the whole image so deep restores don't replay every delta.
+struct mCoreRewindEntry {
+	size_t offset;
+	size_t size;
+	size_t imageSize;
+	uint32_t nPages;
+	bool keyframe;
+};
+
+DECLARE_VECTOR(mCoreRewindEntries, struct mCoreRewindEntry);
+
+struct mCoreRewindStats {
+	size_t entries;
+	size_t keyframes;
+	size_t bytesUsed;
+	size_t budget;
+	size_t rawBytes;
+	uint64_t compressUsec;
+	uint64_t compressions;
+};
 
 struct VFile;
 struct mCoreRewindContext {
-	struct mCoreRewindPatches patchMemory;
+	struct mCoreRewindEntries entries;
 	size_t current;
 	size_t size;
-	struct VFile* previousState;
-	struct VFile* currentState;
+	unsigned keyframeInterval;
+	unsigned sinceKeyframe;
+
+	// Circular byte arena holding the compressed entries; its size is the whole history budget
+	uint8_t* arena;
+	size_t budget;
+	size_t arenaHead;
+
+	uint8_t* image;
+	uint8_t* shadow;
+	uint32_t* dirty;
+	size_t imageSize;
+
+	// Uncompressed payload waiting for the rewind thread, and scratch space for (de)compression
+	uint8_t* staging;
+	size_t stagingSize;
+	size_t stagingCapacity;
+	struct mCoreRewindEntry pending;
+	uint8_t* scratch;
+	size_t scratchCapacity;
+
+	// Used for cores that can't produce snapshot images directly
+	struct VFile* stateVf;
+
+	struct mCoreRewindStats stats;
 
 #ifndef DISABLE_THREADING
 	bool onThread;
 	Thread thread;
 	Condition cond;
 	Mutex mutex;
-	bool ready;
 #endif
+	bool ready;
 };
 
-void mCoreRewindContextInit(struct mCoreRewindContext*, size_t entries, bool onThread);
+bool mCoreRewindContextInit(struct mCoreRewindContext*, size_t entries, size_t budget, bool onThread);
 void mCoreRewindContextDeinit(struct mCoreRewindContext*);
 
 struct mCore;
 void mCoreRewindAppend(struct mCoreRewindContext*, struct mCore*);
 bool mCoreRewindRestore(struct mCoreRewindContext*, struct mCore*);
+size_t mCoreRewindRestoreSteps(struct mCoreRewindContext*, struct mCore*, size_t steps);
+
+void mCoreRewindGetStats(struct mCoreRewindContext*, struct mCoreRewindStats*);
 
 CXX_GUARD_END
 
@@ -0,0 +1,29 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#ifndef M_CORE_ROM_REGISTRY_H
+#define M_CORE_ROM_REGISTRY_H
+
+#include <mgba-util/common.h>
+
+CXX_GUARD_START
+
+// Process-wide store of ROM images keyed by CRC32, so cores running the same game share one copy
+// of it. Each core maps an image copy-on-write: reads come from the shared pages and writes, such
+// as GPIO registers or patches, only privatise the pages they touch. An image lives as long as
+// something holds a reference to it; every acquire or retain needs a matching release.
+struct mROMImage;
+
+struct mROMImage* mROMRegistryAcquire(uint32_t crc32, const void* data, size_t size, size_t mapSize);
+void mROMRegistryRetain(struct mROMImage*);
+void mROMRegistryRelease(struct mROMImage*);
+size_t mROMRegistrySize(void);
+
+void* mROMImageMap(struct mROMImage*);
+void mROMImageUnmap(struct mROMImage*, void* memory);
+
+CXX_GUARD_END
+
+#endif
@@ -28,6 +28,12 @@ enum mStateExtdataTag {
 #define SAVESTATE_METADATA   16
 #define SAVESTATE_ALL        31
 
+// Not part of the contents: writes the chunked LZ container instead of a raw or PNG savestate
+#define SAVESTATE_COMPRESSED 32
+
+#define mSTATE_PAGE_SHIFT 10
+#define mSTATE_PAGE_SIZE (1 << mSTATE_PAGE_SHIFT)
+
 struct mStateExtdataItem {
 	int32_t size;
 	void* data;
@@ -51,6 +57,12 @@ struct mCore;
 bool mCoreSaveStateNamed(struct mCore* core, struct VFile* vf, int flags);
 bool mCoreLoadStateNamed(struct mCore* core, struct VFile* vf, int flags);
 void* mCoreExtractState(struct mCore* core, struct VFile* vf, struct mStateExtdata* extdata);
+
+// Lean in-memory states for rewind, run-ahead and rollback: the raw core state written straight into a
+// caller-owned buffer, followed by the savedata if SAVESTATE_SAVEDATA is set. No other flags are honored.
+size_t mCoreStateBufferSize(struct mCore* core, int flags);
+size_t mCoreSaveStateInto(struct mCore* core, void* buffer, size_t size, int flags);
+bool mCoreLoadStateFrom(struct mCore* core, const void* buffer, size_t size, int flags);
 bool mCoreExtractExtdata(struct mCore* core, struct VFile* vf, struct mStateExtdata* extdata);
 
 CXX_GUARD_END
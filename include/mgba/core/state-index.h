@@ -0,0 +1,64 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#ifndef M_CORE_STATE_INDEX_H
+#define M_CORE_STATE_INDEX_H
+
+#include <mgba-util/common.h>
+
+CXX_GUARD_START
+
+#include <mgba/core/interface.h>
+
+#define mSTATE_INDEX_SLOTS 10
+#define mSTATE_INDEX_CREATOR_SIZE 32
+#define mSTATE_THUMBNAIL_SHIFT 1
+#define mSTATE_INDEX_CRC_SIZE 0x1000
+
+// What the state menus need to know about a slot without opening its state file. The thumbnail
+// is the screen downscaled by 1 << mSTATE_THUMBNAIL_SHIFT, kept in the native color_t format so
+// it can be handed straight to the renderer. stateSize and stateCrc32 describe the state file
+// when the entry was written and are used to notice state files that changed behind the index's back.
+// Only the first mSTATE_INDEX_CRC_SIZE bytes are checksummed: they hold the header, the CPU registers
+// and the cycle counters, which differ between any two states, so the menu never reads a whole state.
+struct mStateIndexEntry {
+	uint64_t creationUsec;
+	uint32_t frameCount;
+	uint32_t stateSize;
+	uint32_t stateCrc32;
+	char creator[mSTATE_INDEX_CREATOR_SIZE];
+
+	unsigned width;
+	unsigned height;
+	color_t* thumbnail;
+};
+
+struct mCore;
+struct VFile;
+
+void mStateIndexEntryInit(struct mStateIndexEntry*);
+void mStateIndexEntryDeinit(struct mStateIndexEntry*);
+
+void mStateIndexEntryCapture(struct mStateIndexEntry*, struct mCore*);
+void mStateIndexEntrySetThumbnail(struct mStateIndexEntry*, const color_t* pixels, unsigned width, unsigned height, size_t stride);
+void mStateIndexEntrySetState(struct mStateIndexEntry*, struct VFile* state);
+void mStateIndexEntrySetStateBuffer(struct mStateIndexEntry*, const void* state, size_t size);
+
+bool mStateIndexRead(struct VFile* index, int slot, struct mStateIndexEntry*);
+bool mStateIndexWrite(struct VFile* index, int slot, const struct mStateIndexEntry*);
+void mStateIndexInvalidate(struct VFile* index, int slot);
+bool mStateIndexVerify(struct VFile* state, const struct mStateIndexEntry*);
+
+#if !defined(MINIMAL_CORE) || MINIMAL_CORE < 2
+struct VFile* mCoreGetStateIndex(struct mCore* core, bool write);
+bool mCoreReadStateIndex(struct mCore* core, int slot, struct mStateIndexEntry*);
+bool mCoreWriteStateIndex(struct mCore* core, int slot, const struct mStateIndexEntry*);
+void mCoreInvalidateStateIndex(struct mCore* core, int slot);
+bool mCoreVerifyStateIndex(struct mCore* core, int slot, const struct mStateIndexEntry*);
+#endif
+
+CXX_GUARD_END
+
+#endif
@@ -12,6 +12,21 @@ CXX_GUARD_START
 
 #include <mgba-util/threading.h>
 
+struct mStereoSample;
+
+// Single-producer, single-consumer ring of stereo frames. The core thread
+// writes and the audio thread reads without taking any locks.
+struct mCoreAudioRing {
+	struct mStereoSample* samples;
+	uint32_t capacity;
+	uint32_t readIndex;
+	uint32_t writeIndex;
+
+	// Nominal output rate, nudged by up to maxRateDelta to keep the ring half full
+	double outputRate;
+	double maxRateDelta;
+};
+
 struct mCoreSync {
 	int videoFramePending;
 	bool videoFrameWait;
@@ -22,6 +37,7 @@ struct mCoreSync {
 	bool audioWait;
 	Condition audioRequiredCond;
 	Mutex audioBufferMutex;
+	struct mCoreAudioRing* audioRing;
 
 	float fpsTarget;
 };
@@ -34,9 +50,23 @@ void mCoreSyncSetVideoSync(struct mCoreSync* sync, bool wait);
 
 struct blip_t;
 bool mCoreSyncProduceAudio(struct mCoreSync* sync, const struct blip_t*, size_t samples);
+struct mAudioResampler;
+bool mCoreSyncProduceResampledAudio(struct mCoreSync* sync, struct mAudioResampler*, size_t samples);
 void mCoreSyncLockAudio(struct mCoreSync* sync);
 void mCoreSyncUnlockAudio(struct mCoreSync* sync);
 void mCoreSyncConsumeAudio(struct mCoreSync* sync);
+void mCoreSyncConsumeAudioRing(struct mCoreSync* sync);
+void mCoreSyncSetAudioRing(struct mCoreSync* sync, struct mCoreAudioRing* ring);
+
+void mCoreAudioRingInit(struct mCoreAudioRing* ring, size_t capacity, double outputRate);
+void mCoreAudioRingDeinit(struct mCoreAudioRing* ring);
+void mCoreAudioRingClear(struct mCoreAudioRing* ring);
+size_t mCoreAudioRingCapacity(const struct mCoreAudioRing* ring);
+size_t mCoreAudioRingSize(const struct mCoreAudioRing* ring);
+size_t mCoreAudioRingWrite(struct mCoreAudioRing* ring, const int16_t* samples, size_t count);
+size_t mCoreAudioRingWriteResampled(struct mCoreAudioRing* ring, struct mAudioResampler* resampler);
+size_t mCoreAudioRingRead(struct mCoreAudioRing* ring, int16_t* samples, size_t count);
+double mCoreAudioRingRate(const struct mCoreAudioRing* ring);
 
 CXX_GUARD_END
 
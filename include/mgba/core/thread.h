@@ -51,6 +51,7 @@ struct mCoreThread {
 };
 
 #ifndef OPAQUE_THREADING
+#include <mgba/core/movie.h>
 #include <mgba/core/rewind.h>
 #include <mgba/core/sync.h>
 #include <mgba-util/threading.h>
@@ -93,7 +94,15 @@ struct mCoreThreadInternal {
 
 	struct mCoreSync sync;
 	struct mCoreRewindContext rewind;
+	struct mMovie movie;
 	struct mCore* core;
+
+	bool runningAhead;
+	bool frameHidden;
+	void* runAheadState;
+	size_t runAheadStateSize;
+	void* runAheadSavedata;
+	size_t runAheadSavedataSize;
 };
 
 #endif
@@ -126,6 +135,12 @@ void mCoreThreadClearCrashed(struct mCoreThread* threadContext);
 
 void mCoreThreadSetRewinding(struct mCoreThread* threadContext, bool);
 void mCoreThreadRewindParamsChanged(struct mCoreThread* threadContext);
+bool mCoreThreadGetRewindStats(struct mCoreThread* threadContext, struct mCoreRewindStats* stats);
+
+struct VFile;
+bool mCoreThreadRecordMovie(struct mCoreThread* threadContext, struct VFile* vf, unsigned checksumInterval);
+bool mCoreThreadPlayMovie(struct mCoreThread* threadContext, struct VFile* vf);
+void mCoreThreadStopMovie(struct mCoreThread* threadContext);
 
 struct mCoreThread* mCoreThreadGet(void);
 struct mLogger* mCoreThreadLogger(void);
@@ -33,6 +33,12 @@ struct mTileCache {
 	struct mTileCacheEntry* status;
 	uint32_t* globalPaletteVersion;
 
+	// Tiles are decoded once per VRAM generation into one palette index per
+	// pixel, and only re-coloured from that when a palette changes
+	uint8_t* indexed;
+	uint32_t* vramVersion;
+	uint32_t* indexedVersion;
+
 	uint32_t tileBase;
 	uint32_t paletteBase;
 	unsigned entriesPerTile;
@@ -41,6 +47,7 @@ struct mTileCache {
 	uint16_t* vram;
 	color_t* palette;
 	color_t temporaryTile[64];
+	uint8_t temporaryIndexed[64];
 
 	mTileCacheConfiguration config;
 	mTileCacheSystemInfo sysConfig;
@@ -55,6 +62,7 @@ void mTileCacheWritePalette(struct mTileCache* cache, uint32_t entry, color_t co
 
 const color_t* mTileCacheGetTile(struct mTileCache* cache, unsigned tileId, unsigned paletteId);
 const color_t* mTileCacheGetTileIfDirty(struct mTileCache* cache, struct mTileCacheEntry* entry, unsigned tileId, unsigned paletteId);
+const uint8_t* mTileCacheGetIndexedTile(struct mTileCache* cache, unsigned tileId);
 const color_t* mTileCacheGetPalette(struct mTileCache* cache, unsigned paletteId);
 const uint16_t* mTileCacheGetVRAM(struct mTileCache* cache, unsigned tileId);
 
@@ -64,6 +64,7 @@ struct mDebuggerEntryInfo {
 			uint32_t newValue;
 			enum mWatchpointType watchType;
 			enum mWatchpointType accessType;
+			int width;
 		} wp;
 
 		struct {
@@ -84,14 +85,17 @@ struct mBreakpoint {
 	int segment;
 	enum mBreakpointType type;
 	struct ParseTree* condition;
+	struct ParseProgram* compiledCondition;
 };
 
 struct mWatchpoint {
 	ssize_t id;
 	uint32_t address;
+	uint32_t size; // 0 is treated the same as 1
 	int segment;
 	enum mWatchpointType type;
 	struct ParseTree* condition;
+	struct ParseProgram* compiledCondition;
 };
 
 DECLARE_VECTOR(mBreakpointList, struct mBreakpoint);
@@ -108,6 +112,7 @@ struct mDebuggerPlatform {
 
 	bool (*hasBreakpoints)(struct mDebuggerPlatform*);
 	void (*checkBreakpoints)(struct mDebuggerPlatform*);
+	void (*runLoop)(struct mDebuggerPlatform*);
 	bool (*clearBreakpoint)(struct mDebuggerPlatform*, ssize_t id);
 
 	ssize_t (*setBreakpoint)(struct mDebuggerPlatform*, const struct mBreakpoint*);
@@ -119,10 +124,13 @@ struct mDebuggerPlatform {
 	void (*trace)(struct mDebuggerPlatform*, char* out, size_t* length);
 
 	bool (*lookupIdentifier)(struct mDebuggerPlatform*, const char* name, int32_t* value, int* segment);
+	const int32_t* (*registerPointer)(struct mDebuggerPlatform*, const char* name);
 
 	uint32_t (*getStackTraceMode)(struct mDebuggerPlatform*);
 	void (*setStackTraceMode)(struct mDebuggerPlatform*, uint32_t mode);
 	bool (*updateStackTrace)(struct mDebuggerPlatform* d);
+
+	uint32_t (*currentAddress)(struct mDebuggerPlatform*, const char** mode);
 };
 
 struct mDebugger {
@@ -139,6 +147,7 @@ struct mDebugger {
 
 	void (*paused)(struct mDebugger*);
 	void (*update)(struct mDebugger*);
+	void (*running)(struct mDebugger*);
 	void (*entered)(struct mDebugger*, enum mDebuggerEntryReason, struct mDebuggerEntryInfo*);
 	void (*custom)(struct mDebugger*);
 
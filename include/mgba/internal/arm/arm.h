@@ -187,6 +187,13 @@ struct ARMCore {
 };
 #undef ARM_REGISTER_FILE
 
+// Breakpoint-aware run loops only look up an address when the bit for its page is set
+#define ARM_BREAKPOINT_PAGE_SHIFT 12
+#define ARM_BREAKPOINT_PAGE_WORDS (1 << (32 - ARM_BREAKPOINT_PAGE_SHIFT - 5))
+
+typedef bool (*ARMBreakpointCheck)(struct ARMCore* cpu, uint32_t address, void* context);
+typedef void (*ARMInstructionHook)(struct ARMCore* cpu, void* context);
+
 void ARMInit(struct ARMCore* cpu);
 void ARMDeinit(struct ARMCore* cpu);
 void ARMSetComponents(struct ARMCore* cpu, struct mCPUComponent* master, int extra, struct mCPUComponent** extras);
@@ -201,6 +208,8 @@ void ARMRaiseUndefined(struct ARMCore*);
 
 void ARMRun(struct ARMCore* cpu);
 void ARMRunLoop(struct ARMCore* cpu);
+void ARMRunLoopBreakpoints(struct ARMCore* cpu, const uint32_t* pages, ARMBreakpointCheck check, void* context);
+void ARMRunLoopTrace(struct ARMCore* cpu, const uint32_t* pages, ARMBreakpointCheck check, ARMInstructionHook hook, void* context);
 void ARMRunFake(struct ARMCore* cpu, uint32_t opcode);
 
 CXX_GUARD_END
@@ -13,9 +13,11 @@ CXX_GUARD_START
 #include <mgba/debugger/debugger.h>
 
 #include <mgba/internal/arm/arm.h>
+#include <mgba-util/table.h>
 #include <mgba-util/vector.h>
 
 struct ParseTree;
+struct ARMTrace;
 struct ARMDebugBreakpoint {
 	struct mBreakpoint d;
 	struct {
@@ -26,17 +28,33 @@ struct ARMDebugBreakpoint {
 
 DECLARE_VECTOR(ARMDebugBreakpointList, struct ARMDebugBreakpoint);
 
+struct ARMWatchpointInterval {
+	uint32_t first;
+	uint32_t last;
+	uint32_t maxLast;
+	size_t index;
+};
+
+DECLARE_VECTOR(ARMWatchpointIntervalList, struct ARMWatchpointInterval);
+
 struct ARMDebugger {
 	struct mDebuggerPlatform d;
 	struct ARMCore* cpu;
 
 	struct ARMDebugBreakpointList breakpoints;
 	struct ARMDebugBreakpointList swBreakpoints;
+	struct Table breakpointIndex;
+	uint32_t* breakpointPages;
+	uint32_t resumeAddress;
+	bool resuming;
 	struct mWatchpointList watchpoints;
+	struct ARMWatchpointIntervalList watchpointIntervals;
+	uint32_t* watchpointPages;
 	struct ARMMemory originalMemory;
 
 	ssize_t nextId;
 	uint32_t stackTraceMode;
+	struct ARMTrace* trace;
 
 	void (*entered)(struct mDebugger*, enum mDebuggerEntryReason, struct mDebuggerEntryInfo*);
 
@@ -46,6 +64,8 @@ struct ARMDebugger {
 
 struct mDebuggerPlatform* ARMDebuggerPlatformCreate(void);
 ssize_t ARMDebuggerSetSoftwareBreakpoint(struct mDebuggerPlatform* debugger, uint32_t address, enum ExecutionMode mode);
+struct ARMTrace* ARMDebuggerStartTrace(struct mDebuggerPlatform* debugger, size_t size, uint32_t flags);
+void ARMDebuggerStopTrace(struct mDebuggerPlatform* debugger);
 
 CXX_GUARD_END
 
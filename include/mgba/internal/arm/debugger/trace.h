@@ -0,0 +1,102 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#ifndef ARM_TRACE_H
+#define ARM_TRACE_H
+
+#include <mgba-util/common.h>
+
+CXX_GUARD_START
+
+#include <mgba/internal/arm/arm.h>
+
+#define ARM_TRACE_MAX_ACCESSES 16
+
+enum ARMTraceFlags {
+	ARM_TRACE_REGISTERS = 1,
+	ARM_TRACE_MEMORY = 2,
+	ARM_TRACE_OPCODES = 4,
+};
+
+// Executed instructions are packed into fixed-size blocks that are reused oldest first, so only
+// the most recent history is kept. Straight-line code collapses into run lengths and everything
+// else is stored as a delta against the previous record. Each block begins with a keyframe of the
+// full state so it can be decoded after the blocks before it have been overwritten.
+struct ARMTrace {
+	uint32_t flags;
+
+	uint8_t* blocks;
+	size_t* blockLengths;
+	size_t blockSize;
+	size_t nBlocks;
+	size_t oldestBlock;
+	size_t usedBlocks;
+	size_t currentBlock;
+	size_t offset;
+
+	uint64_t instructions;
+	uint32_t nextAddress;
+	enum ExecutionMode mode;
+	unsigned run;
+	uint32_t lastAccess;
+	int32_t gprs[16];
+	uint32_t cpsr;
+};
+
+struct ARMTraceAccess {
+	uint32_t address;
+	uint32_t value;
+	int width;
+	bool write;
+};
+
+struct ARMTraceEntry {
+	uint64_t index;
+	uint32_t address;
+	enum ExecutionMode mode;
+	bool hasOpcode;
+	uint32_t opcode; // Thumb opcodes have the next halfword in the top half
+	int32_t gprs[16];
+	uint32_t cpsr;
+	size_t nAccesses;
+	struct ARMTraceAccess accesses[ARM_TRACE_MAX_ACCESSES];
+};
+
+struct VFile;
+struct ARMTraceReader {
+	struct VFile* vf;
+	uint32_t flags;
+	uint32_t blocksLeft;
+
+	uint8_t* block;
+	size_t blockCapacity;
+	size_t blockLength;
+	size_t offset;
+
+	uint64_t index;
+	uint32_t nextAddress;
+	enum ExecutionMode mode;
+	unsigned run;
+	uint32_t lastAccess;
+	int32_t gprs[16];
+	uint32_t cpsr;
+};
+
+void ARMTraceInit(struct ARMTrace*, size_t size, uint32_t flags);
+void ARMTraceDeinit(struct ARMTrace*);
+void ARMTraceClear(struct ARMTrace*);
+
+void ARMTraceRecordInstruction(struct ARMTrace*, struct ARMCore*);
+void ARMTraceRecordAccess(struct ARMTrace*, uint32_t address, uint32_t value, int width, bool write);
+size_t ARMTraceSize(const struct ARMTrace*);
+bool ARMTraceExport(struct ARMTrace*, struct VFile*);
+
+bool ARMTraceReaderInit(struct ARMTraceReader*, struct VFile*);
+void ARMTraceReaderDeinit(struct ARMTraceReader*);
+bool ARMTraceReaderNext(struct ARMTraceReader*, struct ARMTraceEntry*);
+
+CXX_GUARD_END
+
+#endif
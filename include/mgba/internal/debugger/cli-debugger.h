@@ -19,6 +19,7 @@ extern const char* INFO_BREAKPOINT_ADDED;
 extern const char* INFO_WATCHPOINT_ADDED;
 
 struct CLIDebugger;
+struct mProfiler;
 struct VFile;
 
 struct CLIDebugVector {
@@ -89,6 +90,8 @@ struct CLIDebugger {
 	int traceRemaining;
 	struct VFile* traceVf;
 	bool skipStatus;
+
+	struct mProfiler* profiler;
 };
 
 void CLIDebuggerCreate(struct CLIDebugger*);
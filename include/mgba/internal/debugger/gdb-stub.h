@@ -10,12 +10,13 @@
 
 CXX_GUARD_START
 
+#include <mgba/core/timing.h>
 #include <mgba/debugger/debugger.h>
 
 #include <mgba-util/socket.h>
 
-#define GDB_STUB_MAX_LINE 1200
-#define GDB_STUB_INTERVAL 32
+#define GDB_STUB_MAX_LINE 0x4000
+#define GDB_STUB_INTERVAL 0x10000 // Cycles between checks for an interrupt while running
 
 enum GDBStubAckState {
 	GDB_ACK_PENDING = 0,
@@ -34,6 +35,7 @@ struct GDBStub {
 	struct mDebugger d;
 
 	char line[GDB_STUB_MAX_LINE];
+	size_t lineLength;
 	char outgoing[GDB_STUB_MAX_LINE];
 	char memoryMapXml[GDB_STUB_MAX_LINE];
 	enum GDBStubAckState lineAck;
@@ -42,10 +44,11 @@ struct GDBStub {
 	Socket connection;
 
 	bool shouldBlock;
-	int untilPoll;
+	struct mTimingEvent pollEvent;
 
 	bool supportsSwbreak;
 	bool supportsHwbreak;
+	bool supportsBinaryUpload;
 
 	enum GDBWatchpointsBehvaior watchpointsBehavior;
 };
@@ -76,6 +76,14 @@ bool parseLexedExpression(struct ParseTree* tree, struct LexVector* lv);
 struct mDebugger;
 bool mDebuggerEvaluateParseTree(struct mDebugger* debugger, struct ParseTree* tree, int32_t* value, int* segment);
 
+// A parse tree flattened into stack bytecode for expressions that get evaluated over and over,
+// such as breakpoint conditions. Symbols are resolved and registers bound when it's compiled, and
+// it's compiled again from the tree if the symbol table changes, so the tree has to outlive it.
+struct ParseProgram;
+struct ParseProgram* parseCompile(struct mDebugger* debugger, const struct ParseTree* tree);
+void parseProgramFree(struct ParseProgram* program);
+bool mDebuggerEvaluateProgram(struct mDebugger* debugger, struct ParseProgram* program, int32_t* value, int* segment);
+
 CXX_GUARD_END
 
 #endif
@@ -0,0 +1,51 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#ifndef DEBUGGER_PROFILER_H
+#define DEBUGGER_PROFILER_H
+
+#include <mgba-util/common.h>
+
+CXX_GUARD_START
+
+#include <mgba/core/timing.h>
+#include <mgba-util/table.h>
+
+#define mPROFILER_MAX_DEPTH 64
+#define mPROFILER_DEFAULT_PERIOD 0x1000
+
+struct mDebugger;
+struct mDebuggerSymbols;
+struct VFile;
+
+// Samples the guest's execution location from a timing event, so the cost is per sample rather
+// than per instruction. Call stacks are only known while the debugger is tracing the stack; without
+// that each sample is just the current address. Resetting or loading a state clears the schedule,
+// so mProfilerUpdate has to be called before running again to put the sampler back.
+struct mProfiler {
+	struct mDebugger* debugger;
+	struct mTimingEvent event;
+	int32_t period;
+	bool running;
+
+	struct Table stacks;
+	uint64_t samples;
+};
+
+void mProfilerInit(struct mProfiler*, struct mDebugger*);
+void mProfilerDeinit(struct mProfiler*);
+
+void mProfilerStart(struct mProfiler*, int32_t period);
+void mProfilerStop(struct mProfiler*);
+bool mProfilerIsRunning(const struct mProfiler*);
+void mProfilerUpdate(struct mProfiler*);
+
+void mProfilerClear(struct mProfiler*);
+void mProfilerSample(struct mProfiler*);
+bool mProfilerDump(struct mProfiler*, struct mDebuggerSymbols*, struct VFile*);
+
+CXX_GUARD_END
+
+#endif
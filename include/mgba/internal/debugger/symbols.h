@@ -14,15 +14,19 @@ struct mDebuggerSymbols;
 
 struct mDebuggerSymbols* mDebuggerSymbolTableCreate(void);
 void mDebuggerSymbolTableDestroy(struct mDebuggerSymbols*);
+// Changes every time a symbol is added or removed
+uint32_t mDebuggerSymbolTableGeneration(const struct mDebuggerSymbols*);
 
 bool mDebuggerSymbolLookup(const struct mDebuggerSymbols*, const char* name, int32_t* value, int* segment);
 const char* mDebuggerSymbolReverseLookup(const struct mDebuggerSymbols*, int32_t value, int segment);
+const char* mDebuggerSymbolLookupNearest(struct mDebuggerSymbols*, uint32_t value, int segment, uint32_t* offset);
 
 void mDebuggerSymbolAdd(struct mDebuggerSymbols*, const char* name, int32_t value, int segment);
 void mDebuggerSymbolRemove(struct mDebuggerSymbols*, const char* name);
 
 struct VFile;
 void mDebuggerLoadARMIPSSymbols(struct mDebuggerSymbols*, struct VFile* vf);
+void mDebuggerLoadGNUMapSymbols(struct mDebuggerSymbols*, struct VFile* vf);
 
 CXX_GUARD_END
 
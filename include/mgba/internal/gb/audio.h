@@ -168,6 +168,7 @@ struct GBAudio {
 
 	struct blip_t* left;
 	struct blip_t* right;
+	struct mAudioResampler* resampler;
 	int16_t lastLeft;
 	int16_t lastRight;
 	int32_t capLeft;
@@ -209,6 +210,7 @@ struct GBAudio {
 	size_t samples;
 	bool forceDisableCh[4];
 	int masterVolume;
+	bool suppressOutput;
 };
 
 void GBAudioInit(struct GBAudio* audio, size_t samples, uint8_t* nr52, enum GBAudioStyle style);
@@ -216,6 +218,7 @@ void GBAudioDeinit(struct GBAudio* audio);
 void GBAudioReset(struct GBAudio* audio);
 
 void GBAudioResizeBuffer(struct GBAudio* audio, size_t samples);
+void GBAudioSetResampler(struct GBAudio* audio, struct mAudioResampler* resampler);
 
 void GBAudioWriteNR10(struct GBAudio* audio, uint8_t);
 void GBAudioWriteNR11(struct GBAudio* audio, uint8_t);
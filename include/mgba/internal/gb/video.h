@@ -166,6 +166,7 @@ struct GBVideo {
 	uint32_t frameCounter;
 	int frameskip;
 	int frameskipCounter;
+	bool suppressOutput;
 };
 
 void GBVideoInit(struct GBVideo* video);
@@ -21,6 +21,7 @@ CXX_GUARD_START
 
 #define MP2K_MAGIC 0x68736D53
 #define MP2K_MAX_SOUND_CHANNELS 12
+#define MP2K_HLE_SWI 0xF1
 
 mLOG_DECLARE_CATEGORY(GBA_AUDIO);
 
@@ -93,6 +94,7 @@ struct GBAAudio {
 	bool forceDisableChA;
 	bool forceDisableChB;
 	int masterVolume;
+	bool suppressOutput;
 
 	struct mTimingEvent sampleEvent;
 };
@@ -264,10 +266,13 @@ struct GBAAudioMixer {
 	struct GBAAudio* p;
 
 	uint32_t contextAddress;
+	bool nativeMixing;
+	uint32_t hookAddress;
 
 	bool (*engage)(struct GBAAudioMixer* mixer, uint32_t address);
 	void (*vblank)(struct GBAAudioMixer* mixer);
 	void (*step)(struct GBAAudioMixer* mixer);
+	void (*soundMain)(struct GBAAudioMixer* mixer);
 
 	struct GBAMP2kContext context;
 	struct GBAMP2kMusicPlayerInfo player;
@@ -284,6 +289,7 @@ void GBAAudioReset(struct GBAAudio* audio);
 void GBAAudioDeinit(struct GBAAudio* audio);
 
 void GBAAudioResizeBuffer(struct GBAAudio* audio, size_t samples);
+void GBAAudioSetResampler(struct GBAAudio* audio, struct mAudioResampler* resampler);
 
 void GBAAudioScheduleFifoDma(struct GBAAudio* audio, int number, struct GBADMA* info);
 
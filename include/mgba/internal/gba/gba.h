@@ -54,6 +54,7 @@ struct ARMCore;
 struct GBA;
 struct Patch;
 struct VFile;
+struct mROMImage;
 
 mLOG_DECLARE_CATEGORY(GBA);
 mLOG_DECLARE_CATEGORY(GBA_DEBUG);
@@ -97,6 +98,7 @@ struct GBA {
 	size_t yankedRomSize;
 	uint32_t romCrc32;
 	struct VFile* romVf;
+	struct mROMImage* romImage;
 	struct VFile* biosVf;
 	struct VFile* mbVf;
 
@@ -168,6 +170,7 @@ bool GBALoadROM(struct GBA* gba, struct VFile* vf);
 bool GBALoadSave(struct GBA* gba, struct VFile* sav);
 void GBAYankROM(struct GBA* gba);
 void GBAUnloadROM(struct GBA* gba);
+bool GBAShareROM(struct GBA* gba, const struct GBA* source);
 void GBALoadBIOS(struct GBA* gba, struct VFile* vf);
 void GBAApplyPatch(struct GBA* gba, struct Patch* patch);
 
@@ -82,6 +82,21 @@ enum {
 	BASE_OFFSET = 24
 };
 
+// Dirty page bitmap indices; VRAM, IWRAM and WRAM are laid out back-to-back as in GBASerializedState
+enum {
+	DIRTY_PAGE_SHIFT = 10,
+	DIRTY_PAGE_VRAM = 0,
+	DIRTY_PAGE_IWRAM = DIRTY_PAGE_VRAM + (SIZE_VRAM >> DIRTY_PAGE_SHIFT),
+	DIRTY_PAGE_WRAM = DIRTY_PAGE_IWRAM + (SIZE_WORKING_IRAM >> DIRTY_PAGE_SHIFT),
+	DIRTY_PAGE_MAX = DIRTY_PAGE_WRAM + (SIZE_WORKING_RAM >> DIRTY_PAGE_SHIFT)
+};
+
+#define GBA_MEMORY_MARK_DIRTY(MEMORY, BASE, OFFSET) \
+	do { \
+		unsigned _page = (BASE) + ((OFFSET) >> DIRTY_PAGE_SHIFT); \
+		(MEMORY)->dirtyPages[_page >> 5] |= 1U << (_page & 31); \
+	} while (0)
+
 enum {
 	AGB_PRINT_BASE = 0x00FD0000,
 	AGB_PRINT_TOP = 0x00FE0000,
@@ -140,6 +155,8 @@ struct GBAMemory {
 	uint16_t* agbPrintBufferBackup;
 
 	bool mirroring;
+
+	uint32_t dirtyPages[DIRTY_PAGE_MAX / 32];
 };
 
 struct GBA;
@@ -178,6 +195,8 @@ void GBAAdjustEWRAMWaitstates(struct GBA* gba, uint16_t parameters);
 struct GBASerializedState;
 void GBAMemorySerialize(const struct GBAMemory* memory, struct GBASerializedState* state);
 void GBAMemoryDeserialize(struct GBAMemory* memory, const struct GBASerializedState* state);
+void GBAMemoryMarkDirty(struct GBA* gba, uint32_t address, uint32_t size);
+void GBAMemoryRestorePages(struct GBAMemory* memory, unsigned page, void* dest, const void* src, size_t size);
 
 void GBAPrintFlush(struct GBA* gba);
 
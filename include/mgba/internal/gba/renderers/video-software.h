@@ -132,6 +132,12 @@ struct GBAVideoSoftwareRenderer {
 	bool oamDirty;
 	int oamMax;
 	struct GBAVideoRendererSprite sprites[128];
+	uint32_t oamDirtyEntries[4];
+	uint16_t oamShadow[128][3];
+	bool oamIndexValid;
+	int16_t oamIndexOffsetY;
+	uint8_t oamLineCount[GBA_VIDEO_VERTICAL_PIXELS];
+	uint8_t oamLines[GBA_VIDEO_VERTICAL_PIXELS][128];
 	int16_t objOffsetX;
 	int16_t objOffsetY;
 
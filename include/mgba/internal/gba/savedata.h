@@ -90,6 +90,7 @@ struct GBASavedata {
 
 	int dirty;
 	uint32_t dirtAge;
+	bool snapshotDirty;
 
 	enum FlashStateMachine flashState;
 };
@@ -416,11 +416,14 @@ struct GBASerializedState {
 };
 
 static_assert(sizeof(struct GBASerializedState) == 0x61000, "GBA savestate struct sized wrong");
+static_assert(!(offsetof(struct GBASerializedState, vram) & ((1 << DIRTY_PAGE_SHIFT) - 1)), "GBA savestate memory not page aligned");
+static_assert(offsetof(struct GBASerializedState, wram) - offsetof(struct GBASerializedState, vram) == DIRTY_PAGE_WRAM << DIRTY_PAGE_SHIFT, "GBA savestate memory not laid out like dirty pages");
 
 struct VDir;
 
 void GBASerialize(struct GBA* gba, struct GBASerializedState* state);
 bool GBADeserialize(struct GBA* gba, const struct GBASerializedState* state);
+void GBASerializeDirty(struct GBA* gba, struct GBASerializedState* state, uint32_t* dirty);
 
 CXX_GUARD_END
 
@@ -217,6 +217,7 @@ struct GBAVideo {
 	uint32_t frameCounter;
 	int frameskip;
 	int frameskipCounter;
+	bool suppressOutput;
 };
 
 void GBAVideoInit(struct GBAVideo* video);
@@ -230,6 +231,7 @@ void GBAVideoWriteDISPSTAT(struct GBAVideo* video, uint16_t value);
 
 struct GBASerializedState;
 void GBAVideoSerialize(const struct GBAVideo* video, struct GBASerializedState* state);
+void GBAVideoSerializeRegisters(const struct GBAVideo* video, struct GBASerializedState* state);
 void GBAVideoDeserialize(struct GBAVideo* video, const struct GBASerializedState* state);
 
 extern MGBA_EXPORT const int GBAVideoObjSizes[16][2];
@@ -13,6 +13,7 @@ CXX_GUARD_START
 #include <mgba/core/log.h>
 #include <mgba/script/types.h>
 #include <mgba-util/table.h>
+#include <mgba-util/vector.h>
 #include <mgba-util/vfs.h>
 
 #define mSCRIPT_KV_PAIR(KEY, VALUE) { #KEY, VALUE }
@@ -25,6 +26,44 @@ struct mScriptFrame;
 struct mScriptFunction;
 struct mScriptEngineContext;
 
+enum mScriptMemoryAccessType {
+	mSCRIPT_MEMORY_ACCESS_READ = 1,
+	mSCRIPT_MEMORY_ACCESS_WRITE = 2,
+	mSCRIPT_MEMORY_ACCESS_EXECUTE = 4,
+};
+
+enum mScriptCallbackBatch {
+	mSCRIPT_CALLBACK_BATCH_INSTRUCTION = 0,
+	mSCRIPT_CALLBACK_BATCH_FRAME = 1,
+};
+
+struct mScriptMemoryCallback {
+	uint32_t id;
+	enum mScriptMemoryAccessType type;
+	uint32_t address;
+	uint32_t length;
+	enum mScriptCallbackBatch batch;
+	struct mScriptValue* fn;
+};
+
+struct mScriptMemoryEvent {
+	uint32_t cbid;
+	uint32_t address;
+	uint32_t value;
+};
+
+DECLARE_VECTOR(mScriptMemoryCallbackList, struct mScriptMemoryCallback);
+DECLARE_VECTOR(mScriptMemoryEventList, struct mScriptMemoryEvent);
+
+// Whatever owns the memory bus is told when memory callbacks come and go, so that it only has to
+// watch the ranges scripts care about. It reports matching accesses back with
+// mScriptContextReportMemoryAccess.
+struct mScriptMemoryCallbackHandler {
+	void* context;
+	void (*add)(void* context, const struct mScriptMemoryCallback*);
+	void (*remove)(void* context, const struct mScriptMemoryCallback*);
+};
+
 struct mScriptContext {
 	struct Table rootScope;
 	struct Table engines;
@@ -34,6 +73,11 @@ struct mScriptContext {
 	struct Table callbacks;
 	struct Table callbackId;
 	uint32_t nextCallbackId;
+	struct mScriptMemoryCallbackList memoryCallbacks;
+	struct mScriptMemoryEventList instructionEvents;
+	struct mScriptMemoryEventList frameEvents;
+	struct Table frameEventIndex;
+	struct mScriptMemoryCallbackHandler* memoryHandler;
 	struct mScriptValue* constants;
 	struct Table docstrings;
 };
@@ -99,6 +143,11 @@ void mScriptContextTriggerCallback(struct mScriptContext*, const char* callback)
 uint32_t mScriptContextAddCallback(struct mScriptContext*, const char* callback, struct mScriptValue* value);
 void mScriptContextRemoveCallback(struct mScriptContext*, uint32_t cbid);
 
+uint32_t mScriptContextAddMemoryCallback(struct mScriptContext*, enum mScriptMemoryAccessType type, uint32_t address, uint32_t length, enum mScriptCallbackBatch batch, struct mScriptValue* fn);
+void mScriptContextSetMemoryCallbackHandler(struct mScriptContext*, struct mScriptMemoryCallbackHandler*);
+void mScriptContextReportMemoryAccess(struct mScriptContext*, enum mScriptMemoryAccessType type, uint32_t address, uint32_t width, uint32_t value);
+void mScriptContextFlushMemoryCallbacks(struct mScriptContext*, bool frameEnded);
+
 void mScriptContextSetDocstring(struct mScriptContext*, const char* key, const char* docstring);
 const char* mScriptContextGetDocstring(struct mScriptContext*, const char* key);
 
@@ -249,6 +249,55 @@ void ARMRunLoop(struct ARMCore* cpu) {
 	cpu->irqh.processEvents(cpu);
 }
 
+static inline bool _ARMBreakpointPage(const uint32_t* pages, uint32_t address) {
+	address >>= ARM_BREAKPOINT_PAGE_SHIFT;
+	return pages[address >> 5] & (1U << (address & 31));
+}
+
+void ARMRunLoopBreakpoints(struct ARMCore* cpu, const uint32_t* pages, ARMBreakpointCheck check, void* context) {
+	uint32_t address;
+	if (cpu->executionMode == MODE_THUMB) {
+		while (cpu->cycles < cpu->nextEvent) {
+			ThumbStep(cpu);
+			address = cpu->gprs[ARM_PC] - _ARMInstructionLength(cpu);
+			if (_ARMBreakpointPage(pages, address) && check(cpu, address, context)) {
+				return;
+			}
+		}
+	} else {
+		while (cpu->cycles < cpu->nextEvent) {
+			ARMStep(cpu);
+			address = cpu->gprs[ARM_PC] - _ARMInstructionLength(cpu);
+			if (_ARMBreakpointPage(pages, address) && check(cpu, address, context)) {
+				return;
+			}
+		}
+	}
+}
+
+void ARMRunLoopTrace(struct ARMCore* cpu, const uint32_t* pages, ARMBreakpointCheck check, ARMInstructionHook hook, void* context) {
+	uint32_t address;
+	if (cpu->executionMode == MODE_THUMB) {
+		while (cpu->cycles < cpu->nextEvent) {
+			hook(cpu, context);
+			ThumbStep(cpu);
+			address = cpu->gprs[ARM_PC] - _ARMInstructionLength(cpu);
+			if (_ARMBreakpointPage(pages, address) && check(cpu, address, context)) {
+				return;
+			}
+		}
+	} else {
+		while (cpu->cycles < cpu->nextEvent) {
+			hook(cpu, context);
+			ARMStep(cpu);
+			address = cpu->gprs[ARM_PC] - _ARMInstructionLength(cpu);
+			if (_ARMBreakpointPage(pages, address) && check(cpu, address, context)) {
+				return;
+			}
+		}
+	}
+}
+
 void ARMRunFake(struct ARMCore* cpu, uint32_t opcode) {
 	if (cpu->executionMode == MODE_ARM) {
 		cpu->gprs[ARM_PC] -= WORD_SIZE_ARM;
@@ -9,8 +9,12 @@
 #include <mgba/core/timing.h>
 #include <mgba/internal/arm/debugger/debugger.h>
 #include <mgba/internal/arm/debugger/memory-debugger.h>
+#include <mgba/internal/arm/debugger/trace.h>
 #include <mgba/internal/arm/decoder.h>
 #include <mgba/internal/debugger/cli-debugger.h>
+#include <mgba-util/vfs.h>
+
+#define TRACE_BUFFER_SIZE 0x1000000
 
 static void _printStatus(struct CLIDebuggerSystem*);
 
@@ -18,6 +22,9 @@ static void _disassembleArm(struct CLIDebugger*, struct CLIDebugVector*);
 static void _disassembleThumb(struct CLIDebugger*, struct CLIDebugVector*);
 static void _setBreakpointARM(struct CLIDebugger*, struct CLIDebugVector*);
 static void _setBreakpointThumb(struct CLIDebugger*, struct CLIDebugVector*);
+static void _startRecording(struct CLIDebugger*, struct CLIDebugVector*);
+static void _stopRecording(struct CLIDebugger*, struct CLIDebugVector*);
+static void _saveRecording(struct CLIDebugger*, struct CLIDebugVector*);
 
 static void _disassembleMode(struct CLIDebugger*, struct CLIDebugVector*, enum ExecutionMode mode);
 static uint32_t _printLine(struct CLIDebugger* debugger, uint32_t address, enum ExecutionMode mode);
@@ -27,6 +34,9 @@ static struct CLIDebuggerCommandSummary _armCommands[] = {
 	{ "break/t", _setBreakpointThumb, "I", "Set a software breakpoint as Thumb" },
 	{ "disassemble/a", _disassembleArm, "Ii", "Disassemble instructions as ARM" },
 	{ "disassemble/t", _disassembleThumb, "Ii", "Disassemble instructions as Thumb" },
+	{ "record", _startRecording, "s", "Start recording executed instructions, optionally with [r]egisters, [m]emory and [o]pcodes" },
+	{ "record/save", _saveRecording, "S", "Save the recorded instructions to a file" },
+	{ "record/stop", _stopRecording, "", "Stop recording executed instructions" },
 	{ 0, 0, 0, 0 }
 };
 
@@ -37,6 +47,7 @@ static struct CLIDebuggerCommandAlias _armCommandAliases[] = {
 	{ "dis/t", "disassemble/t" },
 	{ "disasm/a",  "disassemble/a" },
 	{ "disasm/t",  "disassemble/t" },
+	{ "rec", "record" },
 	{ 0, 0 }
 };
 
@@ -178,6 +189,57 @@ static void _setBreakpointThumb(struct CLIDebugger* debugger, struct CLIDebugVec
 	}
 }
 
+static void _startRecording(struct CLIDebugger* debugger, struct CLIDebugVector* dv) {
+	uint32_t flags = 0;
+	if (dv && dv->type == CLIDV_CHAR_TYPE) {
+		const char* c;
+		for (c = dv->charValue; *c; ++c) {
+			switch (*c) {
+			case 'r':
+				flags |= ARM_TRACE_REGISTERS;
+				break;
+			case 'm':
+				flags |= ARM_TRACE_MEMORY;
+				break;
+			case 'o':
+				flags |= ARM_TRACE_OPCODES;
+				break;
+			default:
+				debugger->backend->printf(debugger->backend, "%s\n", ERROR_INVALID_ARGS);
+				return;
+			}
+		}
+	}
+	ARMDebuggerStartTrace(debugger->d.platform, TRACE_BUFFER_SIZE, flags);
+}
+
+static void _stopRecording(struct CLIDebugger* debugger, struct CLIDebugVector* dv) {
+	UNUSED(dv);
+	ARMDebuggerStopTrace(debugger->d.platform);
+}
+
+static void _saveRecording(struct CLIDebugger* debugger, struct CLIDebugVector* dv) {
+	struct CLIDebuggerBackend* be = debugger->backend;
+	if (!dv || dv->type != CLIDV_CHAR_TYPE) {
+		be->printf(be, "%s\n", ERROR_MISSING_ARGS);
+		return;
+	}
+	struct ARMDebugger* armDebugger = (struct ARMDebugger*) debugger->d.platform;
+	if (!armDebugger->trace) {
+		be->printf(be, "Not recording\n");
+		return;
+	}
+	struct VFile* vf = VFileOpen(dv->charValue, O_CREAT | O_TRUNC | O_WRONLY);
+	if (!vf) {
+		be->printf(be, "Could not open trace file\n");
+		return;
+	}
+	if (!ARMTraceExport(armDebugger->trace, vf)) {
+		be->printf(be, "Could not write trace file\n");
+	}
+	vf->close(vf);
+}
+
 void ARMCLIDebuggerCreate(struct CLIDebuggerSystem* debugger) {
 	debugger->printStatus = _printStatus;
 	debugger->disassemble = _disassemble;
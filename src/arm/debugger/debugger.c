@@ -11,6 +11,7 @@
 #include <mgba/internal/arm/decoder-inlines.h>
 #include <mgba/internal/arm/isa-inlines.h>
 #include <mgba/internal/arm/debugger/memory-debugger.h>
+#include <mgba/internal/arm/debugger/trace.h>
 #include <mgba/internal/debugger/parser.h>
 #include <mgba/internal/debugger/stack-trace.h>
 #include <mgba-util/math.h>
@@ -187,34 +188,51 @@ static struct ARMDebugBreakpoint* _lookupBreakpoint(struct ARMDebugBreakpointLis
 	return 0;
 }
 
+static bool _tracesMemory(const struct ARMDebugger* debugger) {
+	return debugger->trace && (debugger->trace->flags & ARM_TRACE_MEMORY);
+}
+
 static void _destroyBreakpoint(struct ARMDebugBreakpoint* breakpoint) {
 	if (breakpoint->d.condition) {
 		parseFree(breakpoint->d.condition);
 	}
+	parseProgramFree(breakpoint->d.compiledCondition);
 }
 
 static void _destroyWatchpoint(struct mWatchpoint* watchpoint) {
 	if (watchpoint->condition) {
 		parseFree(watchpoint->condition);
 	}
+	parseProgramFree(watchpoint->compiledCondition);
 }
 
-static void ARMDebuggerCheckBreakpoints(struct mDebuggerPlatform* d) {
-	struct ARMDebugger* debugger = (struct ARMDebugger*) d;
-	int instructionLength = _ARMInstructionLength(debugger->cpu);
-	uint32_t pc = debugger->cpu->gprs[ARM_PC] - instructionLength;
-	if (debugger->stackTraceMode != STACK_TRACE_DISABLED && ARMDebuggerUpdateStackTraceInternal(d, pc)) {
-		return;
+static void _reindexBreakpoints(struct ARMDebugger* debugger) {
+	// The index points into the breakpoint list, so it has to be rebuilt whenever the list changes
+	TableDeinit(&debugger->breakpointIndex);
+	TableInit(&debugger->breakpointIndex, ARMDebugBreakpointListSize(&debugger->breakpoints), NULL);
+	memset(debugger->breakpointPages, 0, ARM_BREAKPOINT_PAGE_WORDS * sizeof(*debugger->breakpointPages));
+	size_t i;
+	for (i = 0; i < ARMDebugBreakpointListSize(&debugger->breakpoints); ++i) {
+		struct ARMDebugBreakpoint* breakpoint = ARMDebugBreakpointListGetPointer(&debugger->breakpoints, i);
+		uint32_t page = breakpoint->d.address >> ARM_BREAKPOINT_PAGE_SHIFT;
+		debugger->breakpointPages[page >> 5] |= 1U << (page & 31);
+		// Only the oldest breakpoint at an address is checked, same as a linear scan would find
+		if (!TableLookup(&debugger->breakpointIndex, breakpoint->d.address)) {
+			TableInsert(&debugger->breakpointIndex, breakpoint->d.address, breakpoint);
+		}
 	}
-	struct ARMDebugBreakpoint* breakpoint = _lookupBreakpoint(&debugger->breakpoints, pc);
+}
+
+static bool _hitBreakpoint(struct ARMDebugger* debugger, uint32_t pc) {
+	struct ARMDebugBreakpoint* breakpoint = TableLookup(&debugger->breakpointIndex, pc);
 	if (!breakpoint) {
-		return;
+		return false;
 	}
 	if (breakpoint->d.condition) {
 		int32_t value;
 		int segment;
-		if (!mDebuggerEvaluateParseTree(d->p, breakpoint->d.condition, &value, &segment) || !(value || segment >= 0)) {
-			return;
+		if (!breakpoint->d.compiledCondition || !mDebuggerEvaluateProgram(debugger->d.p, breakpoint->d.compiledCondition, &value, &segment) || !(value || segment >= 0)) {
+			return false;
 		}
 	}
 	struct mDebuggerEntryInfo info = {
@@ -222,7 +240,84 @@ static void ARMDebuggerCheckBreakpoints(struct mDebuggerPlatform* d) {
 		.type.bp.breakType = BREAKPOINT_HARDWARE,
 		.pointId = breakpoint->d.id
 	};
-	mDebuggerEnter(d->p, DEBUGGER_ENTER_BREAKPOINT, &info);
+	debugger->resumeAddress = pc;
+	debugger->resuming = true;
+	mDebuggerEnter(debugger->d.p, DEBUGGER_ENTER_BREAKPOINT, &info);
+	return true;
+}
+
+static bool _checkBreakpointPage(struct ARMCore* cpu, uint32_t address, void* context) {
+	UNUSED(cpu);
+	return _hitBreakpoint(context, address);
+}
+
+static void ARMDebuggerCheckBreakpoints(struct mDebuggerPlatform* d) {
+	struct ARMDebugger* debugger = (struct ARMDebugger*) d;
+	int instructionLength = _ARMInstructionLength(debugger->cpu);
+	uint32_t pc = debugger->cpu->gprs[ARM_PC] - instructionLength;
+	if (debugger->stackTraceMode != STACK_TRACE_DISABLED && ARMDebuggerUpdateStackTraceInternal(d, pc)) {
+		return;
+	}
+	_hitBreakpoint(debugger, pc);
+}
+
+// The run loops only check the instruction after each one they step, but the events that end a run
+// can move the PC too (IRQs, DMAs, waking from HALT), so the next instruction is checked once before
+// the first step. The breakpoint the debugger just stopped at is skipped, or it would hit again.
+static bool _checkNextInstruction(struct ARMDebugger* debugger) {
+	struct ARMCore* cpu = debugger->cpu;
+	if (cpu->cycles >= cpu->nextEvent) {
+		// The pending events run before anything is stepped and can still move the PC
+		return false;
+	}
+	uint32_t address = cpu->gprs[ARM_PC] - _ARMInstructionLength(cpu);
+	bool resuming = debugger->resuming;
+	debugger->resuming = false;
+	if (resuming && address == debugger->resumeAddress) {
+		return false;
+	}
+	uint32_t page = address >> ARM_BREAKPOINT_PAGE_SHIFT;
+	if (!(debugger->breakpointPages[page >> 5] & (1U << (page & 31)))) {
+		return false;
+	}
+	return _hitBreakpoint(debugger, address);
+}
+
+static void _recordTrace(struct ARMCore* cpu, void* context) {
+	struct ARMDebugger* debugger = context;
+	ARMTraceRecordInstruction(debugger->trace, cpu);
+}
+
+static void ARMDebuggerRunLoop(struct mDebuggerPlatform* d) {
+	struct ARMDebugger* debugger = (struct ARMDebugger*) d;
+	struct ARMCore* cpu = debugger->cpu;
+	if (debugger->stackTraceMode != STACK_TRACE_DISABLED) {
+		// Stack traces have to look at every instruction. Events can redirect the PC, so they
+		// have to run before the instruction is checked or recorded.
+		while (cpu->cycles >= cpu->nextEvent && d->p->state == DEBUGGER_RUNNING) {
+			cpu->irqh.processEvents(cpu);
+		}
+		if (d->p->state != DEBUGGER_RUNNING || _checkNextInstruction(debugger)) {
+			return;
+		}
+		if (debugger->trace) {
+			ARMTraceRecordInstruction(debugger->trace, cpu);
+		}
+		ARMRun(cpu);
+		ARMDebuggerCheckBreakpoints(d);
+		return;
+	}
+	if (_checkNextInstruction(debugger)) {
+		return;
+	}
+	if (debugger->trace) {
+		ARMRunLoopTrace(cpu, debugger->breakpointPages, _checkBreakpointPage, _recordTrace, debugger);
+	} else {
+		ARMRunLoopBreakpoints(cpu, debugger->breakpointPages, _checkBreakpointPage, debugger);
+	}
+	if (d->p->state == DEBUGGER_RUNNING) {
+		cpu->irqh.processEvents(cpu);
+	}
 }
 
 static void ARMDebuggerInit(void* cpu, struct mDebuggerPlatform* platform);
@@ -236,13 +331,16 @@ static void ARMDebuggerListBreakpoints(struct mDebuggerPlatform*, struct mBreakp
 static ssize_t ARMDebuggerSetWatchpoint(struct mDebuggerPlatform*, const struct mWatchpoint*);
 static void ARMDebuggerListWatchpoints(struct mDebuggerPlatform*, struct mWatchpointList*);
 static void ARMDebuggerCheckBreakpoints(struct mDebuggerPlatform*);
+static void ARMDebuggerRunLoop(struct mDebuggerPlatform*);
 static bool ARMDebuggerHasBreakpoints(struct mDebuggerPlatform*);
 static void ARMDebuggerTrace(struct mDebuggerPlatform*, char* out, size_t* length);
 static void ARMDebuggerFormatRegisters(struct ARMRegisterFile* regs, char* out, size_t* length);
 static void ARMDebuggerFrameFormatRegisters(struct mStackFrame* frame, char* out, size_t* length);
 static uint32_t ARMDebuggerGetStackTraceMode(struct mDebuggerPlatform*);
 static void ARMDebuggerSetStackTraceMode(struct mDebuggerPlatform*, uint32_t);
+static const int32_t* ARMDebuggerRegisterPointer(struct mDebuggerPlatform*, const char* name);
 static bool ARMDebuggerUpdateStackTrace(struct mDebuggerPlatform* d);
+static uint32_t ARMDebuggerCurrentAddress(struct mDebuggerPlatform* d, const char** mode);
 
 struct mDebuggerPlatform* ARMDebuggerPlatformCreate(void) {
 	struct mDebuggerPlatform* platform = (struct mDebuggerPlatform*) malloc(sizeof(struct ARMDebugger));
@@ -255,11 +353,14 @@ struct mDebuggerPlatform* ARMDebuggerPlatformCreate(void) {
 	platform->setWatchpoint = ARMDebuggerSetWatchpoint;
 	platform->listWatchpoints = ARMDebuggerListWatchpoints;
 	platform->checkBreakpoints = ARMDebuggerCheckBreakpoints;
+	platform->runLoop = ARMDebuggerRunLoop;
 	platform->hasBreakpoints = ARMDebuggerHasBreakpoints;
 	platform->trace = ARMDebuggerTrace;
 	platform->getStackTraceMode = ARMDebuggerGetStackTraceMode;
 	platform->setStackTraceMode = ARMDebuggerSetStackTraceMode;
 	platform->updateStackTrace = ARMDebuggerUpdateStackTrace;
+	platform->registerPointer = ARMDebuggerRegisterPointer;
+	platform->currentAddress = ARMDebuggerCurrentAddress;
 	return platform;
 }
 
@@ -269,9 +370,16 @@ void ARMDebuggerInit(void* cpu, struct mDebuggerPlatform* platform) {
 	debugger->originalMemory = debugger->cpu->memory;
 	debugger->nextId = 1;
 	debugger->stackTraceMode = STACK_TRACE_DISABLED;
+	debugger->trace = NULL;
 	ARMDebugBreakpointListInit(&debugger->breakpoints, 0);
 	ARMDebugBreakpointListInit(&debugger->swBreakpoints, 0);
+	TableInit(&debugger->breakpointIndex, 0, NULL);
+	debugger->breakpointPages = calloc(ARM_BREAKPOINT_PAGE_WORDS, sizeof(*debugger->breakpointPages));
+	debugger->resumeAddress = 0;
+	debugger->resuming = false;
 	mWatchpointListInit(&debugger->watchpoints, 0);
+	ARMWatchpointIntervalListInit(&debugger->watchpointIntervals, 0);
+	debugger->watchpointPages = calloc(ARM_BREAKPOINT_PAGE_WORDS, sizeof(*debugger->watchpointPages));
 	struct mStackTrace* stack = &platform->p->stackTrace;
 	mStackTraceInit(stack, sizeof(struct ARMRegisterFile));
 	stack->formatRegisters = ARMDebuggerFrameFormatRegisters;
@@ -288,18 +396,26 @@ void ARMDebuggerDeinit(struct mDebuggerPlatform* platform) {
 		}
 	}
 	ARMDebuggerRemoveMemoryShim(debugger);
+	if (debugger->trace) {
+		ARMTraceDeinit(debugger->trace);
+		free(debugger->trace);
+	}
 
 	size_t i;
 	for (i = 0; i < ARMDebugBreakpointListSize(&debugger->breakpoints); ++i) {
 		_destroyBreakpoint(ARMDebugBreakpointListGetPointer(&debugger->breakpoints, i));
 	}
 	ARMDebugBreakpointListDeinit(&debugger->breakpoints);
+	TableDeinit(&debugger->breakpointIndex);
+	free(debugger->breakpointPages);
 
 	for (i = 0; i < mWatchpointListSize(&debugger->watchpoints); ++i) {
 		_destroyWatchpoint(mWatchpointListGetPointer(&debugger->watchpoints, i));
 	}
 	ARMDebugBreakpointListDeinit(&debugger->swBreakpoints);
 	mWatchpointListDeinit(&debugger->watchpoints);
+	ARMWatchpointIntervalListDeinit(&debugger->watchpointIntervals);
+	free(debugger->watchpointPages);
 	mStackTraceDeinit(&platform->p->stackTrace);
 }
 
@@ -342,6 +458,7 @@ ssize_t ARMDebuggerSetSoftwareBreakpoint(struct mDebuggerPlatform* d, uint32_t a
 	breakpoint->d.address = address & ~1; // Clear Thumb bit since it's not part of a valid address
 	breakpoint->d.segment = -1;
 	breakpoint->d.condition = NULL;
+	breakpoint->d.compiledCondition = NULL;
 	breakpoint->d.type = BREAKPOINT_SOFTWARE;
 	breakpoint->sw.opcode = opcode;
 	breakpoint->sw.mode = mode;
@@ -349,6 +466,31 @@ ssize_t ARMDebuggerSetSoftwareBreakpoint(struct mDebuggerPlatform* d, uint32_t a
 	return id;
 }
 
+struct ARMTrace* ARMDebuggerStartTrace(struct mDebuggerPlatform* d, size_t size, uint32_t flags) {
+	struct ARMDebugger* debugger = (struct ARMDebugger*) d;
+	ARMDebuggerStopTrace(d);
+	struct ARMTrace* trace = malloc(sizeof(*trace));
+	ARMTraceInit(trace, size, flags);
+	if ((flags & ARM_TRACE_MEMORY) && !mWatchpointListSize(&debugger->watchpoints)) {
+		ARMDebuggerInstallMemoryShim(debugger);
+	}
+	debugger->trace = trace;
+	return trace;
+}
+
+void ARMDebuggerStopTrace(struct mDebuggerPlatform* d) {
+	struct ARMDebugger* debugger = (struct ARMDebugger*) d;
+	if (!debugger->trace) {
+		return;
+	}
+	if (_tracesMemory(debugger) && !mWatchpointListSize(&debugger->watchpoints)) {
+		ARMDebuggerRemoveMemoryShim(debugger);
+	}
+	ARMTraceDeinit(debugger->trace);
+	free(debugger->trace);
+	debugger->trace = NULL;
+}
+
 static ssize_t ARMDebuggerSetBreakpoint(struct mDebuggerPlatform* d, const struct mBreakpoint* info) {
 	struct ARMDebugger* debugger = (struct ARMDebugger*) d;
 	struct ARMDebugBreakpoint* breakpoint = ARMDebugBreakpointListAppend(&debugger->breakpoints);
@@ -357,10 +499,12 @@ static ssize_t ARMDebuggerSetBreakpoint(struct mDebuggerPlatform* d, const struc
 	breakpoint->d = *info;
 	breakpoint->d.address &= ~1; // Clear Thumb bit since it's not part of a valid address
 	breakpoint->d.id = id;
+	breakpoint->d.compiledCondition = parseCompile(d->p, info->condition);
 	if (info->type == BREAKPOINT_SOFTWARE) {
 		// TODO
 		abort();
 	}
+	_reindexBreakpoints(debugger);
 	return id;
 }
 
@@ -373,6 +517,7 @@ static bool ARMDebuggerClearBreakpoint(struct mDebuggerPlatform* d, ssize_t id)
 		if (ARMDebugBreakpointListGetPointer(breakpoints, i)->d.id == id) {
 			_destroyBreakpoint(ARMDebugBreakpointListGetPointer(breakpoints, i));
 			ARMDebugBreakpointListShift(breakpoints, i, 1);
+			_reindexBreakpoints(debugger);
 			return true;
 		}
 	}
@@ -393,9 +538,10 @@ static bool ARMDebuggerClearBreakpoint(struct mDebuggerPlatform* d, ssize_t id)
 		if (mWatchpointListGetPointer(watchpoints, i)->id == id) {
 			_destroyWatchpoint(mWatchpointListGetPointer(watchpoints, i));
 			mWatchpointListShift(watchpoints, i, 1);
-			if (!mWatchpointListSize(&debugger->watchpoints)) {
+			if (!mWatchpointListSize(&debugger->watchpoints) && !_tracesMemory(debugger)) {
 				ARMDebuggerRemoveMemoryShim(debugger);
 			}
+			ARMDebuggerReindexWatchpoints(debugger);
 			return true;
 		}
 	}
@@ -438,12 +584,12 @@ static void ARMDebuggerListBreakpoints(struct mDebuggerPlatform* d, struct mBrea
 
 static bool ARMDebuggerHasBreakpoints(struct mDebuggerPlatform* d) {
 	struct ARMDebugger* debugger = (struct ARMDebugger*) d;
-	return ARMDebugBreakpointListSize(&debugger->breakpoints) || mWatchpointListSize(&debugger->watchpoints) || debugger->stackTraceMode != STACK_TRACE_DISABLED;
+	return ARMDebugBreakpointListSize(&debugger->breakpoints) || mWatchpointListSize(&debugger->watchpoints) || debugger->stackTraceMode != STACK_TRACE_DISABLED || debugger->trace;
 }
 
 static ssize_t ARMDebuggerSetWatchpoint(struct mDebuggerPlatform* d, const struct mWatchpoint* info) {
 	struct ARMDebugger* debugger = (struct ARMDebugger*) d;
-	if (!mWatchpointListSize(&debugger->watchpoints)) {
+	if (!mWatchpointListSize(&debugger->watchpoints) && !_tracesMemory(debugger)) {
 		ARMDebuggerInstallMemoryShim(debugger);
 	}
 	struct mWatchpoint* watchpoint = mWatchpointListAppend(&debugger->watchpoints);
@@ -451,6 +597,8 @@ static ssize_t ARMDebuggerSetWatchpoint(struct mDebuggerPlatform* d, const struc
 	++debugger->nextId;
 	*watchpoint = *info;
 	watchpoint->id = id;
+	watchpoint->compiledCondition = parseCompile(d->p, info->condition);
+	ARMDebuggerReindexWatchpoints(debugger);
 	return id;
 }
 
@@ -529,3 +677,62 @@ static bool ARMDebuggerUpdateStackTrace(struct mDebuggerPlatform* d) {
 		return false;
 	}
 }
+
+static const int32_t* ARMDebuggerRegisterPointer(struct mDebuggerPlatform* d, const char* name) {
+	struct ARMDebugger* debugger = (struct ARMDebugger*) d;
+	struct ARMCore* cpu = debugger->cpu;
+	if (strcasecmp(name, "sp") == 0) {
+		return &cpu->gprs[ARM_SP];
+	}
+	if (strcasecmp(name, "lr") == 0) {
+		return &cpu->gprs[ARM_LR];
+	}
+	if (strcasecmp(name, "pc") == 0) {
+		return &cpu->gprs[ARM_PC];
+	}
+	if (strcasecmp(name, "ip") == 0) {
+		return &cpu->gprs[12];
+	}
+	if (name[0] != 'r' && name[0] != 'R') {
+		return NULL;
+	}
+	// The CPSR isn't stored as a plain word, so it stays a named lookup
+	char* parseEnd;
+	unsigned long regId = strtoul(&name[1], &parseEnd, 10);
+	if (!name[1] || *parseEnd || regId > 15) {
+		return NULL;
+	}
+	return &cpu->gprs[regId];
+}
+
+static uint32_t ARMDebuggerCurrentAddress(struct mDebuggerPlatform* d, const char** mode) {
+	struct ARMDebugger* debugger = (struct ARMDebugger*) d;
+	struct ARMCore* cpu = debugger->cpu;
+	if (mode) {
+		switch (cpu->cpsr.priv) {
+		case MODE_USER:
+			*mode = "user";
+			break;
+		case MODE_FIQ:
+			*mode = "fiq";
+			break;
+		case MODE_IRQ:
+			*mode = "irq";
+			break;
+		case MODE_SUPERVISOR:
+			*mode = "svc";
+			break;
+		case MODE_ABORT:
+			*mode = "abort";
+			break;
+		case MODE_UNDEFINED:
+			*mode = "undef";
+			break;
+		case MODE_SYSTEM:
+		default:
+			*mode = "system";
+			break;
+		}
+	}
+	return cpu->gprs[ARM_PC] - _ARMInstructionLength(cpu);
+}
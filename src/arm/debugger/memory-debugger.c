@@ -6,61 +6,93 @@
 #include <mgba/internal/arm/debugger/memory-debugger.h>
 
 #include <mgba/internal/arm/debugger/debugger.h>
+#include <mgba/internal/arm/debugger/trace.h>
 #include <mgba/internal/debugger/parser.h>
 
 #include <mgba-util/math.h>
 
 #include <string.h>
 
+DEFINE_VECTOR(ARMWatchpointIntervalList, struct ARMWatchpointInterval);
+
 static bool _checkWatchpoints(struct ARMDebugger* debugger, uint32_t address, struct mDebuggerEntryInfo* info, enum mWatchpointType type, uint32_t newValue, int width);
 
-#define FIND_DEBUGGER(DEBUGGER, CPU) \
-	do { \
-		DEBUGGER = 0; \
-		size_t i; \
-		for (i = 0; i < CPU->numComponents; ++i) { \
-			if (CPU->components[i]->id == DEBUGGER_ID) { \
-				DEBUGGER = (struct ARMDebugger*) ((struct mDebugger*) cpu->components[i])->platform; \
-				goto debuggerFound; \
-			} \
-		} \
-		abort(); \
-		debuggerFound: break; \
-	} while(0)
+static inline struct ARMDebugger* _findDebugger(struct ARMCore* cpu) {
+	// The debugger normally lives in its own slot, so only fall back to scanning if it's elsewhere
+	struct mCPUComponent* component = cpu->components[CPU_COMPONENT_DEBUGGER];
+	if (component && component->id == DEBUGGER_ID) {
+		return (struct ARMDebugger*) ((struct mDebugger*) component)->platform;
+	}
+	size_t i;
+	for (i = 0; i < cpu->numComponents; ++i) {
+		if (cpu->components[i] && cpu->components[i]->id == DEBUGGER_ID) {
+			return (struct ARMDebugger*) ((struct mDebugger*) cpu->components[i])->platform;
+		}
+	}
+	abort();
+}
+
+static inline bool _isWatchedPage(const struct ARMDebugger* debugger, uint32_t address) {
+	address >>= ARM_BREAKPOINT_PAGE_SHIFT;
+	return debugger->watchpointPages[address >> 5] & (1U << (address & 31));
+}
+
+static inline struct ARMTrace* _memoryTrace(const struct ARMDebugger* debugger) {
+	if (debugger->trace && (debugger->trace->flags & ARM_TRACE_MEMORY)) {
+		return debugger->trace;
+	}
+	return NULL;
+}
+
+static void _traceMultiple(struct ARMTrace* trace, struct ARMCore* cpu, uint32_t base, int mask, bool write) {
+	// Registers are transferred lowest first to ascending addresses, whichever way the base moves
+	int i;
+	for (i = 0; i < 16; ++i) {
+		if (mask & (1 << i)) {
+			ARMTraceRecordAccess(trace, base, cpu->gprs[i], 4, write);
+			base += 4;
+		}
+	}
+}
 
 #define CREATE_SHIM(NAME, RETURN, TYPES, ...) \
 	static RETURN DebuggerShim_ ## NAME TYPES { \
-		struct ARMDebugger* debugger; \
-		FIND_DEBUGGER(debugger, cpu); \
+		struct ARMDebugger* debugger = _findDebugger(cpu); \
 		return debugger->originalMemory.NAME(cpu, __VA_ARGS__); \
 	}
 
 #define CREATE_WATCHPOINT_READ_SHIM(NAME, WIDTH, RETURN, TYPES, ...) \
 	static RETURN DebuggerShim_ ## NAME TYPES { \
-		struct ARMDebugger* debugger; \
-		FIND_DEBUGGER(debugger, cpu); \
+		struct ARMDebugger* debugger = _findDebugger(cpu); \
 		struct mDebuggerEntryInfo info; \
-		if (_checkWatchpoints(debugger, address, &info, WATCHPOINT_READ, 0, WIDTH)) { \
+		if (_isWatchedPage(debugger, address) && _checkWatchpoints(debugger, address, &info, WATCHPOINT_READ, 0, WIDTH)) { \
 			mDebuggerEnter(debugger->d.p, DEBUGGER_ENTER_WATCHPOINT, &info); \
 		} \
-		return debugger->originalMemory.NAME(cpu, __VA_ARGS__); \
+		RETURN value = debugger->originalMemory.NAME(cpu, __VA_ARGS__); \
+		struct ARMTrace* trace = _memoryTrace(debugger); \
+		if (trace) { \
+			ARMTraceRecordAccess(trace, address, value, WIDTH, false); \
+		} \
+		return value; \
 	}
 
 #define CREATE_WATCHPOINT_WRITE_SHIM(NAME, WIDTH, RETURN, TYPES, ...) \
 	static RETURN DebuggerShim_ ## NAME TYPES { \
-		struct ARMDebugger* debugger; \
-		FIND_DEBUGGER(debugger, cpu); \
+		struct ARMDebugger* debugger = _findDebugger(cpu); \
 		struct mDebuggerEntryInfo info; \
-		if (_checkWatchpoints(debugger, address, &info, WATCHPOINT_WRITE, value, WIDTH)) { \
+		if (_isWatchedPage(debugger, address) && _checkWatchpoints(debugger, address, &info, WATCHPOINT_WRITE, value, WIDTH)) { \
 			mDebuggerEnter(debugger->d.p, DEBUGGER_ENTER_WATCHPOINT, &info); \
 		} \
+		struct ARMTrace* trace = _memoryTrace(debugger); \
+		if (trace) { \
+			ARMTraceRecordAccess(trace, address, (uint32_t) value & (0xFFFFFFFFU >> (32 - WIDTH * 8)), WIDTH, true); \
+		} \
 		return debugger->originalMemory.NAME(cpu, __VA_ARGS__); \
 	}
 
-#define CREATE_MULTIPLE_WATCHPOINT_SHIM(NAME, ACCESS_TYPE) \
+#define CREATE_MULTIPLE_WATCHPOINT_SHIM(NAME, ACCESS_TYPE, WRITE) \
 	static uint32_t DebuggerShim_ ## NAME (struct ARMCore* cpu, uint32_t address, int mask, enum LSMDirection direction, int* cycleCounter) { \
-		struct ARMDebugger* debugger; \
-		FIND_DEBUGGER(debugger, cpu); \
+		struct ARMDebugger* debugger = _findDebugger(cpu); \
 		uint32_t popcount = popcount32(mask); \
 		int offset = 4; \
 		int base = address; \
@@ -74,11 +106,19 @@ static bool _checkWatchpoints(struct ARMDebugger* debugger, uint32_t address, st
 		unsigned i; \
 		for (i = 0; i < popcount; ++i) { \
 			struct mDebuggerEntryInfo info; \
-			if (_checkWatchpoints(debugger, base + 4 * i, &info, ACCESS_TYPE, 0, 4)) { \
+			if (_isWatchedPage(debugger, base + 4 * i) && _checkWatchpoints(debugger, base + 4 * i, &info, ACCESS_TYPE, 0, 4)) { \
 				mDebuggerEnter(debugger->d.p, DEBUGGER_ENTER_WATCHPOINT, &info); \
 			} \
 		} \
-		return debugger->originalMemory.NAME(cpu, address, mask, direction, cycleCounter); \
+		struct ARMTrace* trace = _memoryTrace(debugger); \
+		if (trace && WRITE) { \
+			_traceMultiple(trace, cpu, base, mask, true); \
+		} \
+		uint32_t result = debugger->originalMemory.NAME(cpu, address, mask, direction, cycleCounter); \
+		if (trace && !WRITE) { \
+			_traceMultiple(trace, cpu, base, mask, false); \
+		} \
+		return result; \
 	}
 
 CREATE_WATCHPOINT_READ_SHIM(load32, 4, uint32_t, (struct ARMCore* cpu, uint32_t address, int* cycleCounter), address, cycleCounter)
@@ -87,55 +127,146 @@ CREATE_WATCHPOINT_READ_SHIM(load8, 1, uint32_t, (struct ARMCore* cpu, uint32_t a
 CREATE_WATCHPOINT_WRITE_SHIM(store32, 4, void, (struct ARMCore* cpu, uint32_t address, int32_t value, int* cycleCounter), address, value, cycleCounter)
 CREATE_WATCHPOINT_WRITE_SHIM(store16, 2, void, (struct ARMCore* cpu, uint32_t address, int16_t value, int* cycleCounter), address, value, cycleCounter)
 CREATE_WATCHPOINT_WRITE_SHIM(store8, 1, void, (struct ARMCore* cpu, uint32_t address, int8_t value, int* cycleCounter), address, value, cycleCounter)
-CREATE_MULTIPLE_WATCHPOINT_SHIM(loadMultiple, WATCHPOINT_READ)
-CREATE_MULTIPLE_WATCHPOINT_SHIM(storeMultiple, WATCHPOINT_WRITE)
+CREATE_MULTIPLE_WATCHPOINT_SHIM(loadMultiple, WATCHPOINT_READ, false)
+CREATE_MULTIPLE_WATCHPOINT_SHIM(storeMultiple, WATCHPOINT_WRITE, true)
 CREATE_SHIM(setActiveRegion, void, (struct ARMCore* cpu, uint32_t address), address)
 
+static bool _testWatchpoint(struct ARMDebugger* debugger, struct mWatchpoint* watchpoint, uint32_t address, struct mDebuggerEntryInfo* info, enum mWatchpointType type, uint32_t newValue, int width) {
+	if (!(watchpoint->type & type)) {
+		return false;
+	}
+	if (watchpoint->condition) {
+		int32_t value;
+		int segment;
+		if (!watchpoint->compiledCondition || !mDebuggerEvaluateProgram(debugger->d.p, watchpoint->compiledCondition, &value, &segment) || !(value || segment >= 0)) {
+			return false;
+		}
+	}
+
+	uint32_t oldValue;
+	switch (width) {
+	case 1:
+		oldValue = debugger->originalMemory.load8(debugger->cpu, address, 0);
+		break;
+	case 2:
+		oldValue = debugger->originalMemory.load16(debugger->cpu, address, 0);
+		break;
+	case 4:
+		oldValue = debugger->originalMemory.load32(debugger->cpu, address, 0);
+		break;
+	default:
+		return false;
+	}
+	if ((watchpoint->type & WATCHPOINT_CHANGE) && newValue == oldValue) {
+		return false;
+	}
+	info->type.wp.oldValue = oldValue;
+	info->type.wp.newValue = newValue;
+	info->address = address;
+	info->type.wp.watchType = watchpoint->type;
+	info->type.wp.accessType = type;
+	info->type.wp.width = width;
+	info->pointId = watchpoint->id;
+	return true;
+}
+
 static bool _checkWatchpoints(struct ARMDebugger* debugger, uint32_t address, struct mDebuggerEntryInfo* info, enum mWatchpointType type, uint32_t newValue, int width) {
-	--width;
-	struct mWatchpoint* watchpoint;
+	uint32_t first = address & ~(width - 1);
+	uint32_t last = address | (width - 1);
+	struct ARMWatchpointIntervalList* intervals = &debugger->watchpointIntervals;
+
+	// Find the first interval starting past the access, then walk back until nothing earlier can reach it
+	size_t low = 0;
+	size_t high = ARMWatchpointIntervalListSize(intervals);
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		if (ARMWatchpointIntervalListGetPointer(intervals, mid)->first <= last) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	// Report the oldest matching watchpoint, regardless of where its interval sorts
+	size_t best = SIZE_MAX;
+	struct mDebuggerEntryInfo candidate;
+	while (low) {
+		--low;
+		struct ARMWatchpointInterval* interval = ARMWatchpointIntervalListGetPointer(intervals, low);
+		if (interval->maxLast < first) {
+			break;
+		}
+		if (interval->last < first || interval->index >= best) {
+			continue;
+		}
+		struct mWatchpoint* watchpoint = mWatchpointListGetPointer(&debugger->watchpoints, interval->index);
+		if (_testWatchpoint(debugger, watchpoint, address, &candidate, type, newValue, width)) {
+			best = interval->index;
+			*info = candidate;
+		}
+	}
+	return best != SIZE_MAX;
+}
+
+static int _compareIntervals(const void* a, const void* b) {
+	const struct ARMWatchpointInterval* intervalA = a;
+	const struct ARMWatchpointInterval* intervalB = b;
+	if (intervalA->first != intervalB->first) {
+		return intervalA->first < intervalB->first ? -1 : 1;
+	}
+	if (intervalA->index != intervalB->index) {
+		return intervalA->index < intervalB->index ? -1 : 1;
+	}
+	return 0;
+}
+
+void ARMDebuggerReindexWatchpoints(struct ARMDebugger* debugger) {
+	struct ARMWatchpointIntervalList* intervals = &debugger->watchpointIntervals;
+	ARMWatchpointIntervalListClear(intervals);
+	memset(debugger->watchpointPages, 0, ARM_BREAKPOINT_PAGE_WORDS * sizeof(*debugger->watchpointPages));
+
 	size_t i;
 	for (i = 0; i < mWatchpointListSize(&debugger->watchpoints); ++i) {
-		watchpoint = mWatchpointListGetPointer(&debugger->watchpoints, i);
-		if (!((watchpoint->address ^ address) & ~width) && watchpoint->type & type) {
-			if (watchpoint->condition) {
-				int32_t value;
-				int segment;
-				if (!mDebuggerEvaluateParseTree(debugger->d.p, watchpoint->condition, &value, &segment) || !(value || segment >= 0)) {
-					continue;
-				}
+		struct mWatchpoint* watchpoint = mWatchpointListGetPointer(&debugger->watchpoints, i);
+		struct ARMWatchpointInterval* interval = ARMWatchpointIntervalListAppend(intervals);
+		interval->first = watchpoint->address;
+		interval->last = watchpoint->address;
+		if (watchpoint->size > 1) {
+			interval->last += watchpoint->size - 1;
+			if (interval->last < interval->first) {
+				interval->last = UINT32_MAX;
 			}
+		}
+		interval->index = i;
 
-			uint32_t oldValue;
-			switch (width + 1) {
-			case 1:
-				oldValue = debugger->originalMemory.load8(debugger->cpu, address, 0);
-				break;
-			case 2:
-				oldValue = debugger->originalMemory.load16(debugger->cpu, address, 0);
-				break;
-			case 4:
-				oldValue = debugger->originalMemory.load32(debugger->cpu, address, 0);
+		uint32_t page;
+		for (page = interval->first >> ARM_BREAKPOINT_PAGE_SHIFT; page <= interval->last >> ARM_BREAKPOINT_PAGE_SHIFT; ++page) {
+			debugger->watchpointPages[page >> 5] |= 1U << (page & 31);
+			if (page == UINT32_MAX >> ARM_BREAKPOINT_PAGE_SHIFT) {
 				break;
-			default:
-				continue;
 			}
-			if ((watchpoint->type & WATCHPOINT_CHANGE) && newValue == oldValue) {
-				continue;
-			}
-			info->type.wp.oldValue = oldValue;
-			info->type.wp.newValue = newValue;
-			info->address = address;
-			info->type.wp.watchType = watchpoint->type;
-			info->type.wp.accessType = type;
-			info->pointId = watchpoint->id;
-			return true;
 		}
 	}
-	return false;
+
+	if (!ARMWatchpointIntervalListSize(intervals)) {
+		return;
+	}
+	qsort(ARMWatchpointIntervalListGetPointer(intervals, 0), ARMWatchpointIntervalListSize(intervals), sizeof(struct ARMWatchpointInterval), _compareIntervals);
+	uint32_t maxLast = 0;
+	for (i = 0; i < ARMWatchpointIntervalListSize(intervals); ++i) {
+		struct ARMWatchpointInterval* interval = ARMWatchpointIntervalListGetPointer(intervals, i);
+		if (interval->last > maxLast) {
+			maxLast = interval->last;
+		}
+		interval->maxLast = maxLast;
+	}
 }
 
 void ARMDebuggerInstallMemoryShim(struct ARMDebugger* debugger) {
+	if (debugger->cpu->memory.load32 == DebuggerShim_load32) {
+		// Watchpoints and memory traces share the shim, and reinstalling it would lose the originals
+		return;
+	}
 	debugger->originalMemory = debugger->cpu->memory;
 	debugger->cpu->memory.store32 = DebuggerShim_store32;
 	debugger->cpu->memory.store16 = DebuggerShim_store16;
@@ -0,0 +1,471 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include <mgba/internal/arm/debugger/trace.h>
+
+#include <mgba-util/vfs.h>
+
+#define ARM_TRACE_MAGIC 0x4352546D // "mTRC"
+#define ARM_TRACE_VERSION 1
+
+#define ARM_TRACE_BLOCK_SIZE 0x10000
+#define ARM_TRACE_MIN_BLOCKS 2
+// Room left at the end of a block for one instruction and every record that can follow it
+#define ARM_TRACE_BLOCK_SLACK 0x200
+#define ARM_TRACE_MAX_RUN 0x40
+
+enum {
+	TAG_RUN = 0x00, // 0x00 - 0x3F: 1 - 64 sequential instructions
+	TAG_BRANCH = 0x40,
+	TAG_BRANCH_SWITCH = 0x41,
+	TAG_REGISTERS = 0x42,
+	TAG_OPCODE = 0x43,
+	TAG_ACCESS = 0x80, // 0x80 - 0x87: bit 2 is set for writes, bits 0-1 are log2 of the width
+};
+
+static uint8_t* _putVarint(uint8_t* out, uint64_t value) {
+	while (value >= 0x80) {
+		*out = value | 0x80;
+		++out;
+		value >>= 7;
+	}
+	*out = value;
+	return out + 1;
+}
+
+static uint8_t* _putSigned(uint8_t* out, int32_t value) {
+	return _putVarint(out, ((uint32_t) value << 1) ^ (uint32_t) (value >> 31));
+}
+
+static uint8_t* _put32(uint8_t* out, uint32_t value) {
+	out[0] = value;
+	out[1] = value >> 8;
+	out[2] = value >> 16;
+	out[3] = value >> 24;
+	return out + 4;
+}
+
+static inline uint8_t* _cursor(struct ARMTrace* trace) {
+	return &trace->blocks[trace->currentBlock * trace->blockSize + trace->offset];
+}
+
+static inline void _advance(struct ARMTrace* trace, const uint8_t* out) {
+	trace->offset = out - &trace->blocks[trace->currentBlock * trace->blockSize];
+}
+
+static void _flushRun(struct ARMTrace* trace) {
+	if (!trace->run) {
+		return;
+	}
+	uint8_t* out = _cursor(trace);
+	*out = TAG_RUN + trace->run - 1;
+	_advance(trace, out + 1);
+	trace->run = 0;
+}
+
+static void _startBlock(struct ARMTrace* trace) {
+	trace->offset = 0;
+	trace->lastAccess = 0;
+	uint8_t* out = _cursor(trace);
+	out = _putVarint(out, trace->instructions);
+	out = _put32(out, trace->nextAddress);
+	*out = trace->mode;
+	++out;
+	if (trace->flags & ARM_TRACE_REGISTERS) {
+		int i;
+		for (i = 0; i < 16; ++i) {
+			out = _put32(out, trace->gprs[i]);
+		}
+		out = _put32(out, trace->cpsr);
+	}
+	_advance(trace, out);
+}
+
+static void _nextBlock(struct ARMTrace* trace) {
+	_flushRun(trace);
+	trace->blockLengths[trace->currentBlock] = trace->offset;
+	trace->currentBlock = (trace->currentBlock + 1) % trace->nBlocks;
+	if (trace->usedBlocks < trace->nBlocks) {
+		++trace->usedBlocks;
+	} else {
+		trace->oldestBlock = (trace->oldestBlock + 1) % trace->nBlocks;
+	}
+	_startBlock(trace);
+}
+
+void ARMTraceInit(struct ARMTrace* trace, size_t size, uint32_t flags) {
+	trace->flags = flags;
+	trace->blockSize = ARM_TRACE_BLOCK_SIZE;
+	trace->nBlocks = size / ARM_TRACE_BLOCK_SIZE;
+	if (trace->nBlocks < ARM_TRACE_MIN_BLOCKS) {
+		trace->nBlocks = ARM_TRACE_MIN_BLOCKS;
+	}
+	trace->blocks = malloc(trace->blockSize * trace->nBlocks);
+	trace->blockLengths = calloc(trace->nBlocks, sizeof(*trace->blockLengths));
+	ARMTraceClear(trace);
+}
+
+void ARMTraceDeinit(struct ARMTrace* trace) {
+	free(trace->blocks);
+	free(trace->blockLengths);
+}
+
+void ARMTraceClear(struct ARMTrace* trace) {
+	trace->oldestBlock = 0;
+	trace->usedBlocks = 1;
+	trace->currentBlock = 0;
+	trace->instructions = 0;
+	trace->nextAddress = 0;
+	trace->mode = MODE_ARM;
+	trace->run = 0;
+	memset(trace->gprs, 0, sizeof(trace->gprs));
+	trace->cpsr = 0;
+	_startBlock(trace);
+}
+
+static void _recordRegisters(struct ARMTrace* trace, struct ARMCore* cpu) {
+	uint32_t mask = 0;
+	int i;
+	for (i = 0; i < ARM_PC; ++i) {
+		if (cpu->gprs[i] != trace->gprs[i]) {
+			mask |= 1 << i;
+		}
+	}
+	// The PC is implied by the instruction stream, so its slot in the mask is used for the CPSR
+	if ((uint32_t) cpu->cpsr.packed != trace->cpsr) {
+		mask |= 1 << ARM_PC;
+	}
+	if (!mask) {
+		return;
+	}
+	_flushRun(trace);
+	uint8_t* out = _cursor(trace);
+	*out = TAG_REGISTERS;
+	out = _putVarint(out + 1, mask);
+	for (i = 0; i < ARM_PC; ++i) {
+		if (mask & (1 << i)) {
+			out = _putSigned(out, cpu->gprs[i] - trace->gprs[i]);
+			trace->gprs[i] = cpu->gprs[i];
+		}
+	}
+	if (mask & (1 << ARM_PC)) {
+		out = _putVarint(out, cpu->cpsr.packed ^ trace->cpsr);
+		trace->cpsr = cpu->cpsr.packed;
+	}
+	_advance(trace, out);
+}
+
+void ARMTraceRecordInstruction(struct ARMTrace* trace, struct ARMCore* cpu) {
+	if (trace->offset + ARM_TRACE_BLOCK_SLACK > trace->blockSize) {
+		_nextBlock(trace);
+	}
+	if (trace->flags & ARM_TRACE_REGISTERS) {
+		_recordRegisters(trace, cpu);
+	}
+
+	enum ExecutionMode mode = cpu->executionMode;
+	uint32_t width = mode == MODE_THUMB ? WORD_SIZE_THUMB : WORD_SIZE_ARM;
+	uint32_t address = cpu->gprs[ARM_PC] - width;
+	if (address != trace->nextAddress || mode != trace->mode) {
+		_flushRun(trace);
+		uint8_t* out = _cursor(trace);
+		*out = mode != trace->mode ? TAG_BRANCH_SWITCH : TAG_BRANCH;
+		_advance(trace, _putSigned(out + 1, address - trace->nextAddress));
+	} else if (trace->flags & ARM_TRACE_OPCODES) {
+		// Opcodes belong to a single instruction, so runs can't span them
+		_flushRun(trace);
+		uint8_t* out = _cursor(trace);
+		*out = TAG_RUN;
+		_advance(trace, out + 1);
+	} else {
+		++trace->run;
+		if (trace->run == ARM_TRACE_MAX_RUN) {
+			_flushRun(trace);
+		}
+	}
+	if (trace->flags & ARM_TRACE_OPCODES) {
+		uint32_t opcode = cpu->prefetch[0];
+		if (mode == MODE_THUMB) {
+			// Keep the following halfword too so BL pairs can be decoded together
+			opcode = (opcode & 0xFFFF) | (cpu->prefetch[1] << 16);
+		}
+		uint8_t* out = _cursor(trace);
+		*out = TAG_OPCODE;
+		_advance(trace, _putVarint(out + 1, opcode));
+	}
+
+	trace->mode = mode;
+	trace->nextAddress = address + width;
+	++trace->instructions;
+}
+
+void ARMTraceRecordAccess(struct ARMTrace* trace, uint32_t address, uint32_t value, int width, bool write) {
+	if (trace->offset + 16 > trace->blockSize) {
+		// Only possible for an instruction with a huge number of accesses, e.g. a DMA
+		return;
+	}
+	_flushRun(trace);
+	uint8_t* out = _cursor(trace);
+	*out = TAG_ACCESS | (write << 2) | (width == 4 ? 2 : width >> 1);
+	out = _putSigned(out + 1, address - trace->lastAccess);
+	_advance(trace, _putVarint(out, value));
+	trace->lastAccess = address;
+}
+
+size_t ARMTraceSize(const struct ARMTrace* trace) {
+	size_t size = 0;
+	size_t i;
+	for (i = 0; i < trace->usedBlocks; ++i) {
+		size_t block = (trace->oldestBlock + i) % trace->nBlocks;
+		size += block == trace->currentBlock ? trace->offset : trace->blockLengths[block];
+	}
+	return size;
+}
+
+bool ARMTraceExport(struct ARMTrace* trace, struct VFile* vf) {
+	_flushRun(trace);
+	uint8_t header[16];
+	_put32(&header[0], ARM_TRACE_MAGIC);
+	_put32(&header[4], ARM_TRACE_VERSION);
+	_put32(&header[8], trace->flags);
+	_put32(&header[12], trace->usedBlocks);
+	if (vf->write(vf, header, sizeof(header)) != sizeof(header)) {
+		return false;
+	}
+	size_t i;
+	for (i = 0; i < trace->usedBlocks; ++i) {
+		size_t block = (trace->oldestBlock + i) % trace->nBlocks;
+		size_t length = block == trace->currentBlock ? trace->offset : trace->blockLengths[block];
+		uint8_t lengthBytes[4];
+		_put32(lengthBytes, length);
+		if (vf->write(vf, lengthBytes, sizeof(lengthBytes)) != sizeof(lengthBytes)) {
+			return false;
+		}
+		if (vf->write(vf, &trace->blocks[block * trace->blockSize], length) != (ssize_t) length) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool _getVarint(struct ARMTraceReader* reader, uint64_t* value) {
+	*value = 0;
+	unsigned shift;
+	for (shift = 0; shift < 64; shift += 7) {
+		if (reader->offset >= reader->blockLength) {
+			return false;
+		}
+		uint8_t byte = reader->block[reader->offset];
+		++reader->offset;
+		*value |= (uint64_t) (byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool _getSigned(struct ARMTraceReader* reader, int32_t* value) {
+	uint64_t raw;
+	if (!_getVarint(reader, &raw)) {
+		return false;
+	}
+	*value = (int32_t) ((uint32_t) raw >> 1) ^ -(int32_t) (raw & 1);
+	return true;
+}
+
+static bool _get32(struct ARMTraceReader* reader, uint32_t* value) {
+	if (reader->offset + 4 > reader->blockLength) {
+		return false;
+	}
+	const uint8_t* in = &reader->block[reader->offset];
+	*value = in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t) in[3] << 24);
+	reader->offset += 4;
+	return true;
+}
+
+static bool _loadBlock(struct ARMTraceReader* reader) {
+	if (!reader->blocksLeft) {
+		return false;
+	}
+	--reader->blocksLeft;
+	uint8_t lengthBytes[4];
+	if (reader->vf->read(reader->vf, lengthBytes, sizeof(lengthBytes)) != sizeof(lengthBytes)) {
+		return false;
+	}
+	size_t length = lengthBytes[0] | (lengthBytes[1] << 8) | (lengthBytes[2] << 16) | ((uint32_t) lengthBytes[3] << 24);
+	if (length > reader->blockCapacity) {
+		reader->block = realloc(reader->block, length);
+		reader->blockCapacity = length;
+	}
+	if (reader->vf->read(reader->vf, reader->block, length) != (ssize_t) length) {
+		return false;
+	}
+	reader->blockLength = length;
+	reader->offset = 0;
+	reader->run = 0;
+	reader->lastAccess = 0;
+
+	uint64_t index;
+	uint32_t mode;
+	if (!_getVarint(reader, &index) || !_get32(reader, &reader->nextAddress) || reader->offset >= length) {
+		return false;
+	}
+	mode = reader->block[reader->offset];
+	++reader->offset;
+	reader->index = index;
+	reader->mode = mode ? MODE_THUMB : MODE_ARM;
+	if (reader->flags & ARM_TRACE_REGISTERS) {
+		int i;
+		for (i = 0; i < 16; ++i) {
+			if (!_get32(reader, (uint32_t*) &reader->gprs[i])) {
+				return false;
+			}
+		}
+		if (!_get32(reader, &reader->cpsr)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ARMTraceReaderInit(struct ARMTraceReader* reader, struct VFile* vf) {
+	memset(reader, 0, sizeof(*reader));
+	uint8_t header[16];
+	if (vf->read(vf, header, sizeof(header)) != sizeof(header)) {
+		return false;
+	}
+	uint32_t magic = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t) header[3] << 24);
+	uint32_t version = header[4] | (header[5] << 8) | (header[6] << 16) | ((uint32_t) header[7] << 24);
+	if (magic != ARM_TRACE_MAGIC || version != ARM_TRACE_VERSION) {
+		return false;
+	}
+	reader->vf = vf;
+	reader->flags = header[8] | (header[9] << 8) | (header[10] << 16) | ((uint32_t) header[11] << 24);
+	reader->blocksLeft = header[12] | (header[13] << 8) | (header[14] << 16) | ((uint32_t) header[15] << 24);
+	return true;
+}
+
+void ARMTraceReaderDeinit(struct ARMTraceReader* reader) {
+	free(reader->block);
+	reader->block = NULL;
+	reader->blockCapacity = 0;
+}
+
+static bool _readRegisters(struct ARMTraceReader* reader) {
+	uint64_t mask;
+	if (!_getVarint(reader, &mask)) {
+		return false;
+	}
+	int i;
+	for (i = 0; i < ARM_PC; ++i) {
+		if (mask & (1 << i)) {
+			int32_t delta;
+			if (!_getSigned(reader, &delta)) {
+				return false;
+			}
+			reader->gprs[i] += delta;
+		}
+	}
+	if (mask & (1 << ARM_PC)) {
+		uint64_t cpsr;
+		if (!_getVarint(reader, &cpsr)) {
+			return false;
+		}
+		reader->cpsr ^= cpsr;
+	}
+	return true;
+}
+
+static bool _readAttachments(struct ARMTraceReader* reader, struct ARMTraceEntry* entry) {
+	while (reader->offset < reader->blockLength) {
+		uint8_t tag = reader->block[reader->offset];
+		if (tag == TAG_OPCODE) {
+			++reader->offset;
+			uint64_t opcode;
+			if (!_getVarint(reader, &opcode)) {
+				return false;
+			}
+			entry->hasOpcode = true;
+			entry->opcode = opcode;
+		} else if ((tag & ~7) == TAG_ACCESS) {
+			++reader->offset;
+			int32_t delta;
+			uint64_t value;
+			if (!_getSigned(reader, &delta) || !_getVarint(reader, &value)) {
+				return false;
+			}
+			reader->lastAccess += delta;
+			if (entry->nAccesses < ARM_TRACE_MAX_ACCESSES) {
+				struct ARMTraceAccess* access = &entry->accesses[entry->nAccesses];
+				access->address = reader->lastAccess;
+				access->value = value;
+				access->width = 1 << (tag & 3);
+				access->write = tag & 4;
+				++entry->nAccesses;
+			}
+		} else {
+			break;
+		}
+	}
+	return true;
+}
+
+bool ARMTraceReaderNext(struct ARMTraceReader* reader, struct ARMTraceEntry* entry) {
+	while (!reader->run) {
+		if (reader->offset >= reader->blockLength) {
+			if (!_loadBlock(reader)) {
+				return false;
+			}
+			continue;
+		}
+		uint8_t tag = reader->block[reader->offset];
+		++reader->offset;
+		if (tag < TAG_BRANCH) {
+			reader->run = tag - TAG_RUN + 1;
+			continue;
+		}
+		int32_t delta;
+		switch (tag) {
+		case TAG_BRANCH_SWITCH:
+			reader->mode = reader->mode == MODE_ARM ? MODE_THUMB : MODE_ARM;
+			// Fall through
+		case TAG_BRANCH:
+			if (!_getSigned(reader, &delta)) {
+				return false;
+			}
+			reader->nextAddress += delta;
+			reader->run = 1;
+			break;
+		case TAG_REGISTERS:
+			if (!_readRegisters(reader)) {
+				return false;
+			}
+			break;
+		default:
+			// Opcodes and accesses only ever follow an instruction
+			return false;
+		}
+	}
+
+	uint32_t width = reader->mode == MODE_THUMB ? WORD_SIZE_THUMB : WORD_SIZE_ARM;
+	entry->index = reader->index;
+	entry->address = reader->nextAddress;
+	entry->mode = reader->mode;
+	entry->hasOpcode = false;
+	entry->opcode = 0;
+	memcpy(entry->gprs, reader->gprs, sizeof(entry->gprs));
+	entry->gprs[ARM_PC] = entry->address + 2 * width;
+	entry->cpsr = reader->cpsr;
+	entry->nAccesses = 0;
+
+	++reader->index;
+	reader->nextAddress += width;
+	--reader->run;
+	if (!reader->run) {
+		return _readAttachments(reader, entry);
+	}
+	return true;
+}
@@ -0,0 +1,278 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include <mgba/core/audio-resampler.h>
+
+#include <mgba-util/math.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RESAMPLER_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RESAMPLER_NEON
+#endif
+
+#define KERNEL_SHIFT 14
+#define INPUT_CAPACITY 1024
+#define CUTOFF_STEPS 64
+
+static const unsigned _taps[] = {
+	[mAUDIO_RESAMPLER_LINEAR] = 4,
+	[mAUDIO_RESAMPLER_FAST] = 8,
+	[mAUDIO_RESAMPLER_GOOD] = 16,
+	[mAUDIO_RESAMPLER_BEST] = 32,
+};
+
+static double _sinc(double x) {
+	if (fabs(x) < 1e-9) {
+		return 1.;
+	}
+	return sin(M_PI * x) / (M_PI * x);
+}
+
+static double _blackman(double x) {
+	if (fabs(x) >= 1.) {
+		return 0.;
+	}
+	return 0.42 + 0.5 * cos(M_PI * x) + 0.08 * cos(2. * M_PI * x);
+}
+
+static void _buildKernel(struct mAudioResampler* resampler) {
+	double values[32];
+	int half = resampler->taps / 2;
+	unsigned phase;
+	for (phase = 0; phase < mAUDIO_RESAMPLER_PHASES; ++phase) {
+		double frac = phase / (double) mAUDIO_RESAMPLER_PHASES;
+		double sum = 0;
+		unsigned i;
+		for (i = 0; i < resampler->taps; ++i) {
+			double x = (int) i - half + 1 - frac;
+			if (resampler->quality == mAUDIO_RESAMPLER_LINEAR) {
+				values[i] = fabs(x) < 1. ? 1. - fabs(x) : 0.;
+			} else {
+				values[i] = _sinc(x * resampler->cutoff) * resampler->cutoff * _blackman(x / half);
+			}
+			sum += values[i];
+		}
+
+		// Normalize each phase to unity gain so there is no ripple on DC
+		int16_t* kernel = &resampler->kernel[phase * resampler->taps * 2];
+		int total = 0;
+		unsigned peak = 0;
+		for (i = 0; i < resampler->taps; ++i) {
+			int16_t value = lround(values[i] / sum * (1 << KERNEL_SHIFT));
+			kernel[i * 2] = value;
+			total += value;
+			if (values[i] > values[peak]) {
+				peak = i;
+			}
+		}
+		kernel[peak * 2] += (1 << KERNEL_SHIFT) - total;
+		for (i = 0; i < resampler->taps; ++i) {
+			kernel[i * 2 + 1] = kernel[i * 2];
+		}
+	}
+}
+
+static void _updateStep(struct mAudioResampler* resampler) {
+	if (resampler->inputRate <= 0 || resampler->outputRate <= 0) {
+		resampler->step = 0;
+		return;
+	}
+	double ratio = resampler->inputRate / resampler->outputRate;
+	resampler->step = (uint64_t) (ratio * 0x100000000ULL);
+
+	// Band-limit to the lower of the two Nyquist frequencies. The cutoff is
+	// quantized so that small drift in the rates doesn't rebuild the kernel.
+	double cutoff = 0.9;
+	if (ratio > 1.) {
+		cutoff /= ratio;
+	}
+	cutoff = floor(cutoff * CUTOFF_STEPS) / CUTOFF_STEPS;
+	if (cutoff < 1. / CUTOFF_STEPS) {
+		cutoff = 1. / CUTOFF_STEPS;
+	}
+	if (cutoff != resampler->cutoff) {
+		resampler->cutoff = cutoff;
+		_buildKernel(resampler);
+	}
+}
+
+static inline void _convolve(const int16_t* restrict input, const int16_t* restrict kernel, unsigned taps, int32_t* left, int32_t* right) {
+	// Input and kernel are both stereo-interleaved, so even lanes accumulate
+	// the left channel and odd lanes accumulate the right channel.
+	unsigned i;
+#if defined(RESAMPLER_SSE2)
+	__m128i acc = _mm_setzero_si128();
+	for (i = 0; i < taps * 2; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i*) &input[i]);
+		__m128i k = _mm_loadu_si128((const __m128i*) &kernel[i]);
+		__m128i lo = _mm_mullo_epi16(x, k);
+		__m128i hi = _mm_mulhi_epi16(x, k);
+		acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(lo, hi));
+		acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(lo, hi));
+	}
+	acc = _mm_add_epi32(acc, _mm_unpackhi_epi64(acc, acc));
+	*left = _mm_cvtsi128_si32(acc);
+	*right = _mm_cvtsi128_si32(_mm_srli_si128(acc, 4));
+#elif defined(RESAMPLER_NEON)
+	int32x4_t acc = vdupq_n_s32(0);
+	for (i = 0; i < taps * 2; i += 8) {
+		int16x8_t x = vld1q_s16(&input[i]);
+		int16x8_t k = vld1q_s16(&kernel[i]);
+		acc = vmlal_s16(acc, vget_low_s16(x), vget_low_s16(k));
+		acc = vmlal_s16(acc, vget_high_s16(x), vget_high_s16(k));
+	}
+	int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+	*left = vget_lane_s32(sum, 0);
+	*right = vget_lane_s32(sum, 1);
+#else
+	int32_t l = 0;
+	int32_t r = 0;
+	for (i = 0; i < taps * 2; i += 2) {
+		l += input[i] * kernel[i];
+		r += input[i + 1] * kernel[i + 1];
+	}
+	*left = l;
+	*right = r;
+#endif
+}
+
+static inline int16_t _clamp(int32_t sample) {
+	sample = (sample + (1 << (KERNEL_SHIFT - 1))) >> KERNEL_SHIFT;
+	if (sample > INT16_MAX) {
+		return INT16_MAX;
+	}
+	if (sample < INT16_MIN) {
+		return INT16_MIN;
+	}
+	return sample;
+}
+
+static void _resample(struct mAudioResampler* resampler) {
+	if (!resampler->step) {
+		return;
+	}
+	const int16_t* input = (const int16_t*) resampler->input;
+	size_t mask = resampler->outputCapacity - 1;
+	while (resampler->outputWrite - resampler->outputRead < resampler->outputCapacity) {
+		size_t index = resampler->position >> 32;
+		if (index + resampler->taps > resampler->inputSize) {
+			break;
+		}
+		unsigned phase = (resampler->position >> (32 - mAUDIO_RESAMPLER_PHASE_BITS)) & (mAUDIO_RESAMPLER_PHASES - 1);
+		int32_t left;
+		int32_t right;
+		_convolve(&input[index * 2], &resampler->kernel[phase * resampler->taps * 2], resampler->taps, &left, &right);
+		struct mStereoSample* sample = &resampler->output[resampler->outputWrite & mask];
+		sample->left = _clamp(left);
+		sample->right = _clamp(right);
+		++resampler->outputWrite;
+		resampler->position += resampler->step;
+	}
+
+	size_t consumed = resampler->position >> 32;
+	if (consumed > resampler->inputSize) {
+		consumed = resampler->inputSize;
+	}
+	if (!consumed) {
+		return;
+	}
+	memmove(resampler->input, &resampler->input[consumed], (resampler->inputSize - consumed) * sizeof(*resampler->input));
+	resampler->inputSize -= consumed;
+	resampler->position -= (uint64_t) consumed << 32;
+}
+
+void mAudioResamplerInit(struct mAudioResampler* resampler, size_t capacity, enum mAudioResamplerQuality quality) {
+	memset(resampler, 0, sizeof(*resampler));
+	resampler->outputCapacity = toPow2(capacity);
+	resampler->output = calloc(resampler->outputCapacity, sizeof(*resampler->output));
+	resampler->inputCapacity = INPUT_CAPACITY;
+	resampler->input = calloc(resampler->inputCapacity, sizeof(*resampler->input));
+	mAudioResamplerSetQuality(resampler, quality);
+}
+
+void mAudioResamplerDeinit(struct mAudioResampler* resampler) {
+	free(resampler->kernel);
+	free(resampler->input);
+	free(resampler->output);
+	resampler->kernel = NULL;
+	resampler->input = NULL;
+	resampler->output = NULL;
+}
+
+void mAudioResamplerSetQuality(struct mAudioResampler* resampler, enum mAudioResamplerQuality quality) {
+	if (quality > mAUDIO_RESAMPLER_BEST) {
+		quality = mAUDIO_RESAMPLER_BEST;
+	}
+	resampler->quality = quality;
+	resampler->taps = _taps[quality];
+	free(resampler->kernel);
+	resampler->kernel = calloc(mAUDIO_RESAMPLER_PHASES * resampler->taps * 2, sizeof(*resampler->kernel));
+	resampler->cutoff = 0;
+	_updateStep(resampler);
+	if (!resampler->cutoff) {
+		// Rates aren't known yet, but the kernel must still be valid
+		resampler->cutoff = 0.9;
+		_buildKernel(resampler);
+	}
+}
+
+void mAudioResamplerSetInputRate(struct mAudioResampler* resampler, double rate) {
+	resampler->inputRate = rate;
+	_updateStep(resampler);
+}
+
+void mAudioResamplerSetOutputRate(struct mAudioResampler* resampler, double rate) {
+	resampler->outputRate = rate;
+	_updateStep(resampler);
+}
+
+void mAudioResamplerClear(struct mAudioResampler* resampler) {
+	resampler->inputSize = 0;
+	resampler->position = 0;
+	resampler->outputRead = 0;
+	resampler->outputWrite = 0;
+}
+
+size_t mAudioResamplerWrite(struct mAudioResampler* resampler, const struct mStereoSample* samples, size_t count) {
+	size_t written = 0;
+	while (written < count) {
+		size_t chunk = resampler->inputCapacity - resampler->inputSize;
+		if (!chunk) {
+			break;
+		}
+		if (chunk > count - written) {
+			chunk = count - written;
+		}
+		memcpy(&resampler->input[resampler->inputSize], &samples[written], chunk * sizeof(*samples));
+		resampler->inputSize += chunk;
+		written += chunk;
+		_resample(resampler);
+	}
+	return written;
+}
+
+size_t mAudioResamplerAvailable(const struct mAudioResampler* resampler) {
+	return resampler->outputWrite - resampler->outputRead;
+}
+
+size_t mAudioResamplerRead(struct mAudioResampler* resampler, int16_t* samples, size_t count) {
+	size_t available = mAudioResamplerAvailable(resampler);
+	if (count > available) {
+		count = available;
+	}
+	size_t mask = resampler->outputCapacity - 1;
+	size_t start = resampler->outputRead & mask;
+	size_t first = resampler->outputCapacity - start;
+	if (first > count) {
+		first = count;
+	}
+	memcpy(samples, &resampler->output[start], first * sizeof(struct mStereoSample));
+	memcpy(&samples[first * 2], resampler->output, (count - first) * sizeof(struct mStereoSample));
+	resampler->outputRead += count;
+	return count;
+}
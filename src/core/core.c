@@ -8,6 +8,9 @@
 #include <mgba/core/cheats.h>
 #include <mgba/core/log.h>
 #include <mgba/core/serialize.h>
+#include <mgba/core/state-index.h>
+#include <mgba-util/memory.h>
+#include <mgba-util/string.h>
 #include <mgba-util/vfs.h>
 #include <mgba/internal/debugger/symbols.h>
 
@@ -86,6 +89,96 @@ struct mCore* mCoreCreate(enum mPlatform platform) {
 	return NULL;
 }
 
+struct mCore* mCoreFork(struct mCore* core) {
+	if (!core->shareROM) {
+		return NULL;
+	}
+	struct mCore* fork = mCoreCreate(core->platform(core));
+	if (!fork) {
+		return NULL;
+	}
+	if (!fork->init(fork)) {
+		free(fork);
+		return NULL;
+	}
+	mCoreInitConfig(fork, NULL);
+	mCoreLoadForeignConfig(fork, &core->config);
+	if (!fork->shareROM(fork, core)) {
+		mCoreConfigDeinit(&fork->config);
+		fork->deinit(fork);
+		return NULL;
+	}
+	fork->reset(fork);
+
+	// The savedata goes in first so the state's save type gets set up on top of the in-memory copy
+	const void* sram = NULL;
+	void* clone = NULL;
+	size_t sramSize;
+	if (core->savedataRef) {
+		sramSize = core->savedataRef(core, &sram);
+	} else {
+		sramSize = core->savedataClone(core, &clone);
+		sram = clone;
+	}
+	if (sramSize) {
+		fork->savedataRestore(fork, sram, sramSize, false);
+	}
+	free(clone);
+
+	size_t stateSize = mCoreStateBufferSize(core, 0);
+	void* state = anonymousMemoryMap(stateSize);
+	bool success = state && mCoreSaveStateInto(core, state, stateSize, 0) && mCoreLoadStateFrom(fork, state, stateSize, 0);
+	if (state) {
+		mappedMemoryFree(state, stateSize);
+	}
+	if (!success) {
+		mCoreConfigDeinit(&fork->config);
+		fork->deinit(fork);
+		return NULL;
+	}
+
+	fork->setKeys(fork, core->getKeys(core));
+	if (core->rtc.override != RTC_CUSTOM_START) {
+		// Custom sources belong to the frontend that set them and may not be safe to share across threads
+		fork->rtc.override = core->rtc.override;
+		fork->rtc.value = core->rtc.value;
+	}
+	return fork;
+}
+
+bool mCoreCompareMemory(struct mCore* core, struct mCore* other, uint32_t address, size_t size, uint32_t* mismatch) {
+	while (size) {
+		size_t blockSize;
+		size_t otherBlockSize;
+		const uint8_t* block = mCoreGetMemoryBlock(core, address, &blockSize);
+		const uint8_t* otherBlock = mCoreGetMemoryBlock(other, address, &otherBlockSize);
+		if (!block || !otherBlock) {
+			// Unmapped or unreadable memory can't be compared, so count it as a mismatch
+			if (mismatch) {
+				*mismatch = address;
+			}
+			return false;
+		}
+		if (blockSize > otherBlockSize) {
+			blockSize = otherBlockSize;
+		}
+		if (blockSize > size) {
+			blockSize = size;
+		}
+		if (memcmp(block, otherBlock, blockSize)) {
+			size_t i;
+			for (i = 0; block[i] == otherBlock[i]; ++i);
+			if (mismatch) {
+				*mismatch = address + i;
+			}
+			return false;
+		}
+		address += blockSize;
+		size -= blockSize;
+	}
+	return true;
+}
+
 #if !defined(MINIMAL_CORE) || MINIMAL_CORE < 2
 #include <mgba-util/png-io.h>
 
@@ -230,7 +323,15 @@ bool mCoreAutoloadSave(struct mCore* core) {
 	if (savePlayerId > 1) {
 		snprintf(sav, sizeof(sav), ".sa%i", savePlayerId);
 	}
-	return core->loadSave(core, mDirectorySetOpenSuffix(&core->dirs, core->dirs.save, sav, O_CREAT | O_RDWR));
+	struct VFile* vf = mDirectorySetOpenSuffix(&core->dirs, core->dirs.save, sav, O_CREAT | O_RDWR);
+	if (vf) {
+		// The writeback gets its own handle on the directory, since the save directory can be
+		// swapped out while the savedata is still loaded
+		char journal[PATH_MAX + 1];
+		snprintf(journal, sizeof(journal), "%s%s.journal", core->dirs.baseName, sav);
+		vf = VFileWriteback(vf, core->dirs.save->openDir(core->dirs.save, "."), journal);
+	}
+	return core->loadSave(core, vf);
 }
 
 bool mCoreAutoloadPatch(struct mCore* core) {
@@ -283,7 +384,12 @@ bool mCoreLoadSaveFile(struct mCore* core, const char* path, bool temporary) {
 	if (temporary) {
 		return core->loadTemporarySave(core, vf);
 	} else {
-		return core->loadSave(core, vf);
+		char dirname[PATH_MAX];
+		char journal[PATH_MAX];
+		const char* name = strnrstr(path, PATH_SEP, strlen(path));
+		separatePath(path, dirname, NULL, NULL);
+		snprintf(journal, sizeof(journal), "%s.journal", name ? name + 1 : path);
+		return core->loadSave(core, VFileWriteback(vf, VDirOpen(dirname), journal));
 	}
 }
 
@@ -292,7 +398,26 @@ bool mCoreSaveState(struct mCore* core, int slot, int flags) {
 	if (!vf) {
 		return false;
 	}
-	bool success = mCoreSaveStateNamed(core, vf, flags);
+	// Serialize into memory first so the index checksum comes from the buffer instead of reading the file back
+	struct VFile* buffer = VFileMemChunk(NULL, 0);
+	bool success = buffer && mCoreSaveStateNamed(core, buffer, flags);
+	if (success) {
+		size_t size = buffer->size(buffer);
+		void* mem = buffer->map(buffer, size, MAP_READ);
+		success = vf->write(vf, mem, size) == (ssize_t) size;
+		if (success) {
+			struct mStateIndexEntry entry;
+			mStateIndexEntryInit(&entry);
+			mStateIndexEntryCapture(&entry, core);
+			mStateIndexEntrySetStateBuffer(&entry, mem, size);
+			mCoreWriteStateIndex(core, slot, &entry);
+			mStateIndexEntryDeinit(&entry);
+		}
+		buffer->unmap(buffer, mem, size);
+	}
+	if (buffer) {
+		buffer->close(buffer);
+	}
 	vf->close(vf);
 	if (success) {
 		mLOG(STATUS, INFO, "State %i saved", slot);
@@ -335,6 +460,7 @@ void mCoreDeleteState(struct mCore* core, int slot) {
 	char name[PATH_MAX + 14]; // Quash warning
 	snprintf(name, sizeof(name), "%s.ss%i", core->dirs.baseName, slot);
 	core->dirs.state->deleteFile(core->dirs.state, name);
+	mCoreInvalidateStateIndex(core, slot);
 }
 
 void mCoreTakeScreenshot(struct mCore* core) {
@@ -433,6 +559,9 @@ void* mCoreGetMemoryBlockMasked(struct mCore* core, uint32_t start, size_t* size
 		return NULL;
 	}
 	uint8_t* out = core->getMemoryBlock(core, block->id, size);
+	if (!out || start - block->start >= *size) {
+		return NULL;
+	}
 	out += start - block->start;
 	*size -= start - block->start;
 	return out;
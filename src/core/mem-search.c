@@ -7,8 +7,12 @@
 
 #include <mgba/core/core.h>
 #include <mgba/core/interface.h>
+#include <mgba-util/math.h>
+
+#define SEARCH_SLAB 0x800
 
 DEFINE_VECTOR(mCoreMemorySearchResults, struct mCoreMemorySearchResult);
+DEFINE_VECTOR(mCoreMemorySearchRegions, struct mCoreMemorySearchRegion);
 
 static bool _op(int32_t value, int32_t match, enum mCoreMemorySearchOp op) {
 	switch (op) {
@@ -31,74 +35,157 @@ static bool _op(int32_t value, int32_t match, enum mCoreMemorySearchOp op) {
 	return false;
 }
 
-static size_t _search32(const void* mem, size_t size, const struct mCoreMemoryBlock* block, uint32_t value32, enum mCoreMemorySearchOp op, struct mCoreMemorySearchResults* out, size_t limit) {
-	const uint32_t* mem32 = mem;
-	size_t found = 0;
-	uint32_t start = block->start;
-	uint32_t end = size; // TODO: Segments
+// Values are compared 32 at a time into one byte each, with no branches so the compiler can
+// vectorize the loop, and the bytes are then packed down into one word of a bitmap
+#define FILTER_WORD(T, COND) \
+	do { \
+		const T* cur = &mem[w << 5]; \
+		const T* prev = old ? &old[w << 5] : (const T*) _zeroes; \
+		union { \
+			uint64_t u64[4]; \
+			uint8_t u8[32]; \
+		} flags; \
+		size_t j; \
+		for (j = 0; j < 32; ++j) { \
+			int32_t value = (int32_t) cur[j]; \
+			int32_t delta = (int32_t) ((uint32_t) value - (uint32_t) prev[j]); \
+			UNUSED(delta); \
+			flags.u8[j] = (COND); \
+		} \
+		bitmap[w] &= _packFlags(flags.u64); \
+	} while (0)
+
+#define FILTER_TAIL(T, COND) \
+	do { \
+		const T* cur = &mem[w << 5]; \
+		const T* prev = old ? &old[w << 5] : (const T*) _zeroes; \
+		uint32_t bits = 0; \
+		size_t j; \
+		for (j = 0; j < (n & 31); ++j) { \
+			int32_t value = (int32_t) cur[j]; \
+			int32_t delta = (int32_t) ((uint32_t) value - (uint32_t) prev[j]); \
+			UNUSED(delta); \
+			bits |= (uint32_t) (COND) << j; \
+		} \
+		bitmap[w] &= bits; \
+	} while (0)
+
+#define FILTER(T, COND) \
+	for (w = 0; w < (n >> 5); ++w) { \
+		if (bitmap[w]) { \
+			FILTER_WORD(T, COND); \
+		} \
+	} \
+	if (n & 31) { \
+		FILTER_TAIL(T, COND); \
+	}
+
+// Without a previous snapshot the delta is against zero, which matches how _op treats a first search
+#define DEFINE_FILTER(BITS) \
+	static void _filter ## BITS(const uint ## BITS ## _t* mem, const uint ## BITS ## _t* old, size_t n, enum mCoreMemorySearchOp op, int32_t match, uint32_t* bitmap) { \
+		size_t w; \
+		switch (op) { \
+		case mCORE_MEMORY_SEARCH_EQUAL: \
+			FILTER(uint ## BITS ## _t, value == match); \
+			break; \
+		case mCORE_MEMORY_SEARCH_GREATER: \
+			FILTER(uint ## BITS ## _t, value > match); \
+			break; \
+		case mCORE_MEMORY_SEARCH_LESS: \
+			FILTER(uint ## BITS ## _t, value < match); \
+			break; \
+		case mCORE_MEMORY_SEARCH_DELTA: \
+			FILTER(uint ## BITS ## _t, delta == match); \
+			break; \
+		case mCORE_MEMORY_SEARCH_DELTA_POSITIVE: \
+			FILTER(uint ## BITS ## _t, delta > 0); \
+			break; \
+		case mCORE_MEMORY_SEARCH_DELTA_NEGATIVE: \
+			FILTER(uint ## BITS ## _t, delta < 0); \
+			break; \
+		case mCORE_MEMORY_SEARCH_DELTA_ANY: \
+			FILTER(uint ## BITS ## _t, delta != 0); \
+			break; \
+		case mCORE_MEMORY_SEARCH_ANY: \
+			break; \
+		} \
+	}
+
+static const uint32_t _zeroes[32];
+
+static inline uint32_t _packFlags(const uint64_t* flags) {
+	uint32_t bits = 0;
 	size_t i;
-	// TODO: Big endian
-	for (i = 0; (!limit || found < limit) && i < end; i += 4) {
-		if (_op(mem32[i >> 2], value32, op)) {
-			struct mCoreMemorySearchResult* res = mCoreMemorySearchResultsAppend(out);
-			res->address = start + i;
-			res->type = mCORE_MEMORY_SEARCH_INT;
-			res->width = 4;
-			res->segment = -1; // TODO
-			res->guessDivisor = 1;
-			res->guessMultiplier = 1;
-			res->oldValue = mem32[i >> 2];
-			++found;
-		}
+	for (i = 0; i < 4; ++i) {
+		uint64_t bytes;
+		LOAD_64LE(bytes, i * 8, flags);
+		// Moves the low bit of each byte into the top byte, in order
+		bits |= (uint32_t) ((bytes * 0x0102040810204080ULL) >> 56) << (i * 8);
 	}
-	return found;
+	return bits;
 }
 
-static size_t _search16(const void* mem, size_t size, const struct mCoreMemoryBlock* block, uint16_t value16, enum mCoreMemorySearchOp op, struct mCoreMemorySearchResults* out, size_t limit) {
-	const uint16_t* mem16 = mem;
-	size_t found = 0;
-	uint32_t start = block->start;
-	uint32_t end = size; // TODO: Segments
-	size_t i;
-	// TODO: Big endian
-	for (i = 0; (!limit || found < limit) && i < end; i += 2) {
-		if (_op(mem16[i >> 1], value16, op)) {
-			struct mCoreMemorySearchResult* res = mCoreMemorySearchResultsAppend(out);
-			res->address = start + i;
-			res->type = mCORE_MEMORY_SEARCH_INT;
-			res->width = 2;
-			res->segment = -1; // TODO
-			res->guessDivisor = 1;
-			res->guessMultiplier = 1;
-			res->oldValue = mem16[i >> 1];
-			++found;
-		}
+DEFINE_FILTER(8)
+DEFINE_FILTER(16)
+DEFINE_FILTER(32)
+
+static void _fillBitmap(uint32_t* bitmap, size_t n) {
+	memset(bitmap, 0xFF, (n >> 5) * sizeof(*bitmap));
+	if (n & 31) {
+		bitmap[n >> 5] = (1U << (n & 31)) - 1;
 	}
-	return found;
 }
 
-static size_t _search8(const void* mem, size_t size, const struct mCoreMemoryBlock* block, uint8_t value8, enum mCoreMemorySearchOp op, struct mCoreMemorySearchResults* out, size_t limit) {
-	const uint8_t* mem8 = mem;
-	size_t found = 0;
-	uint32_t start = block->start;
-	uint32_t end = size; // TODO: Segments
-	size_t i;
-	for (i = 0; (!limit || found < limit) && i < end; ++i) {
-		if (_op(mem8[i], value8, op)) {
-			struct mCoreMemorySearchResult* res = mCoreMemorySearchResultsAppend(out);
-			res->address = start + i;
-			res->type = mCORE_MEMORY_SEARCH_INT;
-			res->width = 1;
-			res->segment = -1; // TODO
-			res->guessDivisor = 1;
-			res->guessMultiplier = 1;
-			res->oldValue = mem8[i];
-			++found;
-		}
+static size_t _countBitmap(const uint32_t* bitmap, size_t n) {
+	size_t count = 0;
+	size_t w;
+	for (w = 0; w < (n + 31) >> 5; ++w) {
+		count += popcount32(bitmap[w]);
 	}
-	return found;
+	return count;
+}
+
+static void _appendInt(struct mCoreMemorySearchResults* out, uint32_t address, int width, int32_t value) {
+	struct mCoreMemorySearchResult* res = mCoreMemorySearchResultsAppend(out);
+	res->address = address;
+	res->type = mCORE_MEMORY_SEARCH_INT;
+	res->width = width;
+	res->segment = -1; // TODO
+	res->guessDivisor = 1;
+	res->guessMultiplier = 1;
+	res->oldValue = value;
 }
 
+// TODO: Big endian
+#define DEFINE_SEARCH(BITS) \
+	static size_t _search ## BITS(const void* mem, size_t size, const struct mCoreMemoryBlock* block, uint ## BITS ## _t value ## BITS, enum mCoreMemorySearchOp op, struct mCoreMemorySearchResults* out, size_t limit) { \
+		const uint ## BITS ## _t* mem ## BITS = mem; \
+		uint32_t bitmap[SEARCH_SLAB >> 5]; \
+		size_t found = 0; \
+		size_t end = size / sizeof(*mem ## BITS); /* TODO: Segments */ \
+		size_t i; \
+		for (i = 0; (!limit || found < limit) && i < end; i += SEARCH_SLAB) { \
+			size_t length = end - i < SEARCH_SLAB ? end - i : SEARCH_SLAB; \
+			_fillBitmap(bitmap, length); \
+			_filter ## BITS(&mem ## BITS[i], NULL, length, op, value ## BITS, bitmap); \
+			size_t w; \
+			for (w = 0; (!limit || found < limit) && w < (length + 31) >> 5; ++w) { \
+				uint32_t bits = bitmap[w]; \
+				while (bits && (!limit || found < limit)) { \
+					size_t index = i + (w << 5) + ctz32(bits); \
+					bits &= bits - 1; \
+					_appendInt(out, block->start + index * sizeof(*mem ## BITS), sizeof(*mem ## BITS), mem ## BITS[index]); \
+					++found; \
+				} \
+			} \
+		} \
+		return found; \
+	}
+
+DEFINE_SEARCH(8)
+DEFINE_SEARCH(16)
+DEFINE_SEARCH(32)
+
 static size_t _searchInt(const void* mem, size_t size, const struct mCoreMemoryBlock* block, const struct mCoreMemorySearchParams* params, struct mCoreMemorySearchResults* out, size_t limit) {
 	if (params->align == params->width || params->align == -1) {
 		switch (params->width) {
@@ -340,3 +427,176 @@ void mCoreMemorySearchRepeat(struct mCore* core, const struct mCoreMemorySearchP
 		}
 	}
 }
+
+static bool _canUseCandidates(const struct mCoreMemorySearchParams* params) {
+	if (params->type != mCORE_MEMORY_SEARCH_INT) {
+		return false;
+	}
+	if (params->align != params->width && params->align != -1) {
+		return false;
+	}
+	return params->width == 1 || params->width == 2 || params->width == 4;
+}
+
+static void _freeRegion(struct mCoreMemorySearchRegion* region) {
+	free(region->snapshot);
+	free(region->bitmap);
+	region->snapshot = NULL;
+	region->bitmap = NULL;
+	region->count = 0;
+}
+
+static void _filterRegion(struct mCoreMemorySearchRegion* region, const void* mem, int width, enum mCoreMemorySearchOp op, int32_t match, bool first) {
+	const void* old = first ? NULL : region->snapshot;
+	size_t n = region->size / width;
+	switch (width) {
+	case 1:
+		_filter8(mem, old, n, op, match, region->bitmap);
+		break;
+	case 2:
+		_filter16(mem, old, n, op, match, region->bitmap);
+		break;
+	case 4:
+		_filter32(mem, old, n, op, match, region->bitmap);
+		break;
+	}
+	region->count = _countBitmap(region->bitmap, n);
+	if (!region->count) {
+		// Nothing left to narrow down, so there's no reason to hold onto the copy
+		_freeRegion(region);
+		return;
+	}
+	memcpy(region->snapshot, mem, region->size);
+}
+
+void mCoreMemorySearchCandidatesInit(struct mCoreMemorySearchCandidates* candidates) {
+	mCoreMemorySearchRegionsInit(&candidates->regions, 0);
+	candidates->width = 0;
+	candidates->count = 0;
+}
+
+void mCoreMemorySearchCandidatesDeinit(struct mCoreMemorySearchCandidates* candidates) {
+	mCoreMemorySearchCandidatesClear(candidates);
+	mCoreMemorySearchRegionsDeinit(&candidates->regions);
+}
+
+void mCoreMemorySearchCandidatesClear(struct mCoreMemorySearchCandidates* candidates) {
+	size_t i;
+	for (i = 0; i < mCoreMemorySearchRegionsSize(&candidates->regions); ++i) {
+		_freeRegion(mCoreMemorySearchRegionsGetPointer(&candidates->regions, i));
+	}
+	mCoreMemorySearchRegionsClear(&candidates->regions);
+	candidates->width = 0;
+	candidates->count = 0;
+}
+
+bool mCoreMemorySearchCandidatesFind(struct mCore* core, const struct mCoreMemorySearchParams* params, struct mCoreMemorySearchCandidates* out) {
+	mCoreMemorySearchCandidatesClear(out);
+	if (!_canUseCandidates(params)) {
+		return false;
+	}
+
+	// The first pass truncates the value to the width, the same as mCoreMemorySearch
+	int32_t match = params->valueInt;
+	switch (params->width) {
+	case 1:
+		match = (uint8_t) match;
+		break;
+	case 2:
+		match = (uint16_t) match;
+		break;
+	}
+
+	const struct mCoreMemoryBlock* blocks;
+	size_t nBlocks = core->listMemoryBlocks(core, &blocks);
+	out->width = params->width;
+
+	size_t b;
+	for (b = 0; b < nBlocks; ++b) {
+		size_t size;
+		const struct mCoreMemoryBlock* block = &blocks[b];
+		if (!(block->flags & params->memoryFlags)) {
+			continue;
+		}
+		void* mem = core->getMemoryBlock(core, block->id, &size);
+		if (!mem) {
+			continue;
+		}
+		if (size > block->end - block->start) {
+			size = block->end - block->start; // TODO: Segments
+		}
+		size_t n = size / params->width;
+		if (!n) {
+			continue;
+		}
+		struct mCoreMemorySearchRegion* region = mCoreMemorySearchRegionsAppend(&out->regions);
+		region->id = block->id;
+		region->start = block->start;
+		region->size = n * params->width;
+		region->snapshot = malloc(region->size);
+		region->bitmap = malloc(((n + 31) >> 5) * sizeof(*region->bitmap));
+		_fillBitmap(region->bitmap, n);
+		_filterRegion(region, mem, params->width, params->op, match, true);
+		out->count += region->count;
+	}
+	return true;
+}
+
+bool mCoreMemorySearchCandidatesNarrow(struct mCore* core, const struct mCoreMemorySearchParams* params, struct mCoreMemorySearchCandidates* inout) {
+	if (!inout->width || params->width != inout->width || !_canUseCandidates(params)) {
+		return false;
+	}
+	inout->count = 0;
+	size_t i;
+	for (i = 0; i < mCoreMemorySearchRegionsSize(&inout->regions); ++i) {
+		struct mCoreMemorySearchRegion* region = mCoreMemorySearchRegionsGetPointer(&inout->regions, i);
+		if (!region->count) {
+			continue;
+		}
+		size_t size;
+		void* mem = core->getMemoryBlock(core, region->id, &size);
+		if (!mem || size < region->size) {
+			_freeRegion(region);
+			continue;
+		}
+		_filterRegion(region, mem, inout->width, params->op, params->valueInt, false);
+		inout->count += region->count;
+	}
+	return true;
+}
+
+size_t mCoreMemorySearchCandidatesExport(const struct mCoreMemorySearchCandidates* candidates, struct mCoreMemorySearchResults* out, size_t limit) {
+	size_t found = 0;
+	size_t i;
+	for (i = 0; (!limit || found < limit) && i < mCoreMemorySearchRegionsSize(&candidates->regions); ++i) {
+		const struct mCoreMemorySearchRegion* region = mCoreMemorySearchRegionsGetConstPointer(&candidates->regions, i);
+		if (!region->count) {
+			continue;
+		}
+		size_t n = region->size / candidates->width;
+		size_t w;
+		for (w = 0; (!limit || found < limit) && w < (n + 31) >> 5; ++w) {
+			uint32_t bits = region->bitmap[w];
+			while (bits && (!limit || found < limit)) {
+				size_t index = (w << 5) + ctz32(bits);
+				bits &= bits - 1;
+				int32_t value = 0;
+				// TODO: Big endian
+				switch (candidates->width) {
+				case 1:
+					value = region->snapshot[index];
+					break;
+				case 2:
+					value = ((const uint16_t*) region->snapshot)[index];
+					break;
+				case 4:
+					value = ((const uint32_t*) region->snapshot)[index];
+					break;
+				}
+				_appendInt(out, region->start + index * candidates->width, candidates->width, value);
+				++found;
+			}
+		}
+	}
+	return found;
+}
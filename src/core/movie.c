@@ -0,0 +1,471 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include <mgba/core/movie.h>
+
+#include <mgba/core/core.h>
+#include <mgba/core/log.h>
+#include <mgba/core/serialize.h>
+#include <mgba-util/crc32.h>
+#include <mgba-util/memory.h>
+#include <mgba-util/vfs.h>
+
+#define MOVIE_MAGIC "mMOV"
+#define MOVIE_VERSION 1
+#define MOVIE_FLUSH_SIZE 0x1000
+#define MOVIE_STATE_FLAGS (SAVESTATE_SAVEDATA | SAVESTATE_RTC)
+
+mLOG_DECLARE_CATEGORY(MOVIE);
+mLOG_DEFINE_CATEGORY(MOVIE, "Movie", "core.movie");
+
+enum {
+	MOVIE_EVENT_END = 0,
+	MOVIE_EVENT_RUN = 1,
+	MOVIE_EVENT_CHECKSUM = 2,
+};
+
+// Followed by keyframeSize bytes of savestate and then the event stream. Each event is a tag byte:
+// a run carries the keys and the number of frames they're held for as LEB128 varints, and a
+// checksum carries the frame number as a varint and the CRC32 as 4 little-endian bytes.
+struct mMovieHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t platform;
+	uint32_t romCrc32;
+	uint32_t checksumInterval;
+	uint32_t frames;
+	uint32_t keyframeSize;
+	uint32_t reserved;
+};
+
+static bool _reserve(struct mMovie* movie, size_t size) {
+	if (movie->streamSize + size <= movie->streamCapacity) {
+		return true;
+	}
+	size_t capacity = movie->streamCapacity ? movie->streamCapacity : MOVIE_FLUSH_SIZE;
+	while (capacity < movie->streamSize + size) {
+		capacity *= 2;
+	}
+	uint8_t* stream = realloc(movie->stream, capacity);
+	if (!stream) {
+		return false;
+	}
+	movie->stream = stream;
+	movie->streamCapacity = capacity;
+	return true;
+}
+
+static void _putByte(struct mMovie* movie, uint8_t value) {
+	if (_reserve(movie, 1)) {
+		movie->stream[movie->streamSize] = value;
+		++movie->streamSize;
+	}
+}
+
+static void _putVarint(struct mMovie* movie, uint32_t value) {
+	while (value >= 0x80) {
+		_putByte(movie, (value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	_putByte(movie, value);
+}
+
+static void _put32(struct mMovie* movie, uint32_t value) {
+	if (_reserve(movie, 4)) {
+		STORE_32LE(value, movie->streamSize, movie->stream);
+		movie->streamSize += 4;
+	}
+}
+
+static bool _getByte(struct mMovie* movie, uint8_t* value) {
+	if (movie->streamOffset >= movie->streamSize) {
+		return false;
+	}
+	*value = movie->stream[movie->streamOffset];
+	++movie->streamOffset;
+	return true;
+}
+
+static bool _getVarint(struct mMovie* movie, uint32_t* value) {
+	uint32_t result = 0;
+	unsigned shift;
+	for (shift = 0; shift < 35; shift += 7) {
+		uint8_t byte;
+		if (!_getByte(movie, &byte)) {
+			return false;
+		}
+		result |= (uint32_t) (byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			*value = result;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool _get32(struct mMovie* movie, uint32_t* value) {
+	if (movie->streamOffset + 4 > movie->streamSize) {
+		return false;
+	}
+	LOAD_32LE(*value, movie->streamOffset, movie->stream);
+	movie->streamOffset += 4;
+	return true;
+}
+
+static void _flushStream(struct mMovie* movie) {
+	if (movie->streamSize) {
+		movie->vf->write(movie->vf, movie->stream, movie->streamSize);
+		movie->streamSize = 0;
+	}
+}
+
+static void _flushRun(struct mMovie* movie) {
+	if (!movie->runLength) {
+		return;
+	}
+	_putByte(movie, MOVIE_EVENT_RUN);
+	_putVarint(movie, movie->keys);
+	_putVarint(movie, movie->runLength);
+	movie->runLength = 0;
+}
+
+static uint32_t _checksum(struct mMovie* movie) {
+	size_t size = mCoreStateBufferSize(movie->core, 0);
+	if (size != movie->stateSize) {
+		if (movie->state) {
+			mappedMemoryFree(movie->state, movie->stateSize);
+		}
+		movie->state = anonymousMemoryMap(size);
+		movie->stateSize = size;
+	}
+	if (!mCoreSaveStateInto(movie->core, movie->state, size, 0)) {
+		return 0;
+	}
+	return crc32(0, movie->state, size);
+}
+
+static uint32_t _romCrc32(struct mCore* core) {
+	uint32_t crc = 0;
+	core->checksum(core, &crc, mCHECKSUM_CRC32);
+	return crc;
+}
+
+static void _finish(struct mMovie* movie) {
+	movie->mode = mMOVIE_FINISHED;
+	if (movie->desyncs) {
+		mLOG(MOVIE, WARN, "Movie finished after %u frames with %u desynced checksums, first at frame %u",
+		     movie->frame, movie->desyncs, movie->firstDesync);
+	} else {
+		mLOG(MOVIE, INFO, "Movie finished after %u frames", movie->frame);
+	}
+}
+
+static void _advance(struct mMovie* movie) {
+	while (movie->mode == mMOVIE_PLAYING && !movie->runLength) {
+		uint8_t event;
+		uint32_t frame;
+		uint32_t crc;
+		if (!_getByte(movie, &event)) {
+			event = MOVIE_EVENT_END;
+		}
+		switch (event) {
+		case MOVIE_EVENT_RUN:
+			if (!_getVarint(movie, &movie->keys) || !_getVarint(movie, &movie->runLength)) {
+				mLOG(MOVIE, ERROR, "Movie is truncated at frame %u", movie->frame);
+				_finish(movie);
+			}
+			break;
+		case MOVIE_EVENT_CHECKSUM:
+			if (!_getVarint(movie, &frame) || !_get32(movie, &crc)) {
+				mLOG(MOVIE, ERROR, "Movie is truncated at frame %u", movie->frame);
+				_finish(movie);
+				break;
+			}
+			if (frame != movie->frame || _checksum(movie) != crc) {
+				if (!movie->desyncs) {
+					movie->firstDesync = movie->frame;
+					mLOG(MOVIE, WARN, "Movie desynced at frame %u", movie->frame);
+				}
+				++movie->desyncs;
+			}
+			break;
+		case MOVIE_EVENT_END:
+		default:
+			_finish(movie);
+			break;
+		}
+	}
+	if (movie->mode == mMOVIE_PLAYING) {
+		// Reapplied every frame so frontend input can't leak into the playback
+		movie->core->setKeys(movie->core, movie->keys);
+	}
+}
+
+static void _captureRTC(struct mMovie* movie, struct mCore* core) {
+	movie->rtcOverride = core->rtc.override;
+	movie->rtcValue = core->rtc.value;
+}
+
+static void _maskSavedata(struct mCore* core) {
+	// Swap the save for a throwaway copy of itself, so that nothing the game writes reaches the real file
+	const void* sram;
+	size_t size = core->savedataRef(core, &sram);
+	if (!size) {
+		return;
+	}
+	struct VFile* vf = VFileMemChunk(sram, size);
+	if (vf) {
+		core->loadTemporarySave(core, vf);
+	}
+}
+
+void mMovieInit(struct mMovie* movie) {
+	memset(movie, 0, sizeof(*movie));
+}
+
+void mMovieDeinit(struct mMovie* movie) {
+	mMovieStop(movie);
+	free(movie->stream);
+	if (movie->state) {
+		mappedMemoryFree(movie->state, movie->stateSize);
+	}
+	memset(movie, 0, sizeof(*movie));
+}
+
+bool mMovieRecord(struct mMovie* movie, struct mCore* core, struct VFile* vf, unsigned checksumInterval) {
+	mMovieStop(movie);
+	struct VFile* keyframe = VFileMemChunk(NULL, 0);
+	if (!keyframe) {
+		return false;
+	}
+
+	_captureRTC(movie, core);
+	// The clock has to follow emulated time instead of the host's for the game to see the same dates on playback
+	if (core->rtc.override != RTC_FIXED && core->rtc.override != RTC_FAKE_EPOCH) {
+		core->rtc.override = RTC_FAKE_EPOCH;
+		core->rtc.value = time(0) * 1000LL;
+	}
+	// Recording continues from the loaded keyframe rather than the live state, so that it starts
+	// from exactly the same place playback will
+	bool success = mCoreSaveStateNamed(core, keyframe, MOVIE_STATE_FLAGS | SAVESTATE_COMPRESSED) &&
+	               mCoreLoadStateNamed(core, keyframe, MOVIE_STATE_FLAGS);
+	size_t keyframeSize = keyframe->size(keyframe);
+	if (success) {
+		struct mMovieHeader header = {0};
+		memcpy(header.magic, MOVIE_MAGIC, sizeof(header.magic));
+		STORE_32LE(MOVIE_VERSION, 0, &header.version);
+		STORE_32LE(core->platform(core), 0, &header.platform);
+		STORE_32LE(_romCrc32(core), 0, &header.romCrc32);
+		STORE_32LE(checksumInterval, 0, &header.checksumInterval);
+		STORE_32LE(keyframeSize, 0, &header.keyframeSize);
+
+		void* contents = keyframe->map(keyframe, keyframeSize, MAP_READ);
+		vf->truncate(vf, 0);
+		success = vf->seek(vf, 0, SEEK_SET) == 0 &&
+		          vf->write(vf, &header, sizeof(header)) == (ssize_t) sizeof(header) &&
+		          vf->write(vf, contents, keyframeSize) == (ssize_t) keyframeSize;
+		keyframe->unmap(keyframe, contents, keyframeSize);
+	}
+	keyframe->close(keyframe);
+	if (!success) {
+		core->rtc.override = movie->rtcOverride;
+		core->rtc.value = movie->rtcValue;
+		mLOG(MOVIE, ERROR, "Failed to start recording movie");
+		return false;
+	}
+
+	movie->mode = mMOVIE_RECORDING;
+	movie->core = core;
+	movie->vf = vf;
+	movie->checksumInterval = checksumInterval;
+	movie->frame = 0;
+	movie->frames = 0;
+	movie->keys = core->getKeys(core);
+	movie->runLength = 0;
+	movie->keysLatched = false;
+	movie->keysHeld = false;
+	movie->streamSize = 0;
+	movie->streamOffset = 0;
+	movie->desyncs = 0;
+	movie->firstDesync = 0;
+	return true;
+}
+
+bool mMoviePlay(struct mMovie* movie, struct mCore* core, struct VFile* vf) {
+	mMovieStop(movie);
+	struct mMovieHeader header;
+	if (vf->seek(vf, 0, SEEK_SET) < 0 || vf->read(vf, &header, sizeof(header)) != (ssize_t) sizeof(header) ||
+	    memcmp(header.magic, MOVIE_MAGIC, sizeof(header.magic)) != 0) {
+		mLOG(MOVIE, ERROR, "Not a movie file");
+		return false;
+	}
+	uint32_t version;
+	uint32_t platform;
+	uint32_t romCrc32;
+	uint32_t keyframeSize;
+	LOAD_32LE(version, 0, &header.version);
+	LOAD_32LE(platform, 0, &header.platform);
+	LOAD_32LE(romCrc32, 0, &header.romCrc32);
+	LOAD_32LE(keyframeSize, 0, &header.keyframeSize);
+	if (version != MOVIE_VERSION) {
+		mLOG(MOVIE, ERROR, "Unsupported movie version %u", version);
+		return false;
+	}
+	if (platform != (uint32_t) core->platform(core) || romCrc32 != _romCrc32(core)) {
+		mLOG(MOVIE, ERROR, "Movie was recorded with a different game");
+		return false;
+	}
+	ssize_t streamSize = vf->size(vf) - (ssize_t) (sizeof(header) + keyframeSize);
+	if (streamSize < 0) {
+		mLOG(MOVIE, ERROR, "Movie is truncated");
+		return false;
+	}
+
+	void* keyframe = malloc(keyframeSize);
+	if (!keyframe || vf->read(vf, keyframe, keyframeSize) != (ssize_t) keyframeSize) {
+		free(keyframe);
+		return false;
+	}
+	movie->streamSize = 0;
+	if (!_reserve(movie, streamSize) || vf->read(vf, movie->stream, streamSize) != streamSize) {
+		free(keyframe);
+		return false;
+	}
+
+	_captureRTC(movie, core);
+	struct VFile* keyframeVf = VFileFromConstMemory(keyframe, keyframeSize);
+	// The keyframe's save is what the movie was recorded against, but it must not replace the
+	// user's own save; loading it without SAVESTATE_SAVEDATA keeps it in memory only
+	bool success = keyframeVf && mCoreLoadStateNamed(core, keyframeVf, MOVIE_STATE_FLAGS & ~SAVESTATE_SAVEDATA);
+	if (keyframeVf) {
+		keyframeVf->close(keyframeVf);
+	}
+	free(keyframe);
+	if (!success) {
+		core->rtc.override = movie->rtcOverride;
+		core->rtc.value = movie->rtcValue;
+		mLOG(MOVIE, ERROR, "Failed to load movie keyframe");
+		return false;
+	}
+	_maskSavedata(core);
+
+	movie->mode = mMOVIE_PLAYING;
+	movie->core = core;
+	movie->vf = vf;
+	LOAD_32LE(movie->checksumInterval, 0, &header.checksumInterval);
+	LOAD_32LE(movie->frames, 0, &header.frames);
+	movie->frame = 0;
+	movie->keys = 0;
+	movie->runLength = 0;
+	movie->streamSize = streamSize;
+	movie->streamOffset = 0;
+	movie->desyncs = 0;
+	movie->firstDesync = 0;
+	_advance(movie);
+	return true;
+}
+
+void mMovieStop(struct mMovie* movie) {
+	if (movie->mode == mMOVIE_IDLE) {
+		return;
+	}
+	if (movie->mode == mMOVIE_RECORDING) {
+		_flushRun(movie);
+		_putByte(movie, MOVIE_EVENT_END);
+		_flushStream(movie);
+		uint32_t frames;
+		STORE_32LE(movie->frame, 0, &frames);
+		movie->vf->seek(movie->vf, offsetof(struct mMovieHeader, frames), SEEK_SET);
+		movie->vf->write(movie->vf, &frames, sizeof(frames));
+		mLOG(MOVIE, INFO, "Recorded movie of %u frames", movie->frame);
+		if (movie->keysHeld && movie->core->getKeys(movie->core) == movie->frameKeys) {
+			movie->core->setKeys(movie->core, movie->heldKeys);
+		}
+		movie->keysLatched = false;
+		movie->keysHeld = false;
+	}
+	movie->core->rtc.override = movie->rtcOverride;
+	movie->core->rtc.value = movie->rtcValue;
+	movie->vf->close(movie->vf);
+	movie->vf = NULL;
+	movie->core = NULL;
+	movie->streamSize = 0;
+	movie->streamOffset = 0;
+	movie->runLength = 0;
+	movie->mode = mMOVIE_IDLE;
+}
+
+bool mMovieIsActive(const struct mMovie* movie) {
+	return movie->mode == mMOVIE_RECORDING || movie->mode == mMOVIE_PLAYING;
+}
+
+void mMovieFrameEnded(struct mMovie* movie) {
+	uint32_t keys;
+	switch (movie->mode) {
+	case mMOVIE_RECORDING:
+		if (movie->keysLatched) {
+			keys = movie->frameKeys;
+			// Let through what the frontend set during the frame, unless it has set keys since
+			if (movie->keysHeld && movie->core->getKeys(movie->core) == keys) {
+				movie->core->setKeys(movie->core, movie->heldKeys);
+			}
+			movie->keysLatched = false;
+			movie->keysHeld = false;
+		} else {
+			// The game never looked, so whatever is held when the frame ends will do
+			keys = movie->core->getKeys(movie->core);
+		}
+		if (keys != movie->keys) {
+			_flushRun(movie);
+			movie->keys = keys;
+		}
+		++movie->runLength;
+		++movie->frame;
+		if (movie->checksumInterval && !(movie->frame % movie->checksumInterval)) {
+			_flushRun(movie);
+			_putByte(movie, MOVIE_EVENT_CHECKSUM);
+			_putVarint(movie, movie->frame);
+			_put32(movie, _checksum(movie));
+		}
+		if (movie->streamSize >= MOVIE_FLUSH_SIZE) {
+			_flushStream(movie);
+		}
+		break;
+	case mMOVIE_PLAYING:
+		++movie->frame;
+		if (movie->runLength) {
+			--movie->runLength;
+		}
+		_advance(movie);
+		break;
+	case mMOVIE_IDLE:
+	case mMOVIE_FINISHED:
+		break;
+	}
+}
+
+void mMovieKeysRead(struct mMovie* movie) {
+	uint32_t keys;
+	switch (movie->mode) {
+	case mMOVIE_RECORDING:
+		// The frontend sets keys whenever it likes, but playback can only change them between frames
+		keys = movie->core->getKeys(movie->core);
+		if (!movie->keysLatched) {
+			movie->frameKeys = keys;
+			movie->keysLatched = true;
+		} else if (keys != movie->frameKeys) {
+			movie->heldKeys = keys;
+			movie->keysHeld = true;
+			movie->core->setKeys(movie->core, movie->frameKeys);
+		}
+		break;
+	case mMOVIE_PLAYING:
+		movie->core->setKeys(movie->core, movie->keys);
+		break;
+	case mMOVIE_IDLE:
+	case mMOVIE_FINISHED:
+		break;
+	}
+}
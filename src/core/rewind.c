@@ -6,33 +6,98 @@
 #include <mgba/core/rewind.h>
 
 #include <mgba/core/core.h>
+#include <mgba/core/log.h>
 #include <mgba/core/serialize.h>
-#include <mgba-util/patch/fast.h>
+#include <mgba-util/clock.h>
+#include <mgba-util/lz.h>
+#include <mgba-util/math.h>
+#include <mgba-util/memory.h>
 #include <mgba-util/vfs.h>
 
-DEFINE_VECTOR(mCoreRewindPatches, struct PatchFast);
+DEFINE_VECTOR(mCoreRewindEntries, struct mCoreRewindEntry);
 
-static void _rewindDiff(struct mCoreRewindContext* context);
+static void _rewindSnapshot(struct mCoreRewindContext* context, struct mCore* core);
+static void _rewindCompress(struct mCoreRewindContext* context);
+static bool _rewindReplay(struct mCoreRewindContext* context, struct mCore* core, size_t steps);
+static bool _rewindResize(struct mCoreRewindContext* context, size_t imageSize);
+static void _rewindClear(struct mCoreRewindContext* context);
 
 #ifndef DISABLE_THREADING
 THREAD_ENTRY _rewindThread(void* context);
 #endif
 
-void mCoreRewindContextInit(struct mCoreRewindContext* context, size_t entries, bool onThread) {
-	if (context->currentState) {
-		return;
+static void _rewindLock(struct mCoreRewindContext* context) {
+#ifndef DISABLE_THREADING
+	if (context->onThread) {
+		MutexLock(&context->mutex);
+	}
+#else
+	UNUSED(context);
+#endif
+}
+
+static void _rewindUnlock(struct mCoreRewindContext* context) {
+#ifndef DISABLE_THREADING
+	if (context->onThread) {
+		MutexUnlock(&context->mutex);
+	}
+#else
+	UNUSED(context);
+#endif
+}
+
+static size_t _rewindRawSize(const struct mCoreRewindEntry* entry) {
+	if (entry->keyframe) {
+		return entry->imageSize;
+	}
+	return entry->nPages * (sizeof(uint32_t) + mSTATE_PAGE_SIZE);
+}
+
+static bool _rewindReserveBuffer(uint8_t** buffer, size_t* capacity, size_t size) {
+	if (*capacity < size) {
+		// Buffers only ever grow, so steady-state appends don't allocate
+		free(*buffer);
+		*buffer = malloc(size);
+		*capacity = *buffer ? size : 0;
+	}
+	return *capacity >= size;
+}
+
+bool mCoreRewindContextInit(struct mCoreRewindContext* context, size_t entries, size_t budget, bool onThread) {
+	if (context->stateVf) {
+		return true;
+	}
+	if (!budget) {
+		budget = mCORE_REWIND_DEFAULT_BUDGET;
 	}
-	mCoreRewindPatchesInit(&context->patchMemory, entries);
-	size_t e;
-	for (e = 0; e < entries; ++e) {
-		initPatchFast(mCoreRewindPatchesAppend(&context->patchMemory));
+	// The whole budget is claimed up front so the history can never grow past it
+	context->arena = anonymousMemoryMap(budget);
+	if (!context->arena) {
+		mLOG(STATUS, ERROR, "Could not allocate %" PRIz "u bytes for rewind", budget);
+		return false;
 	}
-	context->previousState = VFileMemChunk(0, 0);
-	context->currentState = VFileMemChunk(0, 0);
+	mCoreRewindEntriesInit(&context->entries, entries);
+	mCoreRewindEntriesResize(&context->entries, entries);
+	context->current = 0;
 	context->size = 0;
+	context->keyframeInterval = mCORE_REWIND_DEFAULT_KEYFRAME_INTERVAL;
+	context->sinceKeyframe = 0;
+	context->budget = budget;
+	context->arenaHead = 0;
+	context->image = NULL;
+	context->shadow = NULL;
+	context->dirty = NULL;
+	context->imageSize = 0;
+	context->staging = NULL;
+	context->stagingSize = 0;
+	context->stagingCapacity = 0;
+	context->scratch = NULL;
+	context->scratchCapacity = 0;
+	context->stateVf = VFileMemChunk(0, 0);
+	memset(&context->stats, 0, sizeof(context->stats));
+	context->ready = false;
 #ifndef DISABLE_THREADING
 	context->onThread = onThread;
-	context->ready = false;
 	if (onThread) {
 		MutexInit(&context->mutex);
 		ConditionInit(&context->cond);
@@ -41,10 +106,11 @@ void mCoreRewindContextInit(struct mCoreRewindContext* context, size_t entries,
 #else
 	UNUSED(onThread);
 #endif
+	return true;
 }
 
 void mCoreRewindContextDeinit(struct mCoreRewindContext* context) {
-	if (!context->currentState) {
+	if (!context->stateVf) {
 		return;
 	}
 #ifndef DISABLE_THREADING
@@ -58,124 +124,413 @@ void mCoreRewindContextDeinit(struct mCoreRewindContext* context) {
 		ConditionDeinit(&context->cond);
 	}
 #endif
-	context->previousState->close(context->previousState);
-	context->currentState->close(context->currentState);
-	context->previousState = NULL;
-	context->currentState = NULL;
-	size_t s;
-	for (s = 0; s < mCoreRewindPatchesSize(&context->patchMemory); ++s) {
-		deinitPatchFast(mCoreRewindPatchesGetPointer(&context->patchMemory, s));
-	}
-	mCoreRewindPatchesDeinit(&context->patchMemory);
+	context->stateVf->close(context->stateVf);
+	context->stateVf = NULL;
+	mCoreRewindEntriesDeinit(&context->entries);
+	mappedMemoryFree(context->arena, context->budget);
+	context->arena = NULL;
+	free(context->staging);
+	free(context->scratch);
+	context->staging = NULL;
+	context->scratch = NULL;
+	context->stagingCapacity = 0;
+	context->scratchCapacity = 0;
+	context->size = 0;
+	context->ready = false;
+	_rewindResize(context, 0);
 }
 
 void mCoreRewindAppend(struct mCoreRewindContext* context, struct mCore* core) {
-#ifndef DISABLE_THREADING
-	if (context->onThread) {
-		MutexLock(&context->mutex);
-	}
-#endif
-	struct VFile* nextState = context->previousState;
-	mCoreSaveStateNamed(core, nextState, SAVESTATE_SAVEDATA | SAVESTATE_RTC);
-	context->previousState = context->currentState;
-	context->currentState = nextState;
-#ifndef DISABLE_THREADING
-	if (context->onThread) {
-		context->ready = true;
-		ConditionWake(&context->cond);
-		MutexUnlock(&context->mutex);
+	if (!context->stateVf) {
 		return;
 	}
+	_rewindLock(context);
+	if (context->ready) {
+		// The rewind thread hasn't caught up, so the previous entry has to be finished here
+		_rewindCompress(context);
+	}
+	_rewindSnapshot(context, core);
+	if (context->ready) {
+#ifndef DISABLE_THREADING
+		if (context->onThread) {
+			ConditionWake(&context->cond);
+			MutexUnlock(&context->mutex);
+			return;
+		}
 #endif
-	_rewindDiff(context);
+		_rewindCompress(context);
+	}
+	_rewindUnlock(context);
 }
 
-void _rewindDiff(struct mCoreRewindContext* context) {
-	++context->current;
-	if (context->size < mCoreRewindPatchesSize(&context->patchMemory)) {
-		++context->size;
+bool mCoreRewindRestore(struct mCoreRewindContext* context, struct mCore* core) {
+	return mCoreRewindRestoreSteps(context, core, 1) == 1;
+}
+
+size_t mCoreRewindRestoreSteps(struct mCoreRewindContext* context, struct mCore* core, size_t steps) {
+	if (!context->stateVf) {
+		return 0;
 	}
-	if (context->current >= mCoreRewindPatchesSize(&context->patchMemory)) {
-		context->current = 0;
+	_rewindLock(context);
+	if (context->ready) {
+		_rewindCompress(context);
+	}
+	if (steps > context->size) {
+		steps = context->size;
 	}
-	struct PatchFast* patch = mCoreRewindPatchesGetPointer(&context->patchMemory, context->current);
-	size_t size2 = context->currentState->size(context->currentState);
-	size_t size = context->previousState->size(context->previousState);
-	if (size2 > size) {
-		context->previousState->truncate(context->previousState, size2);
-		size = size2;
-	} else if (size > size2) {
-		context->currentState->truncate(context->currentState, size);
+	if (steps && !_rewindReplay(context, core, steps)) {
+		steps = 0;
 	}
-	void* current = context->previousState->map(context->previousState, size, MAP_READ);
-	void* next = context->currentState->map(context->currentState, size, MAP_READ);
-	diffPatchFast(patch, current, next, size);
-	context->previousState->unmap(context->previousState, current, size);
-	context->currentState->unmap(context->currentState, next, size);
+	_rewindUnlock(context);
+	return steps;
 }
 
-bool mCoreRewindRestore(struct mCoreRewindContext* context, struct mCore* core) {
-#ifndef DISABLE_THREADING
-	if (context->onThread) {
-		MutexLock(&context->mutex);
-	}
-#endif
-	if (!context->size) {
-#ifndef DISABLE_THREADING
-		if (context->onThread) {
-			MutexUnlock(&context->mutex);
+void mCoreRewindGetStats(struct mCoreRewindContext* context, struct mCoreRewindStats* stats) {
+	_rewindLock(context);
+	*stats = context->stats;
+	stats->entries = context->size;
+	stats->keyframes = 0;
+	stats->bytesUsed = 0;
+	stats->rawBytes = 0;
+	stats->budget = context->budget;
+	size_t capacity = mCoreRewindEntriesSize(&context->entries);
+	size_t i;
+	for (i = 0; i < context->size; ++i) {
+		const struct mCoreRewindEntry* entry = mCoreRewindEntriesGetPointer(&context->entries, (context->current + capacity - i) % capacity);
+		stats->bytesUsed += entry->size;
+		stats->rawBytes += _rewindRawSize(entry);
+		if (entry->keyframe) {
+			++stats->keyframes;
 		}
-#endif
+	}
+	_rewindUnlock(context);
+}
+
+static bool _rewindResize(struct mCoreRewindContext* context, size_t imageSize) {
+	if (context->image) {
+		mappedMemoryFree(context->image, context->imageSize);
+		context->image = NULL;
+	}
+	if (context->shadow) {
+		mappedMemoryFree(context->shadow, context->imageSize);
+		context->shadow = NULL;
+	}
+	free(context->dirty);
+	context->dirty = NULL;
+	context->imageSize = imageSize;
+	if (!imageSize) {
+		return true;
+	}
+	size_t pages = imageSize >> mSTATE_PAGE_SHIFT;
+	context->image = anonymousMemoryMap(imageSize);
+	context->shadow = anonymousMemoryMap(imageSize);
+	context->dirty = calloc((pages + 31) / 32, sizeof(uint32_t));
+	if (!context->image || !context->shadow || !context->dirty) {
+		mLOG(STATUS, ERROR, "Could not allocate rewind image");
+		_rewindResize(context, 0);
 		return false;
 	}
-	--context->size;
+	return true;
+}
 
-	mCoreLoadStateNamed(core, context->previousState, SAVESTATE_SAVEDATA | SAVESTATE_RTC);
-	if (context->current == 0) {
-		context->current = mCoreRewindPatchesSize(&context->patchMemory);
+static void _rewindClear(struct mCoreRewindContext* context) {
+	context->size = 0;
+	context->arenaHead = 0;
+	context->sinceKeyframe = 0;
+	context->ready = false;
+	_rewindResize(context, 0);
+}
+
+static bool _rewindStageKeyframe(struct mCoreRewindContext* context) {
+	if (!_rewindReserveBuffer(&context->staging, &context->stagingCapacity, context->imageSize)) {
+		return false;
 	}
-	--context->current;
+	memcpy(context->staging, context->image, context->imageSize);
+	context->stagingSize = context->imageSize;
+	context->pending.imageSize = context->imageSize;
+	context->pending.nPages = context->imageSize >> mSTATE_PAGE_SHIFT;
+	context->pending.keyframe = true;
+	context->sinceKeyframe = 0;
+	context->ready = true;
+	return true;
+}
 
-	if (context->size) {
-		struct PatchFast* patch = mCoreRewindPatchesGetPointer(&context->patchMemory, context->current);
-		size_t size2 = context->previousState->size(context->previousState);
-		size_t size = context->currentState->size(context->currentState);
-		if (size2 < size) {
-			size = size2;
+// Moves the dirty pages of the shadow into the image, optionally keeping the pages they replace
+static bool _rewindStageDirty(struct mCoreRewindContext* context, bool keep) {
+	size_t words = ((context->imageSize >> mSTATE_PAGE_SHIFT) + 31) / 32;
+	size_t nPages = 0;
+	size_t i;
+	if (keep) {
+		for (i = 0; i < words; ++i) {
+			nPages += popcount32(context->dirty[i]);
+		}
+		if (!_rewindReserveBuffer(&context->staging, &context->stagingCapacity, nPages * (sizeof(uint32_t) + mSTATE_PAGE_SIZE))) {
+			return false;
 		}
-		void* current = context->currentState->map(context->currentState, size, MAP_READ);
-		void* previous = context->previousState->map(context->previousState, size, MAP_WRITE);
-		patch->d.applyPatch(&patch->d, previous, size, current, size);
-		context->currentState->unmap(context->currentState, current, size);
-		context->previousState->unmap(context->previousState, previous, size);
 	}
-	struct VFile* nextState = context->previousState;
-	context->previousState = context->currentState;
-	context->currentState = nextState;
-#ifndef DISABLE_THREADING
-	if (context->onThread) {
-		MutexUnlock(&context->mutex);
+	uint32_t* pageIds = (uint32_t*) context->staging;
+	uint8_t* pages = &context->staging[nPages * sizeof(uint32_t)];
+	size_t kept = 0;
+	for (i = 0; i < words; ++i) {
+		uint32_t bits = context->dirty[i];
+		while (bits) {
+			unsigned bit = 31 - clz32(bits);
+			bits &= ~(1U << bit);
+			size_t offset = (i * 32 + bit) << mSTATE_PAGE_SHIFT;
+			if (!memcmp(&context->image[offset], &context->shadow[offset], mSTATE_PAGE_SIZE)) {
+				// Written but not actually changed
+				continue;
+			}
+			if (keep) {
+				pageIds[kept] = i * 32 + bit;
+				memcpy(&pages[kept << mSTATE_PAGE_SHIFT], &context->image[offset], mSTATE_PAGE_SIZE);
+				++kept;
+			}
+			memcpy(&context->image[offset], &context->shadow[offset], mSTATE_PAGE_SIZE);
+		}
 	}
-#endif
+	if (!keep) {
+		return true;
+	}
+	if (kept < nPages) {
+		memmove(&context->staging[kept * sizeof(uint32_t)], pages, kept << mSTATE_PAGE_SHIFT);
+	}
+	context->stagingSize = kept * (sizeof(uint32_t) + mSTATE_PAGE_SIZE);
+	context->pending.imageSize = context->imageSize;
+	context->pending.nPages = kept;
+	context->pending.keyframe = false;
+	context->ready = true;
 	return true;
 }
 
+// Compares a serialized state against the image for cores that can't report dirty pages themselves
+static void _rewindDiffState(struct mCoreRewindContext* context, const uint8_t* state, size_t stateSize) {
+	uint8_t tail[mSTATE_PAGE_SIZE];
+	size_t offset;
+	for (offset = 0; offset < stateSize; offset += mSTATE_PAGE_SIZE) {
+		const uint8_t* page = &state[offset];
+		if (stateSize - offset < mSTATE_PAGE_SIZE) {
+			memset(tail, 0, sizeof(tail));
+			memcpy(tail, page, stateSize - offset);
+			page = tail;
+		}
+		if (memcmp(page, &context->image[offset], mSTATE_PAGE_SIZE)) {
+			size_t pageId = offset >> mSTATE_PAGE_SHIFT;
+			memcpy(&context->shadow[offset], page, mSTATE_PAGE_SIZE);
+			context->dirty[pageId >> 5] |= 1U << (pageId & 31);
+		}
+	}
+}
+
+static void _rewindSnapshot(struct mCoreRewindContext* context, struct mCore* core) {
+	size_t imageSize;
+	uint8_t* state = NULL;
+	size_t stateSize = 0;
+	if (core->snapshotSave) {
+		imageSize = core->snapshotSize(core);
+	} else {
+		mCoreSaveStateNamed(core, context->stateVf, SAVESTATE_SAVEDATA | SAVESTATE_RTC);
+		stateSize = context->stateVf->size(context->stateVf);
+		imageSize = (stateSize + mSTATE_PAGE_SIZE - 1) & ~(size_t) (mSTATE_PAGE_SIZE - 1);
+		state = context->stateVf->map(context->stateVf, stateSize, MAP_READ);
+	}
+
+	if (imageSize != context->imageSize) {
+		// The layout changed (e.g. savedata was detected), so the old image has to be kept whole
+		if (context->image && !_rewindStageKeyframe(context)) {
+			_rewindClear(context);
+		}
+		if (!_rewindResize(context, imageSize)) {
+			// Rewinding stays unavailable until there's memory for a new image
+			_rewindClear(context);
+		} else if (state) {
+			memcpy(context->shadow, state, stateSize);
+		} else {
+			core->snapshotSave(core, context->shadow, NULL);
+		}
+		if (context->image) {
+			memcpy(context->image, context->shadow, imageSize);
+		}
+	} else {
+		size_t words = ((imageSize >> mSTATE_PAGE_SHIFT) + 31) / 32;
+		memset(context->dirty, 0, words * sizeof(*context->dirty));
+		if (state) {
+			_rewindDiffState(context, state, stateSize);
+		} else {
+			core->snapshotSave(core, context->shadow, context->dirty);
+		}
+		bool staged;
+		if (context->keyframeInterval && ++context->sinceKeyframe >= context->keyframeInterval) {
+			staged = _rewindStageKeyframe(context);
+			_rewindStageDirty(context, false);
+		} else {
+			staged = _rewindStageDirty(context, true);
+		}
+		if (!staged) {
+			// The history can't be continued without this entry
+			_rewindClear(context);
+		}
+	}
+
+	if (state) {
+		context->stateVf->unmap(context->stateVf, state, stateSize);
+	}
+}
+
+static struct mCoreRewindEntry* _rewindOldest(struct mCoreRewindContext* context) {
+	size_t capacity = mCoreRewindEntriesSize(&context->entries);
+	return mCoreRewindEntriesGetPointer(&context->entries, (context->current + capacity - context->size + 1) % capacity);
+}
+
+// Entries are laid out in the arena in the order they were made, so the oldest ones are always the next to be overwritten
+static size_t _rewindReserve(struct mCoreRewindContext* context, size_t size) {
+	size_t offset = context->arenaHead;
+	if (offset + size > context->budget) {
+		while (context->size && _rewindOldest(context)->offset >= offset) {
+			--context->size;
+		}
+		offset = 0;
+	}
+	while (context->size) {
+		const struct mCoreRewindEntry* oldest = _rewindOldest(context);
+		if (oldest->offset >= offset + size || oldest->offset + oldest->size <= offset) {
+			break;
+		}
+		--context->size;
+	}
+	context->arenaHead = offset + size;
+	return offset;
+}
+
+static void _rewindCompress(struct mCoreRewindContext* context) {
+	context->ready = false;
+	size_t bound = lzCompressBound(context->stagingSize);
+	size_t size = 0;
+	if (_rewindReserveBuffer(&context->scratch, &context->scratchCapacity, bound)) {
+		uint64_t start = currentTimeUsec();
+		size = lzCompress(context->staging, context->stagingSize, context->scratch, bound);
+		context->stats.compressUsec += currentTimeUsec() - start;
+		++context->stats.compressions;
+	}
+	if (!size || size > context->budget) {
+		// Older entries can't be reached without this one, so they're useless now
+		_rewindClear(context);
+		return;
+	}
+
+	size_t offset = _rewindReserve(context, size);
+	memcpy(&context->arena[offset], context->scratch, size);
+
+	size_t capacity = mCoreRewindEntriesSize(&context->entries);
+	++context->current;
+	if (context->current >= capacity) {
+		context->current = 0;
+	}
+	if (context->size < capacity) {
+		++context->size;
+	}
+	struct mCoreRewindEntry* entry = mCoreRewindEntriesGetPointer(&context->entries, context->current);
+	*entry = context->pending;
+	entry->offset = offset;
+	entry->size = size;
+}
+
+static bool _rewindApply(struct mCoreRewindContext* context, const struct mCoreRewindEntry* entry) {
+	size_t rawSize = _rewindRawSize(entry);
+	if (!_rewindReserveBuffer(&context->scratch, &context->scratchCapacity, rawSize)) {
+		return false;
+	}
+	if (lzDecompress(&context->arena[entry->offset], entry->size, context->scratch, rawSize) != rawSize) {
+		return false;
+	}
+	if (entry->keyframe) {
+		if (entry->imageSize != context->imageSize && !_rewindResize(context, entry->imageSize)) {
+			return false;
+		}
+		memcpy(context->image, context->scratch, rawSize);
+		return true;
+	}
+	if (entry->imageSize != context->imageSize) {
+		return false;
+	}
+	const uint32_t* pageIds = (const uint32_t*) context->scratch;
+	const uint8_t* pages = &context->scratch[entry->nPages * sizeof(uint32_t)];
+	size_t i;
+	for (i = 0; i < entry->nPages; ++i) {
+		size_t offset = (size_t) pageIds[i] << mSTATE_PAGE_SHIFT;
+		if (offset >= context->imageSize) {
+			return false;
+		}
+		memcpy(&context->image[offset], &pages[i << mSTATE_PAGE_SHIFT], mSTATE_PAGE_SIZE);
+		memcpy(&context->shadow[offset], &pages[i << mSTATE_PAGE_SHIFT], mSTATE_PAGE_SIZE);
+	}
+	return true;
+}
+
+static bool _rewindReplay(struct mCoreRewindContext* context, struct mCore* core, size_t steps) {
+	size_t capacity = mCoreRewindEntriesSize(&context->entries);
+	size_t first = 0;
+	size_t i;
+	// Deltas newer than the deepest keyframe being stepped past don't need to be applied at all
+	for (i = steps; i--;) {
+		if (mCoreRewindEntriesGetPointer(&context->entries, (context->current + capacity - i) % capacity)->keyframe) {
+			first = i;
+			break;
+		}
+	}
+	bool keyframe = false;
+	for (i = first; i < steps; ++i) {
+		const struct mCoreRewindEntry* entry = mCoreRewindEntriesGetPointer(&context->entries, (context->current + capacity - i) % capacity);
+		if (!_rewindApply(context, entry)) {
+			_rewindClear(context);
+			return false;
+		}
+		keyframe = keyframe || entry->keyframe;
+	}
+	if (keyframe) {
+		memcpy(context->shadow, context->image, context->imageSize);
+	}
+
+	// The space used by the entries that were stepped past can be reused right away
+	context->current = (context->current + capacity - steps + 1) % capacity;
+	context->arenaHead = mCoreRewindEntriesGetPointer(&context->entries, context->current)->offset;
+	context->current = (context->current + capacity - 1) % capacity;
+	context->size -= steps;
+	if (context->sinceKeyframe > steps) {
+		context->sinceKeyframe -= steps;
+	} else {
+		context->sinceKeyframe = 0;
+	}
+
+	bool success;
+	if (core->snapshotLoad) {
+		success = core->snapshotLoad(core, context->image, context->imageSize);
+	} else {
+		struct VFile* vf = VFileFromConstMemory(context->image, context->imageSize);
+		success = mCoreLoadStateNamed(core, vf, SAVESTATE_SAVEDATA | SAVESTATE_RTC);
+		vf->close(vf);
+	}
+	if (!success) {
+		// The image no longer matches the core, so the history can't be trusted either
+		_rewindClear(context);
+	}
+	return success;
+}
+
 #ifndef DISABLE_THREADING
 THREAD_ENTRY _rewindThread(void* context) {
 	struct mCoreRewindContext* rewindContext = context;
-	ThreadSetName("Rewind Diffing");
+	ThreadSetName("Rewind Compression");
 	MutexLock(&rewindContext->mutex);
 	while (rewindContext->onThread) {
 		while (!rewindContext->ready && rewindContext->onThread) {
 			ConditionWait(&rewindContext->cond, &rewindContext->mutex);
 		}
 		if (rewindContext->ready) {
-			_rewindDiff(rewindContext);
+			_rewindCompress(rewindContext);
 		}
-		rewindContext->ready = false;
 	}
 	MutexUnlock(&rewindContext->mutex);
 	THREAD_EXIT(0);
 }
 #endif
-
@@ -0,0 +1,154 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include <mgba/core/rom-registry.h>
+
+#include <mgba-util/memory.h>
+#include <mgba-util/table.h>
+#include <mgba-util/threading.h>
+
+struct mROMImage {
+	uint32_t crc32;
+	size_t size;
+	size_t mapSize;
+	struct SharedMemory* memory;
+	void* base;
+	unsigned refs;
+};
+
+#if !defined(DISABLE_THREADING) && (defined(USE_PTHREADS) || defined(_WIN32))
+static Mutex _registryMutex;
+static struct Table _registry;
+
+#ifdef USE_PTHREADS
+static pthread_once_t _registryOnce = PTHREAD_ONCE_INIT;
+
+static void _initRegistry(void) {
+	MutexInit(&_registryMutex);
+	TableInit(&_registry, 0, NULL);
+}
+#else
+static INIT_ONCE _registryOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK _initRegistry(PINIT_ONCE once, PVOID param, PVOID* context) {
+	UNUSED(once);
+	UNUSED(param);
+	UNUSED(context);
+	MutexInit(&_registryMutex);
+	TableInit(&_registry, 0, NULL);
+	return TRUE;
+}
+#endif
+
+static void _lockRegistry(void) {
+#ifdef USE_PTHREADS
+	pthread_once(&_registryOnce, _initRegistry);
+#else
+	InitOnceExecuteOnce(&_registryOnce, _initRegistry, NULL, 0);
+#endif
+	MutexLock(&_registryMutex);
+}
+
+struct mROMImage* mROMRegistryAcquire(uint32_t crc32, const void* data, size_t size, size_t mapSize) {
+	if (!size || size > mapSize) {
+		return NULL;
+	}
+	_lockRegistry();
+	struct mROMImage* image = TableLookup(&_registry, crc32);
+	if (image) {
+		// A colliding CRC mustn't hand out the wrong game, so the caller just keeps its own copy
+		if (image->size != size || image->mapSize != mapSize || memcmp(image->base, data, size) != 0) {
+			image = NULL;
+		} else {
+			++image->refs;
+		}
+		MutexUnlock(&_registryMutex);
+		return image;
+	}
+
+	struct SharedMemory* memory = sharedMemoryCreate(mapSize);
+	if (!memory) {
+		MutexUnlock(&_registryMutex);
+		return NULL;
+	}
+	void* base = sharedMemoryMap(memory, false);
+	if (!base) {
+		sharedMemoryDestroy(memory);
+		MutexUnlock(&_registryMutex);
+		return NULL;
+	}
+	image = malloc(sizeof(*image));
+	if (!image) {
+		sharedMemoryUnmap(memory, base);
+		sharedMemoryDestroy(memory);
+		MutexUnlock(&_registryMutex);
+		return NULL;
+	}
+	memcpy(base, data, size);
+	image->crc32 = crc32;
+	image->size = size;
+	image->mapSize = mapSize;
+	image->memory = memory;
+	image->base = base;
+	image->refs = 1;
+	TableInsert(&_registry, crc32, image);
+	MutexUnlock(&_registryMutex);
+	return image;
+}
+
+void mROMRegistryRetain(struct mROMImage* image) {
+	_lockRegistry();
+	++image->refs;
+	MutexUnlock(&_registryMutex);
+}
+
+void mROMRegistryRelease(struct mROMImage* image) {
+	_lockRegistry();
+	--image->refs;
+	if (!image->refs) {
+		TableRemove(&_registry, image->crc32);
+		sharedMemoryUnmap(image->memory, image->base);
+		sharedMemoryDestroy(image->memory);
+		free(image);
+	}
+	MutexUnlock(&_registryMutex);
+}
+
+size_t mROMRegistrySize(void) {
+	_lockRegistry();
+	size_t size = TableSize(&_registry);
+	MutexUnlock(&_registryMutex);
+	return size;
+}
+#else
+// Without a way to set up the lock safely, every core keeps its own ROM
+struct mROMImage* mROMRegistryAcquire(uint32_t crc32, const void* data, size_t size, size_t mapSize) {
+	UNUSED(crc32);
+	UNUSED(data);
+	UNUSED(size);
+	UNUSED(mapSize);
+	return NULL;
+}
+
+void mROMRegistryRetain(struct mROMImage* image) {
+	UNUSED(image);
+}
+
+void mROMRegistryRelease(struct mROMImage* image) {
+	UNUSED(image);
+}
+
+size_t mROMRegistrySize(void) {
+	return 0;
+}
+#endif
+
+void* mROMImageMap(struct mROMImage* image) {
+	return sharedMemoryMap(image->memory, true);
+}
+
+void mROMImageUnmap(struct mROMImage* image, void* memory) {
+	sharedMemoryUnmap(image->memory, memory);
+}
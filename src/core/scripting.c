@@ -7,6 +7,7 @@
 
 #include <mgba/core/core.h>
 #include <mgba/core/serialize.h>
+#include <mgba/core/thread.h>
 #include <mgba/script/context.h>
 #include <mgba-util/table.h>
 #include <mgba-util/vfs.h>
@@ -153,12 +154,62 @@ bool mScriptBridgeLookupSymbol(struct mScriptBridge* sb, const char* name, int32
 struct mScriptMemoryDomain {
 	struct mCore* core;
 	struct mCoreMemoryBlock block;
+	struct mScriptContext* context;
+	uint32_t weakref;
+};
+
+struct mScriptMemoryField {
+	uint32_t offset;
+	unsigned width;
+	bool isSigned;
+};
+
+// Views refer to their domain by weakref so they go stale instead of dangling when the core is
+// detached. The host pointer is looked up again on every access, so resets and ROM loads that
+// reallocate memory are safe too.
+struct mScriptMemoryView {
+	struct mScriptContext* context;
+	uint32_t domain;
+	uint32_t offset;
+	uint32_t length;
+	struct Table fields;
+
+	uint8_t* capture;
+	bool captured;
+};
+
+mSCRIPT_DECLARE_STRUCT(mScriptMemoryDomain);
+mSCRIPT_DECLARE_STRUCT(mScriptMemoryView);
+
+#ifdef USE_DEBUGGERS
+#define mSCRIPT_EXECUTE_RANGE_MAX 0x400
+
+struct mScriptDebuggerPoint {
+	uint32_t cbid;
+	ssize_t pointId;
+};
+
+DECLARE_VECTOR(mScriptDebuggerPointList, struct mScriptDebuggerPoint);
+DEFINE_VECTOR(mScriptDebuggerPointList, struct mScriptDebuggerPoint);
+
+// Memory callbacks are backed by the core's own breakpoints and watchpoints, so accesses outside of
+// the watched pages stay on the fast path. A hit pauses this debugger until the current instruction
+// has finished, which is when the callbacks batched per instruction get run.
+struct mScriptDebugger {
+	struct mDebugger d;
+	struct mScriptContext* context;
+	struct mScriptDebuggerPointList points;
 };
+#endif
 
 struct mScriptCoreAdapter {
 	struct mCore* core;
 	struct mScriptContext* context;
 	struct mScriptValue memory;
+#ifdef USE_DEBUGGERS
+	struct mScriptDebugger* debugger;
+	struct mScriptMemoryCallbackHandler memoryHandler;
+#endif
 };
 
 struct mScriptConsole {
@@ -246,11 +297,328 @@ static struct mScriptValue* mScriptMemoryDomainName(struct mScriptMemoryDomain*
 	return mScriptStringCreateFromUTF8(adapter->block.shortName);
 }
 
-mSCRIPT_DECLARE_STRUCT(mScriptMemoryDomain);
+static struct mScriptMemoryDomain* _mScriptMemoryViewDomain(struct mScriptMemoryView* view) {
+	struct mScriptValue* value = TableLookup(&view->context->weakrefs, view->domain);
+	if (!value || value->type != mSCRIPT_TYPE_MS_S(mScriptMemoryDomain)) {
+		return NULL;
+	}
+	return value->value.opaque;
+}
+
+static void _mScriptMemoryViewCopy(struct mScriptMemoryView* view, uint32_t offset, uint8_t* out, uint32_t length) {
+	if (view->captured) {
+		memcpy(out, &view->capture[offset], length);
+		return;
+	}
+	struct mScriptMemoryDomain* domain = _mScriptMemoryViewDomain(view);
+	if (!domain) {
+		memset(out, 0, length);
+		return;
+	}
+	offset += view->offset;
+	size_t hostSize = 0;
+	const uint8_t* host = domain->core->getMemoryBlock(domain->core, domain->block.id, &hostSize);
+	if (host && offset + (uint64_t) length <= hostSize) {
+		memcpy(out, &host[offset], length);
+		return;
+	}
+	// Regions without host memory, such as I/O, have to go through the core
+	uint32_t i;
+	for (i = 0; i < length; ++i) {
+		out[i] = mScriptMemoryDomainRead8(domain, offset + i);
+	}
+}
+
+static uint32_t _mScriptMemoryViewRead(struct mScriptMemoryView* view, uint32_t offset, unsigned width) {
+	if (offset + (uint64_t) width > view->length) {
+		return 0;
+	}
+	uint8_t bytes[4];
+	_mScriptMemoryViewCopy(view, offset, bytes, width);
+	uint32_t value = 0;
+	unsigned i;
+	for (i = 0; i < width; ++i) {
+		value |= bytes[i] << (i * 8);
+	}
+	return value;
+}
+
+static void _mScriptMemoryViewWrite(struct mScriptMemoryView* view, uint32_t offset, unsigned width, uint32_t value) {
+	if (offset + (uint64_t) width > view->length) {
+		return;
+	}
+	struct mScriptMemoryDomain* domain = _mScriptMemoryViewDomain(view);
+	if (!domain) {
+		return;
+	}
+	if (view->captured) {
+		unsigned i;
+		for (i = 0; i < width; ++i) {
+			view->capture[offset + i] = value >> (i * 8);
+		}
+	}
+	// Writes always go through the core so that caches of things like VRAM get updated
+	switch (width) {
+	case 1:
+		mScriptMemoryDomainWrite8(domain, view->offset + offset, value);
+		break;
+	case 2:
+		mScriptMemoryDomainWrite16(domain, view->offset + offset, value);
+		break;
+	case 4:
+		mScriptMemoryDomainWrite32(domain, view->offset + offset, value);
+		break;
+	}
+}
+
+static struct mScriptValue* _mScriptMemoryViewCreate(struct mScriptContext* context, uint32_t domain, uint32_t offset, uint32_t length, const struct Table* fields) {
+	struct mScriptMemoryView* view = calloc(1, sizeof(*view));
+	view->context = context;
+	view->domain = domain;
+	view->offset = offset;
+	view->length = length;
+	HashTableInit(&view->fields, 0, free);
+	if (fields) {
+		struct TableIterator iter;
+		if (HashTableIteratorStart(fields, &iter)) {
+			do {
+				struct mScriptMemoryField* field = malloc(sizeof(*field));
+				memcpy(field, HashTableIteratorGetValue(fields, &iter), sizeof(*field));
+				HashTableInsert(&view->fields, HashTableIteratorGetKey(fields, &iter), field);
+			} while (HashTableIteratorNext(fields, &iter));
+		}
+	}
+
+	struct mScriptValue* value = mScriptValueAlloc(mSCRIPT_TYPE_MS_S(mScriptMemoryView));
+	value->flags = mSCRIPT_VALUE_FLAG_FREE_BUFFER;
+	value->value.opaque = view;
+	return value;
+}
+
+static void _mScriptMemoryViewDeinit(struct mScriptMemoryView* view) {
+	HashTableDeinit(&view->fields);
+	if (view->capture) {
+		free(view->capture);
+	}
+}
+
+static uint32_t _mScriptMemoryViewRead8(struct mScriptMemoryView* view, uint32_t offset) {
+	return _mScriptMemoryViewRead(view, offset, 1);
+}
+
+static uint32_t _mScriptMemoryViewRead16(struct mScriptMemoryView* view, uint32_t offset) {
+	return _mScriptMemoryViewRead(view, offset, 2);
+}
+
+static uint32_t _mScriptMemoryViewRead32(struct mScriptMemoryView* view, uint32_t offset) {
+	return _mScriptMemoryViewRead(view, offset, 4);
+}
+
+static struct mScriptValue* _mScriptMemoryViewReadRange(struct mScriptMemoryView* view, uint32_t offset, uint32_t length) {
+	if (offset > view->length) {
+		offset = view->length;
+	}
+	if (length > view->length - offset) {
+		length = view->length - offset;
+	}
+	struct mScriptValue* value = mScriptStringCreateEmpty(length);
+	_mScriptMemoryViewCopy(view, offset, (uint8_t*) value->value.string->buffer, length);
+	return value;
+}
+
+static void _mScriptMemoryViewWrite8(struct mScriptMemoryView* view, uint32_t offset, uint8_t value) {
+	_mScriptMemoryViewWrite(view, offset, 1, value);
+}
+
+static void _mScriptMemoryViewWrite16(struct mScriptMemoryView* view, uint32_t offset, uint16_t value) {
+	_mScriptMemoryViewWrite(view, offset, 2, value);
+}
+
+static void _mScriptMemoryViewWrite32(struct mScriptMemoryView* view, uint32_t offset, uint32_t value) {
+	_mScriptMemoryViewWrite(view, offset, 4, value);
+}
+
+static struct mScriptValue* _mScriptMemoryViewSubview(struct mScriptMemoryView* view, uint32_t offset, uint32_t length) {
+	if (offset + (uint64_t) length > view->length) {
+		return &mScriptValueNull;
+	}
+	return _mScriptMemoryViewCreate(view->context, view->domain, view->offset + offset, length, &view->fields);
+}
+
+static bool _mScriptMemoryViewDefineField(struct mScriptMemoryView* view, const char* name, uint32_t offset, const char* type) {
+	struct mScriptMemoryField field = {
+		.offset = offset
+	};
+	if (type[0] == 's') {
+		field.isSigned = true;
+	} else if (type[0] != 'u') {
+		return false;
+	}
+	if (strcmp(&type[1], "8") == 0) {
+		field.width = 1;
+	} else if (strcmp(&type[1], "16") == 0) {
+		field.width = 2;
+	} else if (strcmp(&type[1], "32") == 0) {
+		field.width = 4;
+	} else {
+		return false;
+	}
+	if (offset + (uint64_t) field.width > view->length) {
+		return false;
+	}
+	struct mScriptMemoryField* entry = malloc(sizeof(*entry));
+	memcpy(entry, &field, sizeof(field));
+	HashTableInsert(&view->fields, name, entry);
+	return true;
+}
+
+static struct mScriptValue* _mScriptMemoryViewGet(struct mScriptMemoryView* view, const char* name) {
+	const struct mScriptMemoryField* field = HashTableLookup(&view->fields, name);
+	if (!field) {
+		return &mScriptValueNull;
+	}
+	uint32_t raw = _mScriptMemoryViewRead(view, field->offset, field->width);
+	struct mScriptValue* value;
+	if (field->isSigned) {
+		value = mScriptValueAlloc(mSCRIPT_TYPE_MS_S32);
+		switch (field->width) {
+		case 1:
+			value->value.s32 = (int8_t) raw;
+			break;
+		case 2:
+			value->value.s32 = (int16_t) raw;
+			break;
+		default:
+			value->value.s32 = raw;
+			break;
+		}
+	} else {
+		value = mScriptValueAlloc(mSCRIPT_TYPE_MS_U32);
+		value->value.u32 = raw;
+	}
+	return value;
+}
+
+static bool _mScriptMemoryViewSetField(struct mScriptMemoryView* view, const char* name, uint32_t value) {
+	const struct mScriptMemoryField* field = HashTableLookup(&view->fields, name);
+	if (!field) {
+		return false;
+	}
+	_mScriptMemoryViewWrite(view, field->offset, field->width, value);
+	return true;
+}
+
+static bool _mScriptMemoryViewCapture(struct mScriptMemoryView* view) {
+	if (!_mScriptMemoryViewDomain(view)) {
+		return false;
+	}
+	if (!view->capture) {
+		view->capture = malloc(view->length ? view->length : 1);
+	}
+	view->captured = false;
+	_mScriptMemoryViewCopy(view, 0, view->capture, view->length);
+	view->captured = true;
+	return true;
+}
+
+static void _mScriptMemoryViewRelease(struct mScriptMemoryView* view) {
+	view->captured = false;
+}
+
+static bool _mScriptMemoryViewValid(struct mScriptMemoryView* view) {
+	return _mScriptMemoryViewDomain(view);
+}
+
+static uint32_t _mScriptMemoryViewBase(struct mScriptMemoryView* view) {
+	struct mScriptMemoryDomain* domain = _mScriptMemoryViewDomain(view);
+	if (!domain) {
+		return 0;
+	}
+	return domain->block.start + view->offset;
+}
+
+static uint32_t _mScriptMemoryViewSize(struct mScriptMemoryView* view) {
+	return view->length;
+}
+
+static struct mScriptValue* mScriptMemoryDomainView(struct mScriptMemoryDomain* adapter, uint32_t address, uint32_t length) {
+	if (address + (uint64_t) length > adapter->block.size) {
+		return &mScriptValueNull;
+	}
+	return _mScriptMemoryViewCreate(adapter->context, adapter->weakref, address, length, NULL);
+}
+
+mSCRIPT_DECLARE_STRUCT_VOID_METHOD(mScriptMemoryView, _deinit, _mScriptMemoryViewDeinit, 0);
+mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryView, WRAPPER, _get, _mScriptMemoryViewGet, 1, CHARP, name);
+mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryView, U32, read8, _mScriptMemoryViewRead8, 1, U32, offset);
+mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryView, U32, read16, _mScriptMemoryViewRead16, 1, U32, offset);
+mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryView, U32, read32, _mScriptMemoryViewRead32, 1, U32, offset);
+mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryView, WSTR, readRange, _mScriptMemoryViewReadRange, 2, U32, offset, U32, length);
+mSCRIPT_DECLARE_STRUCT_VOID_METHOD(mScriptMemoryView, write8, _mScriptMemoryViewWrite8, 2, U32, offset, U8, value);
+mSCRIPT_DECLARE_STRUCT_VOID_METHOD(mScriptMemoryView, write16, _mScriptMemoryViewWrite16, 2, U32, offset, U16, value);
+mSCRIPT_DECLARE_STRUCT_VOID_METHOD(mScriptMemoryView, write32, _mScriptMemoryViewWrite32, 2, U32, offset, U32, value);
+mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryView, W(mScriptMemoryView), view, _mScriptMemoryViewSubview, 2, U32, offset, U32, length);
+mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryView, BOOL, field, _mScriptMemoryViewDefineField, 3, CHARP, name, U32, offset, CHARP, type);
+mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryView, BOOL, setField, _mScriptMemoryViewSetField, 2, CHARP, name, U32, value);
+mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryView, BOOL, capture, _mScriptMemoryViewCapture, 0);
+mSCRIPT_DECLARE_STRUCT_VOID_METHOD(mScriptMemoryView, release, _mScriptMemoryViewRelease, 0);
+mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryView, BOOL, valid, _mScriptMemoryViewValid, 0);
+mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryView, U32, base, _mScriptMemoryViewBase, 0);
+mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryView, U32, size, _mScriptMemoryViewSize, 0);
+
+mSCRIPT_DEFINE_STRUCT(mScriptMemoryView)
+	mSCRIPT_DEFINE_CLASS_DOCSTRING(
+		"A bounds-checked window onto part of a memory domain that can be kept across frames. "
+		"Reads come straight from the emulated memory where possible instead of going through the bus. "
+		"Fields defined with struct::mScriptMemoryView.field can be read as members of the view. "
+		"If the core is detached, the view stops being valid and reads return 0."
+	)
+	mSCRIPT_DEFINE_STRUCT_DEINIT(mScriptMemoryView)
+	mSCRIPT_DEFINE_STRUCT_DEFAULT_GET(mScriptMemoryView)
+	mSCRIPT_DEFINE_DOCSTRING("Read an 8-bit value from the given offset into the view")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, read8)
+	mSCRIPT_DEFINE_DOCSTRING("Read a 16-bit value from the given offset into the view")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, read16)
+	mSCRIPT_DEFINE_DOCSTRING("Read a 32-bit value from the given offset into the view")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, read32)
+	mSCRIPT_DEFINE_DOCSTRING("Read byte range from the given offset into the view. The range is truncated at the end of the view")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, readRange)
+	mSCRIPT_DEFINE_DOCSTRING("Write an 8-bit value to the given offset into the view")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, write8)
+	mSCRIPT_DEFINE_DOCSTRING("Write a 16-bit value to the given offset into the view")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, write16)
+	mSCRIPT_DEFINE_DOCSTRING("Write a 32-bit value to the given offset into the view")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, write32)
+	mSCRIPT_DEFINE_DOCSTRING("Create a smaller view at the given offset into this one. The new view starts with a copy of this view's fields")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, view)
+	mSCRIPT_DEFINE_DOCSTRING(
+		"Define a named field at the given offset into the view. "
+		"`type` is one of `u8`, `s8`, `u16`, `s16`, `u32` or `s32`. "
+		"Returns false if the type is unknown or the field doesn't fit in the view"
+	)
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, field)
+	mSCRIPT_DEFINE_DOCSTRING("Write a value to a field defined with struct::mScriptMemoryView.field")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, setField)
+	mSCRIPT_DEFINE_DOCSTRING(
+		"Copy the whole view into a buffer that is kept with the view and reused. "
+		"Until struct::mScriptMemoryView.release is called, reads come from that copy, so they are consistent with each other"
+	)
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, capture)
+	mSCRIPT_DEFINE_DOCSTRING("Go back to reading live memory after struct::mScriptMemoryView.capture")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, release)
+	mSCRIPT_DEFINE_DOCSTRING("Check if the memory domain this view was created from is still attached")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, valid)
+	mSCRIPT_DEFINE_DOCSTRING("Get the address of the start of this view")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, base)
+	mSCRIPT_DEFINE_DOCSTRING("Get the size of this view in bytes")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryView, size)
+mSCRIPT_DEFINE_END;
+
 mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryDomain, U32, read8, mScriptMemoryDomainRead8, 1, U32, address);
 mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryDomain, U32, read16, mScriptMemoryDomainRead16, 1, U32, address);
 mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryDomain, U32, read32, mScriptMemoryDomainRead32, 1, U32, address);
 mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryDomain, WSTR, readRange, mScriptMemoryDomainReadRange, 2, U32, address, U32, length);
+mSCRIPT_DECLARE_STRUCT_METHOD(mScriptMemoryDomain, W(mScriptMemoryView), view, mScriptMemoryDomainView, 2, U32, address, U32, length);
 mSCRIPT_DECLARE_STRUCT_VOID_METHOD(mScriptMemoryDomain, write8, mScriptMemoryDomainWrite8, 2, U32, address, U8, value);
 mSCRIPT_DECLARE_STRUCT_VOID_METHOD(mScriptMemoryDomain, write16, mScriptMemoryDomainWrite16, 2, U32, address, U16, value);
 mSCRIPT_DECLARE_STRUCT_VOID_METHOD(mScriptMemoryDomain, write32, mScriptMemoryDomainWrite32, 2, U32, address, U32, value);
@@ -273,6 +641,8 @@ mSCRIPT_DEFINE_STRUCT(mScriptMemoryDomain)
 	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryDomain, read32)
 	mSCRIPT_DEFINE_DOCSTRING("Read byte range from the given offset")
 	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryDomain, readRange)
+	mSCRIPT_DEFINE_DOCSTRING("Create a struct::mScriptMemoryView of the given range, or nil if it doesn't fit in the domain")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryDomain, view)
 	mSCRIPT_DEFINE_DOCSTRING("Write an 8-bit value from the given offset")
 	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptMemoryDomain, write8)
 	mSCRIPT_DEFINE_DOCSTRING("Write a 16-bit value from the given offset")
@@ -399,6 +769,33 @@ static int _mScriptCoreLoadStateFile(struct mCore* core, const char* path, int f
 	vf->close(vf);
 	return ok;
 }
+static bool _mScriptCoreRewindStats(struct mCore* core, struct mCoreRewindStats* stats) {
+	struct mCoreThread* thread = mCoreThreadGet();
+	if (!thread || thread->core != core) {
+		memset(stats, 0, sizeof(*stats));
+		return false;
+	}
+	return mCoreThreadGetRewindStats(thread, stats);
+}
+
+static int64_t _mScriptCoreRewindEntries(struct mCore* core) {
+	struct mCoreRewindStats stats;
+	_mScriptCoreRewindStats(core, &stats);
+	return stats.entries;
+}
+
+static int64_t _mScriptCoreRewindBytes(struct mCore* core) {
+	struct mCoreRewindStats stats;
+	_mScriptCoreRewindStats(core, &stats);
+	return stats.bytesUsed;
+}
+
+static int64_t _mScriptCoreRewindCompressUsec(struct mCore* core) {
+	struct mCoreRewindStats stats;
+	_mScriptCoreRewindStats(core, &stats);
+	return stats.compressUsec;
+}
+
 static void _mScriptCoreTakeScreenshot(struct mCore* core, const char* filename) {
 	if (filename) {
 		struct VFile* vf = VFileOpen(filename, O_WRONLY | O_CREAT | O_TRUNC);
@@ -462,6 +859,11 @@ mSCRIPT_DECLARE_STRUCT_METHOD_WITH_DEFAULTS(mCore, BOOL, loadStateSlot, mCoreLoa
 mSCRIPT_DECLARE_STRUCT_METHOD_WITH_DEFAULTS(mCore, BOOL, loadStateBuffer, _mScriptCoreLoadState, 2, STR, buffer, S32, flags);
 mSCRIPT_DECLARE_STRUCT_METHOD_WITH_DEFAULTS(mCore, BOOL, loadStateFile, _mScriptCoreLoadStateFile, 2, CHARP, path, S32, flags);
 
+// Rewind functions
+mSCRIPT_DECLARE_STRUCT_METHOD(mCore, S64, rewindEntries, _mScriptCoreRewindEntries, 0);
+mSCRIPT_DECLARE_STRUCT_METHOD(mCore, S64, rewindBytes, _mScriptCoreRewindBytes, 0);
+mSCRIPT_DECLARE_STRUCT_METHOD(mCore, S64, rewindCompressUsec, _mScriptCoreRewindCompressUsec, 0);
+
 // Miscellaneous functions
 mSCRIPT_DECLARE_STRUCT_VOID_METHOD_WITH_DEFAULTS(mCore, screenshot, _mScriptCoreTakeScreenshot, 1, CHARP, filename);
 
@@ -549,6 +951,13 @@ mSCRIPT_DEFINE_STRUCT(mCore)
 	mSCRIPT_DEFINE_DOCSTRING("Load state from the given path. See C.SAVESTATE for possible values for `flags`")
 	mSCRIPT_DEFINE_STRUCT_METHOD(mCore, loadStateFile)
 
+	mSCRIPT_DEFINE_DOCSTRING("Get the number of entries currently in the rewind history")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mCore, rewindEntries)
+	mSCRIPT_DEFINE_DOCSTRING("Get the number of bytes of the rewind budget used by the compressed history")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mCore, rewindBytes)
+	mSCRIPT_DEFINE_DOCSTRING("Get the total time spent compressing rewind history, in microseconds")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mCore, rewindCompressUsec)
+
 	mSCRIPT_DEFINE_DOCSTRING("Save a screenshot")
 	mSCRIPT_DEFINE_STRUCT_METHOD(mCore, screenshot)
 mSCRIPT_DEFINE_END;
@@ -621,19 +1030,162 @@ static void _rebuildMemoryMap(struct mScriptContext* context, struct mScriptCore
 		}
 		struct mScriptMemoryDomain* memadapter = calloc(1, sizeof(*memadapter));
 		memadapter->core = adapter->core;
+		memadapter->context = context;
 		memcpy(&memadapter->block, &blocks[i], sizeof(memadapter->block));
 		struct mScriptValue* value = mScriptValueAlloc(mSCRIPT_TYPE_MS_S(mScriptMemoryDomain));
 		value->flags = mSCRIPT_VALUE_FLAG_FREE_BUFFER;
 		value->value.opaque = memadapter;
+		struct mScriptValue* weakref = mScriptContextMakeWeakref(context, value);
+		memadapter->weakref = weakref->value.u32;
 		struct mScriptValue* key = mScriptStringCreateFromUTF8(blocks[i].internalName);
-		mScriptTableInsert(&adapter->memory, key, mScriptContextMakeWeakref(context, value));
+		mScriptTableInsert(&adapter->memory, key, weakref);
 		mScriptValueDeref(key);
 	}
 }
 
+#ifdef USE_DEBUGGERS
+static void _mScriptDebuggerEntered(struct mDebugger* d, enum mDebuggerEntryReason reason, struct mDebuggerEntryInfo* info) {
+	struct mScriptDebugger* debugger = (struct mScriptDebugger*) d;
+	uint32_t value;
+	switch (reason) {
+	case DEBUGGER_ENTER_BREAKPOINT:
+		mScriptContextReportMemoryAccess(debugger->context, mSCRIPT_MEMORY_ACCESS_EXECUTE, info->address, 1, 0);
+		break;
+	case DEBUGGER_ENTER_WATCHPOINT:
+		if (info->type.wp.accessType & WATCHPOINT_WRITE) {
+			value = info->type.wp.newValue;
+			// Narrow stores are passed through sign extended
+			if (info->type.wp.width > 0 && info->type.wp.width < 4) {
+				value &= (1U << (info->type.wp.width * 8)) - 1;
+			}
+			mScriptContextReportMemoryAccess(debugger->context, mSCRIPT_MEMORY_ACCESS_WRITE, info->address, info->type.wp.width, value);
+		} else {
+			mScriptContextReportMemoryAccess(debugger->context, mSCRIPT_MEMORY_ACCESS_READ, info->address, info->type.wp.width, info->type.wp.oldValue);
+		}
+		break;
+	default:
+		break;
+	}
+	if (!mScriptMemoryEventListSize(&debugger->context->instructionEvents)) {
+		// Only callbacks batched per frame were hit, so there's nothing to stop for
+		d->state = DEBUGGER_RUNNING;
+	}
+}
+
+static void _mScriptDebuggerPaused(struct mDebugger* d) {
+	struct mScriptDebugger* debugger = (struct mScriptDebugger*) d;
+	d->state = DEBUGGER_RUNNING;
+	mScriptContextFlushMemoryCallbacks(debugger->context, false);
+}
+
+static struct mScriptDebugger* _mScriptCoreAdapterEnsureDebugger(struct mScriptCoreAdapter* adapter) {
+	struct mCore* core = adapter->core;
+	if (adapter->debugger && core->debugger == &adapter->debugger->d) {
+		return adapter->debugger;
+	}
+	if (core->debugger) {
+		mLOG(SCRIPT, WARN, "Memory callbacks can't be used while another debugger is attached");
+		return NULL;
+	}
+	if (!core->supportsDebuggerType(core, DEBUGGER_CUSTOM)) {
+		mLOG(SCRIPT, WARN, "Memory callbacks aren't supported on this platform");
+		return NULL;
+	}
+	if (adapter->debugger) {
+		// Another debugger replaced this one at some point, and its breakpoints went with it
+		mScriptDebuggerPointListDeinit(&adapter->debugger->points);
+	} else {
+		adapter->debugger = malloc(sizeof(*adapter->debugger));
+	}
+	if (core->opts.runAhead > 0) {
+		mLOG(SCRIPT, WARN, "Run-ahead is disabled while memory callbacks are in use");
+	}
+	struct mScriptDebugger* debugger = adapter->debugger;
+	memset(debugger, 0, sizeof(*debugger));
+	debugger->d.type = DEBUGGER_CUSTOM;
+	debugger->d.entered = _mScriptDebuggerEntered;
+	debugger->d.paused = _mScriptDebuggerPaused;
+	debugger->context = adapter->context;
+	mScriptDebuggerPointListInit(&debugger->points, 0);
+	mDebuggerAttach(&debugger->d, core);
+	return debugger;
+}
+
+static void _mScriptCoreAdapterAddMemoryCallback(void* context, const struct mScriptMemoryCallback* cb) {
+	struct mScriptCoreAdapter* adapter = context;
+	struct mScriptDebugger* debugger = _mScriptCoreAdapterEnsureDebugger(adapter);
+	if (!debugger) {
+		return;
+	}
+	struct mDebuggerPlatform* platform = debugger->d.platform;
+	struct mScriptDebuggerPoint* point;
+	if (cb->type != mSCRIPT_MEMORY_ACCESS_EXECUTE) {
+		struct mWatchpoint watchpoint = {
+			.address = cb->address,
+			.size = cb->length,
+			.segment = -1,
+			.type = cb->type == mSCRIPT_MEMORY_ACCESS_WRITE ? WATCHPOINT_WRITE : WATCHPOINT_READ,
+			.condition = NULL
+		};
+		point = mScriptDebuggerPointListAppend(&debugger->points);
+		point->cbid = cb->id;
+		point->pointId = platform->setWatchpoint(platform, &watchpoint);
+		return;
+	}
+
+	// Breakpoints only cover a single address, so one is needed for each place an instruction can start
+	uint32_t alignment = adapter->core->platform(adapter->core) == mPLATFORM_GBA ? 2 : 1;
+	uint32_t length = cb->length + (cb->address & (alignment - 1));
+	if (length > mSCRIPT_EXECUTE_RANGE_MAX) {
+		mLOG(SCRIPT, WARN, "Execute callback at 0x%08X truncated to 0x%X bytes", cb->address, mSCRIPT_EXECUTE_RANGE_MAX);
+		length = mSCRIPT_EXECUTE_RANGE_MAX;
+	}
+	struct mBreakpoint breakpoint = {
+		.segment = -1,
+		.type = BREAKPOINT_HARDWARE,
+		.condition = NULL
+	};
+	uint32_t offset;
+	for (offset = 0; offset < length; offset += alignment) {
+		breakpoint.address = (cb->address & ~(alignment - 1)) + offset;
+		point = mScriptDebuggerPointListAppend(&debugger->points);
+		point->cbid = cb->id;
+		point->pointId = platform->setBreakpoint(platform, &breakpoint);
+	}
+}
+
+static void _mScriptCoreAdapterRemoveMemoryCallback(void* context, const struct mScriptMemoryCallback* cb) {
+	struct mScriptCoreAdapter* adapter = context;
+	struct mScriptDebugger* debugger = adapter->debugger;
+	if (!debugger || adapter->core->debugger != &debugger->d) {
+		return;
+	}
+	struct mDebuggerPlatform* platform = debugger->d.platform;
+	size_t i;
+	for (i = mScriptDebuggerPointListSize(&debugger->points); i--;) {
+		struct mScriptDebuggerPoint* point = mScriptDebuggerPointListGetPointer(&debugger->points, i);
+		if (point->cbid != cb->id) {
+			continue;
+		}
+		platform->clearBreakpoint(platform, point->pointId);
+		mScriptDebuggerPointListShift(&debugger->points, i, 1);
+	}
+}
+#endif
+
 static void _mScriptCoreAdapterDeinit(struct mScriptCoreAdapter* adapter) {
 	_clearMemoryMap(adapter->context, adapter, false);
 	adapter->memory.type->free(&adapter->memory);
+#ifdef USE_DEBUGGERS
+	if (adapter->context->memoryHandler == &adapter->memoryHandler) {
+		adapter->context->memoryHandler = NULL;
+	}
+	// The core may already be gone by now, so detaching from it is left to mScriptContextDetachCore
+	if (adapter->debugger) {
+		mScriptDebuggerPointListDeinit(&adapter->debugger->points);
+		free(adapter->debugger);
+	}
+#endif
 }
 
 static struct mScriptValue* _mScriptCoreAdapterGet(struct mScriptCoreAdapter* adapter, const char* name) {
@@ -692,6 +1244,13 @@ void mScriptContextAttachCore(struct mScriptContext* context, struct mCore* core
 	coreValue->value.opaque = adapter;
 	coreValue->flags = mSCRIPT_VALUE_FLAG_FREE_BUFFER;
 	mScriptContextSetGlobal(context, "emu", coreValue);
+
+#ifdef USE_DEBUGGERS
+	adapter->memoryHandler.context = adapter;
+	adapter->memoryHandler.add = _mScriptCoreAdapterAddMemoryCallback;
+	adapter->memoryHandler.remove = _mScriptCoreAdapterRemoveMemoryCallback;
+	mScriptContextSetMemoryCallbackHandler(context, &adapter->memoryHandler);
+#endif
 }
 
 void mScriptContextDetachCore(struct mScriptContext* context) {
@@ -703,7 +1262,16 @@ void mScriptContextDetachCore(struct mScriptContext* context) {
 	if (!value) {
 		return;
 	}
-	_clearMemoryMap(context, value->value.opaque, true);
+	struct mScriptCoreAdapter* adapter = value->value.opaque;
+#ifdef USE_DEBUGGERS
+	if (context->memoryHandler == &adapter->memoryHandler) {
+		mScriptContextSetMemoryCallbackHandler(context, NULL);
+	}
+	if (adapter->debugger && adapter->core->debugger == &adapter->debugger->d) {
+		adapter->core->detachDebugger(adapter->core);
+	}
+#endif
+	_clearMemoryMap(context, adapter, true);
 	mScriptContextRemoveGlobal(context, "emu");
 }
 
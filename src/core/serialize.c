@@ -9,6 +9,8 @@
 #include <mgba/core/cheats.h>
 #include <mgba/core/interface.h>
 #include <mgba/core/version.h>
+#include <mgba-util/clock.h>
+#include <mgba-util/lz.h>
 #include <mgba-util/memory.h>
 #include <mgba-util/vfs.h>
 
@@ -32,6 +34,29 @@ struct mStateExtdataHeader {
 	int64_t offset;
 };
 
+#define LZ_STATE_MAGIC "mLZS"
+#define LZ_STATE_VERSION 1
+#define LZ_STATE_CHUNK_STATE 0x10000
+#define LZ_STATE_CHUNK_STATE_END 0x20000
+
+struct mLZStateHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t stateSize;
+	uint32_t reserved;
+};
+
+// A chunk tagged LZ_STATE_CHUNK_STATE + n holds section n of the core state (see listStateSections)
+// at the given offset; n = 0 covers whatever isn't in a section. Other tags are extdata, which
+// is where savedata and the screenshot go. A chunk stored at its full size is raw rather than
+// compressed.
+struct mLZStateChunk {
+	uint32_t tag;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t storedSize;
+};
+
 void mStateExtdataInit(struct mStateExtdata* extdata) {
 	memset(extdata->data, 0, sizeof(extdata->data));
 }
@@ -353,6 +378,262 @@ static bool _loadPNGExtadata(struct VFile* vf, struct mStateExtdata* extdata) {
 }
 #endif
 
+static bool _isLZState(struct VFile* vf) {
+	char magic[4];
+	vf->seek(vf, 0, SEEK_SET);
+	bool isLZ = vf->read(vf, magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, LZ_STATE_MAGIC, sizeof(magic)) == 0;
+	vf->seek(vf, 0, SEEK_SET);
+	return isLZ;
+}
+
+static bool _writeLZChunk(struct VFile* vf, uint32_t tag, uint32_t offset, const void* data, size_t size, void** scratch, size_t* scratchSize) {
+	size_t bound = lzCompressBound(size);
+	if (bound > *scratchSize) {
+		free(*scratch);
+		*scratch = malloc(bound);
+		*scratchSize = *scratch ? bound : 0;
+	}
+	const void* stored = data;
+	size_t storedSize = size;
+	if (*scratch) {
+		size_t compressedSize = lzCompress(data, size, *scratch, *scratchSize);
+		if (compressedSize && compressedSize < size) {
+			stored = *scratch;
+			storedSize = compressedSize;
+		}
+	}
+	struct mLZStateChunk chunk;
+	STORE_32LE(tag, 0, &chunk.tag);
+	STORE_32LE(offset, 0, &chunk.offset);
+	STORE_32LE(size, 0, &chunk.size);
+	STORE_32LE(storedSize, 0, &chunk.storedSize);
+	if (vf->write(vf, &chunk, sizeof(chunk)) != sizeof(chunk)) {
+		return false;
+	}
+	return vf->write(vf, stored, storedSize) == (ssize_t) storedSize;
+}
+
+static size_t _listLZStateSections(struct mCore* core, const struct mCoreStateSection** sections) {
+	*sections = NULL;
+	if (!core->listStateSections) {
+		return 0;
+	}
+	return core->listStateSections(core, sections);
+}
+
+static bool _saveLZState(struct mCore* core, struct VFile* vf, struct mStateExtdata* extdata, bool screenshot) {
+	if (screenshot) {
+		size_t stride;
+		const void* pixels = NULL;
+		unsigned width, height;
+		core->getPixels(core, &pixels, &stride);
+		core->desiredVideoDimensions(core, &width, &height);
+		// Same layout the PNG loader produces: native pixels, packed rows, 4 bytes per pixel allotted
+		uint8_t* copy = pixels ? malloc(width * height * 4) : NULL;
+		if (copy) {
+			unsigned y;
+			for (y = 0; y < height; ++y) {
+				memcpy(&copy[y * width * BYTES_PER_PIXEL], &((const uint8_t*) pixels)[y * stride * BYTES_PER_PIXEL], width * BYTES_PER_PIXEL);
+			}
+			struct mStateExtdataItem item = {
+				.size = width * height * 4,
+				.data = copy,
+				.clean = free
+			};
+			mStateExtdataPut(extdata, EXTDATA_SCREENSHOT, &item);
+		}
+	}
+
+	size_t stateSize = core->stateSize(core);
+	void* state = anonymousMemoryMap(stateSize);
+	if (!state) {
+		return false;
+	}
+	if (!core->saveState(core, state)) {
+		mappedMemoryFree(state, stateSize);
+		return false;
+	}
+
+	void* scratch = NULL;
+	size_t scratchSize = 0;
+	const struct mCoreStateSection* sections;
+	size_t nSections = _listLZStateSections(core, &sections);
+
+	struct mLZStateHeader header = {0};
+	memcpy(header.magic, LZ_STATE_MAGIC, sizeof(header.magic));
+	STORE_32LE(LZ_STATE_VERSION, 0, &header.version);
+	STORE_32LE(stateSize, 0, &header.stateSize);
+
+	vf->seek(vf, 0, SEEK_SET);
+	bool success = vf->write(vf, &header, sizeof(header)) == sizeof(header);
+	size_t offset = 0;
+	size_t i;
+	for (i = 0; success && i <= nSections; ++i) {
+		size_t start = i < nSections ? sections[i].offset : stateSize;
+		if (start > offset) {
+			success = _writeLZChunk(vf, LZ_STATE_CHUNK_STATE, offset, (uint8_t*) state + offset, start - offset, &scratch, &scratchSize);
+		}
+		if (success && i < nSections) {
+			success = _writeLZChunk(vf, LZ_STATE_CHUNK_STATE + sections[i].id, start, (uint8_t*) state + start, sections[i].size, &scratch, &scratchSize);
+			offset = start + sections[i].size;
+		}
+	}
+	for (i = 1; success && i < EXTDATA_MAX; ++i) {
+		if (extdata->data[i].data && extdata->data[i].size > 0) {
+			success = _writeLZChunk(vf, i, 0, extdata->data[i].data, extdata->data[i].size, &scratch, &scratchSize);
+		}
+	}
+	if (success) {
+		struct mLZStateChunk end = {0};
+		success = vf->write(vf, &end, sizeof(end)) == sizeof(end);
+	}
+	if (success) {
+		// Trim anything left over from an older, larger file
+		vf->truncate(vf, vf->seek(vf, 0, SEEK_CUR));
+	}
+
+	free(scratch);
+	mappedMemoryFree(state, stateSize);
+	return success;
+}
+
+static bool _readLZHeader(struct VFile* vf, uint32_t* stateSize) {
+	struct mLZStateHeader header;
+	vf->seek(vf, 0, SEEK_SET);
+	if (vf->read(vf, &header, sizeof(header)) != sizeof(header)) {
+		return false;
+	}
+	uint32_t version;
+	LOAD_32LE(version, 0, &header.version);
+	LOAD_32LE(*stateSize, 0, &header.stateSize);
+	if (version != LZ_STATE_VERSION) {
+		mLOG(SAVESTATE, WARN, "Unknown compressed savestate version %u", version);
+		return false;
+	}
+	return true;
+}
+
+// Chunks are decompressed one at a time straight into place, so the only buffer the size of
+// the whole state is the one handed to the core. They go into that buffer rather than into
+// the core itself so a damaged file can't leave the core half loaded. A chunk for a section the
+// core knows has to stay inside that section. State chunks are skipped if state is NULL.
+static bool _readLZChunks(struct VFile* vf, uint8_t* state, uint32_t stateSize, const struct mCoreStateSection* sections, size_t nSections, struct mStateExtdata* extdata) {
+	void* scratch = NULL;
+	size_t scratchSize = 0;
+	size_t loaded = 0;
+	bool success = true;
+	while (success) {
+		struct mLZStateChunk chunk;
+		if (vf->read(vf, &chunk, sizeof(chunk)) != sizeof(chunk)) {
+			success = false;
+			break;
+		}
+		uint32_t tag;
+		uint32_t offset;
+		uint32_t size;
+		uint32_t storedSize;
+		LOAD_32LE(tag, 0, &chunk.tag);
+		LOAD_32LE(offset, 0, &chunk.offset);
+		LOAD_32LE(size, 0, &chunk.size);
+		LOAD_32LE(storedSize, 0, &chunk.storedSize);
+		if (tag == EXTDATA_NONE) {
+			break;
+		}
+		if (storedSize > size || size > INT32_MAX) {
+			success = false;
+			break;
+		}
+
+		uint8_t* target = NULL;
+		struct mStateExtdataItem item = {
+			.size = size,
+			.data = NULL,
+			.clean = free
+		};
+		if (tag >= LZ_STATE_CHUNK_STATE && tag < LZ_STATE_CHUNK_STATE_END) {
+			if (offset > stateSize || size > stateSize - offset) {
+				success = false;
+				break;
+			}
+			size_t i;
+			for (i = 0; i < nSections; ++i) {
+				if (sections[i].id == tag - LZ_STATE_CHUNK_STATE) {
+					break;
+				}
+			}
+			if (i < nSections && (offset < sections[i].offset || offset + size > sections[i].offset + sections[i].size)) {
+				mLOG(SAVESTATE, WARN, "Compressed savestate section %u is out of place", tag - LZ_STATE_CHUNK_STATE);
+				success = false;
+				break;
+			}
+			if (state) {
+				target = &state[offset];
+				loaded += size;
+			}
+		} else if (extdata && tag < EXTDATA_MAX) {
+			item.data = malloc(size);
+			target = item.data;
+		}
+		if (!target) {
+			vf->seek(vf, storedSize, SEEK_CUR);
+			continue;
+		}
+
+		if (storedSize == size) {
+			success = vf->read(vf, target, size) == (ssize_t) size;
+		} else {
+			if (storedSize > scratchSize) {
+				free(scratch);
+				scratchSize = storedSize;
+				scratch = malloc(scratchSize);
+			}
+			success = scratch && vf->read(vf, scratch, storedSize) == (ssize_t) storedSize;
+			success = success && lzDecompress(scratch, storedSize, target, size) == size;
+		}
+		if (item.data) {
+			if (success) {
+				mStateExtdataPut(extdata, tag, &item);
+			} else {
+				free(item.data);
+			}
+		}
+	}
+	free(scratch);
+	return success && (!state || loaded == stateSize);
+}
+
+static void* _loadLZState(struct mCore* core, struct VFile* vf, struct mStateExtdata* extdata) {
+	uint32_t stateSize;
+	if (!_readLZHeader(vf, &stateSize)) {
+		return NULL;
+	}
+	if (stateSize != core->stateSize(core)) {
+		mLOG(SAVESTATE, WARN, "Compressed savestate is the wrong size for this core");
+		return NULL;
+	}
+	// Unlike a raw savestate, this can't be mapped from the file, so the state passed to loadState
+	// has to be allocated in full. Chunks are decompressed straight into it, though.
+	void* state = anonymousMemoryMap(stateSize);
+	if (!state) {
+		return NULL;
+	}
+	const struct mCoreStateSection* sections;
+	size_t nSections = _listLZStateSections(core, &sections);
+	if (!_readLZChunks(vf, state, stateSize, sections, nSections, extdata)) {
+		mappedMemoryFree(state, stateSize);
+		return NULL;
+	}
+	return state;
+}
+
+static bool _loadLZExtdata(struct VFile* vf, struct mStateExtdata* extdata) {
+	uint32_t stateSize;
+	if (!_readLZHeader(vf, &stateSize)) {
+		return false;
+	}
+	return _readLZChunks(vf, NULL, stateSize, NULL, 0, extdata);
+}
+
 bool mCoreSaveStateNamed(struct mCore* core, struct VFile* vf, int flags) {
 	struct mStateExtdata extdata;
 	mStateExtdataInit(&extdata);
@@ -361,22 +642,10 @@ bool mCoreSaveStateNamed(struct mCore* core, struct VFile* vf, int flags) {
 	if (flags & SAVESTATE_METADATA) {
 		uint64_t* creationUsec = malloc(sizeof(*creationUsec));
 		if (creationUsec) {
-#ifndef _MSC_VER
-			struct timeval tv;
-			if (!gettimeofday(&tv, 0)) {
-				uint64_t usec = tv.tv_usec;
-				usec += tv.tv_sec * 1000000LL;
-				STORE_64LE(usec, 0, creationUsec);
-			}
-#else
-			struct timespec ts;
-			if (timespec_get(&ts, TIME_UTC)) {
-				uint64_t usec = ts.tv_nsec / 1000;
-				usec += ts.tv_sec * 1000000LL;
+			uint64_t usec = currentTimeUsec();
+			if (usec) {
 				STORE_64LE(usec, 0, creationUsec);
-			}
-#endif
-			else {
+			} else {
 				free(creationUsec);
 				creationUsec = 0;
 			}
@@ -434,10 +703,16 @@ bool mCoreSaveStateNamed(struct mCore* core, struct VFile* vf, int flags) {
 			mStateExtdataPut(&extdata, EXTDATA_RTC, &item);
 		}
 	}
+	if (flags & SAVESTATE_COMPRESSED) {
+		bool success = _saveLZState(core, vf, &extdata, flags & SAVESTATE_SCREENSHOT);
+		mStateExtdataDeinit(&extdata);
+		if (cheatVf) {
+			cheatVf->close(cheatVf);
+		}
+		return success;
+	}
 #ifdef USE_PNG
 	if (!(flags & SAVESTATE_SCREENSHOT)) {
-#else
-	UNUSED(flags);
 #endif
 		vf->truncate(vf, stateSize);
 		struct GBASerializedState* state = vf->map(vf, stateSize, MAP_WRITE);
@@ -472,7 +747,84 @@ bool mCoreSaveStateNamed(struct mCore* core, struct VFile* vf, int flags) {
 	return false;
 }
 
+size_t mCoreStateBufferSize(struct mCore* core, int flags) {
+	size_t size = core->stateSize(core);
+	if (flags & SAVESTATE_SAVEDATA) {
+		size += sizeof(uint32_t);
+		if (core->savedataRef) {
+			const void* sram;
+			size += core->savedataRef(core, &sram);
+		} else {
+			void* sram = NULL;
+			size += core->savedataClone(core, &sram);
+			free(sram);
+		}
+	}
+	return size;
+}
+
+size_t mCoreSaveStateInto(struct mCore* core, void* buffer, size_t size, int flags) {
+	size_t stateSize = core->stateSize(core);
+	if (size < stateSize) {
+		return 0;
+	}
+	if (!core->saveState(core, buffer)) {
+		return 0;
+	}
+	if (!(flags & SAVESTATE_SAVEDATA)) {
+		return stateSize;
+	}
+
+	uint8_t* savedata = (uint8_t*) buffer + stateSize;
+	const void* sram = NULL;
+	void* clone = NULL;
+	size_t savedataSize;
+	if (core->savedataRef) {
+		savedataSize = core->savedataRef(core, &sram);
+	} else {
+		savedataSize = core->savedataClone(core, &clone);
+		sram = clone;
+	}
+	if (size - stateSize < sizeof(uint32_t) + savedataSize) {
+		free(clone);
+		return 0;
+	}
+	STORE_32LE(savedataSize, 0, savedata);
+	if (savedataSize) {
+		memcpy(&savedata[sizeof(uint32_t)], sram, savedataSize);
+	}
+	free(clone);
+	return stateSize + sizeof(uint32_t) + savedataSize;
+}
+
+bool mCoreLoadStateFrom(struct mCore* core, const void* buffer, size_t size, int flags) {
+	size_t stateSize = core->stateSize(core);
+	if (size < stateSize) {
+		return false;
+	}
+	if (!core->loadState(core, buffer)) {
+		return false;
+	}
+	if (!(flags & SAVESTATE_SAVEDATA) || size - stateSize < sizeof(uint32_t)) {
+		return true;
+	}
+
+	const uint8_t* savedata = (const uint8_t*) buffer + stateSize;
+	uint32_t savedataSize;
+	LOAD_32LE(savedataSize, 0, savedata);
+	if (!savedataSize || size - stateSize - sizeof(uint32_t) < savedataSize) {
+		return true;
+	}
+	if (!core->savedataRestore(core, &savedata[sizeof(uint32_t)], savedataSize, true)) {
+		mLOG(SAVESTATE, WARN, "Failed to load savedata from savestate");
+	}
+	return true;
+}
+
 void* mCoreExtractState(struct mCore* core, struct VFile* vf, struct mStateExtdata* extdata) {
+	if (_isLZState(vf)) {
+		return _loadLZState(core, vf, extdata);
+	}
 #ifdef USE_PNG
 	if (isPNG(vf)) {
 		return _loadPNGState(core, vf, extdata);
@@ -492,6 +844,9 @@ void* mCoreExtractState(struct mCore* core, struct VFile* vf, struct mStateExtda
 }
 
 bool mCoreExtractExtdata(struct mCore* core, struct VFile* vf, struct mStateExtdata* extdata) {
+	if (_isLZState(vf)) {
+		return _loadLZExtdata(vf, extdata);
+	}
 #ifdef USE_PNG
 	if (isPNG(vf)) {
 		return _loadPNGExtadata(vf, extdata);
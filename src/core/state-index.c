@@ -0,0 +1,356 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include <mgba/core/state-index.h>
+
+#include <mgba/core/core.h>
+#include <mgba/core/version.h>
+#include <mgba-util/clock.h>
+#include <mgba-util/crc32.h>
+#include <mgba-util/vfs.h>
+
+#define STATE_INDEX_MAGIC "mSSI"
+#define STATE_INDEX_VERSION 3
+
+#define STATE_INDEX_RECORD_VALID 1
+#define STATE_INDEX_RECORD_THUMBNAIL 2
+
+// Pixel layout of the stored thumbnails; an index written by a build with a different one is discarded
+#define STATE_INDEX_FORMAT_16_BIT 0x100
+#define STATE_INDEX_FORMAT_5_6_5 0x200
+#define STATE_INDEX_FORMAT_BIG_ENDIAN 0x400
+
+#ifdef COLOR_16_BIT
+#ifdef COLOR_5_6_5
+#define STATE_INDEX_FORMAT_COLOR (STATE_INDEX_FORMAT_16_BIT | STATE_INDEX_FORMAT_5_6_5)
+#define THUMBNAIL_AVERAGE_MASK 0xF7DE
+#else
+#define STATE_INDEX_FORMAT_COLOR STATE_INDEX_FORMAT_16_BIT
+#define THUMBNAIL_AVERAGE_MASK 0x7BDE
+#endif
+#else
+#define STATE_INDEX_FORMAT_COLOR 0
+#define THUMBNAIL_AVERAGE_MASK 0xFEFEFEFE
+#endif
+
+#ifdef __BIG_ENDIAN__
+#define STATE_INDEX_FORMAT (STATE_INDEX_FORMAT_COLOR | STATE_INDEX_FORMAT_BIG_ENDIAN | BYTES_PER_PIXEL)
+#else
+#define STATE_INDEX_FORMAT (STATE_INDEX_FORMAT_COLOR | BYTES_PER_PIXEL)
+#endif
+
+// The file is a header followed by one fixed-size record per slot, so a save only rewrites its
+// own record and the menu only reads the record of the slot it is showing
+struct mStateIndexHeader {
+	char magic[4];
+	uint32_t version;
+	uint16_t width;
+	uint16_t height;
+	uint32_t format;
+};
+
+struct mStateIndexRecord {
+	uint32_t flags;
+	uint32_t stateSize;
+	uint64_t creationUsec;
+	uint32_t frameCount;
+	uint32_t stateCrc32;
+	char creator[mSTATE_INDEX_CREATOR_SIZE];
+};
+
+static inline color_t _average(color_t a, color_t b) {
+	return (a & b) + (((a ^ b) & THUMBNAIL_AVERAGE_MASK) >> 1);
+}
+
+static size_t _recordSize(unsigned width, unsigned height) {
+	return sizeof(struct mStateIndexRecord) + width * height * BYTES_PER_PIXEL;
+}
+
+static bool _resizeThumbnail(struct mStateIndexEntry* entry, unsigned width, unsigned height) {
+	if (entry->thumbnail && entry->width == width && entry->height == height) {
+		return true;
+	}
+	free(entry->thumbnail);
+	entry->thumbnail = NULL;
+	entry->width = 0;
+	entry->height = 0;
+	if (!width || !height) {
+		return true;
+	}
+	entry->thumbnail = malloc(width * height * BYTES_PER_PIXEL);
+	if (!entry->thumbnail) {
+		return false;
+	}
+	entry->width = width;
+	entry->height = height;
+	return true;
+}
+
+static bool _readHeader(struct VFile* vf, unsigned* width, unsigned* height) {
+	struct mStateIndexHeader header;
+	if (vf->seek(vf, 0, SEEK_SET) < 0 || vf->read(vf, &header, sizeof(header)) != (ssize_t) sizeof(header)) {
+		return false;
+	}
+	if (memcmp(header.magic, STATE_INDEX_MAGIC, sizeof(header.magic)) != 0) {
+		return false;
+	}
+	uint32_t version;
+	uint32_t format;
+	uint16_t value;
+	LOAD_32LE(version, 0, &header.version);
+	LOAD_32LE(format, 0, &header.format);
+	if (version != STATE_INDEX_VERSION || format != STATE_INDEX_FORMAT) {
+		return false;
+	}
+	LOAD_16LE(value, 0, &header.width);
+	*width = value;
+	LOAD_16LE(value, 0, &header.height);
+	*height = value;
+	return true;
+}
+
+static bool _initIndex(struct VFile* vf, unsigned width, unsigned height) {
+	struct mStateIndexHeader header = {0};
+	memcpy(header.magic, STATE_INDEX_MAGIC, sizeof(header.magic));
+	STORE_32LE(STATE_INDEX_VERSION, 0, &header.version);
+	STORE_16LE(width, 0, &header.width);
+	STORE_16LE(height, 0, &header.height);
+	STORE_32LE(STATE_INDEX_FORMAT, 0, &header.format);
+
+	size_t recordSize = _recordSize(width, height);
+	uint8_t* empty = calloc(1, recordSize);
+	if (!empty) {
+		return false;
+	}
+	vf->truncate(vf, 0);
+	bool success = vf->seek(vf, 0, SEEK_SET) == 0 && vf->write(vf, &header, sizeof(header)) == (ssize_t) sizeof(header);
+	int slot;
+	for (slot = 0; success && slot < mSTATE_INDEX_SLOTS; ++slot) {
+		success = vf->write(vf, empty, recordSize) == (ssize_t) recordSize;
+	}
+	free(empty);
+	return success;
+}
+
+static bool _seekRecord(struct VFile* vf, int slot, unsigned width, unsigned height) {
+	off_t offset = sizeof(struct mStateIndexHeader) + slot * _recordSize(width, height);
+	return vf->seek(vf, offset, SEEK_SET) == offset;
+}
+
+void mStateIndexEntryInit(struct mStateIndexEntry* entry) {
+	memset(entry, 0, sizeof(*entry));
+}
+
+void mStateIndexEntryDeinit(struct mStateIndexEntry* entry) {
+	free(entry->thumbnail);
+	memset(entry, 0, sizeof(*entry));
+}
+
+void mStateIndexEntryCapture(struct mStateIndexEntry* entry, struct mCore* core) {
+	entry->creationUsec = currentTimeUsec();
+	entry->frameCount = core->frameCounter(core);
+	entry->stateSize = 0;
+	entry->stateCrc32 = 0;
+	snprintf(entry->creator, sizeof(entry->creator), "%s %s", projectName, projectVersion);
+
+	const void* pixels = NULL;
+	size_t stride;
+	unsigned width, height;
+	core->desiredVideoDimensions(core, &width, &height);
+	core->getPixels(core, &pixels, &stride);
+	if (pixels) {
+		mStateIndexEntrySetThumbnail(entry, pixels, width, height, stride);
+	} else {
+		_resizeThumbnail(entry, 0, 0);
+	}
+}
+
+void mStateIndexEntrySetThumbnail(struct mStateIndexEntry* entry, const color_t* pixels, unsigned width, unsigned height, size_t stride) {
+	width >>= mSTATE_THUMBNAIL_SHIFT;
+	height >>= mSTATE_THUMBNAIL_SHIFT;
+	if (!_resizeThumbnail(entry, width, height) || !entry->thumbnail) {
+		return;
+	}
+	// Box filter over the top-left 2x2 pixels of each cell, averaged per channel without unpacking
+	unsigned x, y;
+	for (y = 0; y < height; ++y) {
+		const color_t* row = &pixels[(y << mSTATE_THUMBNAIL_SHIFT) * stride];
+		const color_t* nextRow = &row[stride];
+		color_t* out = &entry->thumbnail[y * width];
+		for (x = 0; x < width; ++x) {
+			unsigned sx = x << mSTATE_THUMBNAIL_SHIFT;
+			out[x] = _average(_average(row[sx], row[sx + 1]), _average(nextRow[sx], nextRow[sx + 1]));
+		}
+	}
+}
+
+static size_t _crcSize(size_t stateSize) {
+	return stateSize < mSTATE_INDEX_CRC_SIZE ? stateSize : mSTATE_INDEX_CRC_SIZE;
+}
+
+void mStateIndexEntrySetState(struct mStateIndexEntry* entry, struct VFile* state) {
+	entry->stateSize = state->size(state);
+	entry->stateCrc32 = fileCrc32(state, _crcSize(entry->stateSize));
+}
+
+void mStateIndexEntrySetStateBuffer(struct mStateIndexEntry* entry, const void* state, size_t size) {
+	entry->stateSize = size;
+	entry->stateCrc32 = doCrc32(state, _crcSize(size));
+}
+
+bool mStateIndexRead(struct VFile* vf, int slot, struct mStateIndexEntry* entry) {
+	if (slot < 0 || slot >= mSTATE_INDEX_SLOTS) {
+		return false;
+	}
+	unsigned width, height;
+	if (!_readHeader(vf, &width, &height) || !_seekRecord(vf, slot, width, height)) {
+		return false;
+	}
+	struct mStateIndexRecord record;
+	if (vf->read(vf, &record, sizeof(record)) != (ssize_t) sizeof(record)) {
+		return false;
+	}
+	uint32_t flags;
+	LOAD_32LE(flags, 0, &record.flags);
+	if (!(flags & STATE_INDEX_RECORD_VALID)) {
+		return false;
+	}
+	if (!(flags & STATE_INDEX_RECORD_THUMBNAIL)) {
+		width = 0;
+		height = 0;
+	}
+	if (!_resizeThumbnail(entry, width, height)) {
+		return false;
+	}
+	if (entry->thumbnail) {
+		ssize_t size = width * height * BYTES_PER_PIXEL;
+		if (vf->read(vf, entry->thumbnail, size) != size) {
+			return false;
+		}
+	}
+	LOAD_32LE(entry->stateSize, 0, &record.stateSize);
+	LOAD_32LE(entry->stateCrc32, 0, &record.stateCrc32);
+	LOAD_64LE(entry->creationUsec, 0, &record.creationUsec);
+	LOAD_32LE(entry->frameCount, 0, &record.frameCount);
+	memcpy(entry->creator, record.creator, sizeof(entry->creator));
+	entry->creator[sizeof(entry->creator) - 1] = '\0';
+	return true;
+}
+
+bool mStateIndexWrite(struct VFile* vf, int slot, const struct mStateIndexEntry* entry) {
+	if (slot < 0 || slot >= mSTATE_INDEX_SLOTS) {
+		return false;
+	}
+	unsigned width, height;
+	bool thumbnail = entry->thumbnail;
+	if (!_readHeader(vf, &width, &height) || (thumbnail && (width != entry->width || height != entry->height))) {
+		// Either there is no usable index yet or the screen size changed, which invalidates every thumbnail
+		width = entry->width;
+		height = entry->height;
+		if (!_initIndex(vf, width, height)) {
+			return false;
+		}
+	}
+	if (!_seekRecord(vf, slot, width, height)) {
+		return false;
+	}
+	struct mStateIndexRecord record = {0};
+	uint32_t flags = STATE_INDEX_RECORD_VALID;
+	if (thumbnail) {
+		flags |= STATE_INDEX_RECORD_THUMBNAIL;
+	}
+	STORE_32LE(flags, 0, &record.flags);
+	STORE_32LE(entry->stateSize, 0, &record.stateSize);
+	STORE_32LE(entry->stateCrc32, 0, &record.stateCrc32);
+	STORE_64LE(entry->creationUsec, 0, &record.creationUsec);
+	STORE_32LE(entry->frameCount, 0, &record.frameCount);
+	strncpy(record.creator, entry->creator, sizeof(record.creator) - 1);
+	if (vf->write(vf, &record, sizeof(record)) != (ssize_t) sizeof(record)) {
+		return false;
+	}
+	if (thumbnail) {
+		ssize_t size = width * height * BYTES_PER_PIXEL;
+		if (vf->write(vf, entry->thumbnail, size) != size) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void mStateIndexInvalidate(struct VFile* vf, int slot) {
+	if (slot < 0 || slot >= mSTATE_INDEX_SLOTS) {
+		return;
+	}
+	unsigned width, height;
+	if (!_readHeader(vf, &width, &height) || !_seekRecord(vf, slot, width, height)) {
+		return;
+	}
+	uint32_t flags = 0;
+	vf->write(vf, &flags, sizeof(flags));
+}
+
+bool mStateIndexVerify(struct VFile* state, const struct mStateIndexEntry* entry) {
+	// Catches states written without updating the index (older versions, other frontends, copied
+	// files). The size check is free; when the sizes match, which is the common case for two states
+	// of the same game, only the leading mSTATE_INDEX_CRC_SIZE bytes are read and checksummed.
+	if (state->size(state) != (ssize_t) entry->stateSize) {
+		return false;
+	}
+	return fileCrc32(state, _crcSize(entry->stateSize)) == entry->stateCrc32;
+}
+
+#if !defined(MINIMAL_CORE) || MINIMAL_CORE < 2
+struct VFile* mCoreGetStateIndex(struct mCore* core, bool write) {
+	if (!core->dirs.state) {
+		return NULL;
+	}
+	char name[PATH_MAX + 14]; // Quash warning
+	snprintf(name, sizeof(name), "%s.ssi", core->dirs.baseName);
+	return core->dirs.state->openFile(core->dirs.state, name, write ? (O_CREAT | O_RDWR) : O_RDONLY);
+}
+
+bool mCoreReadStateIndex(struct mCore* core, int slot, struct mStateIndexEntry* entry) {
+	struct VFile* vf = mCoreGetStateIndex(core, false);
+	if (!vf) {
+		return false;
+	}
+	bool success = mStateIndexRead(vf, slot, entry);
+	vf->close(vf);
+	return success;
+}
+
+bool mCoreWriteStateIndex(struct mCore* core, int slot, const struct mStateIndexEntry* entry) {
+	struct VFile* vf = mCoreGetStateIndex(core, true);
+	if (!vf) {
+		return false;
+	}
+	bool success = mStateIndexWrite(vf, slot, entry);
+	vf->close(vf);
+	return success;
+}
+
+void mCoreInvalidateStateIndex(struct mCore* core, int slot) {
+	struct VFile* vf = mCoreGetStateIndex(core, false);
+	if (!vf) {
+		return;
+	}
+	vf->close(vf);
+	vf = mCoreGetStateIndex(core, true);
+	if (vf) {
+		mStateIndexInvalidate(vf, slot);
+		vf->close(vf);
+	}
+}
+
+bool mCoreVerifyStateIndex(struct mCore* core, int slot, const struct mStateIndexEntry* entry) {
+	struct VFile* vf = mCoreGetState(core, slot, false);
+	if (!vf) {
+		return false;
+	}
+	bool matches = mStateIndexVerify(vf, entry);
+	vf->close(vf);
+	return matches;
+}
+#endif
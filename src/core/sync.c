@@ -5,7 +5,11 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 #include <mgba/core/sync.h>
 
+#include <mgba/core/audio-resampler.h>
 #include <mgba/core/blip_buf.h>
+#include <mgba-util/math.h>
+
+#define AUDIO_RING_RATE_DELTA 0.005
 
 static void _changeVideoSync(struct mCoreSync* sync, bool wait) {
 	// Make sure the video thread can process events while the GBA thread is paused
@@ -79,17 +83,58 @@ void mCoreSyncSetVideoSync(struct mCoreSync* sync, bool wait) {
 	_changeVideoSync(sync, wait);
 }
 
+static size_t _blipAvailable(const void* buf) {
+	return blip_samples_avail(buf);
+}
+
+static size_t _resamplerAvailable(const void* resampler) {
+	return mAudioResamplerAvailable(resampler);
+}
+
+static bool _produceAudio(struct mCoreSync* sync, size_t (*available)(const void*), const void* buf, size_t samples) {
+	size_t produced = available(buf);
+	size_t producedNew = produced;
+	while (sync->audioWait && producedNew >= samples) {
+		ConditionWait(&sync->audioRequiredCond, &sync->audioBufferMutex);
+		produced = producedNew;
+		producedNew = available(buf);
+	}
+	MutexUnlock(&sync->audioBufferMutex);
+	return producedNew != produced;
+}
+
 bool mCoreSyncProduceAudio(struct mCoreSync* sync, const struct blip_t* buf, size_t samples) {
 	if (!sync) {
 		return true;
 	}
 
-	size_t produced = blip_samples_avail(buf);
+	return _produceAudio(sync, _blipAvailable, buf, samples);
+}
+
+bool mCoreSyncProduceResampledAudio(struct mCoreSync* sync, struct mAudioResampler* resampler, size_t samples) {
+	if (!sync) {
+		return true;
+	}
+
+	struct mCoreAudioRing* ring = sync->audioRing;
+	if (!ring) {
+		return _produceAudio(sync, _resamplerAvailable, resampler, samples);
+	}
+
+	// The consumer never takes the lock, so it's only held here to sleep on
+	mCoreAudioRingWriteResampled(ring, resampler);
+	mAudioResamplerSetOutputRate(resampler, mCoreAudioRingRate(ring));
+	// A buffer as large as the ring would never fit, so wait for half of it at most
+	size_t capacity = mCoreAudioRingCapacity(ring);
+	if (samples > capacity / 2) {
+		samples = capacity / 2;
+	}
+	size_t produced = mCoreAudioRingSize(ring);
 	size_t producedNew = produced;
-	while (sync->audioWait && producedNew >= samples) {
+	while (sync->audioWait && sync->audioRing == ring && producedNew + samples > capacity) {
 		ConditionWait(&sync->audioRequiredCond, &sync->audioBufferMutex);
 		produced = producedNew;
-		producedNew = blip_samples_avail(buf);
+		producedNew = mCoreAudioRingSize(ring);
 	}
 	MutexUnlock(&sync->audioBufferMutex);
 	return producedNew != produced;
@@ -119,3 +164,118 @@ void mCoreSyncConsumeAudio(struct mCoreSync* sync) {
 	ConditionWake(&sync->audioRequiredCond);
 	MutexUnlock(&sync->audioBufferMutex);
 }
+
+void mCoreSyncConsumeAudioRing(struct mCoreSync* sync) {
+	if (!sync) {
+		return;
+	}
+
+	// Unlike mCoreSyncConsumeAudio, the lock isn't held. A wakeup can be missed if it lands
+	// between the producer's check and its wait, but then the next read wakes it instead.
+	ConditionWake(&sync->audioRequiredCond);
+}
+
+void mCoreSyncSetAudioRing(struct mCoreSync* sync, struct mCoreAudioRing* ring) {
+	if (!sync) {
+		return;
+	}
+
+	MutexLock(&sync->audioBufferMutex);
+	sync->audioRing = ring;
+	ConditionWake(&sync->audioRequiredCond);
+	MutexUnlock(&sync->audioBufferMutex);
+}
+
+void mCoreAudioRingInit(struct mCoreAudioRing* ring, size_t capacity, double outputRate) {
+	ring->capacity = toPow2(capacity);
+	ring->samples = calloc(ring->capacity, sizeof(*ring->samples));
+	ring->outputRate = outputRate;
+	ring->maxRateDelta = AUDIO_RING_RATE_DELTA;
+	mCoreAudioRingClear(ring);
+}
+
+void mCoreAudioRingDeinit(struct mCoreAudioRing* ring) {
+	free(ring->samples);
+	ring->samples = NULL;
+}
+
+void mCoreAudioRingClear(struct mCoreAudioRing* ring) {
+	ATOMIC_STORE(ring->readIndex, 0);
+	ATOMIC_STORE(ring->writeIndex, 0);
+}
+
+size_t mCoreAudioRingCapacity(const struct mCoreAudioRing* ring) {
+	return ring->capacity;
+}
+
+size_t mCoreAudioRingSize(const struct mCoreAudioRing* ring) {
+	uint32_t read;
+	uint32_t write;
+	ATOMIC_LOAD(read, ring->readIndex);
+	ATOMIC_LOAD(write, ring->writeIndex);
+	return write - read;
+}
+
+size_t mCoreAudioRingWrite(struct mCoreAudioRing* ring, const int16_t* samples, size_t count) {
+	uint32_t read;
+	uint32_t write = ring->writeIndex;
+	ATOMIC_LOAD(read, ring->readIndex);
+	size_t space = ring->capacity - (write - read);
+	if (count > space) {
+		count = space;
+	}
+	uint32_t start = write & (ring->capacity - 1);
+	size_t first = ring->capacity - start;
+	if (first > count) {
+		first = count;
+	}
+	memcpy(&ring->samples[start], samples, first * sizeof(*ring->samples));
+	memcpy(ring->samples, &samples[first * 2], (count - first) * sizeof(*ring->samples));
+	ATOMIC_STORE(ring->writeIndex, write + count);
+	return count;
+}
+
+size_t mCoreAudioRingWriteResampled(struct mCoreAudioRing* ring, struct mAudioResampler* resampler) {
+	uint32_t read;
+	uint32_t write = ring->writeIndex;
+	ATOMIC_LOAD(read, ring->readIndex);
+	size_t space = ring->capacity - (write - read);
+	uint32_t start = write & (ring->capacity - 1);
+	size_t first = ring->capacity - start;
+	if (first > space) {
+		first = space;
+	}
+	size_t count = mAudioResamplerRead(resampler, (int16_t*) &ring->samples[start], first);
+	if (count == first) {
+		count += mAudioResamplerRead(resampler, (int16_t*) ring->samples, space - first);
+	}
+	ATOMIC_STORE(ring->writeIndex, write + count);
+	return count;
+}
+
+size_t mCoreAudioRingRead(struct mCoreAudioRing* ring, int16_t* samples, size_t count) {
+	uint32_t write;
+	uint32_t read = ring->readIndex;
+	ATOMIC_LOAD(write, ring->writeIndex);
+	size_t available = write - read;
+	if (count > available) {
+		count = available;
+	}
+	uint32_t start = read & (ring->capacity - 1);
+	size_t first = ring->capacity - start;
+	if (first > count) {
+		first = count;
+	}
+	memcpy(samples, &ring->samples[start], first * sizeof(*ring->samples));
+	memcpy(&samples[first * 2], ring->samples, (count - first) * sizeof(*ring->samples));
+	ATOMIC_STORE(ring->readIndex, read + count);
+	return count;
+}
+
+double mCoreAudioRingRate(const struct mCoreAudioRing* ring) {
+	// Produce slightly faster when running dry and slightly slower when
+	// filling up, so clock drift between the core and the device never
+	// lets the ring under- or overrun
+	double fill = mCoreAudioRingSize(ring) / (double) ring->capacity;
+	return ring->outputRate * (1. + ring->maxRateDelta * (1. - 2. * fill));
+}
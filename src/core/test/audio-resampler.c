@@ -0,0 +1,103 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba/core/audio-resampler.h>
+
+static void _writeConstant(struct mAudioResampler* resampler, int16_t left, int16_t right, size_t count) {
+	struct mStereoSample samples[64];
+	size_t i;
+	for (i = 0; i < 64; ++i) {
+		samples[i].left = left;
+		samples[i].right = right;
+	}
+	while (count) {
+		size_t chunk = count > 64 ? 64 : count;
+		assert_int_equal(mAudioResamplerWrite(resampler, samples, chunk), chunk);
+		count -= chunk;
+	}
+}
+
+static void _testDC(enum mAudioResamplerQuality quality) {
+	struct mAudioResampler resampler;
+	mAudioResamplerInit(&resampler, 4096, quality);
+	mAudioResamplerSetInputRate(&resampler, 65536);
+	mAudioResamplerSetOutputRate(&resampler, 48000);
+	_writeConstant(&resampler, 1000, -2000, 2048);
+
+	int16_t output[512 * 2];
+	assert_int_equal(mAudioResamplerRead(&resampler, output, 512), 512);
+	size_t i;
+	// Skip the filter's warm-up against the implicit zero history
+	for (i = 32; i < 512; ++i) {
+		assert_int_equal(output[i * 2], 1000);
+		assert_int_equal(output[i * 2 + 1], -2000);
+	}
+	mAudioResamplerDeinit(&resampler);
+}
+
+M_TEST_DEFINE(dcLinear) {
+	_testDC(mAUDIO_RESAMPLER_LINEAR);
+}
+
+M_TEST_DEFINE(dcFast) {
+	_testDC(mAUDIO_RESAMPLER_FAST);
+}
+
+M_TEST_DEFINE(dcBest) {
+	_testDC(mAUDIO_RESAMPLER_BEST);
+}
+
+M_TEST_DEFINE(ratio) {
+	struct mAudioResampler resampler;
+	mAudioResamplerInit(&resampler, 0x10000, mAUDIO_RESAMPLER_GOOD);
+	mAudioResamplerSetInputRate(&resampler, 32768);
+	mAudioResamplerSetOutputRate(&resampler, 48000);
+	_writeConstant(&resampler, 0, 0, 32768);
+	size_t available = mAudioResamplerAvailable(&resampler);
+	assert_true(available > 47950 && available <= 48000);
+	mAudioResamplerDeinit(&resampler);
+}
+
+M_TEST_DEFINE(clear) {
+	struct mAudioResampler resampler;
+	mAudioResamplerInit(&resampler, 1024, mAUDIO_RESAMPLER_FAST);
+	mAudioResamplerSetInputRate(&resampler, 32768);
+	mAudioResamplerSetOutputRate(&resampler, 32768);
+	_writeConstant(&resampler, 100, 100, 256);
+	assert_int_not_equal(mAudioResamplerAvailable(&resampler), 0);
+	mAudioResamplerClear(&resampler);
+	assert_int_equal(mAudioResamplerAvailable(&resampler), 0);
+	mAudioResamplerDeinit(&resampler);
+}
+
+M_TEST_DEFINE(overflow) {
+	struct mAudioResampler resampler;
+	mAudioResamplerInit(&resampler, 256, mAUDIO_RESAMPLER_FAST);
+	mAudioResamplerSetInputRate(&resampler, 32768);
+	mAudioResamplerSetOutputRate(&resampler, 32768);
+	struct mStereoSample samples[64] = {0};
+	size_t written = 0;
+	size_t i;
+	for (i = 0; i < 64; ++i) {
+		written += mAudioResamplerWrite(&resampler, samples, 64);
+	}
+	assert_true(written < 64 * 64);
+	assert_int_equal(mAudioResamplerAvailable(&resampler), 256);
+
+	int16_t output[128 * 2];
+	assert_int_equal(mAudioResamplerRead(&resampler, output, 128), 128);
+	assert_int_equal(mAudioResamplerAvailable(&resampler), 128);
+	mAudioResamplerDeinit(&resampler);
+}
+
+M_TEST_SUITE_DEFINE(mAudioResampler,
+	cmocka_unit_test(dcLinear),
+	cmocka_unit_test(dcFast),
+	cmocka_unit_test(dcBest),
+	cmocka_unit_test(ratio),
+	cmocka_unit_test(clear),
+	cmocka_unit_test(overflow))
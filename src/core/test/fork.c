@@ -0,0 +1,158 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba/core/core.h>
+#include <mgba-util/vfs.h>
+
+#ifdef M_CORE_GBA
+#include <mgba/gba/core.h>
+#include <mgba/internal/gba/gba.h>
+#endif
+
+#define ROM_SIZE 0x400
+
+struct ForkTest {
+	struct mCore* core;
+	struct mCore* fork;
+	uint8_t* rom;
+};
+
+#ifdef M_CORE_GBA
+static const uint32_t _romCode[] = {
+	0xE3A00402, // mov r0, #0x02000000
+	0xE3A01000, // mov r1, #0
+	0xE2811001, // add r1, r1, #1
+	0xE5801000, // str r1, [r0]
+	0xEAFFFFFC, // b 0x080000C8
+};
+
+static int _setupCore(void** state) {
+	struct ForkTest* test = calloc(1, sizeof(*test));
+	test->rom = calloc(1, ROM_SIZE);
+	STORE_32LE(0xEA00002E, 0, test->rom); // b 0x080000C0
+	size_t i;
+	for (i = 0; i < sizeof(_romCode) / sizeof(*_romCode); ++i) {
+		STORE_32LE(_romCode[i], 0xC0 + i * 4, test->rom);
+	}
+
+	test->core = GBACoreCreate();
+	if (!test->core || !test->core->init(test->core)) {
+		return -1;
+	}
+	mCoreInitConfig(test->core, NULL);
+	test->core->opts.skipBios = true;
+	if (!test->core->loadROM(test->core, VFileFromMemory(test->rom, ROM_SIZE))) {
+		return -1;
+	}
+	test->core->reset(test->core);
+	*state = test;
+	return 0;
+}
+
+static int _teardownCore(void** state) {
+	struct ForkTest* test = *state;
+	if (test->fork) {
+		mCoreConfigDeinit(&test->fork->config);
+		test->fork->deinit(test->fork);
+	}
+	mCoreConfigDeinit(&test->core->config);
+	test->core->deinit(test->core);
+	free(test->rom);
+	free(test);
+	return 0;
+}
+
+M_TEST_DEFINE(shareROM) {
+	struct ForkTest* test = *state;
+	struct mCore* core = test->core;
+	core->runFrame(core);
+	test->fork = mCoreFork(core);
+	assert_non_null(test->fork);
+
+	struct GBA* gba = core->board;
+	struct GBA* fork = test->fork->board;
+	if (gba->romImage) {
+		assert_ptr_equal(fork->romImage, gba->romImage);
+	} else {
+		assert_ptr_equal(fork->memory.rom, gba->memory.rom);
+		assert_true(fork->isPristine);
+	}
+	assert_int_equal(test->fork->frameCounter(test->fork), core->frameCounter(core));
+	assert_true(mCoreCompareMemory(core, test->fork, BASE_WORKING_RAM, SIZE_WORKING_RAM, NULL));
+
+	int i;
+	for (i = 0; i < 10; ++i) {
+		core->runFrame(core);
+		test->fork->runFrame(test->fork);
+	}
+	assert_int_not_equal(core->busRead32(core, BASE_WORKING_RAM), 0);
+	assert_true(mCoreCompareMemory(core, test->fork, BASE_WORKING_RAM, SIZE_WORKING_RAM, NULL));
+
+	uint32_t mismatch = 0;
+	test->fork->busWrite8(test->fork, BASE_WORKING_RAM | 0x123, 0xA5);
+	assert_false(mCoreCompareMemory(core, test->fork, BASE_WORKING_RAM, SIZE_WORKING_RAM, &mismatch));
+	assert_int_equal(mismatch, BASE_WORKING_RAM | 0x123);
+	assert_true(mCoreCompareMemory(core, test->fork, BASE_WORKING_RAM | 0x124, 0x1000, NULL));
+}
+
+M_TEST_DEFINE(copyOnWrite) {
+	struct ForkTest* test = *state;
+	struct mCore* core = test->core;
+	test->fork = mCoreFork(core);
+	assert_non_null(test->fork);
+
+	test->fork->rawWrite8(test->fork, BASE_CART0 | 0x200, -1, 0x55);
+	struct GBA* gba = core->board;
+	struct GBA* fork = test->fork->board;
+	if (!gba->romImage) {
+		assert_ptr_not_equal(fork->memory.rom, gba->memory.rom);
+		assert_false(fork->isPristine);
+		assert_true(gba->isPristine);
+	}
+	assert_int_equal(test->fork->busRead8(test->fork, BASE_CART0 | 0x200), 0x55);
+	assert_int_equal(core->busRead8(core, BASE_CART0 | 0x200), 0);
+	assert_int_equal(test->rom[0x200], 0);
+
+	// Code still runs from the private copy
+	test->fork->runFrame(test->fork);
+	assert_int_not_equal(test->fork->busRead32(test->fork, BASE_WORKING_RAM), 0);
+}
+
+M_TEST_DEFINE(carryROMWrites) {
+	struct ForkTest* test = *state;
+	struct mCore* core = test->core;
+	core->rawWrite8(core, BASE_CART0 | 0x300, -1, 0x77);
+	test->fork = mCoreFork(core);
+	assert_non_null(test->fork);
+	assert_int_equal(test->fork->busRead8(test->fork, BASE_CART0 | 0x300), 0x77);
+	assert_int_equal(test->fork->busRead32(test->fork, BASE_CART0 | 0xC0), 0xE3A00402);
+}
+
+M_TEST_DEFINE(savedata) {
+	struct ForkTest* test = *state;
+	struct mCore* core = test->core;
+	struct GBA* gba = core->board;
+	GBASavedataForceType(&gba->memory.savedata, SAVEDATA_SRAM);
+	core->busWrite8(core, BASE_CART_SRAM | 0x10, 0x42);
+
+	test->fork = mCoreFork(core);
+	assert_non_null(test->fork);
+	assert_int_equal(test->fork->busRead8(test->fork, BASE_CART_SRAM | 0x10), 0x42);
+	test->fork->busWrite8(test->fork, BASE_CART_SRAM | 0x10, 0x43);
+	assert_int_equal(test->fork->busRead8(test->fork, BASE_CART_SRAM | 0x10), 0x43);
+	assert_int_equal(core->busRead8(core, BASE_CART_SRAM | 0x10), 0x42);
+}
+#endif
+
+M_TEST_SUITE_DEFINE(mCoreFork,
+#ifdef M_CORE_GBA
+	cmocka_unit_test_setup_teardown(shareROM, _setupCore, _teardownCore),
+	cmocka_unit_test_setup_teardown(copyOnWrite, _setupCore, _teardownCore),
+	cmocka_unit_test_setup_teardown(carryROMWrites, _setupCore, _teardownCore),
+	cmocka_unit_test_setup_teardown(savedata, _setupCore, _teardownCore),
+#endif
+)
@@ -0,0 +1,203 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba/core/core.h>
+#include <mgba/core/interface.h>
+#include <mgba/core/mem-search.h>
+
+#ifdef M_CORE_GBA
+#include <mgba/gba/core.h>
+
+static struct mCore* _createCore(void) {
+	struct mCore* core = GBACoreCreate();
+	if (!core || !core->init(core)) {
+		return NULL;
+	}
+	mCoreInitConfig(core, NULL);
+	core->reset(core);
+	return core;
+}
+
+static void _destroyCore(struct mCore* core) {
+	mCoreConfigDeinit(&core->config);
+	core->deinit(core);
+}
+
+static void _params(struct mCoreMemorySearchParams* params, enum mCoreMemorySearchOp op, int width, int32_t value) {
+	params->memoryFlags = mCORE_MEMORY_WRITE;
+	params->type = mCORE_MEMORY_SEARCH_INT;
+	params->op = op;
+	params->align = -1;
+	params->width = width;
+	params->valueInt = value;
+}
+
+M_TEST_DEFINE(findMatchesList) {
+	struct mCore* core = _createCore();
+	assert_non_null(core);
+	core->busWrite16(core, 0x02000100, 0x1234);
+	core->busWrite16(core, 0x03000200, 0x1234);
+	core->busWrite16(core, 0x03000202, 0x1235);
+
+	struct mCoreMemorySearchParams params;
+	_params(&params, mCORE_MEMORY_SEARCH_EQUAL, 2, 0x1234);
+
+	struct mCoreMemorySearchResults list;
+	mCoreMemorySearchResultsInit(&list, 0);
+	mCoreMemorySearch(core, &params, &list, 0);
+	assert_int_equal(mCoreMemorySearchResultsSize(&list), 2);
+
+	struct mCoreMemorySearchCandidates candidates;
+	mCoreMemorySearchCandidatesInit(&candidates);
+	assert_true(mCoreMemorySearchCandidatesFind(core, &params, &candidates));
+	assert_int_equal(candidates.count, 2);
+
+	struct mCoreMemorySearchResults exported;
+	mCoreMemorySearchResultsInit(&exported, 0);
+	assert_int_equal(mCoreMemorySearchCandidatesExport(&candidates, &exported, 0), 2);
+	size_t i;
+	for (i = 0; i < 2; ++i) {
+		const struct mCoreMemorySearchResult* a = mCoreMemorySearchResultsGetConstPointer(&list, i);
+		const struct mCoreMemorySearchResult* b = mCoreMemorySearchResultsGetConstPointer(&exported, i);
+		assert_int_equal(a->address, b->address);
+		assert_int_equal(a->width, 2);
+		assert_int_equal(b->width, 2);
+		assert_int_equal(b->oldValue, 0x1234);
+	}
+	assert_int_equal(mCoreMemorySearchResultsGetConstPointer(&exported, 0)->address, 0x02000100);
+	assert_int_equal(mCoreMemorySearchResultsGetConstPointer(&exported, 1)->address, 0x03000200);
+
+	mCoreMemorySearchResultsClear(&exported);
+	assert_int_equal(mCoreMemorySearchCandidatesExport(&candidates, &exported, 1), 1);
+
+	mCoreMemorySearchResultsDeinit(&exported);
+	mCoreMemorySearchResultsDeinit(&list);
+	mCoreMemorySearchCandidatesDeinit(&candidates);
+	_destroyCore(core);
+}
+
+M_TEST_DEFINE(narrowByDelta) {
+	struct mCore* core = _createCore();
+	assert_non_null(core);
+	core->busWrite8(core, 0x02000010, 5);
+	core->busWrite8(core, 0x02000020, 5);
+	core->busWrite8(core, 0x03000030, 5);
+
+	struct mCoreMemorySearchParams params;
+	_params(&params, mCORE_MEMORY_SEARCH_EQUAL, 1, 5);
+	struct mCoreMemorySearchCandidates candidates;
+	mCoreMemorySearchCandidatesInit(&candidates);
+	assert_true(mCoreMemorySearchCandidatesFind(core, &params, &candidates));
+	assert_int_equal(candidates.count, 3);
+
+	core->busWrite8(core, 0x02000010, 7);
+	core->busWrite8(core, 0x03000030, 2);
+
+	_params(&params, mCORE_MEMORY_SEARCH_DELTA_ANY, 1, 0);
+	assert_true(mCoreMemorySearchCandidatesNarrow(core, &params, &candidates));
+	assert_int_equal(candidates.count, 2);
+
+	core->busWrite8(core, 0x02000010, 8);
+	core->busWrite8(core, 0x03000030, 1);
+
+	_params(&params, mCORE_MEMORY_SEARCH_DELTA, 1, 1);
+	assert_true(mCoreMemorySearchCandidatesNarrow(core, &params, &candidates));
+	assert_int_equal(candidates.count, 1);
+
+	struct mCoreMemorySearchResults results;
+	mCoreMemorySearchResultsInit(&results, 0);
+	mCoreMemorySearchCandidatesExport(&candidates, &results, 0);
+	assert_int_equal(mCoreMemorySearchResultsSize(&results), 1);
+	assert_int_equal(mCoreMemorySearchResultsGetPointer(&results, 0)->address, 0x02000010);
+	assert_int_equal(mCoreMemorySearchResultsGetPointer(&results, 0)->oldValue, 8);
+
+	_params(&params, mCORE_MEMORY_SEARCH_DELTA_ANY, 1, 0);
+	assert_true(mCoreMemorySearchCandidatesNarrow(core, &params, &candidates));
+	assert_int_equal(candidates.count, 0);
+
+	mCoreMemorySearchResultsDeinit(&results);
+	mCoreMemorySearchCandidatesDeinit(&candidates);
+	_destroyCore(core);
+}
+
+M_TEST_DEFINE(narrowUnknown) {
+	struct mCore* core = _createCore();
+	assert_non_null(core);
+
+	struct mCoreMemorySearchParams params;
+	_params(&params, mCORE_MEMORY_SEARCH_ANY, 4, 0);
+	struct mCoreMemorySearchCandidates candidates;
+	mCoreMemorySearchCandidatesInit(&candidates);
+	assert_true(mCoreMemorySearchCandidatesFind(core, &params, &candidates));
+
+	size_t expected = 0;
+	const struct mCoreMemoryBlock* blocks;
+	size_t nBlocks = core->listMemoryBlocks(core, &blocks);
+	size_t i;
+	for (i = 0; i < nBlocks; ++i) {
+		size_t size;
+		if (!(blocks[i].flags & mCORE_MEMORY_WRITE) || !core->getMemoryBlock(core, blocks[i].id, &size)) {
+			continue;
+		}
+		if (size > blocks[i].end - blocks[i].start) {
+			size = blocks[i].end - blocks[i].start;
+		}
+		expected += size / 4;
+	}
+	assert_int_equal(candidates.count, expected);
+
+	core->busWrite32(core, 0x02000400, 0x80000000);
+	core->busWrite32(core, 0x03000400, 10);
+	_params(&params, mCORE_MEMORY_SEARCH_DELTA_NEGATIVE, 4, 0);
+	assert_true(mCoreMemorySearchCandidatesNarrow(core, &params, &candidates));
+	assert_int_equal(candidates.count, 1);
+
+	struct mCoreMemorySearchResults results;
+	mCoreMemorySearchResultsInit(&results, 0);
+	mCoreMemorySearchCandidatesExport(&candidates, &results, 0);
+	assert_int_equal(mCoreMemorySearchResultsGetPointer(&results, 0)->address, 0x02000400);
+
+	mCoreMemorySearchResultsDeinit(&results);
+	mCoreMemorySearchCandidatesDeinit(&candidates);
+	_destroyCore(core);
+}
+
+M_TEST_DEFINE(unsupported) {
+	struct mCore* core = _createCore();
+	assert_non_null(core);
+
+	struct mCoreMemorySearchParams params;
+	_params(&params, mCORE_MEMORY_SEARCH_EQUAL, 2, 1);
+	struct mCoreMemorySearchCandidates candidates;
+	mCoreMemorySearchCandidatesInit(&candidates);
+	assert_false(mCoreMemorySearchCandidatesNarrow(core, &params, &candidates));
+
+	params.align = 1;
+	assert_false(mCoreMemorySearchCandidatesFind(core, &params, &candidates));
+
+	params.type = mCORE_MEMORY_SEARCH_GUESS;
+	params.valueStr = "1";
+	assert_false(mCoreMemorySearchCandidatesFind(core, &params, &candidates));
+
+	_params(&params, mCORE_MEMORY_SEARCH_EQUAL, 2, 1);
+	assert_true(mCoreMemorySearchCandidatesFind(core, &params, &candidates));
+	params.width = 4;
+	assert_false(mCoreMemorySearchCandidatesNarrow(core, &params, &candidates));
+
+	mCoreMemorySearchCandidatesDeinit(&candidates);
+	_destroyCore(core);
+}
+#endif
+
+M_TEST_SUITE_DEFINE(mCoreMemorySearch,
+#ifdef M_CORE_GBA
+	cmocka_unit_test(findMatchesList),
+	cmocka_unit_test(narrowByDelta),
+	cmocka_unit_test(narrowUnknown),
+	cmocka_unit_test(unsupported),
+#endif
+)
@@ -0,0 +1,231 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba/core/core.h>
+#include <mgba/core/movie.h>
+#include <mgba-util/vfs.h>
+
+#ifdef M_CORE_GBA
+#include <mgba/gba/core.h>
+#include <mgba/internal/gba/gba.h>
+#include <mgba/internal/gba/io.h>
+#include <mgba/internal/gba/savedata.h>
+#endif
+
+#define MOVIE_BUFFER_SIZE 0x100000
+#define MOVIE_FRAMES 120
+
+struct MovieTest {
+	struct mCore* core;
+	struct mMovie movie;
+	color_t* video;
+	// The movie closes its file when it stops, but a file from fixed memory leaves the memory behind
+	uint8_t* buffer;
+};
+
+static uint32_t _keysFor(int frame) {
+	// Mostly idle with a few presses, like walking around
+	if (frame >= 30 && frame < 45) {
+		return 0x10;
+	}
+	if (frame >= 70 && frame < 72) {
+		return 0x1;
+	}
+	return 0;
+}
+
+static void _frameEnded(void* context) {
+	mMovieFrameEnded(context);
+}
+
+static void _keysRead(void* context) {
+	mMovieKeysRead(context);
+}
+
+#ifdef M_CORE_GBA
+static int _setupCore(void** state) {
+	struct MovieTest* test = calloc(1, sizeof(*test));
+	test->core = GBACoreCreate();
+	if (!test->core || !test->core->init(test->core)) {
+		return -1;
+	}
+	mCoreInitConfig(test->core, NULL);
+	test->video = calloc(240 * 160, sizeof(color_t));
+	test->core->setVideoBuffer(test->core, test->video, 240);
+	test->core->reset(test->core);
+	test->buffer = calloc(1, MOVIE_BUFFER_SIZE);
+	mMovieInit(&test->movie);
+
+	struct mCoreCallbacks callbacks = {
+		.videoFrameEnded = _frameEnded,
+		.keysRead = _keysRead,
+		.context = &test->movie
+	};
+	test->core->addCoreCallbacks(test->core, &callbacks);
+	*state = test;
+	return 0;
+}
+
+static int _teardownCore(void** state) {
+	struct MovieTest* test = *state;
+	mMovieDeinit(&test->movie);
+	mCoreConfigDeinit(&test->core->config);
+	test->core->deinit(test->core);
+	free(test->video);
+	free(test->buffer);
+	free(test);
+	return 0;
+}
+
+static void _record(struct MovieTest* test, unsigned checksumInterval) {
+	struct mCore* core = test->core;
+	core->busWrite32(core, BASE_WORKING_RAM, 0x12345678);
+	assert_true(mMovieRecord(&test->movie, core, VFileFromMemory(test->buffer, MOVIE_BUFFER_SIZE), checksumInterval));
+	int frame;
+	for (frame = 0; frame < MOVIE_FRAMES; ++frame) {
+		core->setKeys(core, _keysFor(frame));
+		core->runFrame(core);
+		core->busWrite32(core, BASE_WORKING_RAM | 4, _keysFor(frame) + frame);
+	}
+	assert_int_equal(test->movie.frame, MOVIE_FRAMES);
+	mMovieStop(&test->movie);
+
+	// Scramble the state so playback has to restore it from the keyframe
+	core->busWrite32(core, BASE_WORKING_RAM, 0);
+	core->runFrame(core);
+}
+
+M_TEST_DEFINE(playback) {
+	struct MovieTest* test = *state;
+	struct mCore* core = test->core;
+	_record(test, 16);
+
+	assert_true(mMoviePlay(&test->movie, core, VFileFromMemory(test->buffer, MOVIE_BUFFER_SIZE)));
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM), 0x12345678);
+	assert_int_equal(test->movie.frames, MOVIE_FRAMES);
+	int frame;
+	for (frame = 0; frame < MOVIE_FRAMES; ++frame) {
+		assert_int_equal(core->getKeys(core), _keysFor(frame));
+		assert_true(mMovieIsActive(&test->movie));
+		core->runFrame(core);
+		core->busWrite32(core, BASE_WORKING_RAM | 4, _keysFor(frame) + frame);
+	}
+	assert_int_equal(test->movie.mode, mMOVIE_FINISHED);
+	assert_int_equal(test->movie.desyncs, 0);
+}
+
+M_TEST_DEFINE(desync) {
+	struct MovieTest* test = *state;
+	struct mCore* core = test->core;
+	_record(test, 16);
+
+	assert_true(mMoviePlay(&test->movie, core, VFileFromMemory(test->buffer, MOVIE_BUFFER_SIZE)));
+	int frame;
+	for (frame = 0; frame < MOVIE_FRAMES; ++frame) {
+		core->runFrame(core);
+		core->busWrite32(core, BASE_WORKING_RAM | 4, _keysFor(frame) + frame);
+		if (frame == 40) {
+			core->busWrite32(core, BASE_WORKING_RAM | 8, 1);
+		}
+	}
+	assert_int_equal(test->movie.mode, mMOVIE_FINISHED);
+	assert_true(test->movie.desyncs > 0);
+	assert_int_equal(test->movie.firstDesync, 48);
+}
+
+M_TEST_DEFINE(compact) {
+	struct MovieTest* test = *state;
+	_record(test, 0);
+
+	assert_true(mMoviePlay(&test->movie, test->core, VFileFromMemory(test->buffer, MOVIE_BUFFER_SIZE)));
+	int frame;
+	for (frame = 0; frame < MOVIE_FRAMES; ++frame) {
+		test->core->runFrame(test->core);
+	}
+	assert_int_equal(test->movie.mode, mMOVIE_FINISHED);
+	// Five runs of three bytes each plus the end marker, however long the idle stretches are
+	assert_int_equal(test->movie.streamOffset, 16);
+	mMovieStop(&test->movie);
+}
+
+static uint32_t _readKeys(struct mCore* core) {
+	return 0x3FF ^ core->busRead16(core, BASE_IO | REG_KEYINPUT);
+}
+
+M_TEST_DEFINE(keysChangedAfterRead) {
+	struct MovieTest* test = *state;
+	struct mCore* core = test->core;
+	assert_true(mMovieRecord(&test->movie, core, VFileFromMemory(test->buffer, MOVIE_BUFFER_SIZE), 16));
+	int frame;
+	for (frame = 0; frame < MOVIE_FRAMES; ++frame) {
+		core->setKeys(core, _keysFor(frame));
+		assert_int_equal(_readKeys(core), _keysFor(frame));
+
+		// The frontend changes the keys after the game has already read them this frame
+		core->setKeys(core, _keysFor(frame + 1));
+		assert_int_equal(_readKeys(core), _keysFor(frame));
+		core->runFrame(core);
+		assert_int_equal(core->getKeys(core), _keysFor(frame + 1));
+		core->busWrite32(core, BASE_WORKING_RAM | 4, _readKeys(core) + frame);
+	}
+	mMovieStop(&test->movie);
+
+	assert_true(mMoviePlay(&test->movie, core, VFileFromMemory(test->buffer, MOVIE_BUFFER_SIZE)));
+	for (frame = 0; frame < MOVIE_FRAMES; ++frame) {
+		core->setKeys(core, 0x3FF);
+		assert_int_equal(_readKeys(core), _keysFor(frame));
+		assert_int_equal(_readKeys(core), _keysFor(frame));
+		core->runFrame(core);
+		core->busWrite32(core, BASE_WORKING_RAM | 4, _readKeys(core) + frame);
+	}
+	assert_int_equal(test->movie.mode, mMOVIE_FINISHED);
+	assert_int_equal(test->movie.desyncs, 0);
+}
+
+M_TEST_DEFINE(preserveSave) {
+	struct MovieTest* test = *state;
+	struct mCore* core = test->core;
+	struct GBA* gba = core->board;
+	uint8_t* sram = calloc(1, SIZE_CART_SRAM);
+	assert_true(core->loadSave(core, VFileFromMemory(sram, SIZE_CART_SRAM)));
+	GBASavedataForceType(&gba->memory.savedata, SAVEDATA_SRAM);
+	core->busWrite8(core, BASE_CART_SRAM, 1);
+	_record(test, 16);
+
+	// The game saved again after the movie was recorded
+	core->busWrite8(core, BASE_CART_SRAM, 2);
+	assert_int_equal(sram[0], 2);
+
+	// Playback runs from the save in the keyframe, but must not write it over the real one
+	assert_true(mMoviePlay(&test->movie, core, VFileFromMemory(test->buffer, MOVIE_BUFFER_SIZE)));
+	assert_int_equal(core->busRead8(core, BASE_CART_SRAM), 1);
+	int frame;
+	for (frame = 0; frame < MOVIE_FRAMES; ++frame) {
+		core->runFrame(core);
+		core->busWrite32(core, BASE_WORKING_RAM | 4, _keysFor(frame) + frame);
+	}
+	core->busWrite8(core, BASE_CART_SRAM, 3);
+	mMovieStop(&test->movie);
+	assert_int_equal(test->movie.desyncs, 0);
+	assert_int_equal(sram[0], 2);
+
+	// Nor does what the game saved during playback, even once the real save is put back
+	core->unloadROM(core);
+	assert_int_equal(sram[0], 2);
+	free(sram);
+}
+#endif
+
+M_TEST_SUITE_DEFINE(mCoreMovie,
+#ifdef M_CORE_GBA
+	cmocka_unit_test_setup_teardown(playback, _setupCore, _teardownCore),
+	cmocka_unit_test_setup_teardown(desync, _setupCore, _teardownCore),
+	cmocka_unit_test_setup_teardown(compact, _setupCore, _teardownCore),
+	cmocka_unit_test_setup_teardown(keysChangedAfterRead, _setupCore, _teardownCore),
+	cmocka_unit_test_setup_teardown(preserveSave, _setupCore, _teardownCore),
+#endif
+)
@@ -0,0 +1,168 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba/core/core.h>
+#include <mgba/core/rom-registry.h>
+#include <mgba-util/crc32.h>
+#include <mgba-util/vfs.h>
+
+#ifdef M_CORE_GBA
+#include <mgba/gba/core.h>
+#include <mgba/internal/gba/gba.h>
+#endif
+
+#define ROM_SIZE 0x4000
+#define MAP_SIZE 0x10000
+
+static void _fillROM(uint8_t* rom, uint8_t seed) {
+	size_t i;
+	for (i = 0; i < ROM_SIZE; ++i) {
+		rom[i] = i * 7 + seed;
+	}
+}
+
+M_TEST_DEFINE(acquireShared) {
+	uint8_t* rom = malloc(ROM_SIZE);
+	_fillROM(rom, 1);
+	uint32_t crc = doCrc32(rom, ROM_SIZE);
+	size_t images = mROMRegistrySize();
+
+	struct mROMImage* image = mROMRegistryAcquire(crc, rom, ROM_SIZE, MAP_SIZE);
+	if (!image) {
+		// Nothing gets registered on platforms without copy-on-write shared memory
+		free(rom);
+		return;
+	}
+	assert_int_equal(mROMRegistrySize(), images + 1);
+	assert_ptr_equal(mROMRegistryAcquire(crc, rom, ROM_SIZE, MAP_SIZE), image);
+	assert_int_equal(mROMRegistrySize(), images + 1);
+
+	uint8_t* a = mROMImageMap(image);
+	uint8_t* b = mROMImageMap(image);
+	assert_non_null(a);
+	assert_non_null(b);
+	assert_memory_equal(a, rom, ROM_SIZE);
+	assert_memory_equal(b, rom, ROM_SIZE);
+	assert_int_equal(a[ROM_SIZE], 0);
+
+	// Writes stay in the view they were made through
+	a[0x1234] ^= 0xFF;
+	a[ROM_SIZE + 4] = 0x55;
+	assert_int_equal(b[0x1234], rom[0x1234]);
+	assert_int_equal(b[ROM_SIZE + 4], 0);
+	uint8_t* c = mROMImageMap(image);
+	assert_int_equal(c[0x1234], rom[0x1234]);
+
+	mROMImageUnmap(image, a);
+	mROMImageUnmap(image, b);
+	mROMImageUnmap(image, c);
+	mROMRegistryRelease(image);
+	assert_int_equal(mROMRegistrySize(), images + 1);
+	mROMRegistryRelease(image);
+	assert_int_equal(mROMRegistrySize(), images);
+	free(rom);
+}
+
+M_TEST_DEFINE(collision) {
+	uint8_t* rom = malloc(ROM_SIZE);
+	_fillROM(rom, 2);
+	uint32_t crc = doCrc32(rom, ROM_SIZE);
+
+	struct mROMImage* image = mROMRegistryAcquire(crc, rom, ROM_SIZE, MAP_SIZE);
+	if (!image) {
+		free(rom);
+		return;
+	}
+	assert_null(mROMRegistryAcquire(crc, rom, ROM_SIZE / 2, MAP_SIZE));
+	rom[0x20] ^= 1;
+	assert_null(mROMRegistryAcquire(crc, rom, ROM_SIZE, MAP_SIZE));
+	mROMRegistryRelease(image);
+	free(rom);
+}
+
+#ifdef M_CORE_GBA
+static struct mCore* _loadCore(uint8_t* rom) {
+	struct mCore* core = GBACoreCreate();
+	assert_non_null(core);
+	assert_true(core->init(core));
+	mCoreInitConfig(core, NULL);
+	assert_true(core->loadROM(core, VFileFromMemory(rom, ROM_SIZE)));
+	core->reset(core);
+	return core;
+}
+
+static void _unloadCore(struct mCore* core) {
+	mCoreConfigDeinit(&core->config);
+	core->deinit(core);
+}
+
+M_TEST_DEFINE(gbaShared) {
+	uint8_t* romA = malloc(ROM_SIZE);
+	uint8_t* romB = malloc(ROM_SIZE);
+	_fillROM(romA, 3);
+	_fillROM(romB, 3);
+	size_t images = mROMRegistrySize();
+
+	struct mCore* coreA = _loadCore(romA);
+	struct mCore* coreB = _loadCore(romB);
+	struct GBA* gbaA = coreA->board;
+	struct GBA* gbaB = coreB->board;
+	if (!gbaA->romImage) {
+		_unloadCore(coreA);
+		_unloadCore(coreB);
+		free(romA);
+		free(romB);
+		return;
+	}
+	assert_ptr_equal(gbaA->romImage, gbaB->romImage);
+	assert_int_equal(mROMRegistrySize(), images + 1);
+	assert_ptr_not_equal(gbaA->memory.rom, romA);
+
+	coreA->rawWrite8(coreA, BASE_CART0 | 0x100, -1, 0xA5);
+	assert_int_equal(coreA->busRead8(coreA, BASE_CART0 | 0x100), 0xA5);
+	assert_int_equal(coreB->busRead8(coreB, BASE_CART0 | 0x100), romB[0x100]);
+	assert_ptr_equal(gbaA->romImage, gbaB->romImage);
+
+	_unloadCore(coreA);
+	assert_int_equal(mROMRegistrySize(), images + 1);
+	assert_int_equal(coreB->busRead8(coreB, BASE_CART0 | 0x100), romB[0x100]);
+	_unloadCore(coreB);
+	assert_int_equal(mROMRegistrySize(), images);
+	free(romA);
+	free(romB);
+}
+
+M_TEST_DEFINE(gbaDistinct) {
+	uint8_t* romA = malloc(ROM_SIZE);
+	uint8_t* romB = malloc(ROM_SIZE);
+	_fillROM(romA, 4);
+	_fillROM(romB, 5);
+
+	struct mCore* coreA = _loadCore(romA);
+	struct mCore* coreB = _loadCore(romB);
+	struct GBA* gbaA = coreA->board;
+	struct GBA* gbaB = coreB->board;
+	if (gbaA->romImage) {
+		assert_ptr_not_equal(gbaA->romImage, gbaB->romImage);
+	}
+	assert_int_equal(coreA->busRead8(coreA, BASE_CART0 | 0x100), romA[0x100]);
+	assert_int_equal(coreB->busRead8(coreB, BASE_CART0 | 0x100), romB[0x100]);
+	_unloadCore(coreA);
+	_unloadCore(coreB);
+	free(romA);
+	free(romB);
+}
+#endif
+
+M_TEST_SUITE_DEFINE(mROMRegistry,
+	cmocka_unit_test(acquireShared),
+	cmocka_unit_test(collision),
+#ifdef M_CORE_GBA
+	cmocka_unit_test(gbaShared),
+	cmocka_unit_test(gbaDistinct),
+#endif
+)
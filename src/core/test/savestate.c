@@ -0,0 +1,222 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba/core/core.h>
+#include <mgba/core/serialize.h>
+#include <mgba-util/memory.h>
+#include <mgba-util/vfs.h>
+
+#ifdef M_CORE_GBA
+#include <mgba/gba/core.h>
+#endif
+
+static struct mCore* _createCore(struct mCore* (*create)(void)) {
+	struct mCore* core = create();
+	if (!core || !core->init(core)) {
+		return NULL;
+	}
+	mCoreInitConfig(core, NULL);
+	core->reset(core);
+	return core;
+}
+
+static void _destroyCore(struct mCore* core) {
+	mCoreConfigDeinit(&core->config);
+	core->deinit(core);
+}
+
+static void _writeLZHeader(struct VFile* vf, uint32_t stateSize) {
+	uint32_t header[4] = {0};
+	memcpy(header, "mLZS", 4);
+	STORE_32LE(1, 0, &header[1]);
+	STORE_32LE(stateSize, 0, &header[2]);
+	vf->write(vf, header, sizeof(header));
+}
+
+static void _writeLZRawChunk(struct VFile* vf, uint32_t tag, uint32_t offset, const void* data, uint32_t size) {
+	uint32_t chunk[4];
+	STORE_32LE(tag, 0, &chunk[0]);
+	STORE_32LE(offset, 0, &chunk[1]);
+	STORE_32LE(size, 0, &chunk[2]);
+	STORE_32LE(size, 0, &chunk[3]);
+	vf->write(vf, chunk, sizeof(chunk));
+	if (size) {
+		vf->write(vf, data, size);
+	}
+}
+
+#ifdef M_CORE_GBA
+M_TEST_DEFINE(gbaRoundTrip) {
+	struct mCore* core = _createCore(GBACoreCreate);
+	assert_non_null(core);
+	// Give the state some savedata to carry
+	core->busWrite8(core, 0x0E000000, 0x5A);
+
+	size_t size = mCoreStateBufferSize(core, SAVESTATE_SAVEDATA);
+	assert_true(size > core->stateSize(core));
+	uint8_t* buffer = anonymousMemoryMap(size);
+	uint8_t* first = anonymousMemoryMap(size);
+	uint8_t* second = anonymousMemoryMap(size);
+
+	assert_int_equal(mCoreSaveStateInto(core, buffer, size - 1, SAVESTATE_SAVEDATA), 0);
+	assert_int_equal(mCoreSaveStateInto(core, buffer, size, 0), core->stateSize(core));
+	assert_int_equal(mCoreSaveStateInto(core, buffer, size, SAVESTATE_SAVEDATA), size);
+
+	core->busWrite8(core, 0x0E000000, 0xA5);
+	core->busWrite32(core, 0x02000000, 0x12345678);
+	core->runFrame(core);
+	assert_true(mCoreLoadStateFrom(core, buffer, size, SAVESTATE_SAVEDATA));
+	assert_int_equal(core->busRead8(core, 0x0E000000), 0x5A);
+	assert_int_equal(core->busRead32(core, 0x02000000), 0);
+	assert_int_equal(mCoreSaveStateInto(core, first, size, SAVESTATE_SAVEDATA), size);
+
+	// Loading the same buffer again has to land in exactly the same place
+	core->runFrame(core);
+	assert_true(mCoreLoadStateFrom(core, buffer, size, SAVESTATE_SAVEDATA));
+	assert_int_equal(mCoreSaveStateInto(core, second, size, SAVESTATE_SAVEDATA), size);
+	assert_memory_equal(first, second, size);
+
+	assert_false(mCoreLoadStateFrom(core, buffer, core->stateSize(core) - 1, 0));
+
+	mappedMemoryFree(buffer, size);
+	mappedMemoryFree(first, size);
+	mappedMemoryFree(second, size);
+	_destroyCore(core);
+}
+
+M_TEST_DEFINE(gbaCompressed) {
+	struct mCore* core = _createCore(GBACoreCreate);
+	assert_non_null(core);
+	core->busWrite8(core, 0x0E000000, 0x5A);
+	core->busWrite32(core, 0x02000000, 0x12345678);
+
+	struct VFile* raw = VFileMemChunk(NULL, 0);
+	struct VFile* vf = VFileMemChunk(NULL, 0);
+	assert_true(mCoreSaveStateNamed(core, raw, SAVESTATE_SAVEDATA | SAVESTATE_METADATA));
+	assert_true(mCoreSaveStateNamed(core, vf, SAVESTATE_SAVEDATA | SAVESTATE_METADATA | SAVESTATE_COMPRESSED));
+	assert_true(vf->size(vf) < raw->size(raw) / 4);
+
+	// Both containers have to hold exactly the same state
+	void* rawState = mCoreExtractState(core, raw, NULL);
+	void* lzState = mCoreExtractState(core, vf, NULL);
+	assert_non_null(rawState);
+	assert_non_null(lzState);
+	assert_memory_equal(rawState, lzState, core->stateSize(core));
+	mappedMemoryFree(rawState, core->stateSize(core));
+	mappedMemoryFree(lzState, core->stateSize(core));
+
+	struct mStateExtdata extdata;
+	struct mStateExtdataItem item;
+	mStateExtdataInit(&extdata);
+	assert_true(mCoreExtractExtdata(core, vf, &extdata));
+	assert_true(mStateExtdataGet(&extdata, EXTDATA_META_CREATOR, &item));
+	assert_non_null(item.data);
+	assert_true(mStateExtdataGet(&extdata, EXTDATA_SAVEDATA, &item));
+	assert_non_null(item.data);
+	mStateExtdataDeinit(&extdata);
+
+	core->busWrite8(core, 0x0E000000, 0xA5);
+	core->busWrite32(core, 0x02000000, 0);
+	assert_true(mCoreLoadStateNamed(core, vf, SAVESTATE_SAVEDATA));
+	assert_int_equal(core->busRead8(core, 0x0E000000), 0x5A);
+	assert_int_equal(core->busRead32(core, 0x02000000), 0x12345678);
+
+	// A truncated file must not load
+	size_t size = vf->size(vf);
+	void* contents = vf->map(vf, size, MAP_READ);
+	struct VFile* truncated = VFileMemChunk(contents, size / 2);
+	vf->unmap(vf, contents, size);
+	assert_false(mCoreLoadStateNamed(core, truncated, 0));
+
+	truncated->close(truncated);
+	vf->close(vf);
+	raw->close(raw);
+	_destroyCore(core);
+}
+
+M_TEST_DEFINE(gbaCompressedSections) {
+	struct mCore* core = _createCore(GBACoreCreate);
+	assert_non_null(core);
+	core->busWrite32(core, 0x02000000, 0x12345678);
+	size_t stateSize = core->stateSize(core);
+	const struct mCoreStateSection* sections;
+	size_t nSections = core->listStateSections(core, &sections);
+	assert_true(nSections > 0);
+
+	struct VFile* vf = VFileMemChunk(NULL, 0);
+	assert_true(mCoreSaveStateNamed(core, vf, 0));
+	void* data = mCoreExtractState(core, vf, NULL);
+	assert_non_null(data);
+	assert_true(mCoreSaveStateNamed(core, vf, SAVESTATE_COMPRESSED));
+
+	// Each section is its own chunk, in order, with nothing else in between
+	size_t section = 0;
+	size_t offset = 0;
+	vf->seek(vf, 16, SEEK_SET);
+	while (true) {
+		uint32_t chunk[4];
+		assert_int_equal(vf->read(vf, chunk, sizeof(chunk)), sizeof(chunk));
+		uint32_t tag, chunkOffset, size, storedSize;
+		LOAD_32LE(tag, 0, &chunk[0]);
+		LOAD_32LE(chunkOffset, 0, &chunk[1]);
+		LOAD_32LE(size, 0, &chunk[2]);
+		LOAD_32LE(storedSize, 0, &chunk[3]);
+		if (!tag) {
+			break;
+		}
+		vf->seek(vf, storedSize, SEEK_CUR);
+		if (tag < 0x10000) {
+			continue;
+		}
+		assert_int_equal(chunkOffset, offset);
+		if (tag != 0x10000) {
+			assert_true(section < nSections);
+			assert_int_equal(tag, 0x10000 + sections[section].id);
+			assert_int_equal(chunkOffset, sections[section].offset);
+			assert_int_equal(size, sections[section].size);
+			++section;
+		}
+		offset += size;
+	}
+	assert_int_equal(section, nSections);
+	assert_int_equal(offset, stateSize);
+	vf->close(vf);
+
+	// Untagged blocks that don't follow the sections still load
+	vf = VFileMemChunk(NULL, 0);
+	_writeLZHeader(vf, stateSize);
+	for (offset = 0; offset < stateSize; offset += 0x10000) {
+		size_t size = stateSize - offset < 0x10000 ? stateSize - offset : 0x10000;
+		_writeLZRawChunk(vf, 0x10000, offset, (uint8_t*) data + offset, size);
+	}
+	_writeLZRawChunk(vf, 0, 0, NULL, 0);
+	core->busWrite32(core, 0x02000000, 0);
+	assert_true(mCoreLoadStateNamed(core, vf, 0));
+	assert_int_equal(core->busRead32(core, 0x02000000), 0x12345678);
+	vf->close(vf);
+
+	// A chunk claiming to be a section it doesn't line up with is rejected
+	vf = VFileMemChunk(NULL, 0);
+	_writeLZHeader(vf, stateSize);
+	_writeLZRawChunk(vf, 0x10000 + sections[nSections - 1].id, 0, data, sections[nSections - 1].size);
+	_writeLZRawChunk(vf, 0x10000, sections[nSections - 1].size, (uint8_t*) data + sections[nSections - 1].size, stateSize - sections[nSections - 1].size);
+	_writeLZRawChunk(vf, 0, 0, NULL, 0);
+	assert_false(mCoreLoadStateNamed(core, vf, 0));
+	vf->close(vf);
+
+	mappedMemoryFree(data, stateSize);
+	_destroyCore(core);
+}
+#endif
+
+M_TEST_SUITE_DEFINE(mCoreSavestate,
+#ifdef M_CORE_GBA
+	cmocka_unit_test(gbaRoundTrip),
+	cmocka_unit_test(gbaCompressed),
+	cmocka_unit_test(gbaCompressedSections),
+#endif
+)
@@ -296,6 +296,141 @@ M_TEST_DEFINE(memoryWrite) {
 	mScriptContextDeinit(&context);
 }
 
+M_TEST_DEFINE(memoryView) {
+	SETUP_LUA;
+	CREATE_CORE;
+	core->reset(core);
+
+	int i;
+	for (i = 0; i < 12; ++i) {
+		core->busWrite8(core, RAM_BASE + i, i + 1);
+	}
+	core->busWrite8(core, RAM_BASE + 12, 0xFE);
+
+	LOAD_PROGRAM(
+		"for _, d in pairs(emu.memory) do\n"
+		"	if d:base() == base then domain = d end\n"
+		"end\n"
+		"view = domain:view(0, 16)\n"
+		"assert(view:valid())\n"
+		"assert(not domain:view(domain:size() - 1, 2))\n"
+		"a8 = view:read8(1)\n"
+		"a16 = view:read16(4)\n"
+		"a32 = view:read32(8)\n"
+		"oob = view:read32(14)\n"
+		"range = view:readRange(2, 3)\n"
+		"assert(view:field(\"word\", 8, \"u32\"))\n"
+		"assert(view:field(\"signed\", 12, \"s8\"))\n"
+		"assert(not view:field(\"past\", 14, \"u32\"))\n"
+		"assert(not view:field(\"bad\", 0, \"f32\"))\n"
+		"word = view.word\n"
+		"signed = view.signed\n"
+		"sub = view:view(8, 8)\n"
+		"subWord = sub.word\n"
+		"subBase = sub:base()\n"
+		"assert(not view:view(8, 9))\n"
+		"view:capture()\n"
+		"view:write8(0, 0x55)\n"
+	);
+	struct mScriptValue base = mSCRIPT_MAKE_S32(RAM_BASE);
+	lua->setGlobal(lua, "base", &base);
+	assert_true(lua->run(lua));
+
+	TEST_VALUE(S32, "a8", 2);
+	TEST_VALUE(S32, "a16", 0x0605);
+	TEST_VALUE(S32, "a32", 0x0C0B0A09);
+	TEST_VALUE(S32, "oob", 0);
+	TEST_VALUE(S32, "word", 0x0C0B0A09);
+	TEST_VALUE(S32, "signed", -2);
+	TEST_VALUE(S32, "subBase", RAM_BASE + 8);
+	struct mScriptValue* range = lua->getGlobal(lua, "range");
+	assert_non_null(range);
+	assert_int_equal(range->value.string->size, 3);
+	assert_memory_equal(range->value.string->buffer, "\3\4\5", 3);
+	mScriptValueDeref(range);
+	assert_int_equal(core->busRead8(core, RAM_BASE), 0x55);
+
+	// A captured view keeps its copy until it's released
+	core->busWrite8(core, RAM_BASE + 1, 0x66);
+	LOAD_PROGRAM(
+		"captured = view:read8(1)\n"
+		"written = view:read8(0)\n"
+		"view:release()\n"
+		"live = view:read8(1)\n"
+	);
+	assert_true(lua->run(lua));
+	TEST_VALUE(S32, "captured", 2);
+	TEST_VALUE(S32, "written", 0x55);
+	TEST_VALUE(S32, "live", 0x66);
+
+	mScriptContextDetachCore(&context);
+	LOAD_PROGRAM(
+		"assert(not view:valid())\n"
+		"stale = view:read8(1)\n"
+	);
+	assert_true(lua->run(lua));
+	TEST_VALUE(S32, "stale", 0);
+
+	TEARDOWN_CORE;
+	mScriptContextDeinit(&context);
+}
+
+#if defined(M_CORE_GBA) && defined(USE_DEBUGGERS)
+M_TEST_DEFINE(memoryCallbacks) {
+	SETUP_LUA;
+	mScriptContextAttachStdlib(&context);
+	CREATE_CORE;
+	// mov r1, #0x03000000; loop: ldr r0, [r1]; add r0, r0, #1; str r0, [r1, #4]; b loop
+	core->busWrite32(core, 0x020000C0, 0xE3A01403);
+	core->busWrite32(core, 0x020000C4, 0xE5910000);
+	core->busWrite32(core, 0x020000C8, 0xE2800001);
+	core->busWrite32(core, 0x020000CC, 0xE5810004);
+	core->busWrite32(core, 0x020000D0, 0xEAFFFFFB);
+	core->reset(core);
+	core->busWrite32(core, 0x03000000, 0x41);
+
+	LOAD_PROGRAM(
+		"reads = 0\n"
+		"executes = 0\n"
+		"writes = 0\n"
+		"readId = callbacks:onRead(0x03000000, 4, function(address, value) reads = reads + 1 read = value end)\n"
+		"executeId = callbacks:onExecute(0x020000C8, 4, function(address) executes = executes + 1 end)\n"
+		"callbacks:onWrite(0x03000006, 2, function(address, value) writes = writes + 1 written = value end, C.CALLBACK_BATCH.FRAME)\n"
+	);
+	assert_true(lua->run(lua));
+	assert_non_null(core->debugger);
+
+	mDebuggerRunFrame(core->debugger);
+	mScriptContextFlushMemoryCallbacks(&context, true);
+	LOAD_PROGRAM(
+		"assert(reads > 0)\n"
+		"assert(executes == reads)\n"
+		"assert(read == 0x41)\n"
+		"assert(writes == 1)\n"
+		"assert(written == 0x42)\n"
+		"callbacks:remove(readId)\n"
+		"callbacks:remove(executeId)\n"
+		"reads = 0\n"
+		"executes = 0\n"
+	);
+	assert_true(lua->run(lua));
+
+	mDebuggerRunFrame(core->debugger);
+	mScriptContextFlushMemoryCallbacks(&context, true);
+	LOAD_PROGRAM(
+		"assert(reads == 0)\n"
+		"assert(executes == 0)\n"
+		"assert(writes == 2)\n"
+	);
+	assert_true(lua->run(lua));
+
+	mScriptContextDetachCore(&context);
+	assert_null(core->debugger);
+	TEARDOWN_CORE;
+	mScriptContextDeinit(&context);
+}
+#endif
+
 M_TEST_DEFINE(logging) {
 	SETUP_LUA;
 	struct mScriptTestLogger logger;
@@ -331,5 +466,9 @@ M_TEST_SUITE_DEFINE_SETUP_TEARDOWN(mScriptCore,
 	cmocka_unit_test(runFrame),
 	cmocka_unit_test(memoryRead),
 	cmocka_unit_test(memoryWrite),
+	cmocka_unit_test(memoryView),
+#if defined(M_CORE_GBA) && defined(USE_DEBUGGERS)
+	cmocka_unit_test(memoryCallbacks),
+#endif
 	cmocka_unit_test(logging),
 )
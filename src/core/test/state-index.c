@@ -0,0 +1,211 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba/core/core.h>
+#include <mgba/core/state-index.h>
+#include <mgba-util/vfs.h>
+
+#ifdef M_CORE_GBA
+#include <mgba/gba/core.h>
+#endif
+
+static void _makeEntry(struct mStateIndexEntry* entry, unsigned width, unsigned height, color_t fill) {
+	color_t* pixels = malloc(width * height * sizeof(*pixels));
+	unsigned i;
+	for (i = 0; i < width * height; ++i) {
+		pixels[i] = fill;
+	}
+	mStateIndexEntryInit(entry);
+	mStateIndexEntrySetThumbnail(entry, pixels, width, height, width);
+	entry->creationUsec = 0x123456789ULL;
+	entry->frameCount = 1234;
+	entry->stateSize = 5678;
+	entry->stateCrc32 = 0xDEADBEEF;
+	strncpy(entry->creator, "test", sizeof(entry->creator));
+	free(pixels);
+}
+
+M_TEST_DEFINE(thumbnail) {
+	// Every 2x2 cell averages down to a single pixel
+	color_t pixels[4 * 4] = {
+		0x1084, 0x1084, 0x0000, 0x0000,
+		0x1084, 0x1084, 0x1084, 0x1084,
+		0x0000, 0x0000, 0x0000, 0x0000,
+		0x0000, 0x0000, 0x0000, 0x0000,
+	};
+	struct mStateIndexEntry entry;
+	mStateIndexEntryInit(&entry);
+	mStateIndexEntrySetThumbnail(&entry, pixels, 4, 4, 4);
+	assert_int_equal(entry.width, 2);
+	assert_int_equal(entry.height, 2);
+	assert_int_equal(entry.thumbnail[0], 0x1084);
+	assert_int_equal(entry.thumbnail[1], 0x0842);
+	assert_int_equal(entry.thumbnail[2], 0);
+	assert_int_equal(entry.thumbnail[3], 0);
+	mStateIndexEntryDeinit(&entry);
+}
+
+M_TEST_DEFINE(roundTrip) {
+	struct VFile* vf = VFileMemChunk(NULL, 0);
+	struct mStateIndexEntry entry;
+	struct mStateIndexEntry readback;
+	_makeEntry(&entry, 16, 8, 0x1234);
+	mStateIndexEntryInit(&readback);
+
+	assert_false(mStateIndexRead(vf, 3, &readback));
+	assert_true(mStateIndexWrite(vf, 3, &entry));
+	assert_false(mStateIndexRead(vf, 2, &readback));
+	assert_true(mStateIndexRead(vf, 3, &readback));
+	assert_int_equal(readback.width, 8);
+	assert_int_equal(readback.height, 4);
+	assert_memory_equal(readback.thumbnail, entry.thumbnail, 8 * 4 * sizeof(color_t));
+	assert_true(readback.creationUsec == entry.creationUsec);
+	assert_int_equal(readback.frameCount, 1234);
+	assert_int_equal(readback.stateSize, 5678);
+	assert_int_equal(readback.stateCrc32, 0xDEADBEEF);
+	assert_string_equal(readback.creator, "test");
+
+	// Writing another slot leaves the first one alone
+	entry.stateSize = 1;
+	assert_true(mStateIndexWrite(vf, 0, &entry));
+	assert_true(mStateIndexRead(vf, 3, &readback));
+	assert_int_equal(readback.stateSize, 5678);
+	assert_true(mStateIndexRead(vf, 0, &readback));
+	assert_int_equal(readback.stateSize, 1);
+
+	mStateIndexInvalidate(vf, 3);
+	assert_false(mStateIndexRead(vf, 3, &readback));
+	assert_true(mStateIndexRead(vf, 0, &readback));
+
+	assert_false(mStateIndexWrite(vf, mSTATE_INDEX_SLOTS, &entry));
+	assert_false(mStateIndexRead(vf, -1, &readback));
+
+	mStateIndexEntryDeinit(&readback);
+	mStateIndexEntryDeinit(&entry);
+	vf->close(vf);
+}
+
+M_TEST_DEFINE(resize) {
+	struct VFile* vf = VFileMemChunk(NULL, 0);
+	struct mStateIndexEntry entry;
+	struct mStateIndexEntry readback;
+	_makeEntry(&entry, 16, 8, 0x1234);
+	mStateIndexEntryInit(&readback);
+	assert_true(mStateIndexWrite(vf, 1, &entry));
+	mStateIndexEntryDeinit(&entry);
+
+	// A different screen size makes every stored thumbnail useless, so the index starts over
+	_makeEntry(&entry, 8, 8, 0x4321);
+	assert_true(mStateIndexWrite(vf, 2, &entry));
+	assert_false(mStateIndexRead(vf, 1, &readback));
+	assert_true(mStateIndexRead(vf, 2, &readback));
+	assert_int_equal(readback.width, 4);
+	assert_int_equal(readback.thumbnail[0], 0x4321);
+
+	// Garbage isn't mistaken for an index
+	vf->seek(vf, 0, SEEK_SET);
+	vf->write(vf, "junk", 4);
+	assert_false(mStateIndexRead(vf, 2, &readback));
+
+	mStateIndexEntryDeinit(&readback);
+	mStateIndexEntryDeinit(&entry);
+	vf->close(vf);
+}
+
+M_TEST_DEFINE(verify) {
+	struct VFile* vf = VFileMemChunk(NULL, 0);
+	vf->write(vf, "state one", 9);
+	struct mStateIndexEntry entry;
+	mStateIndexEntryInit(&entry);
+	mStateIndexEntrySetState(&entry, vf);
+	assert_int_equal(entry.stateSize, 9);
+	assert_true(mStateIndexVerify(vf, &entry));
+
+	// A state rewritten behind the index's back is caught even if its size didn't change
+	vf->seek(vf, 0, SEEK_SET);
+	vf->write(vf, "state two", 9);
+	assert_false(mStateIndexVerify(vf, &entry));
+
+	vf->seek(vf, 0, SEEK_END);
+	vf->write(vf, "!", 1);
+	mStateIndexEntrySetState(&entry, vf);
+	assert_true(mStateIndexVerify(vf, &entry));
+	vf->truncate(vf, 9);
+	assert_false(mStateIndexVerify(vf, &entry));
+
+	mStateIndexEntryDeinit(&entry);
+	vf->close(vf);
+}
+
+M_TEST_DEFINE(verifyHeader) {
+	// Only the leading mSTATE_INDEX_CRC_SIZE bytes are checksummed, so the menu never reads a whole state
+	size_t size = mSTATE_INDEX_CRC_SIZE * 4;
+	uint8_t* data = calloc(size, 1);
+	memcpy(data, "state one", 9);
+	struct VFile* vf = VFileMemChunk(data, size);
+	struct mStateIndexEntry entry;
+	mStateIndexEntryInit(&entry);
+	mStateIndexEntrySetStateBuffer(&entry, data, size);
+	assert_int_equal(entry.stateSize, size);
+	assert_true(mStateIndexVerify(vf, &entry));
+
+	struct mStateIndexEntry fromFile;
+	mStateIndexEntryInit(&fromFile);
+	mStateIndexEntrySetState(&fromFile, vf);
+	assert_int_equal(fromFile.stateCrc32, entry.stateCrc32);
+	mStateIndexEntryDeinit(&fromFile);
+
+	vf->seek(vf, mSTATE_INDEX_CRC_SIZE, SEEK_SET);
+	vf->write(vf, "past the header", 15);
+	assert_true(mStateIndexVerify(vf, &entry));
+	vf->seek(vf, mSTATE_INDEX_CRC_SIZE - 1, SEEK_SET);
+	vf->write(vf, "!", 1);
+	assert_false(mStateIndexVerify(vf, &entry));
+
+	mStateIndexEntryDeinit(&entry);
+	vf->close(vf);
+	free(data);
+}
+
+#ifdef M_CORE_GBA
+M_TEST_DEFINE(capture) {
+	struct mCore* core = GBACoreCreate();
+	assert_non_null(core);
+	assert_true(core->init(core));
+	mCoreInitConfig(core, NULL);
+	color_t* buffer = calloc(240 * 160, sizeof(*buffer));
+	core->setVideoBuffer(core, buffer, 240);
+	core->reset(core);
+	core->runFrame(core);
+
+	struct mStateIndexEntry entry;
+	mStateIndexEntryInit(&entry);
+	mStateIndexEntryCapture(&entry, core);
+	assert_int_equal(entry.width, 240 >> mSTATE_THUMBNAIL_SHIFT);
+	assert_int_equal(entry.height, 160 >> mSTATE_THUMBNAIL_SHIFT);
+	assert_non_null(entry.thumbnail);
+	assert_int_equal(entry.frameCount, core->frameCounter(core));
+	assert_true(entry.creationUsec > 0);
+	assert_true(strlen(entry.creator) > 0);
+	mStateIndexEntryDeinit(&entry);
+
+	mCoreConfigDeinit(&core->config);
+	core->deinit(core);
+	free(buffer);
+}
+#endif
+
+M_TEST_SUITE_DEFINE(mCoreStateIndex,
+	cmocka_unit_test(thumbnail),
+	cmocka_unit_test(roundTrip),
+	cmocka_unit_test(resize),
+	cmocka_unit_test(verify),
+	cmocka_unit_test(verifyHeader),
+#ifdef M_CORE_GBA
+	cmocka_unit_test(capture),
+#endif
+)
@@ -0,0 +1,156 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba/core/audio-resampler.h>
+#include <mgba/core/sync.h>
+
+static void _fill(int16_t* samples, size_t count, int16_t base) {
+	size_t i;
+	for (i = 0; i < count; ++i) {
+		samples[i * 2] = base + i;
+		samples[i * 2 + 1] = -(base + i);
+	}
+}
+
+M_TEST_DEFINE(ringWrap) {
+	struct mCoreAudioRing ring;
+	mCoreAudioRingInit(&ring, 7, 48000);
+	assert_int_equal(mCoreAudioRingCapacity(&ring), 8);
+
+	int16_t input[8 * 2];
+	int16_t output[8 * 2];
+	_fill(input, 6, 0);
+	assert_int_equal(mCoreAudioRingWrite(&ring, input, 6), 6);
+	assert_int_equal(mCoreAudioRingRead(&ring, output, 4), 4);
+	assert_memory_equal(output, input, 4 * 2 * sizeof(int16_t));
+
+	// This write straddles the end of the buffer and only 6 frames fit
+	_fill(input, 8, 100);
+	assert_int_equal(mCoreAudioRingWrite(&ring, input, 8), 6);
+	assert_int_equal(mCoreAudioRingSize(&ring), 8);
+	assert_int_equal(mCoreAudioRingRead(&ring, output, 8), 8);
+	assert_int_equal(output[0], 4);
+	assert_int_equal(output[3], -5);
+	assert_memory_equal(&output[4], input, 6 * 2 * sizeof(int16_t));
+	assert_int_equal(mCoreAudioRingRead(&ring, output, 8), 0);
+	mCoreAudioRingDeinit(&ring);
+}
+
+M_TEST_DEFINE(ringRate) {
+	struct mCoreAudioRing ring;
+	mCoreAudioRingInit(&ring, 64, 48000);
+	int16_t input[64 * 2] = {0};
+
+	double empty = mCoreAudioRingRate(&ring);
+	mCoreAudioRingWrite(&ring, input, 32);
+	double half = mCoreAudioRingRate(&ring);
+	mCoreAudioRingWrite(&ring, input, 32);
+	double full = mCoreAudioRingRate(&ring);
+
+	assert_true(empty > half);
+	assert_true(half > full);
+	assert_true(half == 48000.);
+	assert_true(empty <= 48000. * (1. + ring.maxRateDelta));
+	assert_true(full >= 48000. * (1. - ring.maxRateDelta));
+	mCoreAudioRingDeinit(&ring);
+}
+
+M_TEST_DEFINE(ringResampled) {
+	struct mCoreAudioRing ring;
+	struct mAudioResampler resampler;
+	mCoreAudioRingInit(&ring, 256, 32768);
+	mAudioResamplerInit(&resampler, 1024, mAUDIO_RESAMPLER_FAST);
+	mAudioResamplerSetInputRate(&resampler, 32768);
+	mAudioResamplerSetOutputRate(&resampler, 32768);
+
+	struct mStereoSample samples[512];
+	size_t i;
+	for (i = 0; i < 512; ++i) {
+		samples[i].left = 500;
+		samples[i].right = -500;
+	}
+	mAudioResamplerWrite(&resampler, samples, 512);
+	size_t available = mAudioResamplerAvailable(&resampler);
+	assert_true(available > 256);
+
+	// Only as much as fits is moved; the rest stays in the resampler
+	assert_int_equal(mCoreAudioRingWriteResampled(&ring, &resampler), 256);
+	assert_int_equal(mAudioResamplerAvailable(&resampler), available - 256);
+
+	int16_t output[256 * 2];
+	assert_int_equal(mCoreAudioRingRead(&ring, output, 256), 256);
+	assert_int_equal(output[200 * 2], 500);
+	assert_int_equal(output[200 * 2 + 1], -500);
+
+	mAudioResamplerDeinit(&resampler);
+	mCoreAudioRingDeinit(&ring);
+}
+
+M_TEST_DEFINE(produceRing) {
+	struct mCoreSync sync = {0};
+	struct mCoreAudioRing ring;
+	struct mAudioResampler resampler;
+	MutexInit(&sync.audioBufferMutex);
+	ConditionInit(&sync.audioRequiredCond);
+	mCoreAudioRingInit(&ring, 1024, 48000);
+	mAudioResamplerInit(&resampler, 1024, mAUDIO_RESAMPLER_FAST);
+	mAudioResamplerSetInputRate(&resampler, 32768);
+	mAudioResamplerSetOutputRate(&resampler, 48000);
+	mCoreSyncSetAudioRing(&sync, &ring);
+
+	struct mStereoSample samples[256] = {0};
+	mAudioResamplerWrite(&resampler, samples, 256);
+	size_t available = mAudioResamplerAvailable(&resampler);
+	mCoreSyncLockAudio(&sync);
+	mCoreSyncProduceResampledAudio(&sync, &resampler, 256);
+
+	// Producing drains into the ring and speeds up while it's under half full
+	assert_int_equal(mAudioResamplerAvailable(&resampler), 0);
+	assert_int_equal(mCoreAudioRingSize(&ring), available);
+	assert_true(resampler.outputRate > 48000.);
+
+	mCoreSyncSetAudioRing(&sync, NULL);
+	mAudioResamplerDeinit(&resampler);
+	mCoreAudioRingDeinit(&ring);
+	ConditionDeinit(&sync.audioRequiredCond);
+	MutexDeinit(&sync.audioBufferMutex);
+}
+
+M_TEST_DEFINE(produceRingLargeBuffer) {
+	struct mCoreSync sync = {0};
+	struct mCoreAudioRing ring;
+	struct mAudioResampler resampler;
+	MutexInit(&sync.audioBufferMutex);
+	ConditionInit(&sync.audioRequiredCond);
+	mCoreAudioRingInit(&ring, 64, 32768);
+	mAudioResamplerInit(&resampler, 1024, mAUDIO_RESAMPLER_FAST);
+	mAudioResamplerSetInputRate(&resampler, 32768);
+	mAudioResamplerSetOutputRate(&resampler, 32768);
+	mCoreSyncSetAudioRing(&sync, &ring);
+	sync.audioWait = true;
+
+	int16_t input[16 * 2] = {0};
+	mCoreAudioRingWrite(&ring, input, 16);
+
+	// Asking for more than the ring holds waits for half of it instead of forever
+	mCoreSyncLockAudio(&sync);
+	mCoreSyncProduceResampledAudio(&sync, &resampler, 256);
+	assert_int_equal(mCoreAudioRingSize(&ring), 16);
+
+	mCoreSyncSetAudioRing(&sync, NULL);
+	mAudioResamplerDeinit(&resampler);
+	mCoreAudioRingDeinit(&ring);
+	ConditionDeinit(&sync.audioRequiredCond);
+	MutexDeinit(&sync.audioBufferMutex);
+}
+
+M_TEST_SUITE_DEFINE(mCoreSync,
+	cmocka_unit_test(ringWrap),
+	cmocka_unit_test(ringRate),
+	cmocka_unit_test(ringResampled),
+	cmocka_unit_test(produceRing),
+	cmocka_unit_test(produceRingLargeBuffer))
@@ -0,0 +1,146 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba/core/tile-cache.h>
+
+struct TileCacheTest {
+	struct mTileCache cache;
+	uint16_t vram[0x100];
+};
+
+static void _configure(struct TileCacheTest* test, unsigned bpp) {
+	mTileCacheSystemInfo sysconfig = 0;
+	sysconfig = mTileCacheSystemInfoSetPaletteBPP(sysconfig, bpp);
+	sysconfig = mTileCacheSystemInfoSetPaletteCount(sysconfig, 1);
+	sysconfig = mTileCacheSystemInfoSetMaxTiles(sysconfig, 4);
+	mTileCacheConfigureSystem(&test->cache, sysconfig, 0, 0);
+	memset(test->vram, 0, sizeof(test->vram));
+	test->cache.vram = test->vram;
+
+	unsigned entries = 2 << (1 << bpp);
+	unsigned i;
+	for (i = 0; i < entries; ++i) {
+		mTileCacheWritePalette(&test->cache, i, i * 0x10101);
+	}
+}
+
+M_TEST_SUITE_SETUP(mTileCache) {
+	struct TileCacheTest* test = calloc(1, sizeof(*test));
+	mTileCacheInit(&test->cache);
+	mTileCacheConfigure(&test->cache, mTileCacheConfigurationFillShouldStore(0));
+	*state = test;
+	return 0;
+}
+
+M_TEST_SUITE_TEARDOWN(mTileCache) {
+	struct TileCacheTest* test = *state;
+	mTileCacheDeinit(&test->cache);
+	free(test);
+	return 0;
+}
+
+M_TEST_DEFINE(decode2bpp) {
+	struct TileCacheTest* test = *state;
+	_configure(test, 1);
+	uint8_t* vram = (uint8_t*) test->vram;
+	vram[16] = 0xA5;
+	vram[17] = 0x0F;
+
+	const uint8_t* indexed = mTileCacheGetIndexedTile(&test->cache, 1);
+	static const uint8_t expected[8] = { 1, 0, 1, 0, 2, 3, 2, 3 };
+	assert_memory_equal(indexed, expected, sizeof(expected));
+	assert_int_equal(indexed[8], 0);
+}
+
+M_TEST_DEFINE(decode4bpp) {
+	struct TileCacheTest* test = *state;
+	_configure(test, 2);
+	uint8_t* vram = (uint8_t*) test->vram;
+	size_t i;
+	for (i = 0; i < 32; ++i) {
+		vram[32 + i] = i * 0x37;
+	}
+
+	const uint8_t* indexed = mTileCacheGetIndexedTile(&test->cache, 1);
+	for (i = 0; i < 32; ++i) {
+		assert_int_equal(indexed[i * 2], vram[32 + i] & 0xF);
+		assert_int_equal(indexed[i * 2 + 1], vram[32 + i] >> 4);
+	}
+
+	const color_t* tile = mTileCacheGetTile(&test->cache, 1, 1);
+	for (i = 0; i < 64; ++i) {
+		if (indexed[i]) {
+			assert_int_equal(tile[i], ((indexed[i] + 16) * 0x10101) | 0xFF000000);
+		} else {
+			assert_int_equal(tile[i], 16 * 0x10101);
+		}
+	}
+}
+
+M_TEST_DEFINE(decode8bpp) {
+	struct TileCacheTest* test = *state;
+	_configure(test, 3);
+	uint8_t* vram = (uint8_t*) test->vram;
+	size_t i;
+	for (i = 0; i < 64; ++i) {
+		vram[64 * 2 + i] = i * 3;
+	}
+	assert_memory_equal(mTileCacheGetIndexedTile(&test->cache, 2), &vram[128], 64);
+	assert_null(mTileCacheGetIndexedTile(&test->cache, 4));
+}
+
+M_TEST_DEFINE(paletteRecolor) {
+	struct TileCacheTest* test = *state;
+	_configure(test, 2);
+	uint8_t* vram = (uint8_t*) test->vram;
+	vram[0] = 0x21;
+
+	const color_t* tile = mTileCacheGetTile(&test->cache, 0, 0);
+	assert_int_equal(tile[0], 0xFF010101);
+	assert_int_equal(tile[1], 0xFF020202);
+
+	// Without a VRAM write notification the tile is not decoded again, so
+	// this only shows up after the next VRAM write
+	vram[0] = 0x43;
+	mTileCacheWritePalette(&test->cache, 1, 0x123456);
+	tile = mTileCacheGetTile(&test->cache, 0, 0);
+	assert_int_equal(tile[0], 0xFF123456);
+	assert_int_equal(tile[1], 0xFF020202);
+
+	mTileCacheWriteVRAM(&test->cache, 0);
+	tile = mTileCacheGetTile(&test->cache, 0, 0);
+	assert_int_equal(tile[0], 0xFF030303);
+	assert_int_equal(tile[1], 0xFF040404);
+}
+
+M_TEST_DEFINE(vramGeneration) {
+	struct TileCacheTest* test = *state;
+	_configure(test, 2);
+	struct mTileCacheEntry entries[2] = {0};
+
+	assert_non_null(mTileCacheGetTileIfDirty(&test->cache, entries, 3, 1));
+	assert_null(mTileCacheGetTileIfDirty(&test->cache, entries, 3, 1));
+
+	// Writes to other tiles don't affect this one
+	mTileCacheWriteVRAM(&test->cache, 0x40);
+	assert_null(mTileCacheGetTileIfDirty(&test->cache, entries, 3, 1));
+
+	mTileCacheWriteVRAM(&test->cache, 0x7E);
+	assert_non_null(mTileCacheGetTileIfDirty(&test->cache, entries, 3, 1));
+	assert_null(mTileCacheGetTileIfDirty(&test->cache, entries, 3, 1));
+
+	mTileCacheWritePalette(&test->cache, 0x13, 0);
+	assert_non_null(mTileCacheGetTileIfDirty(&test->cache, entries, 3, 1));
+	assert_null(mTileCacheGetTileIfDirty(&test->cache, entries, 3, 1));
+}
+
+M_TEST_SUITE_DEFINE_SETUP_TEARDOWN(mTileCache,
+	cmocka_unit_test(decode2bpp),
+	cmocka_unit_test(decode4bpp),
+	cmocka_unit_test(decode8bpp),
+	cmocka_unit_test(paletteRecolor),
+	cmocka_unit_test(vramGeneration))
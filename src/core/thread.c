@@ -12,6 +12,7 @@
 #include <mgba/core/scripting.h>
 #endif
 #include <mgba/core/serialize.h>
+#include <mgba-util/memory.h>
 #include <mgba-util/patch.h>
 #include <mgba-util/vfs.h>
 
@@ -155,8 +156,12 @@ void _frameStarted(void* context) {
 	if (!thread) {
 		return;
 	}
+	if (thread->impl->runningAhead) {
+		return;
+	}
 	if (thread->core->opts.rewindEnable && thread->core->opts.rewindBufferCapacity > 0) {
-		if (!thread->impl->rewinding || !mCoreRewindRestore(&thread->impl->rewind, thread->core)) {
+		// Stepping backwards would break the input sequence of an active movie
+		if (!thread->impl->rewinding || mMovieIsActive(&thread->impl->movie) || !mCoreRewindRestore(&thread->impl->rewind, thread->core)) {
 			mCoreRewindAppend(&thread->impl->rewind, thread->core);
 		}
 	}
@@ -167,11 +172,23 @@ void _frameEnded(void* context) {
 	if (!thread) {
 		return;
 	}
-	if (thread->frameCallback) {
+	// Before the frame callback, since that's where frontends like to update the keys
+	if (!thread->impl->runningAhead) {
+		mMovieFrameEnded(&thread->impl->movie);
+	}
+	if (!thread->impl->frameHidden && thread->frameCallback) {
 		thread->frameCallback(thread);
 	}
 }
 
+void _keysRead(void* context) {
+	struct mCoreThread* thread = context;
+	if (!thread) {
+		return;
+	}
+	mMovieKeysRead(&thread->impl->movie);
+}
+
 void _crashed(void* context) {
 	struct mCoreThread* thread = context;
 	if (!thread) {
@@ -208,7 +225,15 @@ void _script_ ## NAME(void* context) { \
 	mScriptContextTriggerCallback(threadContext->scriptContext, #NAME); \
 }
 
-ADD_CALLBACK(frame)
+void _script_frame(void* context) {
+	struct mCoreThread* threadContext = context;
+	if (!threadContext->scriptContext || threadContext->impl->runningAhead) {
+		return;
+	}
+	mScriptContextFlushMemoryCallbacks(threadContext->scriptContext, true);
+	mScriptContextTriggerCallback(threadContext->scriptContext, "frame");
+}
+
 ADD_CALLBACK(crashed)
 ADD_CALLBACK(sleep)
 ADD_CALLBACK(stop)
@@ -234,6 +259,61 @@ static void _mCoreThreadAddCallbacks(struct mCoreThread* threadContext) {
 }
 #endif
 
+static void _mCoreThreadRunAhead(struct mCoreThread* threadContext) {
+	struct mCoreThreadInternal* impl = threadContext->impl;
+	struct mCore* core = threadContext->core;
+	size_t stateSize = mCoreStateBufferSize(core, 0);
+	if (stateSize != impl->runAheadStateSize) {
+		if (impl->runAheadState) {
+			mappedMemoryFree(impl->runAheadState, impl->runAheadStateSize);
+		}
+		impl->runAheadState = anonymousMemoryMap(stateSize);
+		impl->runAheadStateSize = impl->runAheadState ? stateSize : 0;
+	}
+	if (!impl->runAheadState) {
+		// Nowhere to come back to, so just run the frame normally
+		core->runFrame(core);
+		return;
+	}
+
+	// The real frame is heard but not seen; the frame shown is the one that the
+	// current input will produce a few frames from now
+	impl->frameHidden = true;
+	core->suppressOutput(core, true, false);
+	core->runFrame(core);
+	mCoreSaveStateInto(core, impl->runAheadState, impl->runAheadStateSize, 0);
+
+	// The state doesn't cover savedata, so anything the game saves while running ahead has to be
+	// undone separately. It's only compared afterwards, since restoring it can mean writing the file.
+	const void* sram = NULL;
+	size_t sramSize = core->savedataRef ? core->savedataRef(core, &sram) : 0;
+	if (sramSize != impl->runAheadSavedataSize) {
+		free(impl->runAheadSavedata);
+		impl->runAheadSavedata = sramSize ? malloc(sramSize) : NULL;
+		impl->runAheadSavedataSize = impl->runAheadSavedata ? sramSize : 0;
+	}
+	if (impl->runAheadSavedata) {
+		memcpy(impl->runAheadSavedata, sram, impl->runAheadSavedataSize);
+	}
+
+	impl->runningAhead = true;
+	int i;
+	for (i = 0; i < core->opts.runAhead; ++i) {
+		impl->frameHidden = i < core->opts.runAhead - 1;
+		core->suppressOutput(core, impl->frameHidden, true);
+		core->runFrame(core);
+	}
+	impl->runningAhead = false;
+	impl->frameHidden = false;
+
+	mCoreLoadStateFrom(core, impl->runAheadState, impl->runAheadStateSize, 0);
+	if (impl->runAheadSavedata && core->savedataRef(core, &sram) == impl->runAheadSavedataSize &&
+	    memcmp(sram, impl->runAheadSavedata, impl->runAheadSavedataSize) != 0) {
+		core->savedataRestore(core, impl->runAheadSavedata, impl->runAheadSavedataSize, true);
+	}
+	core->suppressOutput(core, false, false);
+}
+
 static THREAD_ENTRY _mCoreThreadRun(void* context) {
 	struct mCoreThread* threadContext = context;
 #ifdef USE_PTHREADS
@@ -255,6 +335,7 @@ static THREAD_ENTRY _mCoreThreadRun(void* context) {
 	struct mCoreCallbacks callbacks = {
 		.videoFrameStarted = _frameStarted,
 		.videoFrameEnded = _frameEnded,
+		.keysRead = _keysRead,
 		.coreCrashed = _crashed,
 		.sleep = _coreSleep,
 		.shutdown = _coreShutdown,
@@ -327,6 +408,8 @@ static THREAD_ENTRY _mCoreThreadRun(void* context) {
 #ifdef USE_DEBUGGERS
 		struct mDebugger* debugger = core->debugger;
 		if (debugger) {
+			// Run-ahead is skipped while a debugger is attached: the replayed frames would
+			// hit breakpoints and script memory callbacks a second time
 			mDebuggerRun(debugger);
 			if (debugger->state == DEBUGGER_SHUTDOWN) {
 				_changeState(impl, mTHREAD_EXITING, false);
@@ -335,7 +418,11 @@ static THREAD_ENTRY _mCoreThreadRun(void* context) {
 #endif
 		{
 			while (impl->state == mTHREAD_RUNNING) {
-				core->runLoop(core);
+				if (core->opts.runAhead > 0 && core->suppressOutput && !mMovieIsActive(&impl->movie)) {
+					_mCoreThreadRunAhead(threadContext);
+				} else {
+					core->runLoop(core);
+				}
 			}
 		}
 
@@ -409,6 +496,7 @@ static THREAD_ENTRY _mCoreThreadRun(void* context) {
 			}
 		}
 		if (pendingRequests & mTHREAD_REQ_RESET) {
+			mMovieStop(&impl->movie);
 			core->reset(core);
 			if (threadContext->resetCallback) {
 				threadContext->resetCallback(threadContext);
@@ -433,6 +521,15 @@ static THREAD_ENTRY _mCoreThreadRun(void* context) {
 	if (core->opts.rewindEnable) {
 		 mCoreRewindContextDeinit(&impl->rewind);
 	}
+	mMovieDeinit(&impl->movie);
+	if (impl->runAheadState) {
+		mappedMemoryFree(impl->runAheadState, impl->runAheadStateSize);
+		impl->runAheadState = NULL;
+		impl->runAheadStateSize = 0;
+	}
+	free(impl->runAheadSavedata);
+	impl->runAheadSavedata = NULL;
+	impl->runAheadSavedataSize = 0;
 
 	if (threadContext->cleanCallback) {
 		threadContext->cleanCallback(threadContext);
@@ -457,6 +554,7 @@ bool mCoreThreadStart(struct mCoreThread* threadContext) {
 	threadContext->impl = calloc(sizeof(*threadContext->impl), 1);
 	threadContext->impl->state = mTHREAD_INITIALIZED;
 	threadContext->impl->requested = 0;
+	mMovieInit(&threadContext->impl->movie);
 	threadContext->logger.p = threadContext;
 	threadContext->logger.d.log = _mCoreLog;
 	threadContext->logger.d.filter = NULL;
@@ -715,12 +813,41 @@ void mCoreThreadSetRewinding(struct mCoreThread* threadContext, bool rewinding)
 void mCoreThreadRewindParamsChanged(struct mCoreThread* threadContext) {
 	struct mCore* core = threadContext->core;
 	if (core->opts.rewindEnable && core->opts.rewindBufferCapacity > 0) {
-		 mCoreRewindContextInit(&threadContext->impl->rewind, core->opts.rewindBufferCapacity, true);
+		 mCoreRewindContextInit(&threadContext->impl->rewind, core->opts.rewindBufferCapacity, core->opts.rewindBufferBytes, true);
 	} else {
 		 mCoreRewindContextDeinit(&threadContext->impl->rewind);
 	}
 }
 
+bool mCoreThreadGetRewindStats(struct mCoreThread* threadContext, struct mCoreRewindStats* stats) {
+	if (!threadContext->impl->rewind.stateVf) {
+		memset(stats, 0, sizeof(*stats));
+		return false;
+	}
+	mCoreRewindGetStats(&threadContext->impl->rewind, stats);
+	return true;
+}
+
+bool mCoreThreadRecordMovie(struct mCoreThread* threadContext, struct VFile* vf, unsigned checksumInterval) {
+	mCoreThreadInterrupt(threadContext);
+	bool success = mMovieRecord(&threadContext->impl->movie, threadContext->core, vf, checksumInterval);
+	mCoreThreadContinue(threadContext);
+	return success;
+}
+
+bool mCoreThreadPlayMovie(struct mCoreThread* threadContext, struct VFile* vf) {
+	mCoreThreadInterrupt(threadContext);
+	bool success = mMoviePlay(&threadContext->impl->movie, threadContext->core, vf);
+	mCoreThreadContinue(threadContext);
+	return success;
+}
+
+void mCoreThreadStopMovie(struct mCoreThread* threadContext) {
+	mCoreThreadInterrupt(threadContext);
+	mMovieStop(&threadContext->impl->movie);
+	mCoreThreadContinue(threadContext);
+}
+
 void mCoreThreadWaitFromThread(struct mCoreThread* threadContext) {
 	MutexLock(&threadContext->impl->stateMutex);
 	_sendRequest(threadContext->impl, mTHREAD_REQ_WAIT);
@@ -7,6 +7,14 @@
 
 #include <mgba-util/memory.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TILE_CACHE_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define TILE_CACHE_NEON
+#endif
+
 void mTileCacheInit(struct mTileCache* cache) {
 	// TODO: Reconfigurable cache for space savings
 	cache->cache = NULL;
@@ -14,6 +22,9 @@ void mTileCacheInit(struct mTileCache* cache) {
 	cache->status = NULL;
 	cache->globalPaletteVersion = NULL;
 	cache->palette = NULL;
+	cache->indexed = NULL;
+	cache->vramVersion = NULL;
+	cache->indexedVersion = NULL;
 }
 
 static void _freeCache(struct mTileCache* cache) {
@@ -27,6 +38,14 @@ static void _freeCache(struct mTileCache* cache) {
 		mappedMemoryFree(cache->status, tiles * size * sizeof(*cache->status));
 		cache->status = NULL;
 	}
+	if (cache->indexed) {
+		mappedMemoryFree(cache->indexed, 8 * 8 * tiles);
+		cache->indexed = NULL;
+	}
+	free(cache->vramVersion);
+	cache->vramVersion = NULL;
+	free(cache->indexedVersion);
+	cache->indexedVersion = NULL;
 	free(cache->globalPaletteVersion);
 	cache->globalPaletteVersion = NULL;
 	free(cache->palette);
@@ -46,6 +65,11 @@ static void _redoCacheSize(struct mTileCache* cache) {
 	unsigned tiles = mTileCacheSystemInfoGetMaxTiles(cache->sysConfig);
 	cache->cache = anonymousMemoryMap(8 * 8 * sizeof(color_t) * tiles * size);
 	cache->status = anonymousMemoryMap(tiles * size * sizeof(*cache->status));
+	cache->indexed = anonymousMemoryMap(8 * 8 * tiles);
+	cache->vramVersion = calloc(tiles, sizeof(*cache->vramVersion));
+	cache->indexedVersion = malloc(tiles * sizeof(*cache->indexedVersion));
+	// Start out of sync with the VRAM generations so every tile gets decoded
+	memset(cache->indexedVersion, 0xFF, tiles * sizeof(*cache->indexedVersion));
 	cache->globalPaletteVersion = calloc(size, sizeof(*cache->globalPaletteVersion));
 	cache->palette = calloc(size * bpp, sizeof(*cache->palette));
 }
@@ -76,17 +100,11 @@ void mTileCacheWriteVRAM(struct mTileCache* cache, uint32_t address) {
 		return;
 	}
 	address -= cache->tileBase;
-	unsigned bpp = cache->bpp + 3;
-	unsigned count = cache->entriesPerTile;
-	address >>= bpp;
+	address >>= cache->bpp + 3;
 	if (address >= mTileCacheSystemInfoGetMaxTiles(cache->sysConfig)) {
 		return;
 	}
-	size_t i;
-	for (i = 0; i < count; ++i) {
-		cache->status[address * count + i].vramClean = 0;
-		++cache->status[address * count + i].vramVersion;
-	}
+	++cache->vramVersion[address];
 }
 
 void mTileCacheWritePalette(struct mTileCache* cache, uint32_t entry, color_t color) {
@@ -103,94 +121,82 @@ void mTileCacheWritePalette(struct mTileCache* cache, uint32_t entry, color_t co
 	++cache->globalPaletteVersion[entry];
 }
 
-static void _regenerateTile4(struct mTileCache* cache, color_t* tile, unsigned tileId, unsigned paletteId) {
-	uint8_t* start = (uint8_t*) &cache->vram[tileId << 3];
-	paletteId <<= 2;
-	color_t* palette = &cache->palette[paletteId];
+static void _decodeTile4(const uint8_t* start, uint8_t* indexed) {
 	int i;
 	for (i = 0; i < 8; ++i) {
 		uint8_t tileDataLower = start[0];
 		uint8_t tileDataUpper = start[1];
 		start += 2;
-		int pixel;
-		pixel = ((tileDataUpper & 128) >> 6) | ((tileDataLower & 128) >> 7);
-		tile[0] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = ((tileDataUpper & 64) >> 5) | ((tileDataLower & 64) >> 6);
-		tile[1] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = ((tileDataUpper & 32) >> 4) | ((tileDataLower & 32) >> 5);
-		tile[2] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = ((tileDataUpper & 16) >> 3) | ((tileDataLower & 16) >> 4);
-		tile[3] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = ((tileDataUpper & 8) >> 2) | ((tileDataLower & 8) >> 3);
-		tile[4] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = ((tileDataUpper & 4) >> 1) | ((tileDataLower & 4) >> 2);
-		tile[5] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = (tileDataUpper & 2) | ((tileDataLower & 2) >> 1);
-		tile[6] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = ((tileDataUpper & 1) << 1) | (tileDataLower & 1);
-		tile[7] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		tile += 8;
+		int x;
+		for (x = 0; x < 8; ++x) {
+			indexed[x] = (((tileDataUpper >> (7 - x)) & 1) << 1) | ((tileDataLower >> (7 - x)) & 1);
+		}
+		indexed += 8;
 	}
 }
 
-static void _regenerateTile16(struct mTileCache* cache, color_t* tile, unsigned tileId, unsigned paletteId) {
-	uint32_t* start = (uint32_t*) &cache->vram[tileId << 4];
-	paletteId <<= 4;
-	color_t* palette = &cache->palette[paletteId];
+static void _decodeTile16(const uint8_t* start, uint8_t* indexed) {
+	// Each byte holds two pixels, the low nibble being the leftmost
+#if defined(TILE_CACHE_SSE2)
+	const __m128i mask = _mm_set1_epi8(0xF);
 	int i;
-	for (i = 0; i < 8; ++i) {
-		uint32_t line = *start;
-		++start;
-		int pixel;
-		pixel = line & 0xF;
-		tile[0] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = (line >> 4) & 0xF;
-		tile[1] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = (line >> 8) & 0xF;
-		tile[2] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = (line >> 12) & 0xF;
-		tile[3] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = (line >> 16) & 0xF;
-		tile[4] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = (line >> 20) & 0xF;
-		tile[5] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = (line >> 24) & 0xF;
-		tile[6] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = (line >> 28) & 0xF;
-		tile[7] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		tile += 8;
+	for (i = 0; i < 2; ++i) {
+		__m128i data = _mm_loadu_si128((const __m128i*) &start[i * 16]);
+		__m128i lo = _mm_and_si128(data, mask);
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(data, 4), mask);
+		_mm_storeu_si128((__m128i*) &indexed[i * 32], _mm_unpacklo_epi8(lo, hi));
+		_mm_storeu_si128((__m128i*) &indexed[i * 32 + 16], _mm_unpackhi_epi8(lo, hi));
 	}
+#elif defined(TILE_CACHE_NEON)
+	int i;
+	for (i = 0; i < 2; ++i) {
+		uint8x16_t data = vld1q_u8(&start[i * 16]);
+		uint8x16x2_t pixels = {{ vandq_u8(data, vdupq_n_u8(0xF)), vshrq_n_u8(data, 4) }};
+		vst2q_u8(&indexed[i * 32], pixels);
+	}
+#else
+	int i;
+	for (i = 0; i < 32; ++i) {
+		indexed[i * 2] = start[i] & 0xF;
+		indexed[i * 2 + 1] = start[i] >> 4;
+	}
+#endif
 }
 
-static void _regenerateTile256(struct mTileCache* cache, color_t* tile, unsigned tileId, unsigned paletteId) {
-	uint32_t* start = (uint32_t*) &cache->vram[tileId << 5];
-	paletteId <<= 8;
-	color_t* palette = &cache->palette[paletteId];
-	int i;
-	for (i = 0; i < 8; ++i) {
-		uint32_t line = *start;
-		++start;
-		int pixel;
-		pixel = line & 0xFF;
-		tile[0] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = (line >> 8) & 0xFF;
-		tile[1] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = (line >> 16) & 0xFF;
-		tile[2] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = (line >> 24) & 0xFF;
-		tile[3] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
+static void _decodeTile(struct mTileCache* cache, uint8_t* indexed, unsigned tileId) {
+	const uint8_t* start = (const uint8_t*) cache->vram + (tileId << (cache->bpp + 3));
+	switch (cache->bpp) {
+	case 1:
+		_decodeTile4(start, indexed);
+		break;
+	case 2:
+		_decodeTile16(start, indexed);
+		break;
+	case 3:
+		memcpy(indexed, start, 64);
+		break;
+	}
+}
 
-		line = *start;
-		++start;
-		pixel = line & 0xFF;
-		tile[4] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = (line >> 8) & 0xFF;
-		tile[5] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = (line >> 16) & 0xFF;
-		tile[6] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		pixel = (line >> 24) & 0xFF;
-		tile[7] = pixel ? palette[pixel] | 0xFF000000 : palette[pixel];
-		tile += 8;
+static const uint8_t* _indexedLookup(struct mTileCache* cache, unsigned tileId) {
+	if (!mTileCacheConfigurationIsShouldStore(cache->config)) {
+		_decodeTile(cache, cache->temporaryIndexed, tileId);
+		return cache->temporaryIndexed;
+	}
+	uint8_t* indexed = &cache->indexed[tileId << 6];
+	if (cache->indexedVersion[tileId] != cache->vramVersion[tileId]) {
+		_decodeTile(cache, indexed, tileId);
+		cache->indexedVersion[tileId] = cache->vramVersion[tileId];
+	}
+	return indexed;
+}
+
+static void _colorTile(struct mTileCache* cache, color_t* tile, const uint8_t* indexed, unsigned paletteId) {
+	const color_t* palette = &cache->palette[paletteId << (1 << cache->bpp)];
+	int i;
+	for (i = 0; i < 64; ++i) {
+		unsigned pixel = indexed[i];
+		tile[i] = pixel ? palette[pixel] | 0xFF000000 : palette[0];
 	}
 }
 
@@ -217,25 +223,16 @@ const color_t* mTileCacheGetTile(struct mTileCache* cache, unsigned tileId, unsi
 	struct mTileCacheEntry* status = &cache->status[tileId * count + paletteId];
 	struct mTileCacheEntry desiredStatus = {
 		.paletteVersion = cache->globalPaletteVersion[paletteId],
-		.vramVersion = status->vramVersion,
+		.vramVersion = cache->vramVersion[tileId],
 		.vramClean = 1,
 		.paletteId = paletteId
 	};
 	color_t* tile = _tileLookup(cache, tileId, paletteId);
 	if (!mTileCacheConfigurationIsShouldStore(cache->config) || memcmp(status, &desiredStatus, sizeof(*status))) {
-		switch (bpp) {
-		case 0:
+		if (!bpp) {
 			return NULL;
-		case 1:
-			_regenerateTile4(cache, tile, tileId, paletteId);
-			break;
-		case 2:
-			_regenerateTile16(cache, tile, tileId, paletteId);
-			break;
-		case 3:
-			_regenerateTile256(cache, tile, tileId, paletteId);
-			break;
 		}
+		_colorTile(cache, tile, _indexedLookup(cache, tileId), paletteId);
 		*status = desiredStatus;
 	}
 	return tile;
@@ -247,26 +244,17 @@ const color_t* mTileCacheGetTileIfDirty(struct mTileCache* cache, struct mTileCa
 	struct mTileCacheEntry* status = &cache->status[tileId * count + paletteId];
 	struct mTileCacheEntry desiredStatus = {
 		.paletteVersion = cache->globalPaletteVersion[paletteId],
-		.vramVersion = status->vramVersion,
+		.vramVersion = cache->vramVersion[tileId],
 		.vramClean = 1,
 		.paletteId = paletteId
 	};
 	color_t* tile = NULL;
 	if (memcmp(status, &desiredStatus, sizeof(*status))) {
 		tile = _tileLookup(cache, tileId, paletteId);
-		switch (bpp) {
-		case 0:
+		if (!bpp) {
 			return NULL;
-		case 1:
-			_regenerateTile4(cache, tile, tileId, paletteId);
-			break;
-		case 2:
-			_regenerateTile16(cache, tile, tileId, paletteId);
-			break;
-		case 3:
-			_regenerateTile256(cache, tile, tileId, paletteId);
-			break;
 		}
+		_colorTile(cache, tile, _indexedLookup(cache, tileId), paletteId);
 		*status = desiredStatus;
 	}
 	if (memcmp(status, &entry[paletteId], sizeof(*status))) {
@@ -276,6 +264,13 @@ const color_t* mTileCacheGetTileIfDirty(struct mTileCache* cache, struct mTileCa
 	return tile;
 }
 
+const uint8_t* mTileCacheGetIndexedTile(struct mTileCache* cache, unsigned tileId) {
+	if (!cache->bpp || tileId >= mTileCacheSystemInfoGetMaxTiles(cache->sysConfig)) {
+		return NULL;
+	}
+	return _indexedLookup(cache, tileId);
+}
+
 const color_t* mTileCacheGetPalette(struct mTileCache* cache, unsigned paletteId) {
 	return &cache->palette[paletteId << (1 << cache->bpp)];
 }
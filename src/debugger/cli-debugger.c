@@ -14,6 +14,7 @@
 #include <mgba/core/timing.h>
 #include <mgba/core/version.h>
 #include <mgba/internal/debugger/parser.h>
+#include <mgba/internal/debugger/profiler.h>
 #ifdef USE_ELF
 #include <mgba-util/elf-read.h>
 #endif
@@ -79,6 +80,9 @@ static void _setStackTraceMode(struct CLIDebugger*, struct CLIDebugVector*);
 static void _loadSymbols(struct CLIDebugger*, struct CLIDebugVector*);
 static void _setSymbol(struct CLIDebugger*, struct CLIDebugVector*);
 static void _findSymbol(struct CLIDebugger*, struct CLIDebugVector*);
+static void _startProfiler(struct CLIDebugger*, struct CLIDebugVector*);
+static void _stopProfiler(struct CLIDebugger*, struct CLIDebugVector*);
+static void _saveProfile(struct CLIDebugger*, struct CLIDebugVector*);
 
 static struct CLIDebuggerCommandSummary _debuggerCommands[] = {
 	{ "backtrace", _backtrace, "i", "Print backtrace of all or specified frames" },
@@ -95,6 +99,9 @@ static struct CLIDebuggerCommandSummary _debuggerCommands[] = {
 	{ "print", _print, "S+", "Print a value" },
 	{ "print/t", _printBin, "S+", "Print a value as binary" },
 	{ "print/x", _printHex, "S+", "Print a value as hexadecimal" },
+	{ "profile", _startProfiler, "i", "Start sampling the executing code every specified number of cycles" },
+	{ "profile/save", _saveProfile, "S", "Save the sampled call stacks as folded stacks" },
+	{ "profile/stop", _stopProfiler, "", "Stop sampling the executing code" },
 	{ "quit", _quit, "", "Quit the emulator" },
 	{ "reset", _reset, "", "Reset the emulation" },
 	{ "r/1", _readByte, "I", "Read a byte from a specified offset" },
@@ -1106,6 +1113,7 @@ static void _cliDebuggerInit(struct mDebugger* debugger) {
 	cliDebugger->traceRemaining = 0;
 	cliDebugger->traceVf = NULL;
 	cliDebugger->skipStatus = false;
+	cliDebugger->profiler = NULL;
 	cliDebugger->backend->init(cliDebugger->backend);
 	if (cliDebugger->system && cliDebugger->system->init) {
 		cliDebugger->system->init(cliDebugger->system);
@@ -1118,6 +1126,11 @@ static void _cliDebuggerDeinit(struct mDebugger* debugger) {
 		cliDebugger->traceVf->close(cliDebugger->traceVf);
 		cliDebugger->traceVf = NULL;
 	}
+	if (cliDebugger->profiler) {
+		mProfilerDeinit(cliDebugger->profiler);
+		free(cliDebugger->profiler);
+		cliDebugger->profiler = NULL;
+	}
 
 	if (cliDebugger->system) {
 		if (cliDebugger->system->deinit) {
@@ -1148,6 +1161,13 @@ static void _cliDebuggerCustom(struct mDebugger* debugger) {
 	}
 }
 
+static void _cliDebuggerRunning(struct mDebugger* debugger) {
+	struct CLIDebugger* cliDebugger = (struct CLIDebugger*) debugger;
+	if (cliDebugger->profiler) {
+		mProfilerUpdate(cliDebugger->profiler);
+	}
+}
+
 static void _cliDebuggerInterrupt(struct mDebugger* debugger) {
 	struct CLIDebugger* cliDebugger = (struct CLIDebugger*) debugger;
 	if (cliDebugger->backend->interrupt) {
@@ -1161,6 +1181,7 @@ void CLIDebuggerCreate(struct CLIDebugger* debugger) {
 	debugger->d.custom = _cliDebuggerCustom;
 	debugger->d.paused = _commandLine;
 	debugger->d.update = NULL;
+	debugger->d.running = _cliDebuggerRunning;
 	debugger->d.entered = _reportEntry;
 	debugger->d.interrupt = _cliDebuggerInterrupt;
 	debugger->d.type = DEBUGGER_CLI;
@@ -1325,6 +1346,12 @@ static void _loadSymbols(struct CLIDebugger* debugger, struct CLIDebugVector* dv
 		debugger->backend->printf(debugger->backend, "%s\n", "Could not open symbol file");
 		return;
 	}
+	size_t nameLength = strlen(dv->charValue);
+	if (nameLength > 4 && strcasecmp(&dv->charValue[nameLength - 4], ".map") == 0) {
+		mDebuggerLoadGNUMapSymbols(symbolTable, vf);
+		vf->close(vf);
+		return;
+	}
 #ifdef USE_ELF
 	struct ELF* elf = ELFOpen(vf);
 	if (elf) {
@@ -1382,3 +1409,52 @@ static void _findSymbol(struct CLIDebugger* debugger, struct CLIDebugVector* dv)
 		debugger->backend->printf(debugger->backend, "Not found.\n");
 	}
 }
+
+static void _startProfiler(struct CLIDebugger* debugger, struct CLIDebugVector* dv) {
+	if (!debugger->d.platform->currentAddress) {
+		debugger->backend->printf(debugger->backend, "Profiling is not supported on this platform.\n");
+		return;
+	}
+	int32_t period = 0;
+	if (dv) {
+		if (dv->type != CLIDV_INT_TYPE || dv->intValue <= 0) {
+			debugger->backend->printf(debugger->backend, "%s\n", ERROR_INVALID_ARGS);
+			return;
+		}
+		period = dv->intValue;
+	}
+	if (!debugger->profiler) {
+		debugger->profiler = malloc(sizeof(*debugger->profiler));
+		mProfilerInit(debugger->profiler, &debugger->d);
+	}
+	mProfilerStart(debugger->profiler, period);
+}
+
+static void _stopProfiler(struct CLIDebugger* debugger, struct CLIDebugVector* dv) {
+	UNUSED(dv);
+	if (debugger->profiler) {
+		mProfilerStop(debugger->profiler);
+	}
+}
+
+static void _saveProfile(struct CLIDebugger* debugger, struct CLIDebugVector* dv) {
+	if (!dv || dv->type != CLIDV_CHAR_TYPE) {
+		debugger->backend->printf(debugger->backend, "%s\n", ERROR_MISSING_ARGS);
+		return;
+	}
+	if (!debugger->profiler) {
+		debugger->backend->printf(debugger->backend, "No profile has been recorded.\n");
+		return;
+	}
+	struct VFile* vf = VFileOpen(dv->charValue, O_CREAT | O_TRUNC | O_WRONLY);
+	if (!vf) {
+		debugger->backend->printf(debugger->backend, "Could not open profile file\n");
+		return;
+	}
+	if (!mProfilerDump(debugger->profiler, debugger->d.core->symbolTable, vf)) {
+		debugger->backend->printf(debugger->backend, "Could not write profile file\n");
+	} else {
+		debugger->backend->printf(debugger->backend, "Saved %" PRIu64 " samples\n", debugger->profiler->samples);
+	}
+	vf->close(vf);
+}
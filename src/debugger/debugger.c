@@ -87,8 +87,13 @@ void mDebuggerAttach(struct mDebugger* debugger, struct mCore* core) {
 void mDebuggerRun(struct mDebugger* debugger) {
 	switch (debugger->state) {
 	case DEBUGGER_RUNNING:
+		if (debugger->running) {
+			debugger->running(debugger);
+		}
 		if (!debugger->platform->hasBreakpoints(debugger->platform)) {
 			debugger->core->runLoop(debugger->core);
+		} else if (debugger->platform->runLoop) {
+			debugger->platform->runLoop(debugger->platform);
 		} else {
 			debugger->core->step(debugger->core);
 			debugger->platform->checkBreakpoints(debugger->platform);
@@ -56,15 +56,38 @@ static const char* TARGET_XML = "<target version=\"1.0\">"
 
 static void _sendMessage(struct GDBStub* stub);
 
+static void _schedulePoll(struct GDBStub* stub) {
+	if (!stub->d.core) {
+		return;
+	}
+	struct mTiming* timing = stub->d.core->timing;
+	mTimingDeschedule(timing, &stub->pollEvent);
+	if (!SOCKET_FAILED(stub->socket) && stub->d.state == DEBUGGER_RUNNING) {
+		mTimingSchedule(timing, &stub->pollEvent, GDB_STUB_INTERVAL);
+	}
+}
+
+static void _deschedulePoll(struct GDBStub* stub) {
+	if (stub->d.core) {
+		mTimingDeschedule(stub->d.core->timing, &stub->pollEvent);
+	}
+}
+
+static void _gdbStubInit(struct mDebugger* debugger) {
+	_schedulePoll((struct GDBStub*) debugger);
+}
+
 static void _gdbStubDeinit(struct mDebugger* debugger) {
 	struct GDBStub* stub = (struct GDBStub*) debugger;
 	if (!SOCKET_FAILED(stub->socket)) {
 		GDBStubShutdown(stub);
 	}
+	_deschedulePoll(stub);
 }
 
 static void _gdbStubEntered(struct mDebugger* debugger, enum mDebuggerEntryReason reason, struct mDebuggerEntryInfo* info) {
 	struct GDBStub* stub = (struct GDBStub*) debugger;
+	_deschedulePoll(stub);
 	switch (reason) {
 	case DEBUGGER_ENTER_MANUAL:
 		snprintf(stub->outgoing, GDB_STUB_MAX_LINE - 4, "S%02x", SIGINT);
@@ -118,15 +141,13 @@ static void _gdbStubEntered(struct mDebugger* debugger, enum mDebuggerEntryReaso
 	_sendMessage(stub);
 }
 
-static void _gdbStubPoll(struct mDebugger* debugger) {
-	struct GDBStub* stub = (struct GDBStub*) debugger;
-	--stub->untilPoll;
-	if (stub->untilPoll > 0) {
-		return;
-	}
-	stub->untilPoll = GDB_STUB_INTERVAL;
+static void _gdbStubPoll(struct mTiming* timing, void* context, uint32_t cyclesLate) {
+	UNUSED(timing);
+	UNUSED(cyclesLate);
+	struct GDBStub* stub = context;
 	stub->shouldBlock = false;
 	GDBStubUpdate(stub);
+	_schedulePoll(stub);
 }
 
 static void _gdbStubWait(struct mDebugger* debugger) {
@@ -141,14 +162,28 @@ static void _gdbStubUpdate(struct mDebugger* debugger) {
 	GDBStubUpdate(stub);
 }
 
+static void _gdbStubRunning(struct mDebugger* debugger) {
+	struct GDBStub* stub = (struct GDBStub*) debugger;
+	// Resets and state loads clear every timing event, the poll included
+	if (!SOCKET_FAILED(stub->socket) && !mTimingIsScheduled(debugger->core->timing, &stub->pollEvent)) {
+		_schedulePoll(stub);
+	}
+}
+
 static void _ack(struct GDBStub* stub) {
+	if (stub->lineAck == GDB_ACK_OFF) {
+		return;
+	}
 	char ack = '+';
 	SocketSend(stub->connection, &ack, 1);
 }
 
 static void _nak(struct GDBStub* stub) {
-	char nak = '-';
 	mLOG(DEBUGGER, WARN, "Packet error");
+	if (stub->lineAck == GDB_ACK_OFF) {
+		return;
+	}
+	char nak = '-';
 	SocketSend(stub->connection, &nak, 1);
 }
 
@@ -203,34 +238,31 @@ static uint32_t _readHex(const char* in, unsigned* out) {
 	return _hex2int(in, i);
 }
 
-static void _sendMessage(struct GDBStub* stub) {
+static void _sendPacket(struct GDBStub* stub, size_t length) {
 	if (stub->lineAck != GDB_ACK_OFF) {
 		stub->lineAck = GDB_ACK_PENDING;
 	}
-	uint8_t checksum = 0;
-	int i = 1;
-	char buffer = stub->outgoing[0];
-	char swap;
+	if (length > GDB_STUB_MAX_LINE - 5) {
+		length = GDB_STUB_MAX_LINE - 5;
+	}
+	memmove(&stub->outgoing[1], stub->outgoing, length);
 	stub->outgoing[0] = '$';
-	if (buffer) {
-		for (; i < GDB_STUB_MAX_LINE - 5; ++i) {
-			checksum += buffer;
-			swap = stub->outgoing[i];
-			stub->outgoing[i] = buffer;
-			buffer = swap;
-			if (!buffer) {
-				++i;
-				break;
-			}
-		}
+	uint8_t checksum = 0;
+	size_t i;
+	for (i = 1; i <= length; ++i) {
+		checksum += stub->outgoing[i];
 	}
 	stub->outgoing[i] = '#';
 	_int2hex8(checksum, &stub->outgoing[i + 1]);
 	stub->outgoing[i + 3] = 0;
-	mLOG(DEBUGGER, DEBUG, "> %s", stub->outgoing);
+	mLOG(DEBUGGER, DEBUG, "> %.*s", (int) (i + 3), stub->outgoing);
 	SocketSend(stub->connection, stub->outgoing, i + 3);
 }
 
+static void _sendMessage(struct GDBStub* stub) {
+	_sendPacket(stub, strnlen(stub->outgoing, GDB_STUB_MAX_LINE - 5));
+}
+
 static void _error(struct GDBStub* stub, enum GDBError error) {
 	snprintf(stub->outgoing, GDB_STUB_MAX_LINE - 4, "E%02x", error);
 	_sendMessage(stub);
@@ -241,19 +273,32 @@ static void _writeHostInfo(struct GDBStub* stub) {
 	_sendMessage(stub);
 }
 
+static void _resumeAt(struct GDBStub* stub, const char* message) {
+	if (message[0] == '#') {
+		return;
+	}
+	struct ARMCore* cpu = stub->d.core->cpu;
+	unsigned i = 0;
+	cpu->gprs[ARM_PC] = _readHex(message, &i);
+	if (cpu->executionMode == MODE_ARM) {
+		ARMWritePC(cpu);
+	} else {
+		ThumbWritePC(cpu);
+	}
+}
+
 static void _continue(struct GDBStub* stub, const char* message) {
-	stub->d.state = DEBUGGER_CALLBACK;
-	stub->untilPoll = GDB_STUB_INTERVAL;
-	// TODO: parse message
-	UNUSED(message);
+	_resumeAt(stub, message);
+	// Run at full speed and only look for an interrupt from the client every so often
+	stub->d.state = DEBUGGER_RUNNING;
+	_schedulePoll(stub);
 }
 
 static void _step(struct GDBStub* stub, const char* message) {
+	_resumeAt(stub, message);
 	stub->d.core->step(stub->d.core);
 	snprintf(stub->outgoing, GDB_STUB_MAX_LINE - 4, "S%02x", SIGTRAP);
 	_sendMessage(stub);
-	// TODO: parse message
-	UNUSED(message);
 }
 
 static void _writeMemoryBinary(struct GDBStub* stub, const char* message) {
@@ -266,7 +311,7 @@ static void _writeMemoryBinary(struct GDBStub* stub, const char* message) {
 	uint32_t size = _readHex(readAddress, &i);
 	readAddress += i + 1;
 
-	if (size > 512) {
+	if (size > GDB_STUB_MAX_LINE) {
 		_error(stub, GDB_BAD_ARGUMENTS);
 		return;
 	}
@@ -300,7 +345,7 @@ static void _writeMemory(struct GDBStub* stub, const char* message) {
 	uint32_t size = _readHex(readAddress, &i);
 	readAddress += i + 1;
 
-	if (size > 512) {
+	if (size > GDB_STUB_MAX_LINE / 2) {
 		_error(stub, GDB_BAD_ARGUMENTS);
 		return;
 	}
@@ -315,26 +360,94 @@ static void _writeMemory(struct GDBStub* stub, const char* message) {
 	_sendMessage(stub);
 }
 
+static void _copyMemory(struct GDBStub* stub, uint32_t address, uint8_t* out, uint32_t size) {
+	struct mCore* core = stub->d.core;
+	struct ARMCore* cpu = core->cpu;
+	uint32_t i = 0;
+	while (i < size) {
+		uint32_t chunk = size - i;
+		const struct mCoreMemoryBlock* block = mCoreGetMemoryBlockInfo(core, address + i);
+		if (block && address + i - block->start + (uint64_t) chunk > block->size) {
+			chunk = block->size - (address + i - block->start);
+		}
+		size_t hostSize;
+		// Plain RAM can be copied directly, but anything else may have side effects or mirroring
+		const uint8_t* host = mCoreGetMemoryBlockMasked(core, address + i, &hostSize, mCORE_MEMORY_WRITE);
+		if (host) {
+			if (chunk > hostSize) {
+				chunk = hostSize;
+			}
+			memcpy(&out[i], host, chunk);
+			i += chunk;
+			continue;
+		}
+		for (; chunk; --chunk, ++i) {
+			out[i] = cpu->memory.load8(cpu, address + i, 0);
+		}
+	}
+}
+
 static void _readMemory(struct GDBStub* stub, const char* message) {
 	const char* readAddress = message;
 	unsigned i = 0;
 	uint32_t address = _readHex(readAddress, &i);
 	readAddress += i + 1;
 	uint32_t size = _readHex(readAddress, &i);
-	if (size > 512) {
+	if (size > (GDB_STUB_MAX_LINE - 5) / 2) {
 		_error(stub, GDB_BAD_ARGUMENTS);
 		return;
 	}
-	struct ARMCore* cpu = stub->d.core->cpu;
-	int writeAddress = 0;
-	for (i = 0; i < size; ++i, writeAddress += 2) {
-		uint8_t byte = cpu->memory.load8(cpu, address + i, 0);
-		_int2hex8(byte, &stub->outgoing[writeAddress]);
+	// The raw bytes sit in the upper half of the buffer, where the hex encoding never catches up with them
+	uint8_t* raw = (uint8_t*) &stub->outgoing[size];
+	_copyMemory(stub, address, raw, size);
+	for (i = 0; i < size; ++i) {
+		_int2hex8(raw[i], &stub->outgoing[i * 2]);
 	}
-	stub->outgoing[writeAddress] = 0;
+	stub->outgoing[size * 2] = 0;
 	_sendMessage(stub);
 }
 
+static void _readMemoryBinary(struct GDBStub* stub, const char* message) {
+	const char* readAddress = message;
+	unsigned i = 0;
+	uint32_t address = _readHex(readAddress, &i);
+	readAddress += i + 1;
+	uint32_t size = _readHex(readAddress, &i);
+	if (size > GDB_STUB_MAX_LINE - 5) {
+		size = GDB_STUB_MAX_LINE - 5;
+	}
+
+	size_t length = 0;
+	if (stub->supportsBinaryUpload) {
+		stub->outgoing[length] = 'b';
+		++length;
+	} else if (!size) {
+		// LLDB probes for support with an empty read
+		strncpy(stub->outgoing, "OK", GDB_STUB_MAX_LINE - 4);
+		_sendMessage(stub);
+		return;
+	}
+
+	uint8_t raw[GDB_STUB_MAX_LINE];
+	_copyMemory(stub, address, raw, size);
+	for (i = 0; i < size; ++i) {
+		uint8_t byte = raw[i];
+		bool escape = byte == '#' || byte == '$' || byte == '}' || byte == '*';
+		// Replies are allowed to come up short, so stop instead of overflowing
+		if (length + (escape ? 2 : 1) > GDB_STUB_MAX_LINE - 5) {
+			break;
+		}
+		if (escape) {
+			stub->outgoing[length] = '}';
+			++length;
+			byte ^= 0x20;
+		}
+		stub->outgoing[length] = byte;
+		++length;
+	}
+	_sendPacket(stub, length);
+}
+
 static void _writeGPRs(struct GDBStub* stub, const char* message) {
 	struct ARMCore* cpu = stub->d.core->cpu;
 	const char* readAddress = message;
@@ -441,6 +554,7 @@ static void _processQSupportedCommand(struct GDBStub* stub, const char* message)
 	const char* terminator = strrchr(message, '#');
 	stub->supportsSwbreak = false;
 	stub->supportsHwbreak = false;
+	stub->supportsBinaryUpload = false;
 	while (message < terminator) {
 		const char* end = strchr(message, ';');
 		size_t len;
@@ -457,13 +571,15 @@ static void _processQSupportedCommand(struct GDBStub* stub, const char* message)
 			stub->supportsSwbreak = false;
 		} else if (!strncmp(message, "hwbreak-", len)) {
 			stub->supportsHwbreak = false;
+		} else if (!strncmp(message, "binary-upload+", len)) {
+			stub->supportsBinaryUpload = true;
 		}
 		if (!end) {
 			break;
 		}
 		message = end + 1;
 	}
-	strncpy(stub->outgoing, "swbreak+;hwbreak+;qXfer:features:read+;qXfer:memory-map:read+;QStartNoAckMode+", GDB_STUB_MAX_LINE - 4);
+	snprintf(stub->outgoing, GDB_STUB_MAX_LINE - 4, "PacketSize=%x;swbreak+;hwbreak+;qXfer:features:read+;qXfer:memory-map:read+;QStartNoAckMode+;binary-upload+", GDB_STUB_MAX_LINE - 16);
 }
 
 static void _processQXferCommand(struct GDBStub* stub, const char* params, const char* data) {
@@ -563,7 +679,21 @@ static void _processVWriteCommand(struct GDBStub* stub, const char* message) {
 
 static void _processVReadCommand(struct GDBStub* stub, const char* message) {
 	stub->outgoing[0] = '\0';
-	if (!strncmp("Attach", message, 6)) {
+	if (!strncmp("Cont?#", message, 6)) {
+		strncpy(stub->outgoing, "vCont;c;C;s;S", GDB_STUB_MAX_LINE - 4);
+	} else if (!strncmp("Cont;", message, 5)) {
+		// There's only one thread, so the first action is the one that applies to it
+		switch (message[5]) {
+		case 'c':
+		case 'C':
+			_continue(stub, "#");
+			return;
+		case 's':
+		case 'S':
+			_step(stub, "#");
+			return;
+		}
+	} else if (!strncmp("Attach", message, 6)) {
 		strncpy(stub->outgoing, "1", GDB_STUB_MAX_LINE - 4);
 		mDebuggerEnter(&stub->d, DEBUGGER_ENTER_MANUAL, 0);
 	}
@@ -575,13 +705,16 @@ static void _setBreakpoint(struct GDBStub* stub, const char* message) {
 	unsigned i = 0;
 	uint32_t address = _readHex(readAddress, &i);
 	readAddress += i + 1;
+	i = 0;
+	uint32_t kind = _readHex(readAddress, &i);
 
 	struct mBreakpoint breakpoint = {
 		.address = address,
 		.type = BREAKPOINT_HARDWARE
 	};
 	struct mWatchpoint watchpoint = {
-		.address = address
+		.address = address,
+		.size = kind
 	};
 
 	switch (message[0]) {
@@ -651,15 +784,20 @@ static void _clearBreakpoint(struct GDBStub* stub, const char* message) {
 	_sendMessage(stub);
 }
 
-size_t _parseGDBMessage(struct GDBStub* stub, const char* message) {
+static size_t _parseGDBMessage(struct GDBStub* stub, const char* message, size_t length) {
 	uint8_t checksum = 0;
-	int parsed = 1;
+	size_t parsed = 1;
 	switch (*message) {
 	case '+':
-		stub->lineAck = GDB_ACK_RECEIVED;
+		// The client still acks the reply to QStartNoAckMode, which mustn't turn acks back on
+		if (stub->lineAck != GDB_ACK_OFF) {
+			stub->lineAck = GDB_ACK_RECEIVED;
+		}
 		return parsed;
 	case '-':
-		stub->lineAck = GDB_NAK_RECEIVED;
+		if (stub->lineAck != GDB_ACK_OFF) {
+			stub->lineAck = GDB_NAK_RECEIVED;
+		}
 		return parsed;
 	case '$':
 		++message;
@@ -672,26 +810,17 @@ size_t _parseGDBMessage(struct GDBStub* stub, const char* message) {
 		return parsed;
 	}
 
-	int i;
+	size_t i;
 	char messageType = message[0];
-	for (i = 0; message[i] != '#'; ++i, ++parsed) {
+	for (i = 0; parsed < length && message[i] != '#'; ++i, ++parsed) {
 		checksum += message[i];
 	}
-	if (!message[i]) {
-		_nak(stub);
-		return parsed;
+	if (parsed + 3 > length) {
+		// The rest of the packet hasn't arrived yet
+		return 0;
 	}
 	++i;
-	++parsed;
-	if (!message[i]) {
-		_nak(stub);
-		return parsed;
-	} else if (!message[i + 1]) {
-		++parsed;
-		_nak(stub);
-		return parsed;
-	}
-	parsed += 2;
+	parsed += 3;
 	int networkChecksum = _hex2int(&message[i], 2);
 	if (networkChecksum != checksum) {
 		mLOG(DEBUGGER, WARN, "Checksum error: expected %02x, got %02x", checksum, networkChecksum);
@@ -751,6 +880,9 @@ size_t _parseGDBMessage(struct GDBStub* stub, const char* message) {
 	case 'X':
 		_writeMemoryBinary(stub, message);
 		break;
+	case 'x':
+		_readMemoryBinary(stub, message);
+		break;
 	case 'Z':
 		_setBreakpoint(stub, message);
 		break;
@@ -767,15 +899,20 @@ size_t _parseGDBMessage(struct GDBStub* stub, const char* message) {
 void GDBStubCreate(struct GDBStub* stub) {
 	stub->socket = INVALID_SOCKET;
 	stub->connection = INVALID_SOCKET;
-	stub->d.init = NULL;
+	stub->d.init = _gdbStubInit;
 	stub->d.deinit = _gdbStubDeinit;
 	stub->d.paused = _gdbStubWait;
 	stub->d.update = _gdbStubUpdate;
+	stub->d.running = _gdbStubRunning;
 	stub->d.entered = _gdbStubEntered;
-	stub->d.custom = _gdbStubPoll;
+	stub->d.custom = NULL;
 	stub->d.interrupt = NULL;
 	stub->d.type = DEBUGGER_GDB;
-	stub->untilPoll = GDB_STUB_INTERVAL;
+	stub->pollEvent.context = stub;
+	stub->pollEvent.name = "GDB Stub Poll";
+	stub->pollEvent.callback = _gdbStubPoll;
+	stub->pollEvent.priority = 0xFF;
+	stub->lineLength = 0;
 	stub->lineAck = GDB_ACK_PENDING;
 	stub->shouldBlock = false;
 }
@@ -814,9 +951,14 @@ void GDBStubHangup(struct GDBStub* stub) {
 		SocketClose(stub->connection);
 		stub->connection = INVALID_SOCKET;
 	}
+	// The next client has to negotiate everything again
+	stub->lineLength = 0;
+	stub->lineAck = GDB_ACK_PENDING;
 	if (stub->d.state == DEBUGGER_PAUSED) {
 		stub->d.state = DEBUGGER_RUNNING;
 	}
+	// Keep listening for a new client while running
+	_schedulePoll(stub);
 }
 
 void GDBStubShutdown(struct GDBStub* stub) {
@@ -825,6 +967,26 @@ void GDBStubShutdown(struct GDBStub* stub) {
 		SocketClose(stub->socket);
 		stub->socket = INVALID_SOCKET;
 	}
+	_deschedulePoll(stub);
+}
+
+static void _parseLine(struct GDBStub* stub, enum mDebuggerState state) {
+	size_t position = 0;
+	while (position < stub->lineLength && stub->d.state == state) {
+		size_t parsed = _parseGDBMessage(stub, &stub->line[position], stub->lineLength - position);
+		if (!parsed) {
+			break;
+		}
+		position += parsed;
+	}
+	if (!position && stub->lineLength == GDB_STUB_MAX_LINE - 1) {
+		// A packet that can never fit is dropped so the stream can resynchronize
+		_nak(stub);
+		position = stub->lineLength;
+	}
+	stub->lineLength -= position;
+	memmove(stub->line, &stub->line[position], stub->lineLength);
+	stub->line[stub->lineLength] = '\0';
 }
 
 void GDBStubUpdate(struct GDBStub* stub) {
@@ -852,12 +1014,18 @@ void GDBStubUpdate(struct GDBStub* stub) {
 		}
 		SocketSetTCPPush(stub->connection, 1);
 	}
+	// Once the client resumes or interrupts execution, hand control back without waiting on the socket
+	enum mDebuggerState state = stub->d.state;
 	while (true) {
+		_parseLine(stub, state);
+		if (stub->d.state != state) {
+			return;
+		}
 		if (stub->shouldBlock) {
 			Socket reads = stub->connection;
 			SocketPoll(1, &reads, 0, 0, SOCKET_TIMEOUT);
 		}
-		ssize_t messageLen = SocketRecv(stub->connection, stub->line, GDB_STUB_MAX_LINE - 1);
+		ssize_t messageLen = SocketRecv(stub->connection, &stub->line[stub->lineLength], GDB_STUB_MAX_LINE - 1 - stub->lineLength);
 		if (messageLen == 0) {
 			goto connectionLost;
 		}
@@ -867,12 +1035,9 @@ void GDBStubUpdate(struct GDBStub* stub) {
 			}
 			goto connectionLost;
 		}
-		stub->line[messageLen] = '\0';
-		mLOG(DEBUGGER, DEBUG, "< %s", stub->line);
-		ssize_t position = 0;
-		while (position < messageLen) {
-			position += _parseGDBMessage(stub, &stub->line[position]);
-		}
+		mLOG(DEBUGGER, DEBUG, "< %.*s", (int) messageLen, &stub->line[stub->lineLength]);
+		stub->lineLength += messageLen;
+		stub->line[stub->lineLength] = '\0';
 	}
 
 connectionLost:
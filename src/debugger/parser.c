@@ -7,6 +7,7 @@
 
 #include <mgba/core/core.h>
 #include <mgba/debugger/debugger.h>
+#include <mgba/internal/debugger/symbols.h>
 #include <mgba-util/string.h>
 
 DEFINE_VECTOR(LexVector, struct Token);
@@ -902,3 +903,309 @@ bool mDebuggerEvaluateParseTree(struct mDebugger* debugger, struct ParseTree* tr
 	}
 	return ok;
 }
+
+enum ParseOpcode {
+	PARSE_OP_CONSTANT,
+	PARSE_OP_REGISTER,
+	PARSE_OP_IDENTIFIER,
+	PARSE_OP_SEGMENT,
+	PARSE_OP_UNARY,
+	PARSE_OP_BINARY,
+};
+
+struct ParseInstruction {
+	enum ParseOpcode opcode;
+	union {
+		struct {
+			int32_t value;
+			int segment;
+		} constant;
+		const int32_t* reg;
+		char* identifier;
+		enum Operation operation;
+	};
+};
+
+DECLARE_VECTOR(ParseInstructionList, struct ParseInstruction);
+DEFINE_VECTOR(ParseInstructionList, struct ParseInstruction);
+
+struct ParseProgram {
+	struct ParseInstructionList code;
+	size_t depth;
+	size_t maxDepth;
+	int32_t* values;
+	int* segments;
+
+	// What the resolved identifiers depend on, to tell when they're stale
+	const struct ParseTree* tree;
+	const struct mDebuggerSymbols* symbolTable;
+	uint32_t symbolGeneration;
+	const struct mScriptBridge* bridge;
+};
+
+static bool _isBinaryOperation(enum Operation operation) {
+	switch (operation) {
+	case OP_NEGATE:
+	case OP_FLIP:
+	case OP_NOT:
+	case OP_DEREFERENCE:
+		return false;
+	default:
+		return true;
+	}
+}
+
+static void _pushDepth(struct ParseProgram* program) {
+	++program->depth;
+	if (program->depth > program->maxDepth) {
+		program->maxDepth = program->depth;
+	}
+}
+
+static bool _isConstant(const struct ParseProgram* program, size_t fromEnd) {
+	size_t size = ParseInstructionListSize(&program->code);
+	if (size < fromEnd) {
+		return false;
+	}
+	return ParseInstructionListGetConstPointer(&program->code, size - fromEnd)->opcode == PARSE_OP_CONSTANT;
+}
+
+static void _compileIdentifier(struct mDebugger* debugger, struct ParseProgram* program, const char* name) {
+	struct ParseInstruction* instruction = ParseInstructionListAppend(&program->code);
+	_pushDepth(program);
+
+	// Mirror the search order of mDebuggerLookupIdentifier, but do it once up front
+	int32_t value;
+	int segment = -1;
+	bool dynamic = false;
+#ifdef ENABLE_SCRIPTING
+	// Script symbols can appear at any time and shadow everything else, so with a bridge attached
+	// every name gets looked up again on each evaluation
+	dynamic = debugger->bridge;
+#endif
+	if (!dynamic && debugger->core->symbolTable && mDebuggerSymbolLookup(debugger->core->symbolTable, name, &value, &segment)) {
+		instruction->opcode = PARSE_OP_CONSTANT;
+		instruction->constant.value = value;
+		instruction->constant.segment = segment;
+		return;
+	}
+	segment = -1;
+	if (!dynamic && debugger->core->lookupIdentifier(debugger->core, name, &value, &segment)) {
+		instruction->opcode = PARSE_OP_CONSTANT;
+		instruction->constant.value = value;
+		instruction->constant.segment = segment;
+		return;
+	}
+	if (!dynamic && debugger->platform && debugger->platform->registerPointer) {
+		const int32_t* reg = debugger->platform->registerPointer(debugger->platform, name);
+		if (reg) {
+			instruction->opcode = PARSE_OP_REGISTER;
+			instruction->reg = reg;
+			return;
+		}
+	}
+	// Anything else, including names that don't exist yet, is resolved at evaluation time
+	instruction->opcode = PARSE_OP_IDENTIFIER;
+	instruction->identifier = strdup(name);
+}
+
+static void _clearProgram(struct ParseProgram* program) {
+	size_t i;
+	for (i = 0; i < ParseInstructionListSize(&program->code); ++i) {
+		struct ParseInstruction* instruction = ParseInstructionListGetPointer(&program->code, i);
+		if (instruction->opcode == PARSE_OP_IDENTIFIER) {
+			free(instruction->identifier);
+		}
+	}
+	ParseInstructionListClear(&program->code);
+	program->depth = 0;
+	program->maxDepth = 0;
+}
+
+static bool _compileTree(struct mDebugger* debugger, struct ParseProgram* program, const struct ParseTree* tree) {
+	struct ParseInstruction* instruction;
+	switch (tree->token.type) {
+	case TOKEN_UINT_TYPE:
+		instruction = ParseInstructionListAppend(&program->code);
+		instruction->opcode = PARSE_OP_CONSTANT;
+		instruction->constant.value = tree->token.uintValue;
+		instruction->constant.segment = -1;
+		_pushDepth(program);
+		return true;
+	case TOKEN_IDENTIFIER_TYPE:
+		_compileIdentifier(debugger, program, tree->token.identifierValue);
+		return true;
+	case TOKEN_SEGMENT_TYPE:
+		if (!tree->lhs || !tree->rhs || !_compileTree(debugger, program, tree->lhs) || !_compileTree(debugger, program, tree->rhs)) {
+			return false;
+		}
+		if (_isConstant(program, 1) && _isConstant(program, 2)) {
+			struct ParseInstruction* rhs = ParseInstructionListGetPointer(&program->code, ParseInstructionListSize(&program->code) - 1);
+			struct ParseInstruction* lhs = rhs - 1;
+			lhs->constant.segment = lhs->constant.value;
+			lhs->constant.value = rhs->constant.value;
+			ParseInstructionListResize(&program->code, -1);
+		} else {
+			instruction = ParseInstructionListAppend(&program->code);
+			instruction->opcode = PARSE_OP_SEGMENT;
+		}
+		--program->depth;
+		return true;
+	case TOKEN_OPERATOR_TYPE:
+		break;
+	default:
+		return false;
+	}
+
+	enum Operation operation = tree->token.operatorValue;
+	if (_isBinaryOperation(operation)) {
+		if (!tree->lhs || !tree->rhs || !_compileTree(debugger, program, tree->lhs) || !_compileTree(debugger, program, tree->rhs)) {
+			return false;
+		}
+		--program->depth;
+		if (_isConstant(program, 1) && _isConstant(program, 2)) {
+			struct ParseInstruction* rhs = ParseInstructionListGetPointer(&program->code, ParseInstructionListSize(&program->code) - 1);
+			struct ParseInstruction* lhs = rhs - 1;
+			int32_t value;
+			int segment = lhs->constant.segment;
+			// Division by zero is left for the evaluator to fail on
+			if (_performOperation(debugger, operation, lhs->constant.value, rhs->constant.value, &value, &segment)) {
+				lhs->constant.value = value;
+				lhs->constant.segment = segment;
+				ParseInstructionListResize(&program->code, -1);
+				return true;
+			}
+		}
+		instruction = ParseInstructionListAppend(&program->code);
+		instruction->opcode = PARSE_OP_BINARY;
+		instruction->operation = operation;
+		return true;
+	}
+
+	if (!tree->rhs || !_compileTree(debugger, program, tree->rhs)) {
+		return false;
+	}
+	if (operation != OP_DEREFERENCE && _isConstant(program, 1)) {
+		struct ParseInstruction* rhs = ParseInstructionListGetPointer(&program->code, ParseInstructionListSize(&program->code) - 1);
+		int32_t value;
+		if (_performOperation(debugger, operation, 0, rhs->constant.value, &value, &rhs->constant.segment)) {
+			rhs->constant.value = value;
+			return true;
+		}
+	}
+	instruction = ParseInstructionListAppend(&program->code);
+	instruction->opcode = PARSE_OP_UNARY;
+	instruction->operation = operation;
+	return true;
+}
+
+static bool _compileProgram(struct mDebugger* debugger, struct ParseProgram* program) {
+	_clearProgram(program);
+	program->symbolTable = debugger->core->symbolTable;
+	program->symbolGeneration = program->symbolTable ? mDebuggerSymbolTableGeneration(program->symbolTable) : 0;
+	program->bridge = debugger->bridge;
+	if (!_compileTree(debugger, program, program->tree) || program->depth != 1) {
+		return false;
+	}
+	free(program->values);
+	free(program->segments);
+	program->values = calloc(program->maxDepth, sizeof(*program->values));
+	program->segments = calloc(program->maxDepth, sizeof(*program->segments));
+	return program->values && program->segments;
+}
+
+static bool _isStale(const struct mDebugger* debugger, const struct ParseProgram* program) {
+	const struct mDebuggerSymbols* symbolTable = debugger->core->symbolTable;
+	if (symbolTable != program->symbolTable) {
+		return true;
+	}
+	if (symbolTable && mDebuggerSymbolTableGeneration(symbolTable) != program->symbolGeneration) {
+		return true;
+	}
+	return debugger->bridge != program->bridge;
+}
+
+struct ParseProgram* parseCompile(struct mDebugger* debugger, const struct ParseTree* tree) {
+	if (!tree) {
+		return NULL;
+	}
+	struct ParseProgram* program = malloc(sizeof(*program));
+	ParseInstructionListInit(&program->code, 8);
+	program->values = NULL;
+	program->segments = NULL;
+	program->tree = tree;
+	if (!_compileProgram(debugger, program)) {
+		parseProgramFree(program);
+		return NULL;
+	}
+	return program;
+}
+
+void parseProgramFree(struct ParseProgram* program) {
+	if (!program) {
+		return;
+	}
+	_clearProgram(program);
+	ParseInstructionListDeinit(&program->code);
+	free(program->values);
+	free(program->segments);
+	free(program);
+}
+
+bool mDebuggerEvaluateProgram(struct mDebugger* debugger, struct ParseProgram* program, int32_t* value, int* segment) {
+	if (!value) {
+		return false;
+	}
+	// An empty program is one whose last recompile failed
+	if ((_isStale(debugger, program) || !ParseInstructionListSize(&program->code)) && !_compileProgram(debugger, program)) {
+		_clearProgram(program);
+		return false;
+	}
+	int32_t* values = program->values;
+	int* segments = program->segments;
+	size_t sp = 0;
+	size_t i;
+	size_t size = ParseInstructionListSize(&program->code);
+	for (i = 0; i < size; ++i) {
+		const struct ParseInstruction* instruction = ParseInstructionListGetConstPointer(&program->code, i);
+		switch (instruction->opcode) {
+		case PARSE_OP_CONSTANT:
+			values[sp] = instruction->constant.value;
+			segments[sp] = instruction->constant.segment;
+			++sp;
+			break;
+		case PARSE_OP_REGISTER:
+			values[sp] = *instruction->reg;
+			segments[sp] = -1;
+			++sp;
+			break;
+		case PARSE_OP_IDENTIFIER:
+			if (!mDebuggerLookupIdentifier(debugger, instruction->identifier, &values[sp], &segments[sp])) {
+				return false;
+			}
+			++sp;
+			break;
+		case PARSE_OP_SEGMENT:
+			--sp;
+			segments[sp - 1] = values[sp - 1];
+			values[sp - 1] = values[sp];
+			break;
+		case PARSE_OP_UNARY:
+			if (!_performOperation(debugger, instruction->operation, 0, values[sp - 1], &values[sp - 1], &segments[sp - 1])) {
+				return false;
+			}
+			break;
+		case PARSE_OP_BINARY:
+			--sp;
+			if (!_performOperation(debugger, instruction->operation, values[sp - 1], values[sp], &values[sp - 1], &segments[sp - 1])) {
+				return false;
+			}
+			break;
+		}
+	}
+	*value = values[0];
+	if (segment) {
+		*segment = segments[0];
+	}
+	return true;
+}
@@ -0,0 +1,176 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include <mgba/internal/debugger/profiler.h>
+
+#include <mgba/core/core.h>
+#include <mgba/debugger/debugger.h>
+#include <mgba/internal/debugger/stack-trace.h>
+#include <mgba/internal/debugger/symbols.h>
+#include <mgba-util/vfs.h>
+
+struct mProfilerStack {
+	const char* mode;
+	uint32_t addresses[mPROFILER_MAX_DEPTH + 1]; // Outermost first, the sampled address last
+};
+
+struct mProfilerDumpContext {
+	struct mDebuggerSymbols* symbols;
+	struct VFile* vf;
+	bool ok;
+};
+
+static void _sample(struct mTiming* timing, void* context, uint32_t cyclesLate) {
+	struct mProfiler* profiler = context;
+	mProfilerSample(profiler);
+	int32_t when = profiler->period - (int32_t) cyclesLate;
+	if (when < 1) {
+		when = 1;
+	}
+	mTimingSchedule(timing, &profiler->event, when);
+}
+
+void mProfilerInit(struct mProfiler* profiler, struct mDebugger* debugger) {
+	profiler->debugger = debugger;
+	profiler->event.context = profiler;
+	profiler->event.callback = _sample;
+	profiler->event.name = "Profiler";
+	profiler->event.priority = 0xFF;
+	profiler->period = mPROFILER_DEFAULT_PERIOD;
+	profiler->running = false;
+	HashTableInit(&profiler->stacks, 0, free);
+	profiler->samples = 0;
+}
+
+void mProfilerDeinit(struct mProfiler* profiler) {
+	mProfilerStop(profiler);
+	HashTableDeinit(&profiler->stacks);
+}
+
+void mProfilerStart(struct mProfiler* profiler, int32_t period) {
+	struct mTiming* timing = profiler->debugger->core->timing;
+	if (period > 0) {
+		profiler->period = period;
+	}
+	mTimingDeschedule(timing, &profiler->event);
+	mTimingSchedule(timing, &profiler->event, profiler->period);
+	profiler->running = true;
+}
+
+void mProfilerStop(struct mProfiler* profiler) {
+	mTimingDeschedule(profiler->debugger->core->timing, &profiler->event);
+	profiler->running = false;
+}
+
+bool mProfilerIsRunning(const struct mProfiler* profiler) {
+	return profiler->running;
+}
+
+void mProfilerUpdate(struct mProfiler* profiler) {
+	struct mTiming* timing = profiler->debugger->core->timing;
+	if (profiler->running && !mTimingIsScheduled(timing, &profiler->event)) {
+		mTimingSchedule(timing, &profiler->event, profiler->period);
+	}
+}
+
+void mProfilerClear(struct mProfiler* profiler) {
+	HashTableClear(&profiler->stacks);
+	profiler->samples = 0;
+}
+
+void mProfilerSample(struct mProfiler* profiler) {
+	struct mDebugger* debugger = profiler->debugger;
+	struct mDebuggerPlatform* platform = debugger->platform;
+	if (!platform->currentAddress) {
+		return;
+	}
+
+	// The stack is used as a hash key, so the padding has to be consistent
+	struct mProfilerStack stack;
+	memset(&stack, 0, sizeof(stack));
+	size_t depth = 0;
+	if (platform->getStackTraceMode && platform->getStackTraceMode(platform) != STACK_TRACE_DISABLED) {
+		size_t frames = mStackTraceGetDepth(&debugger->stackTrace);
+		size_t i = 0;
+		if (frames > mPROFILER_MAX_DEPTH) {
+			// Deep recursion loses its outermost frames rather than the ones doing the work
+			i = frames - mPROFILER_MAX_DEPTH;
+		}
+		for (; i < frames; ++i) {
+			stack.addresses[depth] = mStackTraceGetFrame(&debugger->stackTrace, frames - i - 1)->entryAddress;
+			++depth;
+		}
+	}
+	stack.addresses[depth] = platform->currentAddress(platform, &stack.mode);
+	++depth;
+
+	size_t keylen = offsetof(struct mProfilerStack, addresses) + depth * sizeof(*stack.addresses);
+	uint64_t* count = HashTableLookupBinary(&profiler->stacks, &stack, keylen);
+	if (!count) {
+		count = calloc(1, sizeof(*count));
+		HashTableInsertBinary(&profiler->stacks, &stack, keylen, count);
+	}
+	++*count;
+	++profiler->samples;
+}
+
+static const char* _frameName(struct mDebuggerSymbols* symbols, uint32_t address, char* buffer, size_t size) {
+	if (symbols) {
+		uint32_t offset;
+		const char* name = mDebuggerSymbolLookupNearest(symbols, address, -1, &offset);
+		// Symbols don't have sizes, so one from a different memory region is just the last thing mapped below it
+		if (name && ((address - offset) >> 24) == (address >> 24)) {
+			return name;
+		}
+	}
+	snprintf(buffer, size, "0x%08X", address);
+	return buffer;
+}
+
+static void _dumpStack(const char* key, size_t keylen, void* value, void* user) {
+	struct mProfilerDumpContext* context = user;
+	if (!context->ok) {
+		return;
+	}
+	const struct mProfilerStack* stack = (const struct mProfilerStack*) key;
+	size_t depth = (keylen - offsetof(struct mProfilerStack, addresses)) / sizeof(*stack->addresses);
+
+	char line[0x2000];
+	size_t length = 0;
+	if (stack->mode) {
+		length = snprintf(line, sizeof(line), "[%s]", stack->mode);
+	}
+	const char* previous = NULL;
+	size_t i;
+	for (i = 0; i < depth && length < sizeof(line); ++i) {
+		char buffer[16];
+		const char* name = _frameName(context->symbols, stack->addresses[i], buffer, sizeof(buffer));
+		if (i == depth - 1 && previous && strcmp(name, previous) == 0) {
+			// The sampled address is usually inside the function the innermost frame entered
+			break;
+		}
+		length += snprintf(&line[length], sizeof(line) - length, "%s%s", length ? ";" : "", name);
+		previous = name == buffer ? NULL : name;
+	}
+	if (length < sizeof(line)) {
+		length += snprintf(&line[length], sizeof(line) - length, " %" PRIu64 "\n", *(uint64_t*) value);
+	}
+	if (length >= sizeof(line)) {
+		return;
+	}
+	if (context->vf->write(context->vf, line, length) != (ssize_t) length) {
+		context->ok = false;
+	}
+}
+
+bool mProfilerDump(struct mProfiler* profiler, struct mDebuggerSymbols* symbols, struct VFile* vf) {
+	struct mProfilerDumpContext context = {
+		.symbols = symbols,
+		.vf = vf,
+		.ok = true
+	};
+	HashTableEnumerateBinary(&profiler->stacks, _dumpStack, &context);
+	return context.ok;
+}
@@ -15,24 +15,50 @@ struct mDebuggerSymbol {
 	int segment;
 };
 
+struct mDebuggerSymbolAddress {
+	uint32_t value;
+	int segment;
+	const char* name;
+};
+
 struct mDebuggerSymbols {
 	struct Table names;
 	struct Table reverse;
+
+	// Built on demand for nearest lookups and dropped whenever the table changes
+	struct mDebuggerSymbolAddress* sorted;
+	size_t nSorted;
+	uint32_t generation;
 };
 
 struct mDebuggerSymbols* mDebuggerSymbolTableCreate(void) {
 	struct mDebuggerSymbols* st = malloc(sizeof(*st));
 	HashTableInit(&st->names, 0, free);
 	HashTableInit(&st->reverse, 0, free);
+	st->sorted = NULL;
+	st->nSorted = 0;
+	st->generation = 0;
 	return st;
 }
 
+static void _invalidateSorted(struct mDebuggerSymbols* st) {
+	free(st->sorted);
+	st->sorted = NULL;
+	st->nSorted = 0;
+	++st->generation;
+}
+
 void mDebuggerSymbolTableDestroy(struct mDebuggerSymbols* st) {
+	_invalidateSorted(st);
 	HashTableDeinit(&st->names);
 	HashTableDeinit(&st->reverse);
 	free(st);
 }
 
+uint32_t mDebuggerSymbolTableGeneration(const struct mDebuggerSymbols* st) {
+	return st->generation;
+}
+
 bool mDebuggerSymbolLookup(const struct mDebuggerSymbols* st, const char* name, int32_t* value, int* segment) {
 	struct mDebuggerSymbol* sym = HashTableLookup(&st->names, name);
 	if (!sym) {
@@ -48,12 +74,68 @@ const char* mDebuggerSymbolReverseLookup(const struct mDebuggerSymbols* st, int3
 	return HashTableLookupBinary(&st->reverse, &sym, sizeof(sym));
 }
 
+static void _collectAddress(const char* key, size_t keylen, void* value, void* user) {
+	UNUSED(keylen);
+	struct mDebuggerSymbols* st = user;
+	const struct mDebuggerSymbol* sym = (const struct mDebuggerSymbol*) key;
+	struct mDebuggerSymbolAddress* address = &st->sorted[st->nSorted];
+	address->value = sym->value;
+	address->segment = sym->segment;
+	address->name = value;
+	++st->nSorted;
+}
+
+static int _compareAddresses(const void* a, const void* b) {
+	const struct mDebuggerSymbolAddress* addressA = a;
+	const struct mDebuggerSymbolAddress* addressB = b;
+	if (addressA->segment != addressB->segment) {
+		return addressA->segment < addressB->segment ? -1 : 1;
+	}
+	if (addressA->value != addressB->value) {
+		return addressA->value < addressB->value ? -1 : 1;
+	}
+	return 0;
+}
+
+const char* mDebuggerSymbolLookupNearest(struct mDebuggerSymbols* st, uint32_t value, int segment, uint32_t* offset) {
+	if (!st->sorted) {
+		size_t size = HashTableSize(&st->reverse);
+		if (!size) {
+			return NULL;
+		}
+		st->sorted = malloc(size * sizeof(*st->sorted));
+		HashTableEnumerateBinary(&st->reverse, _collectAddress, st);
+		qsort(st->sorted, st->nSorted, sizeof(*st->sorted), _compareAddresses);
+	}
+
+	// Find the last symbol at or below the value in the same segment
+	struct mDebuggerSymbolAddress key = { value, segment, NULL };
+	size_t low = 0;
+	size_t high = st->nSorted;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		if (_compareAddresses(&st->sorted[mid], &key) <= 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	if (!low || st->sorted[low - 1].segment != segment) {
+		return NULL;
+	}
+	if (offset) {
+		*offset = value - st->sorted[low - 1].value;
+	}
+	return st->sorted[low - 1].name;
+}
+
 void mDebuggerSymbolAdd(struct mDebuggerSymbols* st, const char* name, int32_t value, int segment) {
 	struct mDebuggerSymbol* sym = malloc(sizeof(*sym));
 	sym->value = value;
 	sym->segment = segment;
 	HashTableInsert(&st->names, name, sym);
 	HashTableInsertBinary(&st->reverse, sym, sizeof(*sym), strdup(name));
+	_invalidateSorted(st);
 }
 
 void mDebuggerSymbolRemove(struct mDebuggerSymbols* st, const char* name) {
@@ -61,6 +143,7 @@ void mDebuggerSymbolRemove(struct mDebuggerSymbols* st, const char* name) {
 	if (sym) {
 		HashTableRemoveBinary(&st->reverse, sym, sizeof(*sym));
 		HashTableRemove(&st->names, name);
+		_invalidateSorted(st);
 	}
 }
 
@@ -107,3 +190,48 @@ void mDebuggerLoadARMIPSSymbols(struct mDebuggerSymbols* st, struct VFile* vf) {
 		mDebuggerSymbolAdd(st, buf, address, -1);
 	}
 }
+
+void mDebuggerLoadGNUMapSymbols(struct mDebuggerSymbols* st, struct VFile* vf) {
+	char line[512];
+
+	while (true) {
+		ssize_t bytesRead = vf->readline(vf, line, sizeof(line));
+		if (bytesRead <= 0) {
+			break;
+		}
+		// Symbols are listed as an indented address followed by nothing but the name;
+		// section headers, fill lines and assignments all have something else on them
+		char* buf = line;
+		while (isspace((int) buf[0])) {
+			++buf;
+		}
+		if (buf == line || strncmp(buf, "0x", 2) != 0) {
+			continue;
+		}
+		char* end;
+		unsigned long long address = strtoull(buf, &end, 16);
+		if (end == buf || !isspace((int) end[0]) || address > UINT32_MAX) {
+			continue;
+		}
+		buf = end;
+		while (isspace((int) buf[0])) {
+			++buf;
+		}
+		if (!isalpha((int) buf[0]) && buf[0] != '_') {
+			continue;
+		}
+		end = buf;
+		while (isalnum((int) end[0]) || end[0] == '_' || end[0] == '.' || end[0] == '$') {
+			++end;
+		}
+		char* trailing = end;
+		while (isspace((int) trailing[0])) {
+			++trailing;
+		}
+		if (trailing[0]) {
+			continue;
+		}
+		*end = '\0';
+		mDebuggerSymbolAdd(st, buf, address, -1);
+	}
+}
@@ -58,6 +58,7 @@ void FFmpegEncoderInit(struct FFmpegEncoder* encoder) {
 	encoder->d.postVideoFrame = _ffmpegPostVideoFrame;
 	encoder->d.postAudioFrame = _ffmpegPostAudioFrame;
 	encoder->d.postAudioBuffer = NULL;
+	encoder->d.postAudioResampled = NULL;
 
 	encoder->audioCodec = NULL;
 	encoder->videoCodec = NULL;
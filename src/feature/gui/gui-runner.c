@@ -45,6 +45,8 @@ enum {
 enum {
 	SCREENSHOT_VALID = 0x10000,
 	SCREENSHOT_INVALID = 0x20000,
+	SCREENSHOT_INDEXED = 0x40000,
+	SCREENSHOT_UNVERIFIED = 0x80000,
 };
 
 static const struct mInputPlatformInfo _mGUIKeyInfo = {
@@ -117,8 +119,30 @@ static void _drawState(struct GUIBackground* background, void* id) {
 	struct mGUIBackground* gbaBackground = (struct mGUIBackground*) background;
 	unsigned stateId = ((uint32_t) id) >> 16;
 	if (gbaBackground->p->drawScreenshot) {
+		struct mCore* core = gbaBackground->p->core;
+		struct mStateIndexEntry* entry = &gbaBackground->index;
+		if ((gbaBackground->screenshotId & ~SCREENSHOT_UNVERIFIED) == (stateId | SCREENSHOT_INDEXED)) {
+			gbaBackground->p->drawScreenshot(gbaBackground->p, entry->thumbnail, entry->width, entry->height, true);
+			if (gbaBackground->screenshotId & SCREENSHOT_UNVERIFIED) {
+				// The thumbnail is already on screen; only now check that the state still matches it
+				if (mCoreVerifyStateIndex(core, stateId, entry)) {
+					gbaBackground->screenshotId &= ~SCREENSHOT_UNVERIFIED;
+				} else {
+					mCoreInvalidateStateIndex(core, stateId);
+					gbaBackground->screenshotId = SCREENSHOT_INVALID | SCREENSHOT_VALID;
+				}
+			}
+			return;
+		}
+		if (gbaBackground->screenshotId != (stateId | SCREENSHOT_VALID) && gbaBackground->screenshotId != (stateId | SCREENSHOT_INVALID) &&
+		    mCoreReadStateIndex(core, stateId, entry) && entry->thumbnail) {
+			gbaBackground->p->drawScreenshot(gbaBackground->p, entry->thumbnail, entry->width, entry->height, true);
+			gbaBackground->screenshotId = stateId | SCREENSHOT_INDEXED | SCREENSHOT_UNVERIFIED;
+			return;
+		}
+
 		unsigned w, h;
-		gbaBackground->p->core->desiredVideoDimensions(gbaBackground->p->core, &w, &h);
+		core->desiredVideoDimensions(core, &w, &h);
 		size_t size = w * h * BYTES_PER_PIXEL;
 		if (size != gbaBackground->imageSize) {
 			mappedMemoryFree(gbaBackground->image, gbaBackground->imageSize);
@@ -128,7 +152,8 @@ static void _drawState(struct GUIBackground* background, void* id) {
 			gbaBackground->p->drawScreenshot(gbaBackground->p, gbaBackground->image, w, h, true);
 			return;
 		} else if (gbaBackground->screenshotId != (stateId | SCREENSHOT_INVALID)) {
-			struct VFile* vf = mCoreGetState(gbaBackground->p->core, stateId, false);
+			// Nothing usable in the index, so decode the state itself and put the result back in the index
+			struct VFile* vf = mCoreGetState(core, stateId, false);
 			color_t* pixels = gbaBackground->image;
 			if (!pixels) {
 				pixels = anonymousMemoryMap(size);
@@ -136,6 +161,7 @@ static void _drawState(struct GUIBackground* background, void* id) {
 				gbaBackground->imageSize = size;
 			}
 			bool success = false;
+			uint64_t creationUsec = 0;
 			if (vf && isPNG(vf) && pixels) {
 				png_structp png = PNGReadOpen(vf, PNG_HEADER_BYTES);
 				png_infop info = png_create_info_struct(png);
@@ -146,6 +172,28 @@ static void _drawState(struct GUIBackground* background, void* id) {
 					success = success && PNGReadFooter(png, end);
 				}
 				PNGReadClose(png, info, end);
+			} else if (vf && pixels) {
+				// Compressed savestates carry the screenshot as extdata
+				struct mStateExtdata extdata;
+				struct mStateExtdataItem item;
+				mStateExtdataInit(&extdata);
+				if (mCoreExtractExtdata(core, vf, &extdata) &&
+				    mStateExtdataGet(&extdata, EXTDATA_SCREENSHOT, &item) && item.data && item.size >= (int32_t) (w * h * 4)) {
+					memcpy(pixels, item.data, size);
+					success = true;
+					if (mStateExtdataGet(&extdata, EXTDATA_META_TIME, &item) && item.data && item.size == sizeof(creationUsec)) {
+						LOAD_64LE(creationUsec, 0, item.data);
+					}
+				}
+				mStateExtdataDeinit(&extdata);
+			}
+			if (success) {
+				mStateIndexEntrySetThumbnail(entry, pixels, w, h, w);
+				entry->creationUsec = creationUsec;
+				entry->frameCount = 0;
+				mStateIndexEntrySetState(entry, vf);
+				entry->creator[0] = '\0';
+				mCoreWriteStateIndex(core, stateId, entry);
 			}
 			if (vf) {
 				vf->close(vf);
@@ -176,6 +224,15 @@ static uint8_t _readLux(struct GBALuminanceSource* lux) {
 	return 0xFF - value;
 }
 
+static int _saveStateFlags(struct mGUIRunner* runner, int flags) {
+	int compress = false;
+	mCoreConfigGetIntValue(&runner->config, "compressSaveStates", &compress);
+	if (compress) {
+		flags |= SAVESTATE_COMPRESSED;
+	}
+	return flags;
+}
+
 static void _tryAutosave(struct mGUIRunner* runner) {
 	int autosave = false;
 	mCoreConfigGetIntValue(&runner->config, "autosave", &autosave);
@@ -184,7 +241,7 @@ static void _tryAutosave(struct mGUIRunner* runner) {
 	}
 
 #ifdef DISABLE_THREADING
-	mCoreSaveState(runner->core, 0, SAVESTATE_SAVEDATA | SAVESTATE_RTC | SAVESTATE_METADATA);
+	mCoreSaveState(runner->core, 0, _saveStateFlags(runner, SAVESTATE_SAVEDATA | SAVESTATE_RTC | SAVESTATE_METADATA));
 #else
 	MutexLock(&runner->autosave.mutex);
 	if (!runner->autosave.buffer) {
@@ -192,6 +249,7 @@ static void _tryAutosave(struct mGUIRunner* runner) {
 	}
 	runner->autosave.core = runner->core;
 	mCoreSaveStateNamed(runner->core, runner->autosave.buffer, SAVESTATE_SAVEDATA | SAVESTATE_RTC | SAVESTATE_METADATA);
+	mStateIndexEntryCapture(&runner->autosave.index, runner->core);
 	ConditionWake(&runner->autosave.cond);
 	MutexUnlock(&runner->autosave.mutex);
 #endif
@@ -222,6 +280,7 @@ void mGUIInit(struct mGUIRunner* runner, const char* port) {
 #else
 	mCoreConfigSetDefaultIntValue(&runner->config, "autosave", true);
 #endif
+	mCoreConfigSetDefaultIntValue(&runner->config, "compressSaveStates", false);
 	mCoreConfigSetDefaultIntValue(&runner->config, "showOSD", true);
 	mCoreConfigLoad(&runner->config);
 	mCoreConfigGetIntValue(&runner->config, "logLevel", &logger.logLevel);
@@ -246,6 +305,7 @@ void mGUIInit(struct mGUIRunner* runner, const char* port) {
 	if (!runner->autosave.running) {
 		runner->autosave.running = true;
 		runner->autosave.core = NULL;
+		mStateIndexEntryInit(&runner->autosave.index);
 		MutexInit(&runner->autosave.mutex);
 		ConditionInit(&runner->autosave.cond);
 		ThreadCreate(&runner->autosave.thread, mGUIAutosaveThread, &runner->autosave);
@@ -268,6 +328,7 @@ void mGUIDeinit(struct mGUIRunner* runner) {
 	if (runner->autosave.buffer) {
 		runner->autosave.buffer->close(runner->autosave.buffer);
 	}
+	mStateIndexEntryDeinit(&runner->autosave.index);
 #endif
 
 	if (runner->teardown) {
@@ -651,7 +712,7 @@ void mGUIRun(struct mGUIRunner* runner, const char* path) {
 				// If we are saving state, then the screenshot stored for the state previously should no longer be considered up-to-date.
 				// Therefore, mark it as stale so that at draw time we load the new save state's screenshot.
 				((struct mGUIBackground*) stateSaveMenu.background)->screenshotId |= SCREENSHOT_INVALID;
-				mCoreSaveState(runner->core, item->data.v.u >> 16, SAVESTATE_SCREENSHOT | SAVESTATE_SAVEDATA | SAVESTATE_RTC | SAVESTATE_METADATA);
+				mCoreSaveState(runner->core, item->data.v.u >> 16, _saveStateFlags(runner, SAVESTATE_SCREENSHOT | SAVESTATE_SAVEDATA | SAVESTATE_RTC | SAVESTATE_METADATA));
 				break;
 			case RUNNER_LOAD_STATE:
 				mCoreLoadState(runner->core, item->data.v.u >> 16, SAVESTATE_SCREENSHOT | SAVESTATE_RTC);
@@ -713,7 +774,7 @@ void mGUIRun(struct mGUIRunner* runner, const char* path) {
 	int autosave = false;
 	mCoreConfigGetIntValue(&runner->config, "autosave", &autosave);
 	if (autosave) {
-		mCoreSaveState(runner->core, 0, SAVESTATE_SAVEDATA | SAVESTATE_RTC | SAVESTATE_METADATA);
+		mCoreSaveState(runner->core, 0, _saveStateFlags(runner, SAVESTATE_SAVEDATA | SAVESTATE_RTC | SAVESTATE_METADATA));
 	}
 
 	mLOG(GUI_RUNNER, DEBUG, "Unloading game...");
@@ -722,6 +783,7 @@ void mGUIRun(struct mGUIRunner* runner, const char* path) {
 	if (drawState.image) {
 		mappedMemoryFree(drawState.image, drawState.imageSize);
 	}
+	mStateIndexEntryDeinit(&drawState.index);
 
 	if (runner->config.port) {
 		mLOG(GUI_RUNNER, DEBUG, "Saving key sources...");
@@ -787,10 +849,13 @@ THREAD_ENTRY mGUIAutosaveThread(void* context) {
 			if (!vf) {
 				continue;
 			}
-			void* mem = autosave->buffer->map(autosave->buffer, autosave->buffer->size(autosave->buffer), MAP_READ);
-			vf->write(vf, mem, autosave->buffer->size(autosave->buffer));
-			autosave->buffer->unmap(autosave->buffer, mem, autosave->buffer->size(autosave->buffer));
+			size_t size = autosave->buffer->size(autosave->buffer);
+			void* mem = autosave->buffer->map(autosave->buffer, size, MAP_READ);
+			vf->write(vf, mem, size);
+			mStateIndexEntrySetStateBuffer(&autosave->index, mem, size);
+			autosave->buffer->unmap(autosave->buffer, mem, size);
 			vf->close(vf);
+			mCoreWriteStateIndex(autosave->core, 0, &autosave->index);
 		}
 	}
 	MutexUnlock(&autosave->mutex);
@@ -11,6 +11,7 @@
 CXX_GUARD_START
 
 #include <mgba/core/config.h>
+#include <mgba/core/state-index.h>
 #include "feature/gui/remap.h"
 #include <mgba/gba/interface.h>
 #include <mgba-util/circle-buffer.h>
@@ -33,6 +34,7 @@ struct mGUIBackground {
 
 	color_t* image;
 	size_t imageSize;
+	struct mStateIndexEntry index;
 
 	unsigned screenshotId;
 };
@@ -48,6 +50,7 @@ struct VFile;
 struct mGUIAutosaveContext {
 	struct VFile* buffer;
 	struct mCore* core;
+	struct mStateIndexEntry index;
 	Thread thread;
 	Mutex mutex;
 	Condition cond;
@@ -5,6 +5,7 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 #include <mgba/internal/gb/audio.h>
 
+#include <mgba/core/audio-resampler.h>
 #include <mgba/core/blip_buf.h>
 #include <mgba/core/interface.h>
 #include <mgba/core/sync.h>
@@ -59,6 +60,7 @@ void GBAudioInit(struct GBAudio* audio, size_t samples, uint8_t* nr52, enum GBAu
 	audio->samples = samples;
 	audio->left = blip_new(BLIP_BUFFER_SIZE);
 	audio->right = blip_new(BLIP_BUFFER_SIZE);
+	audio->resampler = NULL;
 	audio->clockRate = DMG_SM83_FREQUENCY;
 	// Guess too large; we hang producing extra samples if we guess too low
 	blip_set_rates(audio->left, DMG_SM83_FREQUENCY, 96000);
@@ -68,6 +70,7 @@ void GBAudioInit(struct GBAudio* audio, size_t samples, uint8_t* nr52, enum GBAu
 	audio->forceDisableCh[2] = false;
 	audio->forceDisableCh[3] = false;
 	audio->masterVolume = GB_AUDIO_VOLUME_MAX;
+	audio->suppressOutput = false;
 	audio->nr52 = nr52;
 	audio->style = style;
 	if (style == GB_AUDIO_GBA) {
@@ -128,6 +131,9 @@ void GBAudioReset(struct GBAudio* audio) {
 	audio->capLeft = 0;
 	audio->capRight = 0;
 	audio->clock = 0;
+	if (audio->resampler) {
+		mAudioResamplerClear(audio->resampler);
+	}
 	audio->playingCh1 = false;
 	audio->playingCh2 = false;
 	audio->playingCh3 = false;
@@ -147,10 +153,27 @@ void GBAudioResizeBuffer(struct GBAudio* audio, size_t samples) {
 	audio->samples = samples;
 	blip_clear(audio->left);
 	blip_clear(audio->right);
+	if (audio->resampler) {
+		mAudioResamplerClear(audio->resampler);
+	}
 	audio->clock = 0;
 	mCoreSyncConsumeAudio(audio->p->sync);
 }
 
+void GBAudioSetResampler(struct GBAudio* audio, struct mAudioResampler* resampler) {
+	mCoreSyncLockAudio(audio->p ? audio->p->sync : NULL);
+	audio->resampler = resampler;
+	if (resampler) {
+		// In GB mode the PSG samples at a fixed rate in DMG clocks; in GBA mode
+		// the GBA audio code feeds the resampler and sets the rate itself
+		if (audio->style != GB_AUDIO_GBA) {
+			mAudioResamplerSetInputRate(resampler, DMG_SM83_FREQUENCY / (double) SAMPLE_INTERVAL);
+		}
+		mAudioResamplerClear(resampler);
+	}
+	mCoreSyncUnlockAudio(audio->p ? audio->p->sync : NULL);
+}
+
 void GBAudioWriteNR10(struct GBAudio* audio, uint8_t value) {
 	GBAudioRun(audio, mTimingCurrentTime(audio->timing), 0x1);
 	if (!_writeSweep(&audio->ch1.sweep, value)) {
@@ -811,38 +834,63 @@ static void _sample(struct mTiming* timing, void* user, uint32_t cyclesLate) {
 	struct GBAudio* audio = user;
 	GBAudioSample(audio, mTimingCurrentTime(audio->timing));
 
+	if (audio->suppressOutput) {
+		mTimingSchedule(timing, &audio->sampleEvent, audio->sampleInterval * audio->timingFactor - cyclesLate);
+		return;
+	}
+
 	mCoreSyncLockAudio(audio->p->sync);
 	unsigned produced;
 	int i;
-	for (i = 0; i < GB_MAX_SAMPLES; ++i) {
-		int16_t sampleLeft = audio->currentSamples[i].left;
-		int16_t sampleRight = audio->currentSamples[i].right;
-		if ((size_t) blip_samples_avail(audio->left) < audio->samples) {
-			blip_add_delta(audio->left, audio->clock, sampleLeft - audio->lastLeft);
-			blip_add_delta(audio->right, audio->clock, sampleRight - audio->lastRight);
-			audio->lastLeft = sampleLeft;
-			audio->lastRight = sampleRight;
-			audio->clock += SAMPLE_INTERVAL;
-			if (audio->clock >= CLOCKS_PER_BLIP_FRAME) {
-				blip_end_frame(audio->left, CLOCKS_PER_BLIP_FRAME);
-				blip_end_frame(audio->right, CLOCKS_PER_BLIP_FRAME);
-				audio->clock -= CLOCKS_PER_BLIP_FRAME;
+	if (audio->resampler) {
+		if (mAudioResamplerAvailable(audio->resampler) < audio->samples) {
+			mAudioResamplerWrite(audio->resampler, audio->currentSamples, GB_MAX_SAMPLES);
+		}
+	} else {
+		for (i = 0; i < GB_MAX_SAMPLES; ++i) {
+			int16_t sampleLeft = audio->currentSamples[i].left;
+			int16_t sampleRight = audio->currentSamples[i].right;
+			if ((size_t) blip_samples_avail(audio->left) < audio->samples) {
+				blip_add_delta(audio->left, audio->clock, sampleLeft - audio->lastLeft);
+				blip_add_delta(audio->right, audio->clock, sampleRight - audio->lastRight);
+				audio->lastLeft = sampleLeft;
+				audio->lastRight = sampleRight;
+				audio->clock += SAMPLE_INTERVAL;
+				if (audio->clock >= CLOCKS_PER_BLIP_FRAME) {
+					blip_end_frame(audio->left, CLOCKS_PER_BLIP_FRAME);
+					blip_end_frame(audio->right, CLOCKS_PER_BLIP_FRAME);
+					audio->clock -= CLOCKS_PER_BLIP_FRAME;
+				}
 			}
 		}
-		if (audio->p->stream && audio->p->stream->postAudioFrame) {
-			audio->p->stream->postAudioFrame(audio->p->stream, sampleLeft, sampleRight);
+	}
+	if (audio->p->stream && audio->p->stream->postAudioFrame) {
+		for (i = 0; i < GB_MAX_SAMPLES; ++i) {
+			audio->p->stream->postAudioFrame(audio->p->stream, audio->currentSamples[i].left, audio->currentSamples[i].right);
 		}
 	}
 
-	produced = blip_samples_avail(audio->left);
+	bool interrupted;
+	if (audio->resampler) {
+		produced = mAudioResamplerAvailable(audio->resampler);
+		interrupted = !mCoreSyncProduceResampledAudio(audio->p->sync, audio->resampler, audio->samples);
+	} else {
+		produced = blip_samples_avail(audio->left);
+		interrupted = !mCoreSyncProduceAudio(audio->p->sync, audio->left, audio->samples);
+	}
 	bool wait = produced >= audio->samples;
-	if (!mCoreSyncProduceAudio(audio->p->sync, audio->left, audio->samples)) {
-		// Interrupted
+	if (interrupted) {
 		audio->p->earlyExit = true;
 	}
 
-	if (wait && audio->p->stream && audio->p->stream->postAudioBuffer) {
-		audio->p->stream->postAudioBuffer(audio->p->stream, audio->left, audio->right);
+	if (wait && audio->p->stream) {
+		if (audio->resampler) {
+			if (audio->p->stream->postAudioResampled) {
+				audio->p->stream->postAudioResampled(audio->p->stream, audio->resampler);
+			}
+		} else if (audio->p->stream->postAudioBuffer) {
+			audio->p->stream->postAudioBuffer(audio->p->stream, audio->left, audio->right);
+		}
 	}
 	mTimingSchedule(timing, &audio->sampleEvent, audio->sampleInterval * audio->timingFactor - cyclesLate);
 }
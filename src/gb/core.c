@@ -38,6 +38,15 @@ static const struct mCoreChannelInfo _GBAudioChannels[] = {
 	{ 3, "ch4", "Channel 4", "Noise" },
 };
 
+static const struct mCoreStateSection _GBStateSections[] = {
+	{ 1, "cpu", 0, offsetof(struct GBSerializedState, oam) },
+	{ 2, "oam", offsetof(struct GBSerializedState, oam), GB_SIZE_OAM },
+	{ 3, "io", offsetof(struct GBSerializedState, io), offsetof(struct GBSerializedState, vram) - offsetof(struct GBSerializedState, io) },
+	{ 4, "vram", offsetof(struct GBSerializedState, vram), GB_SIZE_VRAM },
+	{ 5, "wram", offsetof(struct GBSerializedState, wram), GB_SIZE_WORKING_RAM },
+	{ 6, "sgb", offsetof(struct GBSerializedState, sgb), sizeof(struct GBSerializedState) - offsetof(struct GBSerializedState, sgb) },
+};
+
 static const struct mCoreMemoryBlock _GBMemoryBlocks[] = {
 	{ -1, "mem", "All", "All", 0, 0x10000, 0x10000, mCORE_MEMORY_VIRTUAL },
 	{ GB_REGION_CART_BANK0, "cart0", "ROM Bank", "Game Pak (32kiB)", GB_BASE_CART_BANK0, GB_BASE_CART_BANK0 + GB_SIZE_CART_BANK0 * 2, 0x800000, mCORE_MEMORY_READ | mCORE_MEMORY_WORM | mCORE_MEMORY_MAPPED, 511, GB_BASE_CART_BANK0 + GB_SIZE_CART_BANK0 },
@@ -409,6 +418,11 @@ static size_t _GBCoreGetAudioBufferSize(struct mCore* core) {
 	return gb->audio.samples;
 }
 
+static void _GBCoreSetAudioResampler(struct mCore* core, struct mAudioResampler* resampler) {
+	struct GB* gb = core->board;
+	GBAudioSetResampler(&gb->audio, resampler);
+}
+
 static void _GBCoreAddCoreCallbacks(struct mCore* core, struct mCoreCallbacks* coreCallbacks) {
 	struct GB* gb = core->board;
 	*mCoreCallbacksListAppend(&gb->coreCallbacks) = *coreCallbacks;
@@ -690,6 +704,14 @@ static size_t _GBCoreStateSize(struct mCore* core) {
 	return sizeof(struct GBSerializedState);
 }
 
+static size_t _GBCoreListStateSections(const struct mCore* core, const struct mCoreStateSection** sections) {
+	UNUSED(core);
+	if (sections) {
+		*sections = _GBStateSections;
+	}
+	return sizeof(_GBStateSections) / sizeof(*_GBStateSections);
+}
+
 static bool _GBCoreLoadState(struct mCore* core, const void* state) {
 	return GBDeserialize(core->board, state);
 }
@@ -1140,6 +1162,13 @@ static bool _GBCoreSavedataRestore(struct mCore* core, const void* sram, size_t
 	return true;
 }
 
+static size_t _GBCoreSavedataRef(struct mCore* core, const void** sram) {
+	struct GB* gb = core->board;
+	// Unlike savedataClone this leaves out any RTC footer in the save file, which is part of the state anyway
+	*sram = gb->memory.sram;
+	return gb->sramSize;
+}
+
 static size_t _GBCoreListVideoLayers(const struct mCore* core, const struct mCoreChannelInfo** info) {
 	UNUSED(core);
 	if (info) {
@@ -1207,6 +1236,12 @@ static void _GBCoreAdjustVideoLayer(struct mCore* core, size_t id, int32_t x, in
 	}
 }
 
+static void _GBCoreSuppressOutput(struct mCore* core, bool video, bool audio) {
+	struct GB* gb = core->board;
+	gb->video.suppressOutput = video;
+	gb->audio.suppressOutput = audio;
+}
+
 #ifndef MINIMAL_CORE
 static void _GBCoreStartVideoLog(struct mCore* core, struct mVideoLogContext* context) {
 	struct GBCore* gbcore = (struct GBCore*) core;
@@ -1257,6 +1292,7 @@ struct mCore* GBCoreCreate(void) {
 	core->getAudioChannel = _GBCoreGetAudioChannel;
 	core->setAudioBufferSize = _GBCoreSetAudioBufferSize;
 	core->getAudioBufferSize = _GBCoreGetAudioBufferSize;
+	core->setAudioResampler = _GBCoreSetAudioResampler;
 	core->setAVStream = _GBCoreSetAVStream;
 	core->addCoreCallbacks = _GBCoreAddCoreCallbacks;
 	core->clearCoreCallbacks = _GBCoreClearCoreCallbacks;
@@ -1266,6 +1302,7 @@ struct mCore* GBCoreCreate(void) {
 	core->loadSave = _GBCoreLoadSave;
 	core->loadTemporarySave = _GBCoreLoadTemporarySave;
 	core->loadPatch = _GBCoreLoadPatch;
+	core->shareROM = NULL;
 	core->unloadROM = _GBCoreUnloadROM;
 	core->romSize = _GBCoreROMSize;
 	core->checksum = _GBCoreChecksum;
@@ -1276,6 +1313,10 @@ struct mCore* GBCoreCreate(void) {
 	core->stateSize = _GBCoreStateSize;
 	core->loadState = _GBCoreLoadState;
 	core->saveState = _GBCoreSaveState;
+	core->listStateSections = _GBCoreListStateSections;
+	core->snapshotSize = NULL;
+	core->snapshotSave = NULL;
+	core->snapshotLoad = NULL;
 	core->setKeys = _GBCoreSetKeys;
 	core->addKeys = _GBCoreAddKeys;
 	core->clearKeys = _GBCoreClearKeys;
@@ -1315,11 +1356,13 @@ struct mCore* GBCoreCreate(void) {
 	core->cheatDevice = _GBCoreCheatDevice;
 	core->savedataClone = _GBCoreSavedataClone;
 	core->savedataRestore = _GBCoreSavedataRestore;
+	core->savedataRef = _GBCoreSavedataRef;
 	core->listVideoLayers = _GBCoreListVideoLayers;
 	core->listAudioChannels = _GBCoreListAudioChannels;
 	core->enableVideoLayer = _GBCoreEnableVideoLayer;
 	core->enableAudioChannel = _GBCoreEnableAudioChannel;
 	core->adjustVideoLayer = _GBCoreAdjustVideoLayer;
+	core->suppressOutput = _GBCoreSuppressOutput;
 #ifndef MINIMAL_CORE
 	core->startVideoLog = _GBCoreStartVideoLog;
 	core->endVideoLog = _GBCoreEndVideoLog;
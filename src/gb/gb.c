@@ -1164,7 +1164,7 @@ void GBFrameEnded(struct GB* gb) {
 	}
 
 	// TODO: Move to common code
-	if (gb->stream && gb->stream->postVideoFrame) {
+	if (gb->stream && gb->stream->postVideoFrame && !gb->video.suppressOutput) {
 		const color_t* pixels;
 		size_t stride;
 		gb->video.renderer->getPixels(gb->video.renderer, &stride, (const void**) &pixels);
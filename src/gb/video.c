@@ -284,6 +284,7 @@ void GBVideoInit(struct GBVideo* video) {
 	video->renderer = NULL;
 	video->vram = anonymousMemoryMap(GB_SIZE_VRAM);
 	video->frameskip = 0;
+	video->suppressOutput = false;
 
 	video->modeEvent.context = video;
 	video->modeEvent.name = "GB Video Mode";
@@ -546,7 +547,7 @@ void GBVideoSkipBIOS(struct GBVideo* video) {
 
 void _endMode0(struct mTiming* timing, void* context, uint32_t cyclesLate) {
 	struct GBVideo* video = context;
-	if (video->frameskipCounter <= 0) {
+	if (video->frameskipCounter <= 0 && !video->suppressOutput) {
 		video->renderer->finishScanline(video->renderer, video->ly);
 	}
 	int lyc = video->p->memory.io[GB_REG_LYC];
@@ -679,11 +680,15 @@ void _updateFrameCount(struct mTiming* timing, void* context, uint32_t cyclesLat
 
 	--video->frameskipCounter;
 	if (video->frameskipCounter < 0) {
-		video->renderer->finishFrame(video->renderer);
+		if (!video->suppressOutput) {
+			video->renderer->finishFrame(video->renderer);
+		}
 		video->frameskipCounter = video->frameskip;
 	}
 	GBFrameEnded(video->p);
-	mCoreSyncPostFrame(video->p->sync);
+	if (!video->suppressOutput) {
+		mCoreSyncPostFrame(video->p->sync);
+	}
 	++video->frameCounter;
 	video->p->earlyExit = true;
 
@@ -721,7 +726,7 @@ void GBVideoProcessDots(struct GBVideo* video, uint32_t cyclesLate) {
 	if (oldX < 0) {
 		oldX = 0;
 	}
-	if (video->frameskipCounter <= 0) {
+	if (video->frameskipCounter <= 0 && !video->suppressOutput) {
 		video->renderer->drawRange(video->renderer, oldX, video->x, video->ly);
 	}
 }
@@ -6,6 +6,7 @@
 #include <mgba/internal/gba/audio.h>
 
 #include <mgba/internal/arm/macros.h>
+#include <mgba/core/audio-resampler.h>
 #include <mgba/core/blip_buf.h>
 #include <mgba/core/sync.h>
 #include <mgba/internal/gba/dma.h>
@@ -29,6 +30,7 @@ static const int SAMPLE_INTERVAL = GBA_ARM7TDMI_FREQUENCY / 0x4000;
 static const int CLOCKS_PER_FRAME = 0x800;
 
 static int _applyBias(struct GBAAudio* audio, int sample);
+static void _updateResamplerRate(struct GBAAudio* audio);
 static void _sample(struct mTiming* timing, void* user, uint32_t cyclesLate);
 
 void GBAAudioInit(struct GBAAudio* audio, size_t samples) {
@@ -54,6 +56,7 @@ void GBAAudioInit(struct GBAAudio* audio, size_t samples) {
 	audio->forceDisableChA = false;
 	audio->forceDisableChB = false;
 	audio->masterVolume = GBA_AUDIO_VOLUME_MAX;
+	audio->suppressOutput = false;
 	audio->mixer = NULL;
 }
 
@@ -98,6 +101,10 @@ void GBAAudioReset(struct GBAAudio* audio) {
 
 	blip_clear(audio->psg.left);
 	blip_clear(audio->psg.right);
+	if (audio->psg.resampler) {
+		mAudioResamplerClear(audio->psg.resampler);
+		_updateResamplerRate(audio);
+	}
 	audio->clock = 0;
 }
 
@@ -113,10 +120,29 @@ void GBAAudioResizeBuffer(struct GBAAudio* audio, size_t samples) {
 	audio->samples = samples;
 	blip_clear(audio->psg.left);
 	blip_clear(audio->psg.right);
+	if (audio->psg.resampler) {
+		mAudioResamplerClear(audio->psg.resampler);
+	}
 	audio->clock = 0;
 	mCoreSyncConsumeAudio(audio->p->sync);
 }
 
+void GBAAudioSetResampler(struct GBAAudio* audio, struct mAudioResampler* resampler) {
+	mCoreSyncLockAudio(audio->p->sync);
+	audio->psg.resampler = resampler;
+	if (resampler) {
+		_updateResamplerRate(audio);
+		mAudioResamplerClear(resampler);
+	}
+	mCoreSyncUnlockAudio(audio->p->sync);
+}
+
+static void _updateResamplerRate(struct GBAAudio* audio) {
+	if (audio->psg.resampler) {
+		mAudioResamplerSetInputRate(audio->psg.resampler, GBA_ARM7TDMI_FREQUENCY / (double) audio->sampleInterval);
+	}
+}
+
 void GBAAudioScheduleFifoDma(struct GBAAudio* audio, int number, struct GBADMA* info) {
 	info->reg = GBADMARegisterSetDestControl(info->reg, GBA_DMA_FIXED);
 	info->reg = GBADMARegisterSetWidth(info->reg, 1);
@@ -271,6 +297,7 @@ void GBAAudioWriteSOUNDBIAS(struct GBAAudio* audio, uint16_t value) {
 		if (audio->sampleIndex < 0 || audio->sampleIndex >= GBA_MAX_SAMPLES) {
 			audio->sampleIndex = 0;
 		}
+		_updateResamplerRate(audio);
 		if (audio->p->stream && audio->p->stream->audioRateChanged) {
 			audio->p->stream->audioRateChanged(audio->p->stream, GBA_ARM7TDMI_FREQUENCY / audio->sampleInterval);
 		}
@@ -444,38 +471,64 @@ static void _sample(struct mTiming* timing, void* user, uint32_t cyclesLate) {
 	memset(audio->chA.samples, audio->chA.samples[samples - 1], sizeof(audio->chA.samples));
 	memset(audio->chB.samples, audio->chB.samples[samples - 1], sizeof(audio->chB.samples));
 
+	if (audio->suppressOutput) {
+		mTimingSchedule(timing, &audio->sampleEvent, SAMPLE_INTERVAL - cyclesLate);
+		return;
+	}
+
 	mCoreSyncLockAudio(audio->p->sync);
 	unsigned produced;
 	int i;
-	for (i = 0; i < samples; ++i) {
-		int16_t sampleLeft = audio->currentSamples[i].left;
-		int16_t sampleRight = audio->currentSamples[i].right;
-		if ((size_t) blip_samples_avail(audio->psg.left) < audio->samples) {
-			blip_add_delta(audio->psg.left, audio->clock, sampleLeft - audio->lastLeft);
-			blip_add_delta(audio->psg.right, audio->clock, sampleRight - audio->lastRight);
-			audio->lastLeft = sampleLeft;
-			audio->lastRight = sampleRight;
-			audio->clock += audio->sampleInterval;
-			if (audio->clock >= CLOCKS_PER_FRAME) {
-				blip_end_frame(audio->psg.left, CLOCKS_PER_FRAME);
-				blip_end_frame(audio->psg.right, CLOCKS_PER_FRAME);
-				audio->clock -= CLOCKS_PER_FRAME;
+	struct mAudioResampler* resampler = audio->psg.resampler;
+	if (resampler) {
+		if (mAudioResamplerAvailable(resampler) < audio->samples) {
+			mAudioResamplerWrite(resampler, audio->currentSamples, samples);
+		}
+	} else {
+		for (i = 0; i < samples; ++i) {
+			int16_t sampleLeft = audio->currentSamples[i].left;
+			int16_t sampleRight = audio->currentSamples[i].right;
+			if ((size_t) blip_samples_avail(audio->psg.left) < audio->samples) {
+				blip_add_delta(audio->psg.left, audio->clock, sampleLeft - audio->lastLeft);
+				blip_add_delta(audio->psg.right, audio->clock, sampleRight - audio->lastRight);
+				audio->lastLeft = sampleLeft;
+				audio->lastRight = sampleRight;
+				audio->clock += audio->sampleInterval;
+				if (audio->clock >= CLOCKS_PER_FRAME) {
+					blip_end_frame(audio->psg.left, CLOCKS_PER_FRAME);
+					blip_end_frame(audio->psg.right, CLOCKS_PER_FRAME);
+					audio->clock -= CLOCKS_PER_FRAME;
+				}
 			}
 		}
-
-		if (audio->p->stream && audio->p->stream->postAudioFrame) {
-			audio->p->stream->postAudioFrame(audio->p->stream, sampleLeft, sampleRight);
+	}
+	if (audio->p->stream && audio->p->stream->postAudioFrame) {
+		for (i = 0; i < samples; ++i) {
+			audio->p->stream->postAudioFrame(audio->p->stream, audio->currentSamples[i].left, audio->currentSamples[i].right);
 		}
 	}
-	produced = blip_samples_avail(audio->psg.left);
+
+	bool interrupted;
+	if (resampler) {
+		produced = mAudioResamplerAvailable(resampler);
+		interrupted = !mCoreSyncProduceResampledAudio(audio->p->sync, resampler, audio->samples);
+	} else {
+		produced = blip_samples_avail(audio->psg.left);
+		interrupted = !mCoreSyncProduceAudio(audio->p->sync, audio->psg.left, audio->samples);
+	}
 	bool wait = produced >= audio->samples;
-	if (!mCoreSyncProduceAudio(audio->p->sync, audio->psg.left, audio->samples)) {
-		// Interrupted
+	if (interrupted) {
 		audio->p->earlyExit = true;
 	}
 
-	if (wait && audio->p->stream && audio->p->stream->postAudioBuffer) {
-		audio->p->stream->postAudioBuffer(audio->p->stream, audio->psg.left, audio->psg.right);
+	if (wait && audio->p->stream) {
+		if (resampler) {
+			if (audio->p->stream->postAudioResampled) {
+				audio->p->stream->postAudioResampled(audio->p->stream, resampler);
+			}
+		} else if (audio->p->stream->postAudioBuffer) {
+			audio->p->stream->postAudioBuffer(audio->p->stream, audio->psg.left, audio->psg.right);
+		}
 	}
 
 	mTimingSchedule(timing, &audio->sampleEvent, SAMPLE_INTERVAL - cyclesLate);
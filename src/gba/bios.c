@@ -50,6 +50,7 @@ static void _SoftReset(struct GBA* gba) {
 	cpu->gprs[ARM_SP] = GBA_SP_BASE_SYSTEM;
 	int8_t flag = ((int8_t*) gba->memory.iwram)[0x7FFA];
 	memset(((int8_t*) gba->memory.iwram) + SIZE_WORKING_IRAM - 0x200, 0, 0x200);
+	GBAMemoryMarkDirty(gba, BASE_WORKING_IRAM + SIZE_WORKING_IRAM - 0x200, 0x200);
 	if (flag) {
 		cpu->gprs[ARM_PC] = BASE_WORKING_RAM;
 	} else {
@@ -65,15 +66,18 @@ static void _RegisterRamReset(struct GBA* gba) {
 	cpu->memory.store16(cpu, BASE_IO | REG_DISPCNT, 0x0080, 0);
 	if (registers & 0x01) {
 		memset(gba->memory.wram, 0, SIZE_WORKING_RAM);
+		GBAMemoryMarkDirty(gba, BASE_WORKING_RAM, SIZE_WORKING_RAM);
 	}
 	if (registers & 0x02) {
 		memset(gba->memory.iwram, 0, SIZE_WORKING_IRAM - 0x200);
+		GBAMemoryMarkDirty(gba, BASE_WORKING_IRAM, SIZE_WORKING_IRAM - 0x200);
 	}
 	if (registers & 0x04) {
 		memset(gba->video.palette, 0, SIZE_PALETTE_RAM);
 	}
 	if (registers & 0x08) {
 		memset(gba->video.vram, 0, SIZE_VRAM);
+		GBAMemoryMarkDirty(gba, BASE_VRAM, SIZE_VRAM);
 	}
 	if (registers & 0x10) {
 		memset(gba->video.oam.raw, 0, SIZE_OAM);
@@ -435,6 +439,14 @@ void GBASwi16(struct ARMCore* cpu, int immediate) {
 	case 0xFA:
 		GBAPrintFlush(gba);
 		return;
+#ifndef MINIMAL_CORE
+	case MP2K_HLE_SWI: // Patched into the MP2K sound driver by the audio mixer
+		if (gba->audio.mixer) {
+			gba->audio.mixer->soundMain(gba->audio.mixer);
+			return;
+		}
+		break;
+#endif
 	}
 
 	if (gba->memory.fullBios) {
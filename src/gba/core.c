@@ -7,9 +7,11 @@
 
 #include <mgba/core/core.h>
 #include <mgba/core/log.h>
+#include <mgba/core/serialize.h>
 #include <mgba/internal/arm/debugger/debugger.h>
 #include <mgba/internal/arm/isa-inlines.h>
 #include <mgba/internal/debugger/symbols.h>
+#include <mgba/internal/defines.h>
 #include <mgba/internal/gba/cheats.h>
 #include <mgba/internal/gba/gba.h>
 #include <mgba/internal/gba/io.h>
@@ -55,6 +57,16 @@ static const struct mCoreChannelInfo _GBAAudioChannels[] = {
 	{ 5, "chB", "FIFO Channel B", NULL },
 };
 
+static const struct mCoreStateSection _GBAStateSections[] = {
+	{ 1, "cpu", 0, offsetof(struct GBASerializedState, io) },
+	{ 2, "io", offsetof(struct GBASerializedState, io), SIZE_IO },
+	{ 3, "palette", offsetof(struct GBASerializedState, pram), SIZE_PALETTE_RAM },
+	{ 4, "oam", offsetof(struct GBASerializedState, oam), SIZE_OAM },
+	{ 5, "vram", offsetof(struct GBASerializedState, vram), SIZE_VRAM },
+	{ 6, "iwram", offsetof(struct GBASerializedState, iwram), SIZE_WORKING_IRAM },
+	{ 7, "wram", offsetof(struct GBASerializedState, wram), SIZE_WORKING_RAM },
+};
+
 static const struct mCoreMemoryBlock _GBAMemoryBlocks[] = {
 	{ -1, "mem", "All", "All", 0, 0x10000000, 0x10000000, mCORE_MEMORY_VIRTUAL },
 	{ REGION_BIOS, "bios", "BIOS", "BIOS (16kiB)", BASE_BIOS, SIZE_BIOS, SIZE_BIOS, mCORE_MEMORY_READ | mCORE_MEMORY_MAPPED },
@@ -181,6 +193,7 @@ struct GBACore {
 	struct mDebuggerPlatform* debuggerPlatform;
 	struct mCheatDevice* cheatDevice;
 	struct GBAAudioMixer* audioMixer;
+	const void* snapshotSavedata;
 };
 
 static bool _GBACoreInit(struct mCore* core) {
@@ -206,6 +219,7 @@ static bool _GBACoreInit(struct mCore* core) {
 	gbacore->logContext = NULL;
 #endif
 	gbacore->audioMixer = NULL;
+	gbacore->snapshotSavedata = NULL;
 
 	GBACreate(gba);
 	// TODO: Restore cheats
@@ -485,6 +499,11 @@ static size_t _GBACoreGetAudioBufferSize(struct mCore* core) {
 	return gba->audio.samples;
 }
 
+static void _GBACoreSetAudioResampler(struct mCore* core, struct mAudioResampler* resampler) {
+	struct GBA* gba = core->board;
+	GBAAudioSetResampler(&gba->audio, resampler);
+}
+
 static void _GBACoreAddCoreCallbacks(struct mCore* core, struct mCoreCallbacks* coreCallbacks) {
 	struct GBA* gba = core->board;
 	*mCoreCallbacksListAppend(&gba->coreCallbacks) = *coreCallbacks;
@@ -560,6 +579,22 @@ static bool _GBACoreLoadPatch(struct mCore* core, struct VFile* vf) {
 	return true;
 }
 
+static bool _GBACoreShareROM(struct mCore* core, struct mCore* source) {
+	struct GBA* gba = core->board;
+	struct GBA* sourceGBA = source->board;
+	if (!GBAShareROM(gba, sourceGBA)) {
+		return false;
+	}
+	if (sourceGBA->memory.fullBios) {
+		// Closing a const memory file leaves the memory alone, so this borrows the source's mapping
+		struct VFile* bios = VFileFromConstMemory(sourceGBA->memory.bios, SIZE_BIOS);
+		if (bios) {
+			GBALoadBIOS(gba, bios);
+		}
+	}
+	return true;
+}
+
 static void _GBACoreUnloadROM(struct mCore* core) {
 	struct GBACore* gbacore = (struct GBACore*) core;
 	struct ARMCore* cpu = core->cpu;
@@ -632,13 +667,18 @@ static void _GBACoreReset(struct mCore* core) {
 	}
 
 #ifndef MINIMAL_CORE
-	int useAudioMixer;
-	if (!gbacore->audioMixer && mCoreConfigGetIntValue(&core->config, "gba.audioHle", &useAudioMixer) && useAudioMixer) {
+	int useAudioMixer = 0;
+	mCoreConfigGetIntValue(&core->config, "gba.audioHle", &useAudioMixer);
+	if (!gbacore->audioMixer && useAudioMixer) {
 		gbacore->audioMixer = malloc(sizeof(*gbacore->audioMixer));
 		GBAAudioMixerCreate(gbacore->audioMixer);
 		((struct ARMCore*) core->cpu)->components[CPU_COMPONENT_AUDIO_MIXER] = &gbacore->audioMixer->d;
 		ARMHotplugAttach(core->cpu, CPU_COMPONENT_AUDIO_MIXER);
 	}
+	if (gbacore->audioMixer) {
+		// 1 mixes MP2K output externally, 2 replaces the game's own mixer
+		gbacore->audioMixer->nativeMixing = useAudioMixer == 2;
+	}
 #endif
 
 	bool forceGbp = false;
@@ -738,6 +778,14 @@ static size_t _GBACoreStateSize(struct mCore* core) {
 	return sizeof(struct GBASerializedState);
 }
 
+static size_t _GBACoreListStateSections(const struct mCore* core, const struct mCoreStateSection** sections) {
+	UNUSED(core);
+	if (sections) {
+		*sections = _GBAStateSections;
+	}
+	return sizeof(_GBAStateSections) / sizeof(*_GBAStateSections);
+}
+
 static bool _GBACoreLoadState(struct mCore* core, const void* state) {
 	return GBADeserialize(core->board, state);
 }
@@ -747,6 +795,78 @@ static bool _GBACoreSaveState(struct mCore* core, void* state) {
 	return true;
 }
 
+static_assert(DIRTY_PAGE_SHIFT == mSTATE_PAGE_SHIFT, "GBA dirty pages do not match snapshot pages");
+
+static size_t _GBACoreSnapshotSavedataSize(struct GBA* gba) {
+	if (!gba->memory.savedata.data) {
+		return 0;
+	}
+	return (GBASavedataSize(&gba->memory.savedata) + mSTATE_PAGE_SIZE - 1) & ~(mSTATE_PAGE_SIZE - 1);
+}
+
+static size_t _GBACoreSnapshotSize(struct mCore* core) {
+	return sizeof(struct GBASerializedState) + _GBACoreSnapshotSavedataSize(core->board);
+}
+
+static void _GBACoreSnapshotSave(struct mCore* core, void* image, uint32_t* dirty) {
+	struct GBACore* gbacore = (struct GBACore*) core;
+	struct GBA* gba = core->board;
+	struct GBASavedata* savedata = &gba->memory.savedata;
+	size_t savedataSize = savedata->data ? GBASavedataSize(savedata) : 0;
+	uint8_t* savedataImage = (uint8_t*) image + sizeof(struct GBASerializedState);
+	if (!dirty) {
+		GBASerialize(gba, image);
+		memset(gba->memory.dirtyPages, 0, sizeof(gba->memory.dirtyPages));
+		memset(savedataImage, 0xFF, _GBACoreSnapshotSavedataSize(gba));
+		memcpy(savedataImage, savedata->data, savedataSize);
+	} else {
+		GBASerializeDirty(gba, image, dirty);
+		if (savedataSize && (savedata->snapshotDirty || gbacore->snapshotSavedata != savedata->data)) {
+			// Savedata is only written in small bursts, so diff it page by page instead of tracking stores
+			size_t offset;
+			for (offset = 0; offset < savedataSize; offset += mSTATE_PAGE_SIZE) {
+				size_t chunk = savedataSize - offset;
+				if (chunk > mSTATE_PAGE_SIZE) {
+					chunk = mSTATE_PAGE_SIZE;
+				}
+				if (!memcmp(&savedataImage[offset], &savedata->data[offset], chunk)) {
+					continue;
+				}
+				memcpy(&savedataImage[offset], &savedata->data[offset], chunk);
+				size_t page = (sizeof(struct GBASerializedState) + offset) >> mSTATE_PAGE_SHIFT;
+				dirty[page >> 5] |= 1U << (page & 31);
+			}
+		}
+	}
+	savedata->snapshotDirty = false;
+	gbacore->snapshotSavedata = savedata->data;
+}
+
+static bool _GBACoreSnapshotLoad(struct mCore* core, const void* image, size_t size) {
+	struct GBACore* gbacore = (struct GBACore*) core;
+	struct GBA* gba = core->board;
+	if (size < sizeof(struct GBASerializedState) || !GBADeserialize(gba, image)) {
+		return false;
+	}
+	memset(gba->memory.dirtyPages, 0, sizeof(gba->memory.dirtyPages));
+
+	struct GBASavedata* savedata = &gba->memory.savedata;
+	size_t savedataSize = savedata->data ? GBASavedataSize(savedata) : 0;
+	const uint8_t* savedataImage = (const uint8_t*) image + sizeof(struct GBASerializedState);
+	if (size - sizeof(struct GBASerializedState) != _GBACoreSnapshotSavedataSize(gba)) {
+		// Savedata type changed since this snapshot; leave it be and let the next save resync
+		savedata->snapshotDirty = true;
+		return true;
+	}
+	if (savedataSize && memcmp(savedata->data, savedataImage, savedataSize)) {
+		memcpy(savedata->data, savedataImage, savedataSize);
+		savedata->dirty |= mSAVEDATA_DIRT_NEW;
+	}
+	savedata->snapshotDirty = false;
+	gbacore->snapshotSavedata = savedata->data;
+	return true;
+}
+
 static void _GBACoreSetKeys(struct mCore* core, uint32_t keys) {
 	struct GBA* gba = core->board;
 	gba->keysActive = keys;
@@ -1220,11 +1340,21 @@ static size_t _GBACoreSavedataClone(struct mCore* core, void** sram) {
 }
 
 static bool _GBACoreSavedataRestore(struct mCore* core, const void* sram, size_t size, bool writeback) {
+	struct GBA* gba = core->board;
+	struct GBASavedata* savedata = &gba->memory.savedata;
+	if (writeback && savedata->data && size == GBASavedataSize(savedata)) {
+		// Same type and size, so there's nothing to reconfigure
+		if (memcmp(savedata->data, sram, size)) {
+			memcpy(savedata->data, sram, size);
+			savedata->dirty |= mSAVEDATA_DIRT_NEW;
+			savedata->snapshotDirty = true;
+		}
+		return true;
+	}
 	struct VFile* vf = VFileMemChunk(sram, size);
 	if (!vf) {
 		return false;
 	}
-	struct GBA* gba = core->board;
 	bool success = true;
 	if (writeback) {
 		success = GBASavedataLoad(&gba->memory.savedata, vf);
@@ -1235,6 +1365,16 @@ static bool _GBACoreSavedataRestore(struct mCore* core, const void* sram, size_t
 	return success;
 }
 
+static size_t _GBACoreSavedataRef(struct mCore* core, const void** sram) {
+	struct GBA* gba = core->board;
+	if (!gba->memory.savedata.data) {
+		*sram = NULL;
+		return 0;
+	}
+	*sram = gba->memory.savedata.data;
+	return GBASavedataSize(&gba->memory.savedata);
+}
+
 static size_t _GBACoreListVideoLayers(const struct mCore* core, const struct mCoreChannelInfo** info) {
 	UNUSED(core);
 	if (info) {
@@ -1336,6 +1476,12 @@ static void _GBACoreAdjustVideoLayer(struct mCore* core, size_t id, int32_t x, i
 	memset(gbacore->renderer.scanlineDirty, 0xFFFFFFFF, sizeof(gbacore->renderer.scanlineDirty));
 }
 
+static void _GBACoreSuppressOutput(struct mCore* core, bool video, bool audio) {
+	struct GBA* gba = core->board;
+	gba->video.suppressOutput = video;
+	gba->audio.suppressOutput = audio;
+}
+
 #ifndef MINIMAL_CORE
 static void _GBACoreStartVideoLog(struct mCore* core, struct mVideoLogContext* context) {
 	struct GBACore* gbacore = (struct GBACore*) core;
@@ -1389,6 +1535,7 @@ struct mCore* GBACoreCreate(void) {
 	core->getAudioChannel = _GBACoreGetAudioChannel;
 	core->setAudioBufferSize = _GBACoreSetAudioBufferSize;
 	core->getAudioBufferSize = _GBACoreGetAudioBufferSize;
+	core->setAudioResampler = _GBACoreSetAudioResampler;
 	core->addCoreCallbacks = _GBACoreAddCoreCallbacks;
 	core->clearCoreCallbacks = _GBACoreClearCoreCallbacks;
 	core->setAVStream = _GBACoreSetAVStream;
@@ -1398,6 +1545,7 @@ struct mCore* GBACoreCreate(void) {
 	core->loadSave = _GBACoreLoadSave;
 	core->loadTemporarySave = _GBACoreLoadTemporarySave;
 	core->loadPatch = _GBACoreLoadPatch;
+	core->shareROM = _GBACoreShareROM;
 	core->unloadROM = _GBACoreUnloadROM;
 	core->romSize = _GBACoreROMSize;
 	core->checksum = _GBACoreChecksum;
@@ -1408,6 +1556,10 @@ struct mCore* GBACoreCreate(void) {
 	core->stateSize = _GBACoreStateSize;
 	core->loadState = _GBACoreLoadState;
 	core->saveState = _GBACoreSaveState;
+	core->listStateSections = _GBACoreListStateSections;
+	core->snapshotSize = _GBACoreSnapshotSize;
+	core->snapshotSave = _GBACoreSnapshotSave;
+	core->snapshotLoad = _GBACoreSnapshotLoad;
 	core->setKeys = _GBACoreSetKeys;
 	core->addKeys = _GBACoreAddKeys;
 	core->clearKeys = _GBACoreClearKeys;
@@ -1447,11 +1599,13 @@ struct mCore* GBACoreCreate(void) {
 	core->cheatDevice = _GBACoreCheatDevice;
 	core->savedataClone = _GBACoreSavedataClone;
 	core->savedataRestore = _GBACoreSavedataRestore;
+	core->savedataRef = _GBACoreSavedataRef;
 	core->listVideoLayers = _GBACoreListVideoLayers;
 	core->listAudioChannels = _GBACoreListAudioChannels;
 	core->enableVideoLayer = _GBACoreEnableVideoLayer;
 	core->enableAudioChannel = _GBACoreEnableAudioChannel;
 	core->adjustVideoLayer = _GBACoreAdjustVideoLayer;
+	core->suppressOutput = _GBACoreSuppressOutput;
 #ifndef MINIMAL_CORE
 	core->startVideoLog = _GBACoreStartVideoLog;
 	core->endVideoLog = _GBACoreEndVideoLog;
@@ -1559,6 +1713,9 @@ struct mCore* GBAVideoLogPlayerCreate(void) {
 	core->reset = _GBAVLPReset;
 	core->loadROM = _GBAVLPLoadROM;
 	core->loadState = _GBAVLPLoadState;
+	core->snapshotSize = NULL;
+	core->snapshotSave = NULL;
+	core->snapshotLoad = NULL;
 	core->isROM = _returnTrue;
 	return core;
 }
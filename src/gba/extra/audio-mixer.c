@@ -6,17 +6,60 @@
 #include <mgba/internal/gba/extra/audio-mixer.h>
 
 #include <mgba/core/blip_buf.h>
+#include <mgba/internal/arm/isa-inlines.h>
+#include <mgba/internal/arm/macros.h>
 #include <mgba/internal/gba/gba.h>
+#include <mgba/internal/gba/memory.h>
 #include <mgba/internal/gba/video.h>
 
 #define OVERSAMPLE 2
 
+#define MP2K_PCM_DMA_BUF_SIZE 0x630
+#define MP2K_PCM_BUFFER_OFFSET 0x350
+#define MP2K_CHANNEL_SIZE 0x40
+#define MP2K_WAVE_HEADER_SIZE 0x10
+#define MP2K_SOUND_MAIN_FRAME 0x40
+
+#define MP2K_STATUS_ON 0xC7
+#define MP2K_STATUS_START 0x80
+#define MP2K_STATUS_STOP 0x40
+#define MP2K_STATUS_LOOP 0x10
+#define MP2K_STATUS_IEC 0x04
+#define MP2K_STATUS_ENV 0x03
+#define MP2K_STATUS_ATTACK 0x03
+#define MP2K_STATUS_DECAY 0x02
+#define MP2K_TYPE_FIX 0x08
+
+// Prologue of SoundMain, up to the point where it reserves its locals
+static const struct {
+	uint16_t value;
+	uint16_t mask;
+} _mp2kSoundMainSignature[] = {
+	{ 0x4800, 0xFF00 }, // ldr r0, =SOUND_INFO_PTR
+	{ 0x6800, 0xFFFF }, // ldr r0, [r0]
+	{ 0x4A00, 0xFF00 }, // ldr r2, =ID_NUMBER
+	{ 0x6803, 0xFFFF }, // ldr r3, [r0, ident]
+	{ 0x429A, 0xFFFF }, // cmp r2, r3
+	{ 0xD000, 0xFF00 }, // beq
+	{ 0x4770, 0xFFFF }, // bx lr
+	{ 0x3301, 0xFFFF }, // adds r3, 1
+	{ 0x6003, 0xFFFF }, // str r3, [r0, ident]
+	{ 0xB5F0, 0xFFFF }, // push {r4-r7, lr}
+	{ 0x4641, 0xFFFF }, // mov r1, r8
+	{ 0x464A, 0xFFFF }, // mov r2, r9
+	{ 0x4653, 0xFFFF }, // mov r3, r10
+	{ 0x465C, 0xFFFF }, // mov r4, r11
+	{ 0xB41F, 0xFFFF }, // push {r0-r4}
+	{ 0xB086, 0xFFFF }, // sub sp, 0x18
+};
+
 static void _mp2kInit(void* cpu, struct mCPUComponent* component);
 static void _mp2kDeinit(struct mCPUComponent* component);
 
 static bool _mp2kEngage(struct GBAAudioMixer* mixer, uint32_t address);
 static void _mp2kVblank(struct GBAAudioMixer* mixer);
 static void _mp2kStep(struct GBAAudioMixer* mixer);
+static void _mp2kSoundMain(struct GBAAudioMixer* mixer);
 
 void GBAAudioMixerCreate(struct GBAAudioMixer* mixer) {
 	mixer->d.init = _mp2kInit;
@@ -24,6 +67,7 @@ void GBAAudioMixerCreate(struct GBAAudioMixer* mixer) {
 	mixer->engage = _mp2kEngage;
 	mixer->vblank = _mp2kVblank;
 	mixer->step = _mp2kStep;
+	mixer->soundMain = _mp2kSoundMain;
 }
 
 void _mp2kInit(void* cpu, struct mCPUComponent* component) {
@@ -33,6 +77,8 @@ void _mp2kInit(void* cpu, struct mCPUComponent* component) {
 	gba->audio.mixer = mixer;
 	mixer->p = &gba->audio;
 	mixer->contextAddress = 0;
+	mixer->nativeMixing = false;
+	mixer->hookAddress = 0;
 	mixer->tempo = 120.0 / 75.0;
 	mixer->frame = 0;
 	mixer->last.left = 0;
@@ -244,9 +290,119 @@ static void _mp2kReload(struct GBAAudioMixer* mixer) {
 	}
 }
 
+static void* _mp2kPointer(struct GBA* gba, uint32_t address, uint32_t size) {
+	uint32_t offset;
+	switch (address >> BASE_OFFSET) {
+	case REGION_WORKING_RAM:
+		offset = address & (SIZE_WORKING_RAM - 1);
+		if (offset + size > SIZE_WORKING_RAM) {
+			return NULL;
+		}
+		return &((uint8_t*) gba->memory.wram)[offset];
+	case REGION_WORKING_IRAM:
+		offset = address & (SIZE_WORKING_IRAM - 1);
+		if (offset + size > SIZE_WORKING_IRAM) {
+			return NULL;
+		}
+		return &((uint8_t*) gba->memory.iwram)[offset];
+	case REGION_CART0:
+	case REGION_CART0_EX:
+	case REGION_CART1:
+	case REGION_CART1_EX:
+	case REGION_CART2:
+	case REGION_CART2_EX:
+		offset = address & (SIZE_CART0 - 1);
+		if (!gba->memory.rom || (uint64_t) offset + size > gba->memory.romSize) {
+			return NULL;
+		}
+		return &((uint8_t*) gba->memory.rom)[offset];
+	default:
+		return NULL;
+	}
+}
+
+static uint32_t _mp2kFindHook(struct GBA* gba) {
+	const uint16_t* rom = (const uint16_t*) gba->memory.rom;
+	size_t length = gba->memory.romSize / 2;
+	size_t signatureLength = sizeof(_mp2kSoundMainSignature) / sizeof(*_mp2kSoundMainSignature);
+	size_t i;
+	for (i = 0; i + signatureLength < length; ++i) {
+		size_t j;
+		for (j = 0; j < signatureLength; ++j) {
+			uint16_t value;
+			LOAD_16(value, (i + j) * 2, rom);
+			if ((value & _mp2kSoundMainSignature[j].mask) != _mp2kSoundMainSignature[j].value) {
+				break;
+			}
+		}
+		if (j < signatureLength) {
+			continue;
+		}
+
+		// SoundMain ends by loading the buffer size into r6 and jumping to
+		// SoundMainRAM in IWRAM. That jump is what gets replaced.
+		for (j = i + signatureLength; j + 2 < length && j < i + 0x60; ++j) {
+			uint16_t ldrR6;
+			uint16_t ldrR3;
+			uint16_t bxR3;
+			LOAD_16(ldrR6, j * 2, rom);
+			LOAD_16(ldrR3, j * 2 + 2, rom);
+			LOAD_16(bxR3, j * 2 + 4, rom);
+			if ((ldrR6 & 0xFF00) != 0x4E00 || (ldrR3 & 0xFF00) != 0x4B00 || bxR3 != 0x4718) {
+				continue;
+			}
+			uint32_t literal = (((j * 2 + 4) & ~3) + (ldrR6 & 0xFF) * 4);
+			uint32_t size;
+			if (literal + 4 > gba->memory.romSize) {
+				break;
+			}
+			LOAD_32(size, literal, rom);
+			literal = (((j * 2 + 6) & ~3) + (ldrR3 & 0xFF) * 4);
+			uint32_t target;
+			if (literal + 4 > gba->memory.romSize) {
+				break;
+			}
+			LOAD_32(target, literal, rom);
+			if (size != MP2K_PCM_DMA_BUF_SIZE || (target >> BASE_OFFSET) != REGION_WORKING_IRAM) {
+				break;
+			}
+			return BASE_CART0 + j * 2 + 4;
+		}
+	}
+	return 0;
+}
+
+static void _mp2kInstallHook(struct GBAAudioMixer* mixer) {
+	struct GBA* gba = mixer->p->p;
+	if (mixer->hookAddress) {
+		uint16_t value;
+		LOAD_16(value, mixer->hookAddress & (SIZE_CART0 - 2), gba->memory.rom);
+		if (value == (0xDF00 | MP2K_HLE_SWI)) {
+			return;
+		}
+	}
+	mixer->hookAddress = 0;
+	if (!gba->memory.rom) {
+		return;
+	}
+	uint32_t address = _mp2kFindHook(gba);
+	if (!address) {
+		mLOG(GBA_AUDIO, INFO, "Could not find MP2K mixer, falling back to emulated mixing");
+		return;
+	}
+	mLOG(GBA_AUDIO, DEBUG, "Replacing MP2K mixer call at 0x%08X", address);
+	GBAPatch16(gba->cpu, address, 0xDF00 | MP2K_HLE_SWI, NULL);
+	mixer->hookAddress = address;
+}
+
 bool _mp2kEngage(struct GBAAudioMixer* mixer, uint32_t address) {
 	if (address != mixer->contextAddress) {
 		mixer->contextAddress = address;
+		if (mixer->nativeMixing) {
+			mixer->p->externalMixing = false;
+			_mp2kInstallHook(mixer);
+			return true;
+		}
 		mixer->p->externalMixing = true;
 		_mp2kReload(mixer);
 	}
@@ -254,6 +410,9 @@ bool _mp2kEngage(struct GBAAudioMixer* mixer, uint32_t address) {
 }
 
 void _mp2kStep(struct GBAAudioMixer* mixer) {
+	if (mixer->nativeMixing) {
+		return;
+	}
 	mixer->frame += mixer->p->sampleInterval;
 
 	while (mixer->frame >= VIDEO_TOTAL_LENGTH / mixer->tempo) {
@@ -300,7 +459,302 @@ void _mp2kVblank(struct GBAAudioMixer* mixer) {
 	if (!mixer->contextAddress) {
 		return;
 	}
+	if (mixer->nativeMixing) {
+		return;
+	}
 	mLOG(GBA_AUDIO, DEBUG, "Frame");
 	mixer->p->externalMixing = true;
 	_mp2kReload(mixer);
 }
+
+static bool _mp2kValidateChannel(struct GBA* gba, const uint8_t* channel) {
+	uint8_t status = channel[0x0];
+	if (!(status & MP2K_STATUS_ON)) {
+		return true;
+	}
+	uint32_t wave;
+	LOAD_32(wave, 0x24, channel);
+	const uint8_t* header = _mp2kPointer(gba, wave, MP2K_WAVE_HEADER_SIZE);
+	if (!header) {
+		return false;
+	}
+	uint32_t size;
+	LOAD_32(size, 0xC, header);
+	// The interpolator reads one sample past the current position
+	if (size > SIZE_CART0 || !_mp2kPointer(gba, wave + MP2K_WAVE_HEADER_SIZE, size + 2)) {
+		return false;
+	}
+	if (status & MP2K_STATUS_START) {
+		return true;
+	}
+	uint32_t cp;
+	LOAD_32(cp, 0x28, channel);
+	return cp - wave - MP2K_WAVE_HEADER_SIZE <= size;
+}
+
+static void _mp2kMixChannel(uint8_t* channel, const int8_t* data, int8_t* out, int samples, uint32_t divFreq, uint32_t loopStart, uint32_t loopLength) {
+	int32_t count;
+	uint32_t cp;
+	uint32_t wave;
+	LOAD_32(count, 0x18, channel);
+	LOAD_32(cp, 0x28, channel);
+	LOAD_32(wave, 0x24, channel);
+	uint32_t position = cp - wave - MP2K_WAVE_HEADER_SIZE;
+	int envelopeRight = channel[0xA];
+	int envelopeLeft = channel[0xB];
+	int i;
+
+	// The game's mixer accumulates into the 8-bit buffer with wraparound, so
+	// only the truncated 8-bit sum is ever observable
+	if (channel[0x1] & MP2K_TYPE_FIX) {
+		for (i = 0; i < samples; ++i) {
+			if (!loopLength) {
+				// Fixed-frequency samples are mixed a word at a time, and the end of a one-shot sample is
+				// only checked between words, so its last one to four samples are never played
+				if (!(i & 3) && count <= 4) {
+					channel[0x0] = 0;
+					break;
+				}
+			} else if (count <= 0) {
+				position = loopStart;
+				count = loopLength;
+			}
+			int sample = data[position];
+			out[i] += (sample * envelopeRight) >> 8;
+			out[i + MP2K_PCM_DMA_BUF_SIZE] += (sample * envelopeLeft) >> 8;
+			++position;
+			--count;
+		}
+	} else {
+		uint32_t fw;
+		uint32_t freq;
+		LOAD_32(fw, 0x1C, channel);
+		LOAD_32(freq, 0x20, channel);
+		uint32_t step = freq * divFreq;
+		int s0 = data[position];
+		int delta = data[position + 1] - s0;
+		for (i = 0; i < samples; ++i) {
+			int sample = s0 + ((int32_t) (fw * delta) >> 23);
+			out[i] += (sample * envelopeRight) >> 8;
+			out[i + MP2K_PCM_DMA_BUF_SIZE] += (sample * envelopeLeft) >> 8;
+			fw += step;
+			uint32_t advance = fw >> 23;
+			if (!advance) {
+				continue;
+			}
+			fw &= 0x7FFFFF;
+			count -= advance;
+			if (count <= 0) {
+				if (!loopLength) {
+					channel[0x0] = 0;
+					break;
+				}
+				uint32_t overrun = -count;
+				while (overrun >= loopLength) {
+					overrun -= loopLength;
+				}
+				position = loopStart + overrun;
+				count = loopLength - overrun;
+			} else {
+				position += advance;
+			}
+			s0 = data[position];
+			delta = data[position + 1] - s0;
+		}
+		STORE_32(fw, 0x1C, channel);
+	}
+	STORE_32(count, 0x18, channel);
+	STORE_32(wave + MP2K_WAVE_HEADER_SIZE + position, 0x28, channel);
+}
+
+static bool _mp2kMixNative(struct GBAAudioMixer* mixer) {
+	struct GBA* gba = mixer->p->p;
+	struct ARMCore* cpu = gba->cpu;
+	uint32_t address = cpu->gprs[0];
+	int samples = cpu->gprs[8];
+	if (cpu->gprs[6] != MP2K_PCM_DMA_BUF_SIZE || samples <= 0 || samples > MP2K_PCM_DMA_BUF_SIZE) {
+		return false;
+	}
+
+	uint8_t* info = _mp2kPointer(gba, address, MP2K_PCM_BUFFER_OFFSET + MP2K_PCM_DMA_BUF_SIZE * 2);
+	if (!info) {
+		return false;
+	}
+	uint32_t ident;
+	LOAD_32(ident, 0x0, info);
+	if (ident != MP2K_MAGIC + 1) {
+		return false;
+	}
+	uint32_t pcmBufferAddress = address + MP2K_PCM_BUFFER_OFFSET;
+	uint32_t bufferAddress = cpu->gprs[5];
+	if (bufferAddress - pcmBufferAddress > (uint32_t) (MP2K_PCM_DMA_BUF_SIZE - samples)) {
+		return false;
+	}
+	int8_t* pcmBuffer = (int8_t*) &info[MP2K_PCM_BUFFER_OFFSET];
+	int8_t* buffer = &pcmBuffer[bufferAddress - pcmBufferAddress];
+	int8_t* reverbSource = buffer + samples;
+	if (cpu->gprs[4] == 2) {
+		reverbSource = pcmBuffer;
+	} else if (reverbSource + samples > &pcmBuffer[MP2K_PCM_DMA_BUF_SIZE]) {
+		return false;
+	}
+
+	int maxChans = info[0x6];
+	if (maxChans > MP2K_MAX_SOUND_CHANNELS) {
+		return false;
+	}
+	uint8_t* channels = _mp2kPointer(gba, address + 0x50, maxChans * MP2K_CHANNEL_SIZE);
+	if (!channels) {
+		return false;
+	}
+	int i;
+	for (i = 0; i < maxChans; ++i) {
+		if (!_mp2kValidateChannel(gba, &channels[i * MP2K_CHANNEL_SIZE])) {
+			mLOG(GBA_AUDIO, DEBUG, "MP2K channel %i references unmapped sample data", i);
+			return false;
+		}
+	}
+	// The mixer writes through host pointers, bypassing the store paths
+	GBAMemoryMarkDirty(gba, address, MP2K_PCM_BUFFER_OFFSET + MP2K_PCM_DMA_BUF_SIZE * 2);
+	GBAMemoryMarkDirty(gba, address + 0x50, maxChans * MP2K_CHANNEL_SIZE);
+
+	int reverb = info[0x5];
+	if (reverb) {
+		for (i = 0; i < samples; ++i) {
+			int32_t sample = buffer[i + MP2K_PCM_DMA_BUF_SIZE] + buffer[i] + reverbSource[i + MP2K_PCM_DMA_BUF_SIZE] + reverbSource[i];
+			sample = (sample * reverb) >> 9;
+			if (sample & 0x80) {
+				++sample;
+			}
+			buffer[i] = sample;
+			buffer[i + MP2K_PCM_DMA_BUF_SIZE] = sample;
+		}
+	} else {
+		memset(buffer, 0, samples & ~3);
+		memset(&buffer[MP2K_PCM_DMA_BUF_SIZE], 0, samples & ~3);
+	}
+
+	uint32_t divFreq;
+	LOAD_32(divFreq, 0x18, info);
+	int masterVolume = info[0x7];
+	for (i = 0; i < maxChans; ++i) {
+		uint8_t* channel = &channels[i * MP2K_CHANNEL_SIZE];
+		uint8_t status = channel[0x0];
+		if (!(status & MP2K_STATUS_ON)) {
+			continue;
+		}
+		uint32_t wave;
+		LOAD_32(wave, 0x24, channel);
+		const uint8_t* header = _mp2kPointer(gba, wave, MP2K_WAVE_HEADER_SIZE);
+		int envelope;
+		if (status & MP2K_STATUS_START) {
+			if (status & MP2K_STATUS_STOP) {
+				channel[0x0] = 0;
+				continue;
+			}
+			status = MP2K_STATUS_ATTACK;
+			if (header[0x3] & 0xC0) {
+				status |= MP2K_STATUS_LOOP;
+			}
+			uint32_t size;
+			LOAD_32(size, 0xC, header);
+			STORE_32(wave + MP2K_WAVE_HEADER_SIZE, 0x28, channel);
+			STORE_32(size, 0x18, channel);
+			STORE_32(0, 0x1C, channel);
+			envelope = channel[0x4];
+			if (envelope >= 0xFF) {
+				envelope = 0xFF;
+				--status;
+			}
+		} else {
+			envelope = channel[0x9];
+			if (status & MP2K_STATUS_IEC) {
+				if (channel[0xD] <= 1) {
+					channel[0xD] = channel[0xD] - 1;
+					channel[0x0] = 0;
+					continue;
+				}
+				--channel[0xD];
+			} else if (status & MP2K_STATUS_STOP) {
+				envelope = (envelope * channel[0x7]) >> 8;
+				if (envelope <= channel[0xC]) {
+					envelope = channel[0xC];
+					if (!envelope) {
+						channel[0x0] = 0;
+						continue;
+					}
+					status |= MP2K_STATUS_IEC;
+				}
+			} else if ((status & MP2K_STATUS_ENV) == MP2K_STATUS_DECAY) {
+				envelope = (envelope * channel[0x5]) >> 8;
+				if (envelope <= channel[0x6]) {
+					envelope = channel[0x6];
+					if (!envelope) {
+						envelope = channel[0xC];
+						if (!envelope) {
+							channel[0x0] = 0;
+							continue;
+						}
+						status |= MP2K_STATUS_IEC;
+					} else {
+						--status;
+					}
+				}
+			} else if ((status & MP2K_STATUS_ENV) == MP2K_STATUS_ATTACK) {
+				envelope += channel[0x4];
+				if (envelope >= 0xFF) {
+					envelope = 0xFF;
+					--status;
+				}
+			}
+		}
+		channel[0x0] = status;
+		channel[0x9] = envelope;
+		envelope = ((masterVolume + 1) * envelope) >> 4;
+		channel[0xA] = (channel[0x2] * envelope) >> 8;
+		channel[0xB] = (channel[0x3] * envelope) >> 8;
+
+		uint32_t loopStart = 0;
+		uint32_t loopLength = 0;
+		if (status & MP2K_STATUS_LOOP) {
+			uint32_t size;
+			LOAD_32(loopStart, 0x8, header);
+			LOAD_32(size, 0xC, header);
+			loopLength = size - loopStart;
+		}
+		const int8_t* data = (const int8_t*) &header[MP2K_WAVE_HEADER_SIZE];
+		_mp2kMixChannel(channel, data, buffer, samples, divFreq, loopStart, loopLength);
+	}
+
+	STORE_32(MP2K_MAGIC, 0x0, info);
+	return true;
+}
+
+void _mp2kSoundMain(struct GBAAudioMixer* mixer) {
+	struct ARMCore* cpu = mixer->p->p->cpu;
+	uint32_t target;
+	if (mixer->nativeMixing && _mp2kMixNative(mixer)) {
+		// Unwind SoundMain's stack frame the same way SoundMainRAM's epilogue does
+		uint32_t sp = cpu->gprs[ARM_SP];
+		int i;
+		for (i = 0; i < 4; ++i) {
+			cpu->gprs[i] = cpu->memory.load32(cpu, sp + 0x1C + i * 4, NULL);
+			cpu->gprs[8 + i] = cpu->gprs[i];
+			cpu->gprs[4 + i] = cpu->memory.load32(cpu, sp + 0x2C + i * 4, NULL);
+		}
+		target = cpu->memory.load32(cpu, sp + 0x3C, NULL);
+		cpu->gprs[3] = target;
+		cpu->gprs[ARM_SP] = sp + MP2K_SOUND_MAIN_FRAME;
+	} else {
+		// Fall back to running the game's own mixer
+		target = cpu->gprs[3];
+	}
+	cpu->gprs[ARM_PC] = target & ~1;
+	if (target & 1) {
+		_ARMSetMode(cpu, MODE_THUMB);
+		ThumbWritePC(cpu);
+	} else {
+		_ARMSetMode(cpu, MODE_ARM);
+		ARMWritePC(cpu);
+	}
+}
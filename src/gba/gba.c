@@ -5,6 +5,7 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 #include <mgba/internal/gba/gba.h>
 
+#include <mgba/core/rom-registry.h>
 #include <mgba/internal/arm/isa-inlines.h>
 #include <mgba/internal/arm/debugger/debugger.h>
 #include <mgba/internal/arm/decoder.h>
@@ -101,6 +102,7 @@ static void GBAInit(void* cpu, struct mCPUComponent* component) {
 	gba->rumble = NULL;
 
 	gba->romVf = NULL;
+	gba->romImage = NULL;
 	gba->mbVf = NULL;
 	gba->biosVf = NULL;
 
@@ -138,9 +140,17 @@ void GBAUnloadROM(struct GBA* gba) {
 			gba->yankedRomSize = 0;
 		}
 #ifndef FIXED_ROM_BUFFER
-		mappedMemoryFree(gba->memory.rom, SIZE_CART0);
+		if (gba->romImage) {
+			mROMImageUnmap(gba->romImage, gba->memory.rom);
+		} else {
+			mappedMemoryFree(gba->memory.rom, SIZE_CART0);
+		}
 #endif
 	}
+	if (gba->romImage) {
+		mROMRegistryRelease(gba->romImage);
+		gba->romImage = NULL;
+	}
 
 	if (gba->romVf) {
 #ifndef FIXED_ROM_BUFFER
@@ -384,6 +394,7 @@ bool GBALoadMB(struct GBA* gba, struct VFile* vf) {
 	vf->seek(vf, 0, SEEK_SET);
 	memset(gba->memory.wram, 0, SIZE_WORKING_RAM);
 	vf->read(vf, gba->memory.wram, SIZE_WORKING_RAM);
+	GBAMemoryMarkDirty(gba, BASE_WORKING_RAM, SIZE_WORKING_RAM);
 	if (gba->cpu && gba->memory.activeRegion == REGION_WORKING_RAM) {
 		gba->cpu->memory.setActiveRegion(gba->cpu, gba->cpu->gprs[ARM_PC]);
 	}
@@ -459,6 +470,22 @@ bool GBALoadROM(struct GBA* gba, struct VFile* vf) {
 		gba->memory.romMask = SIZE_CART0 - 1;
 		gba->isPristine = false;
 	}
+#ifndef FIXED_ROM_BUFFER
+	if (gba->isPristine) {
+		// Other cores may already have this ROM, and a copy-on-write view of it means writes no longer
+		// need to copy the whole thing first
+		struct mROMImage* image = mROMRegistryAcquire(gba->romCrc32, gba->memory.rom, gba->pristineRomSize, SIZE_CART0);
+		void* rom = image ? mROMImageMap(image) : NULL;
+		if (rom) {
+			vf->unmap(vf, gba->memory.rom, gba->pristineRomSize);
+			gba->memory.rom = rom;
+			gba->romImage = image;
+			gba->isPristine = false;
+		} else if (image) {
+			mROMRegistryRelease(image);
+		}
+	}
+#endif
 	if (gba->cpu && gba->memory.activeRegion >= REGION_CART0) {
 		gba->cpu->memory.setActiveRegion(gba->cpu, gba->cpu->gprs[ARM_PC]);
 	}
@@ -468,6 +495,69 @@ bool GBALoadROM(struct GBA* gba, struct VFile* vf) {
 	return true;
 }
 
+bool GBAShareROM(struct GBA* gba, const struct GBA* source) {
+#ifdef FIXED_ROM_BUFFER
+	UNUSED(gba);
+	UNUSED(source);
+	return false;
+#else
+	if (!source->memory.rom) {
+		return false;
+	}
+	if (source->romVf && source->romVf->size(source->romVf) > SIZE_CART0) {
+		// Matrix carts page the ROM in from the file
+		return false;
+	}
+	GBAUnloadROM(gba);
+	gba->pristineRomSize = source->pristineRomSize;
+	gba->yankedRomSize = source->yankedRomSize;
+	gba->memory.romSize = source->memory.romSize;
+	gba->memory.romMask = source->memory.romMask;
+	gba->romCrc32 = source->romCrc32;
+	void* rom = source->romImage ? mROMImageMap(source->romImage) : NULL;
+	if (rom) {
+		// Carry over anything the source wrote to its view a page at a time, so untouched pages stay shared
+		size_t size = source->pristineRomSize;
+		if (source->memory.romSize > size) {
+			size = source->memory.romSize;
+		}
+		if (source->yankedRomSize > size) {
+			size = source->yankedRomSize;
+		}
+		const size_t pageSize = 0x1000;
+		size_t offset;
+		for (offset = 0; offset < size; offset += pageSize) {
+			size_t length = size - offset < pageSize ? size - offset : pageSize;
+			const uint8_t* sourcePage = (const uint8_t*) source->memory.rom + offset;
+			if (memcmp((uint8_t*) rom + offset, sourcePage, length) != 0) {
+				memcpy((uint8_t*) rom + offset, sourcePage, length);
+			}
+		}
+		mROMRegistryRetain(source->romImage);
+		gba->romImage = source->romImage;
+		gba->memory.rom = rom;
+		gba->isPristine = false;
+	} else if (source->isPristine && !(source->memory.hw.devices & (HW_RTC | HW_RUMBLE | HW_LIGHT_SENSOR | HW_GYRO))) {
+		// Nothing writes to a pristine ROM without privatising it first, so the mapping can be used as-is
+		gba->memory.rom = source->memory.rom;
+		gba->isPristine = true;
+	} else {
+		// GPIO registers live in ROM space and are written without copying, so they can't be shared
+		size_t size = source->isPristine ? source->pristineRomSize : SIZE_CART0;
+		gba->memory.rom = anonymousMemoryMap(SIZE_CART0);
+		memcpy(gba->memory.rom, source->memory.rom, size);
+		memset(((uint8_t*) gba->memory.rom) + size, 0xFF, SIZE_CART0 - size);
+		gba->isPristine = false;
+	}
+	if (gba->cpu && gba->memory.activeRegion >= REGION_CART0) {
+		gba->cpu->memory.setActiveRegion(gba->cpu, gba->cpu->gprs[ARM_PC]);
+	}
+	GBAHardwareInit(&gba->memory.hw, &((uint16_t*) gba->memory.rom)[GPIO_REG_DATA >> 1]);
+	GBAVFameDetect(&gba->memory.vfame, gba->memory.rom, gba->memory.romSize);
+	return true;
+#endif
+}
+
 bool GBALoadSave(struct GBA* gba, struct VFile* sav) {
 	enum SavedataType type = gba->memory.savedata.type;
 	GBASavedataDeinit(&gba->memory.savedata);
@@ -528,7 +618,11 @@ void GBAApplyPatch(struct GBA* gba, struct Patch* patch) {
 		mappedMemoryFree(newRom, SIZE_CART0);
 		return;
 	}
-	if (gba->romVf) {
+	if (gba->romImage) {
+		mROMImageUnmap(gba->romImage, gba->memory.rom);
+		mROMRegistryRelease(gba->romImage);
+		gba->romImage = NULL;
+	} else if (gba->romVf) {
 #ifndef FIXED_ROM_BUFFER
 		if (!gba->isPristine) {
 			mappedMemoryFree(gba->memory.rom, SIZE_CART0);
@@ -536,6 +630,8 @@ void GBAApplyPatch(struct GBA* gba, struct Patch* patch) {
 			gba->romVf->unmap(gba->romVf, gba->memory.rom, gba->pristineRomSize);
 		}
 #endif
+	}
+	if (gba->romVf) {
 		gba->romVf->close(gba->romVf);
 		gba->romVf = NULL;
 	}
@@ -900,7 +996,7 @@ void GBAFrameEnded(struct GBA* gba) {
 		}
 	}
 
-	if (gba->stream && gba->stream->postVideoFrame) {
+	if (gba->stream && gba->stream->postVideoFrame && !gba->video.suppressOutput) {
 		const color_t* pixels;
 		size_t stride;
 		gba->video.renderer->getPixels(gba->video.renderer, &stride, (const void**) &pixels);
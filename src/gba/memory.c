@@ -140,6 +140,7 @@ void GBAMemoryReset(struct GBA* gba) {
 
 	GBADMAReset(gba);
 	memset(&gba->memory.matrix, 0, sizeof(gba->memory.matrix));
+	memset(gba->memory.dirtyPages, 0xFF, sizeof(gba->memory.dirtyPages));
 }
 
 void GBAMemoryClearAGBPrint(struct GBA* gba) {
@@ -743,10 +744,12 @@ uint32_t GBALoad8(struct ARMCore* cpu, uint32_t address, int* cycleCounter) {
 
 #define STORE_WORKING_RAM \
 	STORE_32(value, address & (SIZE_WORKING_RAM - 4), memory->wram); \
+	GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_WRAM, address & (SIZE_WORKING_RAM - 4)); \
 	wait += waitstatesRegion[REGION_WORKING_RAM];
 
 #define STORE_WORKING_IRAM \
-	STORE_32(value, address & (SIZE_WORKING_IRAM - 4), memory->iwram);
+	STORE_32(value, address & (SIZE_WORKING_IRAM - 4), memory->iwram); \
+	GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_IWRAM, address & (SIZE_WORKING_IRAM - 4));
 
 #define STORE_IO \
 	GBAIOWrite32(gba, address & (OFFSET_MASK - 3), value);
@@ -768,6 +771,7 @@ uint32_t GBALoad8(struct ARMCore* cpu, uint32_t address, int* cycleCounter) {
 			LOAD_32(oldValue, address & 0x00017FFC, gba->video.vram); \
 			if (oldValue != value) { \
 				STORE_32(value, address & 0x00017FFC, gba->video.vram); \
+				GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_VRAM, address & 0x00017FFC); \
 				gba->video.renderer->writeVRAM(gba->video.renderer, (address & 0x00017FFC) + 2); \
 				gba->video.renderer->writeVRAM(gba->video.renderer, (address & 0x00017FFC)); \
 			} \
@@ -776,6 +780,7 @@ uint32_t GBALoad8(struct ARMCore* cpu, uint32_t address, int* cycleCounter) {
 		LOAD_32(oldValue, address & 0x0001FFFC, gba->video.vram); \
 		if (oldValue != value) { \
 			STORE_32(value, address & 0x0001FFFC, gba->video.vram); \
+			GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_VRAM, address & 0x0001FFFC); \
 			gba->video.renderer->writeVRAM(gba->video.renderer, (address & 0x0001FFFC) + 2); \
 			gba->video.renderer->writeVRAM(gba->video.renderer, (address & 0x0001FFFC)); \
 		} \
@@ -875,10 +880,12 @@ void GBAStore16(struct ARMCore* cpu, uint32_t address, int16_t value, int* cycle
 	switch (address >> BASE_OFFSET) {
 	case REGION_WORKING_RAM:
 		STORE_16(value, address & (SIZE_WORKING_RAM - 2), memory->wram);
+		GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_WRAM, address & (SIZE_WORKING_RAM - 2));
 		wait = memory->waitstatesNonseq16[REGION_WORKING_RAM];
 		break;
 	case REGION_WORKING_IRAM:
 		STORE_16(value, address & (SIZE_WORKING_IRAM - 2), memory->iwram);
+		GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_IWRAM, address & (SIZE_WORKING_IRAM - 2));
 		break;
 	case REGION_IO:
 		GBAIOWrite(gba, address & (OFFSET_MASK - 1), value);
@@ -899,12 +906,14 @@ void GBAStore16(struct ARMCore* cpu, uint32_t address, int16_t value, int* cycle
 			LOAD_16(oldValue, address & 0x00017FFE, gba->video.vram);
 			if (value != oldValue) {
 				STORE_16(value, address & 0x00017FFE, gba->video.vram);
+				GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_VRAM, address & 0x00017FFE);
 				gba->video.renderer->writeVRAM(gba->video.renderer, address & 0x00017FFE);
 			}
 		} else {
 			LOAD_16(oldValue, address & 0x0001FFFE, gba->video.vram);
 			if (value != oldValue) {
 				STORE_16(value, address & 0x0001FFFE, gba->video.vram);
+				GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_VRAM, address & 0x0001FFFE);
 				gba->video.renderer->writeVRAM(gba->video.renderer, address & 0x0001FFFE);
 			}
 		}
@@ -1017,10 +1026,12 @@ void GBAStore8(struct ARMCore* cpu, uint32_t address, int8_t value, int* cycleCo
 	switch (address >> BASE_OFFSET) {
 	case REGION_WORKING_RAM:
 		((int8_t*) memory->wram)[address & (SIZE_WORKING_RAM - 1)] = value;
+		GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_WRAM, address & (SIZE_WORKING_RAM - 1));
 		wait = memory->waitstatesNonseq16[REGION_WORKING_RAM];
 		break;
 	case REGION_WORKING_IRAM:
 		((int8_t*) memory->iwram)[address & (SIZE_WORKING_IRAM - 1)] = value;
+		GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_IWRAM, address & (SIZE_WORKING_IRAM - 1));
 		break;
 	case REGION_IO:
 		GBAIOWrite8(gba, address & OFFSET_MASK, value);
@@ -1036,6 +1047,7 @@ void GBAStore8(struct ARMCore* cpu, uint32_t address, int8_t value, int* cycleCo
 		oldValue = gba->video.renderer->vram[(address & 0x1FFFE) >> 1];
 		if (oldValue != (((uint8_t) value) | (value << 8))) {
 			gba->video.renderer->vram[(address & 0x1FFFE) >> 1] = ((uint8_t) value) | (value << 8);
+			GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_VRAM, address & 0x0001FFFE);
 			gba->video.renderer->writeVRAM(gba->video.renderer, address & 0x0001FFFE);
 		}
 		if (gba->video.shouldStall) {
@@ -1070,11 +1082,13 @@ void GBAStore8(struct ARMCore* cpu, uint32_t address, int8_t value, int* cycleCo
 				memory->savedata.data[address & (SIZE_CART_SRAM - 1)] = value;
 			}
 			memory->savedata.dirty |= mSAVEDATA_DIRT_NEW;
+			memory->savedata.snapshotDirty = true;
 		} else if (memory->hw.devices & HW_TILT) {
 			GBAHardwareTiltWrite(&memory->hw, address & OFFSET_MASK, value);
 		} else if (memory->savedata.type == SAVEDATA_SRAM512) {
 			memory->savedata.data[address & (SIZE_CART_SRAM512 - 1)] = value;
 			memory->savedata.dirty |= mSAVEDATA_DIRT_NEW;
+			memory->savedata.snapshotDirty = true;
 		} else {
 			mLOG(GBA_MEM, GAME_ERROR, "Writing to non-existent SRAM: 0x%08X", address);
 		}
@@ -1215,10 +1229,12 @@ void GBAPatch32(struct ARMCore* cpu, uint32_t address, int32_t value, int32_t* o
 	case REGION_WORKING_RAM:
 		LOAD_32(oldValue, address & (SIZE_WORKING_RAM - 4), memory->wram);
 		STORE_32(value, address & (SIZE_WORKING_RAM - 4), memory->wram);
+		GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_WRAM, address & (SIZE_WORKING_RAM - 4));
 		break;
 	case REGION_WORKING_IRAM:
 		LOAD_32(oldValue, address & (SIZE_WORKING_IRAM - 4), memory->iwram);
 		STORE_32(value, address & (SIZE_WORKING_IRAM - 4), memory->iwram);
+		GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_IWRAM, address & (SIZE_WORKING_IRAM - 4));
 		break;
 	case REGION_IO:
 		mLOG(GBA_MEM, STUB, "Unimplemented memory Patch32: 0x%08X", address);
@@ -1233,11 +1249,13 @@ void GBAPatch32(struct ARMCore* cpu, uint32_t address, int32_t value, int32_t* o
 		if ((address & 0x0001FFFF) < SIZE_VRAM) {
 			LOAD_32(oldValue, address & 0x0001FFFC, gba->video.vram);
 			STORE_32(value, address & 0x0001FFFC, gba->video.vram);
+			GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_VRAM, address & 0x0001FFFC);
 			gba->video.renderer->writeVRAM(gba->video.renderer, address & 0x0001FFFC);
 			gba->video.renderer->writeVRAM(gba->video.renderer, (address & 0x0001FFFC) | 2);
 		} else {
 			LOAD_32(oldValue, address & 0x00017FFC, gba->video.vram);
 			STORE_32(value, address & 0x00017FFC, gba->video.vram);
+			GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_VRAM, address & 0x00017FFC);
 			gba->video.renderer->writeVRAM(gba->video.renderer, address & 0x00017FFC);
 			gba->video.renderer->writeVRAM(gba->video.renderer, (address & 0x00017FFC) | 2);
 		}
@@ -1289,10 +1307,12 @@ void GBAPatch16(struct ARMCore* cpu, uint32_t address, int16_t value, int16_t* o
 	case REGION_WORKING_RAM:
 		LOAD_16(oldValue, address & (SIZE_WORKING_RAM - 2), memory->wram);
 		STORE_16(value, address & (SIZE_WORKING_RAM - 2), memory->wram);
+		GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_WRAM, address & (SIZE_WORKING_RAM - 2));
 		break;
 	case REGION_WORKING_IRAM:
 		LOAD_16(oldValue, address & (SIZE_WORKING_IRAM - 2), memory->iwram);
 		STORE_16(value, address & (SIZE_WORKING_IRAM - 2), memory->iwram);
+		GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_IWRAM, address & (SIZE_WORKING_IRAM - 2));
 		break;
 	case REGION_IO:
 		mLOG(GBA_MEM, STUB, "Unimplemented memory Patch16: 0x%08X", address);
@@ -1306,10 +1326,12 @@ void GBAPatch16(struct ARMCore* cpu, uint32_t address, int16_t value, int16_t* o
 		if ((address & 0x0001FFFF) < SIZE_VRAM) {
 			LOAD_16(oldValue, address & 0x0001FFFE, gba->video.vram);
 			STORE_16(value, address & 0x0001FFFE, gba->video.vram);
+			GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_VRAM, address & 0x0001FFFE);
 			gba->video.renderer->writeVRAM(gba->video.renderer, address & 0x0001FFFE);
 		} else {
 			LOAD_16(oldValue, address & 0x00017FFE, gba->video.vram);
 			STORE_16(value, address & 0x00017FFE, gba->video.vram);
+			GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_VRAM, address & 0x00017FFE);
 			gba->video.renderer->writeVRAM(gba->video.renderer, address & 0x00017FFE);
 		}
 		break;
@@ -1359,10 +1381,12 @@ void GBAPatch8(struct ARMCore* cpu, uint32_t address, int8_t value, int8_t* old)
 	case REGION_WORKING_RAM:
 		oldValue = ((int8_t*) memory->wram)[address & (SIZE_WORKING_RAM - 1)];
 		((int8_t*) memory->wram)[address & (SIZE_WORKING_RAM - 1)] = value;
+		GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_WRAM, address & (SIZE_WORKING_RAM - 1));
 		break;
 	case REGION_WORKING_IRAM:
 		oldValue = ((int8_t*) memory->iwram)[address & (SIZE_WORKING_IRAM - 1)];
 		((int8_t*) memory->iwram)[address & (SIZE_WORKING_IRAM - 1)] = value;
+		GBA_MEMORY_MARK_DIRTY(memory, DIRTY_PAGE_IWRAM, address & (SIZE_WORKING_IRAM - 1));
 		break;
 	case REGION_IO:
 		mLOG(GBA_MEM, STUB, "Unimplemented memory Patch8: 0x%08X", address);
@@ -1807,8 +1831,59 @@ void GBAMemorySerialize(const struct GBAMemory* memory, struct GBASerializedStat
 }
 
 void GBAMemoryDeserialize(struct GBAMemory* memory, const struct GBASerializedState* state) {
-	memcpy(memory->wram, state->wram, SIZE_WORKING_RAM);
-	memcpy(memory->iwram, state->iwram, SIZE_WORKING_IRAM);
+	GBAMemoryRestorePages(memory, DIRTY_PAGE_WRAM, memory->wram, state->wram, SIZE_WORKING_RAM);
+	GBAMemoryRestorePages(memory, DIRTY_PAGE_IWRAM, memory->iwram, state->iwram, SIZE_WORKING_IRAM);
+}
+
+void GBAMemoryRestorePages(struct GBAMemory* memory, unsigned page, void* dest, const void* src, size_t size) {
+	// Only pages that actually change are reported, so that reloading a recent state (e.g. after running ahead)
+	// doesn't force the next incremental snapshot to copy everything
+	uint8_t* out = dest;
+	const uint8_t* in = src;
+	size_t offset;
+	for (offset = 0; offset < size; offset += 1 << DIRTY_PAGE_SHIFT, ++page) {
+		if (memcmp(&out[offset], &in[offset], 1 << DIRTY_PAGE_SHIFT)) {
+			memcpy(&out[offset], &in[offset], 1 << DIRTY_PAGE_SHIFT);
+			memory->dirtyPages[page >> 5] |= 1U << (page & 31);
+		}
+	}
+}
+
+void GBAMemoryMarkDirty(struct GBA* gba, uint32_t address, uint32_t size) {
+	if (!size) {
+		return;
+	}
+	unsigned base;
+	uint32_t mask;
+	switch (address >> BASE_OFFSET) {
+	case REGION_WORKING_RAM:
+		base = DIRTY_PAGE_WRAM;
+		mask = SIZE_WORKING_RAM - 1;
+		break;
+	case REGION_WORKING_IRAM:
+		base = DIRTY_PAGE_IWRAM;
+		mask = SIZE_WORKING_IRAM - 1;
+		break;
+	case REGION_VRAM:
+		base = DIRTY_PAGE_VRAM;
+		mask = 0x0001FFFF;
+		break;
+	default:
+		return;
+	}
+	uint32_t start = address & mask;
+	uint32_t end = start + size - 1;
+	if (end > mask) {
+		end = mask;
+	}
+	if (base == DIRTY_PAGE_VRAM && end >= SIZE_VRAM) {
+		// Conservatively cover the mirrored OBJ region too
+		start = 0;
+		end = SIZE_VRAM - 1;
+	}
+	for (start >>= DIRTY_PAGE_SHIFT, end >>= DIRTY_PAGE_SHIFT; start <= end; ++start) {
+		GBA_MEMORY_MARK_DIRTY(&gba->memory, base, start << DIRTY_PAGE_SHIFT);
+	}
 }
 
 void _pristineCow(struct GBA* gba) {
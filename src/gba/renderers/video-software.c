@@ -125,6 +125,8 @@ static void GBAVideoSoftwareRendererReset(struct GBAVideoRenderer* renderer) {
 	softwareRenderer->winout = (struct WindowControl) { .priority = 3 };
 	softwareRenderer->oamDirty = 1;
 	softwareRenderer->oamMax = 0;
+	softwareRenderer->oamIndexValid = false;
+	memset(softwareRenderer->oamDirtyEntries, 0, sizeof(softwareRenderer->oamDirtyEntries));
 
 	softwareRenderer->mosaic = 0;
 	softwareRenderer->greenswap = false;
@@ -404,8 +406,12 @@ static void GBAVideoSoftwareRendererWriteVRAM(struct GBAVideoRenderer* renderer,
 
 static void GBAVideoSoftwareRendererWriteOAM(struct GBAVideoRenderer* renderer, uint32_t oam) {
 	struct GBAVideoSoftwareRenderer* softwareRenderer = (struct GBAVideoSoftwareRenderer*) renderer;
-	UNUSED(oam);
-	softwareRenderer->oamDirty = 1;
+	// Affine parameters are read directly when drawing, so they don't affect the sprite index
+	if ((oam & 3) != 3) {
+		unsigned entry = oam >> 2;
+		softwareRenderer->oamDirtyEntries[entry >> 5] |= 1U << (entry & 31);
+		softwareRenderer->oamDirty = 1;
+	}
 	memset(softwareRenderer->scanlineDirty, 0xFFFFFFFF, sizeof(softwareRenderer->scanlineDirty));
 }
 
@@ -961,24 +967,79 @@ void GBAVideoSoftwareRendererPostprocessBuffer(struct GBAVideoSoftwareRenderer*
 	}
 }
 
+static void _addSpriteLines(struct GBAVideoSoftwareRenderer* renderer, int index, int start, int end) {
+	if (start < 0) {
+		start = 0;
+	}
+	if (end > GBA_VIDEO_VERTICAL_PIXELS) {
+		end = GBA_VIDEO_VERTICAL_PIXELS;
+	}
+	int y;
+	for (y = start; y < end; ++y) {
+		renderer->oamLines[y][renderer->oamLineCount[y]] = index;
+		++renderer->oamLineCount[y];
+	}
+}
+
+static void _cleanOAM(struct GBAVideoSoftwareRenderer* renderer) {
+	struct GBAObj* oam = renderer->d.oam->obj;
+	bool changed = !renderer->oamIndexValid || renderer->oamIndexOffsetY != renderer->objOffsetY;
+	int i;
+	for (i = 0; i < 128; ++i) {
+		if (!changed && !(renderer->oamDirtyEntries[i >> 5] & (1U << (i & 31)))) {
+			continue;
+		}
+		uint16_t a;
+		uint16_t b;
+		uint16_t c;
+		LOAD_16LE(a, 0, &oam[i].a);
+		LOAD_16LE(b, 0, &oam[i].b);
+		LOAD_16LE(c, 0, &oam[i].c);
+		if (a != renderer->oamShadow[i][0] || b != renderer->oamShadow[i][1] || c != renderer->oamShadow[i][2]) {
+			renderer->oamShadow[i][0] = a;
+			renderer->oamShadow[i][1] = b;
+			renderer->oamShadow[i][2] = c;
+			changed = true;
+		}
+	}
+	memset(renderer->oamDirtyEntries, 0, sizeof(renderer->oamDirtyEntries));
+	renderer->oamDirty = false;
+	if (!changed) {
+		// Most games rewrite all of OAM every frame, usually with the same values
+		return;
+	}
+
+	renderer->oamMax = GBAVideoRendererCleanOAM(oam, renderer->sprites, renderer->objOffsetY);
+	renderer->oamIndexValid = true;
+	renderer->oamIndexOffsetY = renderer->objOffsetY;
+
+	// Bucket sprites by the scanlines they cover, keeping OAM order within each line
+	memset(renderer->oamLineCount, 0, sizeof(renderer->oamLineCount));
+	for (i = 0; i < renderer->oamMax; ++i) {
+		struct GBAVideoRendererSprite* sprite = &renderer->sprites[i];
+		_addSpriteLines(renderer, i, sprite->y, sprite->endY);
+		if (sprite->endY > 256) {
+			// Wraps around from the bottom of the screen
+			_addSpriteLines(renderer, i, 0, sprite->endY - 256);
+		}
+	}
+}
+
 int GBAVideoSoftwareRendererPreprocessSpriteLayer(struct GBAVideoSoftwareRenderer* renderer, int y) {
 	int w;
 	int spriteLayers = 0;
 	if (GBARegisterDISPCNTIsObjEnable(renderer->dispcnt) && !renderer->d.disableOBJ) {
 		if (renderer->oamDirty) {
-			renderer->oamMax = GBAVideoRendererCleanOAM(renderer->d.oam->obj, renderer->sprites, renderer->objOffsetY);
-			renderer->oamDirty = false;
+			_cleanOAM(renderer);
 		}
 		int mosaicV = GBAMosaicControlGetObjV(renderer->mosaic) + 1;
 		int mosaicY = y - (y % mosaicV);
+		const uint8_t* lines = renderer->oamLines[y];
 		int i;
-		for (i = 0; i < renderer->oamMax; ++i) {
-			struct GBAVideoRendererSprite* sprite = &renderer->sprites[i];
+		for (i = 0; i < renderer->oamLineCount[y]; ++i) {
+			struct GBAVideoRendererSprite* sprite = &renderer->sprites[lines[i]];
 			int localY = y;
 			renderer->end = 0;
-			if ((y < sprite->y && (sprite->endY - 256 < 0 || y >= sprite->endY - 256)) || y >= sprite->endY) {
-				continue;
-			}
 			if (GBAObjAttributesAIsMosaic(sprite->obj.a) && mosaicV > 1) {
 				localY = mosaicY;
 				if (localY < sprite->y && sprite->y < GBA_VIDEO_VERTICAL_PIXELS) {
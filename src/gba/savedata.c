@@ -57,6 +57,7 @@ void GBASavedataInit(struct GBASavedata* savedata, struct VFile* vf) {
 	savedata->maskWriteback = false;
 	savedata->dirty = 0;
 	savedata->dirtAge = 0;
+	savedata->snapshotDirty = true;
 	savedata->dust.name = "GBA Savedata Settling";
 	savedata->dust.priority = 0x70;
 	savedata->dust.context = savedata;
@@ -187,6 +188,7 @@ size_t GBASavedataSize(const struct GBASavedata* savedata) {
 }
 
 bool GBASavedataLoad(struct GBASavedata* savedata, struct VFile* in) {
+	savedata->snapshotDirty = true;
 	if (savedata->data) {
 		if (!in || savedata->type == SAVEDATA_FORCE_NONE) {
 			return false;
@@ -387,6 +389,7 @@ void GBASavedataWriteFlash(struct GBASavedata* savedata, uint16_t address, uint8
 		switch (savedata->command) {
 		case FLASH_COMMAND_PROGRAM:
 			savedata->dirty |= mSAVEDATA_DIRT_NEW;
+			savedata->snapshotDirty = true;
 			savedata->currentBank[address] = value;
 			savedata->command = FLASH_COMMAND_NONE;
 			mTimingDeschedule(savedata->timing, &savedata->dust);
@@ -519,6 +522,7 @@ void GBASavedataWriteEEPROM(struct GBASavedata* savedata, uint16_t value, uint32
 			current &= ~(1 << (0x7 - (savedata->writeAddress & 0x7)));
 			current |= (value & 0x1) << (0x7 - (savedata->writeAddress & 0x7));
 			savedata->dirty |= mSAVEDATA_DIRT_NEW;
+			savedata->snapshotDirty = true;
 			savedata->data[savedata->writeAddress >> 3] = current;
 			mTimingDeschedule(savedata->timing, &savedata->dust);
 			mTimingSchedule(savedata->timing, &savedata->dust, EEPROM_SETTLE_CYCLES);
@@ -578,8 +582,11 @@ void GBASavedataClean(struct GBASavedata* savedata, uint32_t frameCount) {
 		}
 		if (savedata->mapMode & MAP_WRITE) {
 			size_t size = GBASavedataSize(savedata);
-			if (savedata->data && savedata->vf->sync(savedata->vf, savedata->data, size)) {
+			if (savedata->data) {
+				// Write the RTC footer first so it goes out with the same sync
 				GBASavedataRTCWrite(savedata);
+			}
+			if (savedata->data && savedata->vf->sync(savedata->vf, savedata->data, size)) {
 				mLOG(GBA_SAVE, INFO, "Savedata synced");
 			} else {
 				mLOG(GBA_SAVE, INFO, "Savedata failed to sync!");
@@ -763,6 +770,7 @@ void _flashSwitchBank(struct GBASavedata* savedata, int bank) {
 void _flashErase(struct GBASavedata* savedata) {
 	mLOG(GBA_SAVE, DEBUG, "Performing flash chip erase");
 	savedata->dirty |= mSAVEDATA_DIRT_NEW;
+	savedata->snapshotDirty = true;
 	size_t size = SIZE_CART_FLASH512;
 	if (savedata->type == SAVEDATA_FLASH1M) {
 		size = SIZE_CART_FLASH1M;
@@ -773,6 +781,7 @@ void _flashErase(struct GBASavedata* savedata) {
 void _flashEraseSector(struct GBASavedata* savedata, uint16_t sectorStart) {
 	mLOG(GBA_SAVE, DEBUG, "Performing flash sector erase at 0x%04x", sectorStart);
 	savedata->dirty |= mSAVEDATA_DIRT_NEW;
+	savedata->snapshotDirty = true;
 	size_t size = 0x1000;
 	if (savedata->type == SAVEDATA_FLASH1M) {
 		mLOG(GBA_SAVE, DEBUG, "Performing unknown sector-size erase at 0x%04x", sectorStart);
@@ -9,6 +9,7 @@
 #include <mgba/internal/gba/bios.h>
 #include <mgba/internal/gba/io.h>
 
+#include <mgba-util/math.h>
 #include <mgba-util/memory.h>
 #include <mgba-util/vfs.h>
 
@@ -24,7 +25,7 @@ struct GBABundledState {
 	struct mStateExtdata* extdata;
 };
 
-void GBASerialize(struct GBA* gba, struct GBASerializedState* state) {
+static void _GBASerializeRegisters(struct GBA* gba, struct GBASerializedState* state) {
 	STORE_32(GBASavestateMagic + GBASavestateVersion, 0, &state->versionMagic);
 	STORE_32(gba->biosChecksum, 0, &state->biosChecksum);
 	STORE_32(gba->romCrc32, 0, &state->romCrc32);
@@ -72,9 +73,8 @@ void GBASerialize(struct GBA* gba, struct GBASerializedState* state) {
 	STORE_32(miscFlags, 0, &state->miscFlags);
 	STORE_32(gba->biosStall, 0, &state->biosStall);
 
-	GBAMemorySerialize(&gba->memory, state);
 	GBAIOSerialize(gba, state);
-	GBAVideoSerialize(&gba->video, state);
+	GBAVideoSerializeRegisters(&gba->video, state);
 	GBAAudioSerialize(&gba->audio, state);
 	GBASavedataSerialize(&gba->memory.savedata, state);
 
@@ -83,6 +83,46 @@ void GBASerialize(struct GBA* gba, struct GBASerializedState* state) {
 	}
 }
 
+void GBASerialize(struct GBA* gba, struct GBASerializedState* state) {
+	_GBASerializeRegisters(gba, state);
+	GBAMemorySerialize(&gba->memory, state);
+	memcpy(state->vram, gba->video.vram, SIZE_VRAM);
+}
+
+void GBASerializeDirty(struct GBA* gba, struct GBASerializedState* state, uint32_t* dirty) {
+	_GBASerializeRegisters(gba, state);
+
+	// Everything ahead of VRAM is rewritten every time and always reported
+	unsigned headerPages = offsetof(struct GBASerializedState, vram) >> DIRTY_PAGE_SHIFT;
+	unsigned page;
+	for (page = 0; page < headerPages; ++page) {
+		dirty[page >> 5] |= 1U << (page & 31);
+	}
+
+	uint8_t* pages = (uint8_t*) state->vram;
+	size_t i;
+	for (i = 0; i < DIRTY_PAGE_MAX / 32; ++i) {
+		uint32_t bits = gba->memory.dirtyPages[i];
+		gba->memory.dirtyPages[i] = 0;
+		while (bits) {
+			unsigned bit = 31 - clz32(bits);
+			bits &= ~(1U << bit);
+			page = i * 32 + bit;
+			const uint8_t* source;
+			if (page >= DIRTY_PAGE_WRAM) {
+				source = (const uint8_t*) gba->memory.wram + ((page - DIRTY_PAGE_WRAM) << DIRTY_PAGE_SHIFT);
+			} else if (page >= DIRTY_PAGE_IWRAM) {
+				source = (const uint8_t*) gba->memory.iwram + ((page - DIRTY_PAGE_IWRAM) << DIRTY_PAGE_SHIFT);
+			} else {
+				source = (const uint8_t*) gba->video.vram + ((page - DIRTY_PAGE_VRAM) << DIRTY_PAGE_SHIFT);
+			}
+			memcpy(&pages[page << DIRTY_PAGE_SHIFT], source, 1 << DIRTY_PAGE_SHIFT);
+			page += headerPages;
+			dirty[page >> 5] |= 1U << (page & 31);
+		}
+	}
+}
+
 bool GBADeserialize(struct GBA* gba, const struct GBASerializedState* state) {
 	bool error = false;
 	int32_t check;
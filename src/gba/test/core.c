@@ -5,8 +5,15 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 #include "util/test/suite.h"
 
+#include <mgba/core/blip_buf.h>
 #include <mgba/core/core.h>
+#include <mgba/core/thread.h>
 #include <mgba/gba/core.h>
+#include <mgba/internal/gba/gba.h>
+#include <mgba/internal/gba/savedata.h>
+#include <mgba-util/vfs.h>
+
+#define ROM_SIZE 0x400
 
 M_TEST_DEFINE(create) {
 	struct mCore* core = GBACoreCreate();
@@ -44,8 +51,118 @@ M_TEST_DEFINE(loadNullROM) {
 	core->deinit(core);
 }
 
+M_TEST_DEFINE(suppressOutput) {
+	struct mCore* core = GBACoreCreate();
+	assert_non_null(core);
+	assert_true(core->init(core));
+	mCoreInitConfig(core, NULL);
+	unsigned width, height;
+	core->desiredVideoDimensions(core, &width, &height);
+	color_t* buffer = calloc(width * height, sizeof(*buffer));
+	core->setVideoBuffer(core, buffer, width);
+	core->reset(core);
+	memset(buffer, 0x55, width * height * sizeof(*buffer));
+
+	struct blip_t* left = core->getAudioChannel(core, 0);
+	int samples = blip_samples_avail(left);
+	uint32_t frame = core->frameCounter(core);
+	core->suppressOutput(core, true, true);
+	core->runFrame(core);
+	assert_int_equal(core->frameCounter(core), frame + 1);
+	assert_int_equal(blip_samples_avail(left), samples);
+	size_t i;
+	for (i = 0; i < width * height; ++i) {
+		if (buffer[i] != buffer[0]) {
+			break;
+		}
+	}
+	assert_int_equal(i, width * height);
+	assert_int_equal(((uint8_t*) buffer)[0], 0x55);
+
+	core->suppressOutput(core, false, false);
+	core->runFrame(core);
+	assert_true(blip_samples_avail(left) > samples);
+	assert_int_not_equal(((uint8_t*) buffer)[0], 0x55);
+
+	free(buffer);
+	mCoreConfigDeinit(&core->config);
+	core->deinit(core);
+}
+
+#ifndef DISABLE_THREADING
+static const uint32_t _saveLoopCode[] = {
+	0xE3A00402, // mov r0, #0x02000000
+	0xE3A0240E, // mov r2, #0x0E000000
+	0xE3A01000, // mov r1, #0
+	0xE2811001, // add r1, r1, #1
+	0xE5801000, // str r1, [r0]
+	0xE5C21000, // strb r1, [r2]
+	0xEAFFFFFB, // b 0x080000CC
+};
+
+static void _countFrame(struct mCoreThread* thread) {
+	++*(unsigned*) thread->userData;
+}
+
+M_TEST_DEFINE(runAheadSavedata) {
+	uint8_t* rom = calloc(1, ROM_SIZE);
+	STORE_32LE(0xEA00002E, 0, rom); // b 0x080000C0
+	size_t i;
+	for (i = 0; i < sizeof(_saveLoopCode) / sizeof(*_saveLoopCode); ++i) {
+		STORE_32LE(_saveLoopCode[i], 0xC0 + i * 4, rom);
+	}
+	uint8_t* sram = calloc(1, SIZE_CART_SRAM);
+
+	struct mCore* core = GBACoreCreate();
+	assert_non_null(core);
+	assert_true(core->init(core));
+	mCoreInitConfig(core, NULL);
+	core->opts.skipBios = true;
+	core->opts.runAhead = 2;
+	assert_true(core->loadROM(core, VFileFromMemory(rom, ROM_SIZE)));
+	assert_true(core->loadSave(core, VFileFromMemory(sram, SIZE_CART_SRAM)));
+	struct GBA* gba = core->board;
+	GBASavedataForceType(&gba->memory.savedata, SAVEDATA_SRAM);
+
+	unsigned frames = 0;
+	struct mCoreThread thread = {
+		.core = core,
+		.frameCallback = _countFrame,
+		.userData = &frames
+	};
+	assert_true(mCoreThreadStart(&thread));
+
+	// The game saves a counter every loop, so the frames run ahead leave a later value behind
+	int checks = 0;
+	while (checks < 5) {
+		mCoreThreadInterrupt(&thread);
+		if (frames > 2) {
+			uint32_t counter = core->busRead32(core, BASE_WORKING_RAM);
+			assert_int_not_equal(counter, 0);
+			// The frame can end between the two stores, leaving the save one behind
+			assert_in_range((uint8_t) (counter - sram[0]), 0, 1);
+			frames = 0;
+			++checks;
+		}
+		mCoreThreadContinue(&thread);
+	}
+
+	mCoreThreadEnd(&thread);
+	mCoreThreadJoin(&thread);
+	mCoreConfigDeinit(&core->config);
+	core->deinit(core);
+	free(sram);
+	free(rom);
+}
+#endif
+
 M_TEST_SUITE_DEFINE(GBACore,
 	cmocka_unit_test(create),
 	cmocka_unit_test(platform),
 	cmocka_unit_test(reset),
-	cmocka_unit_test(loadNullROM))
+	cmocka_unit_test(loadNullROM),
+	cmocka_unit_test(suppressOutput),
+#ifndef DISABLE_THREADING
+	cmocka_unit_test(runAheadSavedata),
+#endif
+)
@@ -0,0 +1,547 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba/core/core.h>
+#include <mgba/debugger/debugger.h>
+#include <mgba/gba/core.h>
+#include <mgba/internal/arm/debugger/debugger.h>
+#include <mgba/internal/arm/debugger/trace.h>
+#include <mgba/internal/arm/isa-inlines.h>
+#include <mgba/internal/debugger/parser.h>
+#include <mgba/internal/debugger/profiler.h>
+#include <mgba/internal/debugger/symbols.h>
+#include <mgba/internal/gba/gba.h>
+#include <mgba/internal/gba/io.h>
+#include <mgba-util/vfs.h>
+
+#define ROM_SIZE 0x400
+
+struct DebuggerTest {
+	struct mCore* core;
+	struct mDebugger debugger;
+	uint8_t* rom;
+};
+
+static const uint32_t _romCode[] = {
+	0xE3A00402, // mov r0, #0x02000000
+	0xE3A01000, // mov r1, #0
+	0xE2811001, // add r1, r1, #1
+	0xE5801000, // str r1, [r0]
+	0xEAFFFFFC, // b 0x080000C8
+};
+
+static int _setupDebugger(void** state) {
+	struct DebuggerTest* test = calloc(1, sizeof(*test));
+	test->rom = calloc(1, ROM_SIZE);
+	STORE_32LE(0xEA00002E, 0, test->rom); // b 0x080000C0
+	size_t i;
+	for (i = 0; i < sizeof(_romCode) / sizeof(*_romCode); ++i) {
+		STORE_32LE(_romCode[i], 0xC0 + i * 4, test->rom);
+	}
+
+	test->core = GBACoreCreate();
+	if (!test->core || !test->core->init(test->core)) {
+		return -1;
+	}
+	mCoreInitConfig(test->core, NULL);
+	test->core->opts.skipBios = true;
+	if (!test->core->loadROM(test->core, VFileFromMemory(test->rom, ROM_SIZE))) {
+		return -1;
+	}
+	test->debugger.type = DEBUGGER_CUSTOM;
+	mDebuggerAttach(&test->debugger, test->core);
+	test->core->reset(test->core);
+	*state = test;
+	return 0;
+}
+
+static int _teardownDebugger(void** state) {
+	struct DebuggerTest* test = *state;
+	test->core->detachDebugger(test->core);
+	mCoreConfigDeinit(&test->core->config);
+	test->core->deinit(test->core);
+	free(test->rom);
+	free(test);
+	return 0;
+}
+
+static struct ParseTree* _parseCondition(const char* condition) {
+	struct LexVector lv;
+	LexVectorInit(&lv, 0);
+	lexExpression(&lv, condition, strlen(condition), "");
+	struct ParseTree* tree = parseTreeCreate();
+	parseLexedExpression(tree, &lv);
+	lexFree(&lv);
+	LexVectorDeinit(&lv);
+	return tree;
+}
+
+static ssize_t _setBreakpoint(struct mDebugger* debugger, uint32_t address, const char* condition) {
+	struct mBreakpoint breakpoint = {
+		.address = address,
+		.segment = -1,
+		.type = BREAKPOINT_HARDWARE
+	};
+	if (condition) {
+		breakpoint.condition = _parseCondition(condition);
+	}
+	return debugger->platform->setBreakpoint(debugger->platform, &breakpoint);
+}
+
+static bool _runUntilBreak(struct mDebugger* debugger, int limit) {
+	debugger->state = DEBUGGER_RUNNING;
+	int i;
+	for (i = 0; i < limit && debugger->state == DEBUGGER_RUNNING; ++i) {
+		mDebuggerRun(debugger);
+	}
+	return debugger->state == DEBUGGER_PAUSED;
+}
+
+M_TEST_DEFINE(breakpointHit) {
+	struct DebuggerTest* test = *state;
+	struct mCore* core = test->core;
+	struct ARMCore* cpu = core->cpu;
+	_setBreakpoint(&test->debugger, BASE_CART0 | 0xCC, NULL);
+
+	assert_true(_runUntilBreak(&test->debugger, 1000));
+	assert_int_equal(cpu->gprs[ARM_PC] - _ARMInstructionLength(cpu), BASE_CART0 | 0xCC);
+	assert_int_equal(cpu->gprs[1], 1);
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM), 0);
+
+	assert_true(_runUntilBreak(&test->debugger, 1000));
+	assert_int_equal(cpu->gprs[ARM_PC] - _ARMInstructionLength(cpu), BASE_CART0 | 0xCC);
+	assert_int_equal(cpu->gprs[1], 2);
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM), 1);
+}
+
+static const uint32_t _irqHandler[] = {
+	0xE3A00301, // mov r0, #0x04000000
+	0xE2800C02, // add r0, r0, #0x200
+	0xE3A01001, // mov r1, #1
+	0xE1C010B2, // strh r1, [r0, #2]
+	0xE12FFF1E, // bx lr
+};
+
+M_TEST_DEFINE(breakpointAfterEvent) {
+	struct DebuggerTest* test = *state;
+	struct mCore* core = test->core;
+	struct ARMCore* cpu = core->cpu;
+	size_t i;
+	for (i = 0; i < sizeof(_irqHandler) / sizeof(*_irqHandler); ++i) {
+		core->busWrite32(core, BASE_WORKING_RAM + 0x100 + i * 4, _irqHandler[i]);
+	}
+	core->busWrite32(core, BASE_WORKING_IRAM + 0x7FFC, BASE_WORKING_RAM + 0x100);
+	core->busWrite16(core, BASE_IO | REG_DISPSTAT, 0x8);
+	core->busWrite16(core, BASE_IO | REG_IE, 0x1);
+	core->busWrite16(core, BASE_IO | REG_IME, 0x1);
+
+	// The IRQ is taken while events are processed, so the vector is never the instruction after a step
+	_setBreakpoint(&test->debugger, 0x18, NULL);
+	assert_true(_runUntilBreak(&test->debugger, 100000));
+	assert_int_equal(cpu->gprs[ARM_PC] - _ARMInstructionLength(cpu), 0x18);
+	assert_int_equal(cpu->cpsr.priv, MODE_IRQ);
+	uint32_t frame = core->frameCounter(core);
+
+	// Resuming runs the instruction it stopped at instead of hitting the same breakpoint again
+	assert_true(_runUntilBreak(&test->debugger, 100000));
+	assert_int_equal(cpu->gprs[ARM_PC] - _ARMInstructionLength(cpu), 0x18);
+	assert_int_equal(core->frameCounter(core), frame + 1);
+}
+
+M_TEST_DEFINE(breakpointMany) {
+	struct DebuggerTest* test = *state;
+	struct mCore* core = test->core;
+	struct ARMCore* cpu = core->cpu;
+
+	// Breakpoints that never get hit, both in the page being run and elsewhere
+	ssize_t ids[64];
+	size_t i;
+	for (i = 0; i < 63; ++i) {
+		ids[i] = _setBreakpoint(&test->debugger, BASE_CART0 | 0x10000 | (i << 12), NULL);
+	}
+	ids[63] = _setBreakpoint(&test->debugger, BASE_CART0 | 0x200, NULL);
+	mDebuggerRunFrame(&test->debugger);
+	assert_int_equal(test->debugger.state, DEBUGGER_RUNNING);
+	uint32_t counter = core->busRead32(core, BASE_WORKING_RAM);
+	assert_int_not_equal(counter, 0);
+
+	ssize_t id = _setBreakpoint(&test->debugger, BASE_CART0 | 0xC8, NULL);
+	assert_true(_runUntilBreak(&test->debugger, 1000));
+	assert_int_equal(cpu->gprs[ARM_PC] - _ARMInstructionLength(cpu), BASE_CART0 | 0xC8);
+
+	assert_true(test->debugger.platform->clearBreakpoint(test->debugger.platform, id));
+	for (i = 0; i < 64; ++i) {
+		assert_true(test->debugger.platform->clearBreakpoint(test->debugger.platform, ids[i]));
+	}
+	assert_false(test->debugger.platform->hasBreakpoints(test->debugger.platform));
+	mDebuggerRunFrame(&test->debugger);
+	assert_int_equal(test->debugger.state, DEBUGGER_RUNNING);
+	assert_true(core->busRead32(core, BASE_WORKING_RAM) > counter);
+}
+
+M_TEST_DEFINE(breakpointCondition) {
+	struct DebuggerTest* test = *state;
+	struct ARMCore* cpu = test->core->cpu;
+	_setBreakpoint(&test->debugger, BASE_CART0 | 0xCC, "r1 == 100");
+
+	assert_true(_runUntilBreak(&test->debugger, 100000));
+	assert_int_equal(cpu->gprs[ARM_PC] - _ARMInstructionLength(cpu), BASE_CART0 | 0xCC);
+	assert_int_equal(cpu->gprs[1], 100);
+}
+
+static ssize_t _setWatchpoint(struct mDebugger* debugger, uint32_t address, uint32_t size, enum mWatchpointType type) {
+	struct mWatchpoint watchpoint = {
+		.address = address,
+		.size = size,
+		.segment = -1,
+		.type = type
+	};
+	return debugger->platform->setWatchpoint(debugger->platform, &watchpoint);
+}
+
+M_TEST_DEFINE(watchpointHit) {
+	struct DebuggerTest* test = *state;
+	struct mCore* core = test->core;
+	ssize_t id = _setWatchpoint(&test->debugger, BASE_WORKING_RAM | 2, 0, WATCHPOINT_WRITE);
+	assert_true(_runUntilBreak(&test->debugger, 1000));
+	// The store that tripped the watchpoint still completes
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM), 1);
+
+	assert_true(test->debugger.platform->clearBreakpoint(test->debugger.platform, id));
+	mDebuggerRunFrame(&test->debugger);
+	assert_int_equal(test->debugger.state, DEBUGGER_RUNNING);
+}
+
+M_TEST_DEFINE(watchpointRange) {
+	struct DebuggerTest* test = *state;
+	struct mCore* core = test->core;
+
+	// Neither of these overlap the counter, one shares its page and one doesn't
+	_setWatchpoint(&test->debugger, BASE_WORKING_RAM | 4, 0x100, WATCHPOINT_WRITE);
+	_setWatchpoint(&test->debugger, BASE_WORKING_RAM | 0x10000, 0x20000, WATCHPOINT_RW);
+	mDebuggerRunFrame(&test->debugger);
+	assert_int_equal(test->debugger.state, DEBUGGER_RUNNING);
+	uint32_t counter = core->busRead32(core, BASE_WORKING_RAM);
+	assert_int_not_equal(counter, 0);
+
+	_setWatchpoint(&test->debugger, BASE_WORKING_RAM - 0x100, 0x101, WATCHPOINT_WRITE);
+	assert_true(_runUntilBreak(&test->debugger, 1000));
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM), counter + 1);
+	assert_true(_runUntilBreak(&test->debugger, 1000));
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM), counter + 2);
+
+	// Reads and writes land in the original memory handlers when the page isn't watched
+	core->busWrite32(core, BASE_WORKING_RAM | 0x200, 0x12345678);
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM | 0x200), 0x12345678);
+}
+
+M_TEST_DEFINE(watchpointCondition) {
+	struct DebuggerTest* test = *state;
+	struct ARMCore* cpu = test->core->cpu;
+	struct mWatchpoint watchpoint = {
+		.address = BASE_WORKING_RAM,
+		.segment = -1,
+		.type = WATCHPOINT_WRITE
+	};
+	watchpoint.condition = _parseCondition("r1 == 50");
+	test->debugger.platform->setWatchpoint(test->debugger.platform, &watchpoint);
+
+	assert_true(_runUntilBreak(&test->debugger, 100000));
+	assert_int_equal(cpu->gprs[1], 50);
+	assert_int_equal(test->core->busRead32(test->core, BASE_WORKING_RAM), 50);
+}
+
+M_TEST_DEFINE(conditionProgram) {
+	struct DebuggerTest* test = *state;
+	struct mCore* core = test->core;
+	struct ARMCore* cpu = core->cpu;
+	static const char* expressions[] = {
+		"r1 + 2 * 3",
+		"(4 - 6) * -2",
+		"~r1 & 0xFF",
+		"0x1:100",
+		"*0x02000000",
+		"*r0 == 0x42",
+		"pc == r15 && sp != 0",
+		"cpsr & 0x1F",
+		"10 / 0",
+		"r1 % (r2 - r2)",
+		"doesNotExist + 1",
+	};
+
+	core->busWrite8(core, BASE_WORKING_RAM, 0x42);
+	size_t i;
+	for (i = 0; i < sizeof(expressions) / sizeof(*expressions); ++i) {
+		cpu->gprs[0] = BASE_WORKING_RAM;
+		cpu->gprs[1] = 5;
+		cpu->gprs[2] = 7;
+		struct ParseTree* tree = _parseCondition(expressions[i]);
+		struct ParseProgram* program = parseCompile(&test->debugger, tree);
+		assert_non_null(program);
+
+		int32_t treeValue = 0;
+		int treeSegment = -1;
+		int32_t programValue = 0;
+		int programSegment = -1;
+		bool treeOk = mDebuggerEvaluateParseTree(&test->debugger, tree, &treeValue, &treeSegment);
+		bool programOk = mDebuggerEvaluateProgram(&test->debugger, program, &programValue, &programSegment);
+		assert_int_equal(programOk, treeOk);
+		if (treeOk) {
+			assert_int_equal(programValue, treeValue);
+			assert_int_equal(programSegment, treeSegment);
+		}
+
+		// Registers are bound, not copied, when the program is compiled
+		cpu->gprs[1] = 6;
+		if (i == 0) {
+			assert_true(mDebuggerEvaluateProgram(&test->debugger, program, &programValue, &programSegment));
+			assert_int_equal(programValue, 12);
+		}
+		parseProgramFree(program);
+		parseFree(tree);
+	}
+}
+
+M_TEST_DEFINE(conditionSymbols) {
+	struct DebuggerTest* test = *state;
+	struct mCore* core = test->core;
+	struct ARMCore* cpu = core->cpu;
+	if (!core->symbolTable) {
+		core->symbolTable = mDebuggerSymbolTableCreate();
+	}
+	mDebuggerSymbolAdd(core->symbolTable, "limit", 10, -1);
+	cpu->gprs[1] = 5;
+
+	struct ParseTree* tree = _parseCondition("limit + r1");
+	struct ParseProgram* program = parseCompile(&test->debugger, tree);
+	assert_non_null(program);
+	int32_t value;
+	int segment;
+	assert_true(mDebuggerEvaluateProgram(&test->debugger, program, &value, &segment));
+	assert_int_equal(value, 15);
+
+	// Symbols loaded or changed after the condition was set are picked up like the tree walker would
+	mDebuggerSymbolAdd(core->symbolTable, "limit", 20, -1);
+	assert_true(mDebuggerEvaluateProgram(&test->debugger, program, &value, &segment));
+	assert_int_equal(value, 25);
+
+	// Including ones that shadow a register
+	mDebuggerSymbolAdd(core->symbolTable, "r1", 1, -1);
+	assert_true(mDebuggerEvaluateProgram(&test->debugger, program, &value, &segment));
+	assert_int_equal(value, 21);
+	mDebuggerSymbolRemove(core->symbolTable, "r1");
+	assert_true(mDebuggerEvaluateProgram(&test->debugger, program, &value, &segment));
+	assert_int_equal(value, 25);
+
+	mDebuggerSymbolRemove(core->symbolTable, "limit");
+	assert_false(mDebuggerEvaluateParseTree(&test->debugger, tree, &value, &segment));
+	assert_false(mDebuggerEvaluateProgram(&test->debugger, program, &value, &segment));
+	mDebuggerSymbolAdd(core->symbolTable, "limit", 30, -1);
+	assert_true(mDebuggerEvaluateProgram(&test->debugger, program, &value, &segment));
+	assert_int_equal(value, 35);
+
+	parseProgramFree(program);
+	parseFree(tree);
+}
+
+static struct VFile* _exportTrace(struct mDebugger* debugger, struct ARMTraceReader* reader) {
+	struct ARMDebugger* armDebugger = (struct ARMDebugger*) debugger->platform;
+	struct VFile* vf = VFileMemChunk(NULL, 0);
+	assert_true(ARMTraceExport(armDebugger->trace, vf));
+	vf->seek(vf, 0, SEEK_SET);
+	assert_true(ARMTraceReaderInit(reader, vf));
+	return vf;
+}
+
+M_TEST_DEFINE(traceRecord) {
+	struct DebuggerTest* test = *state;
+	ARMDebuggerStartTrace(test->debugger.platform, 0, ARM_TRACE_REGISTERS | ARM_TRACE_MEMORY);
+	_setBreakpoint(&test->debugger, BASE_CART0 | 0xCC, NULL);
+	assert_true(_runUntilBreak(&test->debugger, 1000));
+	assert_true(_runUntilBreak(&test->debugger, 1000));
+	assert_true(_runUntilBreak(&test->debugger, 1000));
+
+	static const uint32_t addresses[] = { 0x00, 0xC0, 0xC4, 0xC8, 0xCC, 0xD0, 0xC8, 0xCC, 0xD0, 0xC8 };
+	struct ARMTraceReader reader;
+	struct VFile* vf = _exportTrace(&test->debugger, &reader);
+	struct ARMTraceEntry entry;
+	size_t i;
+	for (i = 0; i < sizeof(addresses) / sizeof(*addresses); ++i) {
+		assert_true(ARMTraceReaderNext(&reader, &entry));
+		assert_int_equal(entry.index, i);
+		assert_int_equal(entry.address, BASE_CART0 | addresses[i]);
+		assert_int_equal(entry.mode, MODE_ARM);
+		assert_false(entry.hasOpcode);
+		if (addresses[i] == 0xCC) {
+			// Registers are captured before the instruction runs, and the store comes with it
+			assert_int_equal(entry.gprs[0], BASE_WORKING_RAM);
+			assert_int_equal(entry.gprs[1], i < 5 ? 1 : 2);
+			assert_int_equal(entry.nAccesses, 1);
+			assert_int_equal(entry.accesses[0].address, BASE_WORKING_RAM);
+			assert_int_equal(entry.accesses[0].value, entry.gprs[1]);
+			assert_int_equal(entry.accesses[0].width, 4);
+			assert_true(entry.accesses[0].write);
+		} else {
+			assert_int_equal(entry.nAccesses, 0);
+		}
+	}
+	assert_false(ARMTraceReaderNext(&reader, &entry));
+	ARMTraceReaderDeinit(&reader);
+	vf->close(vf);
+
+	// Stopping the trace hands the memory handlers back
+	struct ARMCore* cpu = test->core->cpu;
+	ARMDebuggerStopTrace(test->debugger.platform);
+	assert_ptr_equal(cpu->memory.store32, ((struct ARMDebugger*) test->debugger.platform)->originalMemory.store32);
+}
+
+M_TEST_DEFINE(traceWrap) {
+	struct DebuggerTest* test = *state;
+	struct ARMTrace* trace = ARMDebuggerStartTrace(test->debugger.platform, 0, ARM_TRACE_OPCODES);
+	_runUntilBreak(&test->debugger, 2000);
+	assert_int_equal(test->debugger.state, DEBUGGER_RUNNING);
+	assert_true(trace->usedBlocks == trace->nBlocks);
+	assert_int_not_equal(trace->oldestBlock, 0);
+	uint64_t instructions = trace->instructions;
+
+	struct ARMTraceReader reader;
+	struct VFile* vf = _exportTrace(&test->debugger, &reader);
+	struct ARMTraceEntry entry;
+	assert_true(ARMTraceReaderNext(&reader, &entry));
+	// The oldest instructions were overwritten, but the rest still decodes from the keyframe
+	assert_int_not_equal(entry.index, 0);
+	uint64_t index = entry.index;
+	do {
+		assert_int_equal(entry.index, index);
+		assert_true(entry.hasOpcode);
+		assert_true(entry.address >= (BASE_CART0 | 0xC8) && entry.address <= (BASE_CART0 | 0xD0));
+		assert_int_equal(entry.opcode, _romCode[(entry.address - (BASE_CART0 | 0xC0)) / 4]);
+		++index;
+	} while (ARMTraceReaderNext(&reader, &entry));
+	assert_int_equal(index, instructions);
+	ARMTraceReaderDeinit(&reader);
+	vf->close(vf);
+}
+
+M_TEST_DEFINE(profileSamples) {
+	struct DebuggerTest* test = *state;
+	static const char map[] =
+		" .text          0x080000c0       0x14 src/main.o\n"
+		"                0x080000c0                Setup\n"
+		"                0x080000c8                Loop\n"
+		"                0x080000d4                . = ALIGN (0x4)\n"
+		"                0x02000000                PROVIDE (counter = .)\n";
+	struct mDebuggerSymbols* symbols = mDebuggerSymbolTableCreate();
+	struct VFile* vf = VFileFromConstMemory(map, sizeof(map) - 1);
+	mDebuggerLoadGNUMapSymbols(symbols, vf);
+	vf->close(vf);
+
+	uint32_t offset;
+	assert_string_equal(mDebuggerSymbolLookupNearest(symbols, BASE_CART0 | 0xCC, -1, &offset), "Loop");
+	assert_int_equal(offset, 4);
+	assert_string_equal(mDebuggerSymbolLookupNearest(symbols, BASE_CART0 | 0xC4, -1, &offset), "Setup");
+	assert_null(mDebuggerSymbolLookupNearest(symbols, BASE_CART0, -1, &offset));
+	assert_null(mDebuggerSymbolLookupNearest(symbols, BASE_CART0 | 0xC0, 1, &offset));
+
+	// Line up with the start of a frame, since the first one after skipping the BIOS is short
+	mDebuggerRunFrame(&test->debugger);
+	struct mProfiler profiler;
+	mProfilerInit(&profiler, &test->debugger);
+	mProfilerStart(&profiler, 0x100);
+	assert_true(mProfilerIsRunning(&profiler));
+	mDebuggerRunFrame(&test->debugger);
+	mProfilerStop(&profiler);
+	assert_false(mProfilerIsRunning(&profiler));
+	// A frame is 280896 cycles
+	assert_in_range(profiler.samples, 1000, 1100);
+
+	vf = VFileMemChunk(NULL, 0);
+	assert_true(mProfilerDump(&profiler, symbols, vf));
+	size_t size = vf->size(vf);
+	char* folded = calloc(1, size + 1);
+	vf->seek(vf, 0, SEEK_SET);
+	assert_int_equal(vf->read(vf, folded, size), size);
+	vf->close(vf);
+
+	uint64_t total = 0;
+	char* line;
+	char* next;
+	for (line = folded; *line; line = next + 1) {
+		next = strchr(line, '\n');
+		assert_non_null(next);
+		*next = '\0';
+		char* count = strrchr(line, ' ');
+		assert_non_null(count);
+		*count = '\0';
+		total += strtoull(count + 1, NULL, 10);
+		// The counter loop never leaves system mode or the routines in the map
+		if (strcmp(line, "[system];Loop") != 0) {
+			assert_string_equal(line, "[system];Setup");
+		}
+	}
+	assert_int_equal(total, profiler.samples);
+
+	free(folded);
+	mProfilerDeinit(&profiler);
+	mDebuggerSymbolTableDestroy(symbols);
+}
+
+M_TEST_DEFINE(profileReset) {
+	struct DebuggerTest* test = *state;
+	struct mCore* core = test->core;
+	struct mTiming* timing = core->timing;
+	void* savestate = malloc(core->stateSize(core));
+	assert_true(core->saveState(core, savestate));
+
+	struct mProfiler profiler;
+	mProfilerInit(&profiler, &test->debugger);
+	mProfilerStart(&profiler, 0x100);
+	mDebuggerRunFrame(&test->debugger);
+	uint64_t samples = profiler.samples;
+	assert_true(samples > 0);
+
+	// Resetting clears the sampler along with every other event, but the profiler still counts as running
+	core->reset(core);
+	assert_false(mTimingIsScheduled(timing, &profiler.event));
+	assert_true(mProfilerIsRunning(&profiler));
+	mProfilerUpdate(&profiler);
+	assert_true(mTimingIsScheduled(timing, &profiler.event));
+	mDebuggerRunFrame(&test->debugger);
+	assert_true(profiler.samples > samples);
+	samples = profiler.samples;
+
+	assert_true(core->loadState(core, savestate));
+	assert_false(mTimingIsScheduled(timing, &profiler.event));
+	mProfilerUpdate(&profiler);
+	mDebuggerRunFrame(&test->debugger);
+	assert_true(profiler.samples > samples);
+
+	// A stopped profiler stays stopped
+	mProfilerStop(&profiler);
+	core->reset(core);
+	mProfilerUpdate(&profiler);
+	assert_false(mTimingIsScheduled(timing, &profiler.event));
+	assert_false(mProfilerIsRunning(&profiler));
+
+	mProfilerDeinit(&profiler);
+	free(savestate);
+}
+
+M_TEST_SUITE_DEFINE(GBADebugger,
+	cmocka_unit_test_setup_teardown(breakpointHit, _setupDebugger, _teardownDebugger),
+	cmocka_unit_test_setup_teardown(breakpointAfterEvent, _setupDebugger, _teardownDebugger),
+	cmocka_unit_test_setup_teardown(breakpointMany, _setupDebugger, _teardownDebugger),
+	cmocka_unit_test_setup_teardown(breakpointCondition, _setupDebugger, _teardownDebugger),
+	cmocka_unit_test_setup_teardown(watchpointHit, _setupDebugger, _teardownDebugger),
+	cmocka_unit_test_setup_teardown(watchpointRange, _setupDebugger, _teardownDebugger),
+	cmocka_unit_test_setup_teardown(watchpointCondition, _setupDebugger, _teardownDebugger),
+	cmocka_unit_test_setup_teardown(conditionProgram, _setupDebugger, _teardownDebugger),
+	cmocka_unit_test_setup_teardown(conditionSymbols, _setupDebugger, _teardownDebugger),
+	cmocka_unit_test_setup_teardown(traceRecord, _setupDebugger, _teardownDebugger),
+	cmocka_unit_test_setup_teardown(traceWrap, _setupDebugger, _teardownDebugger),
+	cmocka_unit_test_setup_teardown(profileSamples, _setupDebugger, _teardownDebugger),
+	cmocka_unit_test_setup_teardown(profileReset, _setupDebugger, _teardownDebugger))
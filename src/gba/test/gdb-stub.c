@@ -0,0 +1,378 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba/core/core.h>
+#include <mgba/core/serialize.h>
+#include <mgba/gba/core.h>
+#include <mgba/internal/arm/arm.h>
+#include <mgba/internal/debugger/gdb-stub.h>
+#include <mgba/internal/gba/gba.h>
+#include <mgba-util/vfs.h>
+
+#define ROM_SIZE 0x400
+#define BASE_PORT 23460
+#define PORT_ATTEMPTS 20
+#define RECV_TIMEOUT 1000
+
+struct GDBStubTest {
+	struct mCore* core;
+	struct GDBStub stub;
+	Socket client;
+	uint8_t* rom;
+};
+
+static const uint32_t _romCode[] = {
+	0xE3A00402, // mov r0, #0x02000000
+	0xE3A01000, // mov r1, #0
+	0xE2811001, // add r1, r1, #1
+	0xE5801000, // str r1, [r0]
+	0xEAFFFFFC, // b 0x080000C8
+};
+
+static void _update(struct GDBStubTest* test) {
+	// Drain everything sent so far, even if it arrives in several pieces
+	Socket reads = test->stub.connection;
+	int64_t timeout = RECV_TIMEOUT;
+	while (SocketPoll(1, &reads, 0, 0, timeout) > 0) {
+		GDBStubUpdate(&test->stub);
+		reads = test->stub.connection;
+		timeout = 20;
+	}
+}
+
+static void _sendRaw(struct GDBStubTest* test, const char* data) {
+	assert_int_equal(SocketSend(test->client, data, strlen(data)), (ssize_t) strlen(data));
+}
+
+static void _send(struct GDBStubTest* test, const char* payload) {
+	char packet[0x200];
+	uint8_t checksum = 0;
+	size_t i;
+	for (i = 0; payload[i]; ++i) {
+		checksum += payload[i];
+	}
+	snprintf(packet, sizeof(packet), "$%s#%02x", payload, checksum);
+	_sendRaw(test, packet);
+}
+
+static size_t _recv(struct GDBStubTest* test, char* out, size_t size) {
+	size_t length = 0;
+	while (length < size) {
+		Socket reads = test->client;
+		if (SocketPoll(1, &reads, 0, 0, RECV_TIMEOUT) <= 0) {
+			break;
+		}
+		ssize_t received = SocketRecv(test->client, &out[length], size - length);
+		if (received <= 0) {
+			break;
+		}
+		length += received;
+	}
+	return length;
+}
+
+static void _expect(struct GDBStubTest* test, const char* expected) {
+	char reply[0x200];
+	size_t length = strlen(expected);
+	assert_true(length <= sizeof(reply));
+	assert_int_equal(_recv(test, reply, length), length);
+	assert_memory_equal(reply, expected, length);
+}
+
+static void _expectData(struct GDBStubTest* test, const char* payload, size_t length) {
+	char packet[0x200];
+	assert_true(length + 4 <= sizeof(packet));
+	uint8_t checksum = 0;
+	size_t i;
+	for (i = 0; i < length; ++i) {
+		checksum += payload[i];
+	}
+	packet[0] = '$';
+	memcpy(&packet[1], payload, length);
+	snprintf(&packet[length + 1], 4, "#%02x", checksum);
+	_expect(test, packet);
+}
+
+static void _expectPacket(struct GDBStubTest* test, const char* payload) {
+	_expectData(test, payload, strlen(payload));
+}
+
+static void _skipPacket(struct GDBStubTest* test) {
+	char c;
+	do {
+		assert_int_equal(_recv(test, &c, 1), 1);
+	} while (c != '#');
+	char checksum[2];
+	assert_int_equal(_recv(test, checksum, 2), 2);
+}
+
+static void _expectNothing(struct GDBStubTest* test) {
+	Socket reads = test->client;
+	assert_int_equal(SocketPoll(1, &reads, 0, 0, 50), 0);
+}
+
+static int _setupStub(void** state) {
+	struct GDBStubTest* test = calloc(1, sizeof(*test));
+	test->rom = calloc(1, ROM_SIZE);
+	STORE_32LE(0xEA00002E, 0, test->rom); // b 0x080000C0
+	size_t i;
+	for (i = 0; i < sizeof(_romCode) / sizeof(*_romCode); ++i) {
+		STORE_32LE(_romCode[i], 0xC0 + i * 4, test->rom);
+	}
+
+	test->core = GBACoreCreate();
+	if (!test->core || !test->core->init(test->core)) {
+		return -1;
+	}
+	mCoreInitConfig(test->core, NULL);
+	test->core->opts.skipBios = true;
+	if (!test->core->loadROM(test->core, VFileFromMemory(test->rom, ROM_SIZE))) {
+		return -1;
+	}
+
+	SocketSubsystemInit();
+	struct Address localhost = {
+		.version = IPV4,
+		.ipv4 = 0x7F000001
+	};
+	GDBStubCreate(&test->stub);
+	int port;
+	for (port = BASE_PORT; port < BASE_PORT + PORT_ATTEMPTS; ++port) {
+		if (GDBStubListen(&test->stub, port, &localhost, GDB_WATCHPOINT_STANDARD_LOGIC)) {
+			break;
+		}
+	}
+	if (port == BASE_PORT + PORT_ATTEMPTS) {
+		return -1;
+	}
+	mDebuggerAttach(&test->stub.d, test->core);
+	test->core->reset(test->core);
+
+	test->client = SocketConnectTCP(port, &localhost);
+	if (SOCKET_FAILED(test->client)) {
+		return -1;
+	}
+	// Don't let Nagle hold back the tiny packets the tests send back to back
+	SocketSetTCPPush(test->client, 1);
+	Socket reads = test->stub.socket;
+	SocketPoll(1, &reads, 0, 0, RECV_TIMEOUT);
+	GDBStubUpdate(&test->stub);
+	if (SOCKET_FAILED(test->stub.connection) || test->stub.d.state != DEBUGGER_PAUSED) {
+		return -1;
+	}
+	*state = test;
+	return 0;
+}
+
+static int _teardownStub(void** state) {
+	struct GDBStubTest* test = *state;
+	SocketClose(test->client);
+	test->core->detachDebugger(test->core);
+	mCoreConfigDeinit(&test->core->config);
+	test->core->deinit(test->core);
+	SocketSubsystemDeinit();
+	free(test->rom);
+	free(test);
+	return 0;
+}
+
+M_TEST_DEFINE(noAck) {
+	struct GDBStubTest* test = *state;
+	_send(test, "?");
+	_update(test);
+	_expect(test, "+");
+	_expectPacket(test, "S02");
+	_sendRaw(test, "+");
+
+	_send(test, "QStartNoAckMode");
+	_update(test);
+	_expect(test, "+");
+	_expectPacket(test, "OK");
+	_sendRaw(test, "+");
+
+	// Neither good nor bad packets get acknowledged any more
+	_send(test, "?");
+	_update(test);
+	_expectPacket(test, "S02");
+	_sendRaw(test, "$?#00");
+	_update(test);
+	_expectNothing(test);
+
+	// A new client starts out with acks again
+	GDBStubHangup(&test->stub);
+	assert_int_equal(test->stub.lineAck, GDB_ACK_PENDING);
+}
+
+M_TEST_DEFINE(splitPackets) {
+	struct GDBStubTest* test = *state;
+	struct ARMCore* cpu = test->core->cpu;
+	cpu->gprs[0] = 0x12345678;
+
+	// Nothing is acked or answered until the checksum has arrived
+	_sendRaw(test, "$p");
+	_update(test);
+	_expectNothing(test);
+	_sendRaw(test, "0#");
+	_update(test);
+	_expectNothing(test);
+	_sendRaw(test, "a0");
+	_update(test);
+	_expect(test, "+");
+	_expectPacket(test, "78563412");
+
+	// Several packets in one read are all answered
+	_sendRaw(test, "+$p0#a0$p0#a0");
+	_update(test);
+	_expect(test, "+");
+	_expectPacket(test, "78563412");
+	_expect(test, "+");
+	_expectPacket(test, "78563412");
+
+	// A bad checksum is nak'd without losing the packet after it
+	_sendRaw(test, "$p0#00$p0#a0");
+	_update(test);
+	_expect(test, "-+");
+	_expectPacket(test, "78563412");
+}
+
+M_TEST_DEFINE(binaryRead) {
+	struct GDBStubTest* test = *state;
+	struct mCore* core = test->core;
+	static const uint8_t data[] = { 'a', '#', '$', '}', '*', 0 };
+	size_t i;
+	for (i = 0; i < sizeof(data); ++i) {
+		core->busWrite8(core, BASE_WORKING_RAM + i, data[i]);
+	}
+
+	// Without binary-upload, an empty read is how LLDB probes for support
+	_send(test, "x2000000,0");
+	_update(test);
+	_expect(test, "+");
+	_expectPacket(test, "OK");
+
+	_send(test, "qSupported:binary-upload+");
+	_update(test);
+	_expect(test, "+");
+	_skipPacket(test);
+	_sendRaw(test, "+");
+
+	// The reserved characters are escaped, and the reply is marked as binary
+	static const char escaped[] = { 'b', 'a', '}', 0x03, '}', 0x04, '}', ']', '}', 0x0A, 0 };
+	_send(test, "x2000000,6");
+	_update(test);
+	_expect(test, "+");
+	_expectData(test, escaped, sizeof(escaped));
+}
+
+M_TEST_DEFINE(copyMemory) {
+	struct GDBStubTest* test = *state;
+	struct mCore* core = test->core;
+	core->busWrite32(core, BASE_WORKING_IRAM + SIZE_WORKING_IRAM - 4, 0x11223344);
+	core->busWrite32(core, BASE_WORKING_IRAM, 0x55667788);
+
+	// RAM and its mirrors, a block boundary, I/O and ROM must all read the same as the bus
+	static const uint32_t ranges[][2] = {
+		{ BASE_WORKING_IRAM + SIZE_WORKING_IRAM - 4, 8 },
+		{ BASE_WORKING_IRAM + SIZE_WORKING_IRAM * 3 - 2, 4 },
+		{ BASE_IO, 8 },
+		{ BASE_CART0 + 0xC0, 8 },
+		{ BASE_WORKING_RAM + SIZE_WORKING_RAM - 2, 4 },
+	};
+	size_t i;
+	for (i = 0; i < sizeof(ranges) / sizeof(*ranges); ++i) {
+		char request[32];
+		snprintf(request, sizeof(request), "m%x,%x", ranges[i][0], ranges[i][1]);
+		_send(test, request);
+		_update(test);
+		_expect(test, "+");
+
+		char expected[32] = "";
+		uint32_t offset;
+		for (offset = 0; offset < ranges[i][1]; ++offset) {
+			snprintf(&expected[offset * 2], 3, "%02x", core->busRead8(core, ranges[i][0] + offset));
+		}
+		_expectPacket(test, expected);
+		_sendRaw(test, "+");
+	}
+}
+
+M_TEST_DEFINE(vCont) {
+	struct GDBStubTest* test = *state;
+	struct ARMCore* cpu = test->core->cpu;
+
+	_send(test, "vCont?");
+	_update(test);
+	_expect(test, "+");
+	_expectPacket(test, "vCont;c;C;s;S");
+	_sendRaw(test, "+");
+
+	int32_t pc = cpu->gprs[ARM_PC];
+	_send(test, "vCont;s:1");
+	_update(test);
+	_expect(test, "+");
+	_expectPacket(test, "S05");
+	_sendRaw(test, "+");
+	assert_int_not_equal(cpu->gprs[ARM_PC], pc);
+	assert_int_equal(test->stub.d.state, DEBUGGER_PAUSED);
+
+	_send(test, "vCont;c");
+	_update(test);
+	_expect(test, "+");
+	assert_int_equal(test->stub.d.state, DEBUGGER_RUNNING);
+	assert_true(mTimingIsScheduled(test->core->timing, &test->stub.pollEvent));
+
+	// The poll catches the interrupt while running at full speed
+	_sendRaw(test, "\x03");
+	int i;
+	for (i = 0; i < 100000 && test->stub.d.state == DEBUGGER_RUNNING; ++i) {
+		mDebuggerRun(&test->stub.d);
+	}
+	assert_int_equal(test->stub.d.state, DEBUGGER_PAUSED);
+	_expectPacket(test, "S02");
+}
+
+M_TEST_DEFINE(pollSurvivesReset) {
+	struct GDBStubTest* test = *state;
+	struct mCore* core = test->core;
+	struct mTiming* timing = core->timing;
+	size_t stateSize = core->stateSize(core);
+	void* savedState = malloc(stateSize);
+	assert_true(core->saveState(core, savedState));
+
+	_send(test, "c");
+	_update(test);
+	_expect(test, "+");
+	assert_int_equal(test->stub.d.state, DEBUGGER_RUNNING);
+	assert_true(mTimingIsScheduled(timing, &test->stub.pollEvent));
+
+	core->reset(core);
+	assert_false(mTimingIsScheduled(timing, &test->stub.pollEvent));
+	mDebuggerRun(&test->stub.d);
+	assert_true(mTimingIsScheduled(timing, &test->stub.pollEvent));
+
+	assert_true(core->loadState(core, savedState));
+	assert_false(mTimingIsScheduled(timing, &test->stub.pollEvent));
+	mDebuggerRun(&test->stub.d);
+	assert_true(mTimingIsScheduled(timing, &test->stub.pollEvent));
+
+	_sendRaw(test, "\x03");
+	int i;
+	for (i = 0; i < 100000 && test->stub.d.state == DEBUGGER_RUNNING; ++i) {
+		mDebuggerRun(&test->stub.d);
+	}
+	assert_int_equal(test->stub.d.state, DEBUGGER_PAUSED);
+	_expectPacket(test, "S02");
+	free(savedState);
+}
+
+M_TEST_SUITE_DEFINE(GBAGDBStub,
+	cmocka_unit_test_setup_teardown(noAck, _setupStub, _teardownStub),
+	cmocka_unit_test_setup_teardown(splitPackets, _setupStub, _teardownStub),
+	cmocka_unit_test_setup_teardown(binaryRead, _setupStub, _teardownStub),
+	cmocka_unit_test_setup_teardown(copyMemory, _setupStub, _teardownStub),
+	cmocka_unit_test_setup_teardown(vCont, _setupStub, _teardownStub),
+	cmocka_unit_test_setup_teardown(pollSurvivesReset, _setupStub, _teardownStub))
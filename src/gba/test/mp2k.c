@@ -0,0 +1,763 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba/core/core.h>
+#include <mgba/gba/core.h>
+#include <mgba/internal/arm/macros.h>
+#include <mgba/internal/gba/gba.h>
+#include <mgba-util/vfs.h>
+
+#define SOUND_INFO 0x02000000
+#define PCM_BUFFER (SOUND_INFO + 0x350)
+#define WAVE 0x02001000
+#define RETURN 0x02002000
+#define STACK 0x03007E00
+#define SOUND_MAIN_RAM 0x03001000
+#define SAMPLES 16
+#define STATE_SIZE (0x350 + 0x630 * 2)
+
+// A transcription of SoundMainRAM's mixer into ARM code, used as the low-level reference for the
+// native mixer. It takes the same registers and unwinds the same stack frame as the original.
+static const uint32_t _referenceMixer[] = {
+	0x46C04778, // bx pc; nop
+	0xE24DD020, // sub sp, sp, #0x20
+	0xE58D0014, // str r0, [sp, #0x14]
+	0xE58D5000, // str r5, [sp, #0]
+	0xE58D8008, // str r8, [sp, #8]
+	0xE5D03005, // ldrb r3, [r0, #5]
+	0xE3530000, // cmp r3, #0
+	0x0A000016, // beq noreverb
+	0xE3540002, // cmp r4, #2
+	0x02807E35, // addeq r7, r0, #0x350
+	0x10857008, // addne r7, r5, r8
+	0xE1A04008, // mov r4, r8
+	// rloop:
+	0xE2852E63, // add r2, r5, #0x630
+	0xE1D200D0, // ldrsb r0, [r2]
+	0xE1D510D0, // ldrsb r1, [r5]
+	0xE0800001, // add r0, r0, r1
+	0xE2872E63, // add r2, r7, #0x630
+	0xE1D210D0, // ldrsb r1, [r2]
+	0xE0800001, // add r0, r0, r1
+	0xE0D710D1, // ldrsb r1, [r7], #1
+	0xE0800001, // add r0, r0, r1
+	0xE0010390, // mul r1, r0, r3
+	0xE1A004C1, // mov r0, r1, asr #9
+	0xE3100080, // tst r0, #0x80
+	0x12800001, // addne r0, r0, #1
+	0xE2852E63, // add r2, r5, #0x630
+	0xE5C20000, // strb r0, [r2]
+	0xE4C50001, // strb r0, [r5], #1
+	0xE2544001, // subs r4, r4, #1
+	0xCAFFFFED, // bgt rloop
+	0xEA000007, // b channels
+	// noreverb:
+	0xE3A00000, // mov r0, #0
+	0xE3C81003, // bic r1, r8, #3
+	0xE2852E63, // add r2, r5, #0x630
+	// nloop:
+	0xE2511001, // subs r1, r1, #1
+	0xBA000002, // blt channels
+	0xE7C50001, // strb r0, [r5, r1]
+	0xE7C20001, // strb r0, [r2, r1]
+	0xEAFFFFFA, // b nloop
+	// channels:
+	0xE59D0014, // ldr r0, [sp, #0x14]
+	0xE5901018, // ldr r1, [r0, #0x18]
+	0xE58D100C, // str r1, [sp, #0xC]
+	0xE5D01007, // ldrb r1, [r0, #7]
+	0xE58D1004, // str r1, [sp, #4]
+	0xE5D01006, // ldrb r1, [r0, #6]
+	0xE58D1010, // str r1, [sp, #0x10]
+	0xE2804050, // add r4, r0, #0x50
+	0xE3510000, // cmp r1, #0
+	0xDA0000BF, // ble done
+	// chan:
+	0xE5D4A000, // ldrb r10, [r4]
+	0xE31A00C7, // tst r10, #0xC7
+	0x0A0000B7, // beq next
+	0xE5943024, // ldr r3, [r4, #0x24]
+	0xE31A0080, // tst r10, #0x80
+	0x0A000012, // beq running
+	0xE31A0040, // tst r10, #0x40
+	0x13A00000, // movne r0, #0
+	0x15C40000, // strbne r0, [r4]
+	0x1A0000B0, // bne next
+	0xE3A0A003, // mov r10, #3
+	0xE5D30003, // ldrb r0, [r3, #3]
+	0xE31000C0, // tst r0, #0xC0
+	0x138AA010, // orrne r10, r10, #0x10
+	0xE593000C, // ldr r0, [r3, #0xC]
+	0xE5840018, // str r0, [r4, #0x18]
+	0xE2830010, // add r0, r3, #0x10
+	0xE5840028, // str r0, [r4, #0x28]
+	0xE3A00000, // mov r0, #0
+	0xE584001C, // str r0, [r4, #0x1C]
+	0xE5D49004, // ldrb r9, [r4, #4]
+	0xE35900FF, // cmp r9, #0xFF
+	0xA3A090FF, // movge r9, #0xFF
+	0xA24AA001, // subge r10, r10, #1
+	0xEA000030, // b envDone
+	// running:
+	0xE5D49009, // ldrb r9, [r4, #9]
+	0xE31A0004, // tst r10, #4
+	0x0A000007, // beq notIec
+	0xE5D4000D, // ldrb r0, [r4, #0xD]
+	0xE2401001, // sub r1, r0, #1
+	0xE5C4100D, // strb r1, [r4, #0xD]
+	0xE3500001, // cmp r0, #1
+	0x8A000028, // bhi envDone
+	0xE3A00000, // mov r0, #0
+	0xE5C40000, // strb r0, [r4]
+	0xEA000096, // b next
+	// notIec:
+	0xE31A0040, // tst r10, #0x40
+	0x0A00000A, // beq notStop
+	0xE5D40007, // ldrb r0, [r4, #7]
+	0xE0010099, // mul r1, r9, r0
+	0xE1A09421, // mov r9, r1, lsr #8
+	0xE5D4000C, // ldrb r0, [r4, #0xC]
+	0xE1590000, // cmp r9, r0
+	0xCA00001D, // bgt envDone
+	0xE1B09000, // movs r9, r0
+	0x138AA004, // orrne r10, r10, #4
+	0x1A00001A, // bne envDone
+	0xE5C49000, // strb r9, [r4]
+	0xEA000089, // b next
+	// notStop:
+	0xE20A0003, // and r0, r10, #3
+	0xE3500002, // cmp r0, #2
+	0x1A00000E, // bne notDecay
+	0xE5D40005, // ldrb r0, [r4, #5]
+	0xE0010099, // mul r1, r9, r0
+	0xE1A09421, // mov r9, r1, lsr #8
+	0xE5D40006, // ldrb r0, [r4, #6]
+	0xE1590000, // cmp r9, r0
+	0xCA00000F, // bgt envDone
+	0xE1B09000, // movs r9, r0
+	0x124AA001, // subne r10, r10, #1
+	0x1A00000C, // bne envDone
+	0xE5D4900C, // ldrb r9, [r4, #0xC]
+	0xE3590000, // cmp r9, #0
+	0x138AA004, // orrne r10, r10, #4
+	0x1A000008, // bne envDone
+	0xE5C49000, // strb r9, [r4]
+	0xEA000077, // b next
+	// notDecay:
+	0xE3500003, // cmp r0, #3
+	0x1A000004, // bne envDone
+	0xE5D40004, // ldrb r0, [r4, #4]
+	0xE0899000, // add r9, r9, r0
+	0xE35900FF, // cmp r9, #0xFF
+	0xA3A090FF, // movge r9, #0xFF
+	0xA24AA001, // subge r10, r10, #1
+	// envDone:
+	0xE5C4A000, // strb r10, [r4]
+	0xE5C49009, // strb r9, [r4, #9]
+	0xE59D0004, // ldr r0, [sp, #4]
+	0xE2800001, // add r0, r0, #1
+	0xE0010099, // mul r1, r9, r0
+	0xE1A01221, // mov r1, r1, lsr #4
+	0xE5D40002, // ldrb r0, [r4, #2]
+	0xE0020190, // mul r2, r0, r1
+	0xE1A02422, // mov r2, r2, lsr #8
+	0xE5C4200A, // strb r2, [r4, #0xA]
+	0xE5D40003, // ldrb r0, [r4, #3]
+	0xE0070190, // mul r7, r0, r1
+	0xE1A07427, // mov r7, r7, lsr #8
+	0xE5C4700B, // strb r7, [r4, #0xB]
+	0xE3A00000, // mov r0, #0
+	0xE58D0018, // str r0, [sp, #0x18]
+	0xE58D001C, // str r0, [sp, #0x1C]
+	0xE31A0010, // tst r10, #0x10
+	0x15930008, // ldrne r0, [r3, #8]
+	0x158D001C, // strne r0, [sp, #0x1C]
+	0x1593100C, // ldrne r1, [r3, #0xC]
+	0x10411000, // subne r1, r1, r0
+	0x158D1018, // strne r1, [sp, #0x18]
+	0xE59D5000, // ldr r5, [sp, #0]
+	0xE2833010, // add r3, r3, #0x10
+	0xE5940028, // ldr r0, [r4, #0x28]
+	0xE0401003, // sub r1, r0, r3
+	0xE5940018, // ldr r0, [r4, #0x18]
+	0xE59DA008, // ldr r10, [sp, #8]
+	0xE5D49001, // ldrb r9, [r4, #1]
+	0xE3190008, // tst r9, #8
+	0x0A000020, // beq interp
+	// floop:
+	0xE25AA001, // subs r10, r10, #1
+	0xBA00004B, // blt mixDone
+	0xE59DC018, // ldr r12, [sp, #0x18]
+	0xE35C0000, // cmp r12, #0
+	0x1A000006, // bne fcount
+	0xE59DE000, // ldr lr, [sp, #0]
+	0xE045E00E, // sub lr, r5, lr
+	0xE31E0003, // tst lr, #3
+	0x1A000006, // bne fhave
+	0xE3500004, // cmp r0, #4
+	0xDA000012, // ble stopChan
+	0xEA000003, // b fhave
+	// fcount:
+	0xE3500000, // cmp r0, #0
+	0xCA000001, // bgt fhave
+	0xE1A0000C, // mov r0, r12
+	0xE59D101C, // ldr r1, [sp, #0x1C]
+	// fhave:
+	0xE19390D1, // ldrsb r9, [r3, r1]
+	0xE1D5C0D0, // ldrsb r12, [r5]
+	0xE00E0299, // mul lr, r9, r2
+	0xE08CC44E, // add r12, r12, lr, asr #8
+	0xE5C5C000, // strb r12, [r5]
+	0xE285EE63, // add lr, r5, #0x630
+	0xE1DEC0D0, // ldrsb r12, [lr]
+	0xE0090997, // mul r9, r7, r9
+	0xE08CC449, // add r12, r12, r9, asr #8
+	0xE5CEC000, // strb r12, [lr]
+	0xE2855001, // add r5, r5, #1
+	0xE2811001, // add r1, r1, #1
+	0xE2400001, // sub r0, r0, #1
+	0xEAFFFFE1, // b floop
+	// stopChan:
+	0xE3A0C000, // mov r12, #0
+	0xE5C4C000, // strb r12, [r4]
+	0xEA00002C, // b mixDone
+	// interp:
+	0xE5949020, // ldr r9, [r4, #0x20]
+	0xE59DC00C, // ldr r12, [sp, #0xC]
+	0xE0080C99, // mul r8, r9, r12
+	0xE594601C, // ldr r6, [r4, #0x1C]
+	// iLoad:
+	0xE083C001, // add r12, r3, r1
+	0xE1DCB0D0, // ldrsb r11, [r12]
+	0xE1DC90D1, // ldrsb r9, [r12, #1]
+	0xE049900B, // sub r9, r9, r11
+	// iloop:
+	0xE25AA001, // subs r10, r10, #1
+	0xBA000021, // blt iDone
+	0xE00C0996, // mul r12, r6, r9
+	0xE08BCBCC, // add r12, r11, r12, asr #23
+	0xE007029C, // mul r7, r12, r2
+	0xE5D5E000, // ldrb lr, [r5]
+	0xE08EE447, // add lr, lr, r7, asr #8
+	0xE5C5E000, // strb lr, [r5]
+	0xE5D4700B, // ldrb r7, [r4, #0xB]
+	0xE00E079C, // mul lr, r12, r7
+	0xE2857E63, // add r7, r5, #0x630
+	0xE5D7C000, // ldrb r12, [r7]
+	0xE08CC44E, // add r12, r12, lr, asr #8
+	0xE5C7C000, // strb r12, [r7]
+	0xE2855001, // add r5, r5, #1
+	0xE0866008, // add r6, r6, r8
+	0xE1B0CBA6, // movs r12, r6, lsr #23
+	0x0AFFFFED, // beq iloop
+	0xE1A06486, // mov r6, r6, lsl #9
+	0xE1A064A6, // mov r6, r6, lsr #9
+	0xE050000C, // subs r0, r0, r12
+	0xC081100C, // addgt r1, r1, r12
+	0xCAFFFFE4, // bgt iLoad
+	0xE59DE018, // ldr lr, [sp, #0x18]
+	0xE35E0000, // cmp lr, #0
+	0x0A000007, // beq iStop
+	0xE260C000, // rsb r12, r0, #0
+	// iWrap:
+	0xE15C000E, // cmp r12, lr
+	0x204CC00E, // subhs r12, r12, lr
+	0x2AFFFFFC, // bhs iWrap
+	0xE59D101C, // ldr r1, [sp, #0x1C]
+	0xE081100C, // add r1, r1, r12
+	0xE04E000C, // sub r0, lr, r12
+	0xEAFFFFD9, // b iLoad
+	// iStop:
+	0xE3A0C000, // mov r12, #0
+	0xE5C4C000, // strb r12, [r4]
+	// iDone:
+	0xE584601C, // str r6, [r4, #0x1C]
+	// mixDone:
+	0xE5840018, // str r0, [r4, #0x18]
+	0xE0839001, // add r9, r3, r1
+	0xE5849028, // str r9, [r4, #0x28]
+	// next:
+	0xE2844040, // add r4, r4, #0x40
+	0xE59D0010, // ldr r0, [sp, #0x10]
+	0xE2500001, // subs r0, r0, #1
+	0xE58D0010, // str r0, [sp, #0x10]
+	0xCAFFFF3F, // bgt chan
+	// done:
+	0xE59D0014, // ldr r0, [sp, #0x14]
+	0xE59F1028, // ldr r1, =MP2K_MAGIC
+	0xE5801000, // str r1, [r0]
+	0xE28DD020, // add sp, sp, #0x20
+	0xE28DD01C, // add sp, sp, #0x1C
+	0xE8BD000F, // ldmia sp!, {r0-r3}
+	0xE1A08000, // mov r8, r0
+	0xE1A09001, // mov r9, r1
+	0xE1A0A002, // mov r10, r2
+	0xE1A0B003, // mov r11, r3
+	0xE8BD00F0, // ldmia sp!, {r4-r7}
+	0xE8BD0008, // ldmia sp!, {r3}
+	0xE12FFF13, // bx r3
+	0x68736D53, // MP2K_MAGIC
+};
+
+static uint8_t* _wram(struct mCore* core, uint32_t address) {
+	struct GBA* gba = core->board;
+	return &((uint8_t*) gba->memory.wram)[address & (SIZE_WORKING_RAM - 1)];
+}
+
+static uint8_t* _channel(struct mCore* core, int channel) {
+	return _wram(core, SOUND_INFO + 0x50 + channel * 0x40);
+}
+
+static int8_t _right(struct mCore* core, int sample) {
+	return *(int8_t*) _wram(core, PCM_BUFFER + sample);
+}
+
+static int8_t _left(struct mCore* core, int sample) {
+	return *(int8_t*) _wram(core, PCM_BUFFER + 0x630 + sample);
+}
+
+static void _setWave(struct mCore* core, uint32_t address, const int8_t* samples, uint32_t size, bool loop, uint32_t loopStart) {
+	uint8_t* wave = _wram(core, address);
+	memset(wave, 0, 0x10);
+	wave[0x3] = loop ? 0x40 : 0;
+	STORE_32(loopStart, 0x8, wave);
+	STORE_32(size, 0xC, wave);
+	memcpy(&wave[0x10], samples, size);
+}
+
+static void _setChannel(struct mCore* core, int id, uint8_t status, uint8_t type, uint32_t wave, uint32_t freq) {
+	uint8_t* channel = _channel(core, id);
+	memset(channel, 0, 0x40);
+	channel[0x0] = status;
+	channel[0x1] = type;
+	channel[0x2] = 0x80;
+	channel[0x3] = 0x40;
+	channel[0x4] = 0xFF;
+	channel[0x5] = 0xFF;
+	channel[0x6] = 0xFF;
+	STORE_32(freq, 0x20, channel);
+	STORE_32(wave, 0x24, channel);
+}
+
+static void _callSoundMainWith(struct mCore* core, int samples, int counter) {
+	struct ARMCore* cpu = core->cpu;
+	struct GBA* gba = core->board;
+	int i;
+	// SoundMain bumps the ident to lock out reentry before calling the mixer
+	uint32_t ident;
+	LOAD_32(ident, 0x0, _wram(core, SOUND_INFO));
+	if (ident == MP2K_MAGIC) {
+		STORE_32(MP2K_MAGIC + 1, 0x0, _wram(core, SOUND_INFO));
+	}
+	for (i = 0; i < 8; ++i) {
+		core->busWrite32(core, STACK + 0x1C + i * 4, 0x1000 + i);
+	}
+	core->busWrite32(core, STACK + 0x3C, RETURN | 1);
+	cpu->gprs[0] = SOUND_INFO;
+	cpu->gprs[3] = SOUND_MAIN_RAM | 1;
+	cpu->gprs[4] = counter;
+	cpu->gprs[5] = PCM_BUFFER;
+	cpu->gprs[6] = 0x630;
+	cpu->gprs[8] = samples;
+	cpu->gprs[ARM_SP] = STACK;
+	gba->audio.mixer->soundMain(gba->audio.mixer);
+}
+
+static void _callSoundMain(struct mCore* core) {
+	_callSoundMainWith(core, SAMPLES, 1);
+}
+
+static void _callReference(struct mCore* core, int samples, int counter) {
+	struct ARMCore* cpu = core->cpu;
+	struct GBA* gba = core->board;
+	gba->audio.mixer->nativeMixing = false;
+	_callSoundMainWith(core, samples, counter);
+	gba->audio.mixer->nativeMixing = true;
+	int i;
+	for (i = 0; i < 0x100000; ++i) {
+		if (cpu->executionMode == MODE_THUMB && cpu->gprs[ARM_PC] == RETURN + 2) {
+			break;
+		}
+		ARMRun(cpu);
+	}
+	assert_int_equal(cpu->gprs[ARM_PC], RETURN + 2);
+}
+
+static int _setupHle(void** state) {
+	struct mCore* core = GBACoreCreate();
+	if (!core || !core->init(core)) {
+		return -1;
+	}
+	mCoreInitConfig(core, NULL);
+	mCoreConfigSetIntValue(&core->config, "gba.audioHle", 2);
+	core->reset(core);
+
+	uint8_t* info = _wram(core, SOUND_INFO);
+	memset(info, 0, 0x350 + 0x630 * 2);
+	STORE_32(MP2K_MAGIC + 1, 0x0, info);
+	info[0x6] = 2;
+	info[0x7] = 15;
+	STORE_32(1, 0x18, info);
+	*state = core;
+	return 0;
+}
+
+static int _teardownHle(void** state) {
+	struct mCore* core = *state;
+	mCoreConfigDeinit(&core->config);
+	core->deinit(core);
+	return 0;
+}
+
+M_TEST_DEFINE(attachNative) {
+	struct mCore* core = *state;
+	struct GBA* gba = core->board;
+	assert_non_null(gba->audio.mixer);
+	assert_true(gba->audio.mixer->nativeMixing);
+}
+
+M_TEST_DEFINE(startFixed) {
+	struct mCore* core = *state;
+	struct ARMCore* cpu = core->cpu;
+	int8_t samples[32];
+	memset(samples, 64, sizeof(samples));
+	_setWave(core, WAVE, samples, sizeof(samples), false, 0);
+	_setChannel(core, 0, 0x80, 0x08, WAVE, 0);
+	_callSoundMain(core);
+
+	uint8_t* channel = _channel(core, 0);
+	uint32_t value;
+	assert_int_equal(channel[0x0], 0x02);
+	assert_int_equal(channel[0x9], 0xFF);
+	assert_int_equal(channel[0xA], 127);
+	assert_int_equal(channel[0xB], 63);
+	LOAD_32(value, 0x18, channel);
+	assert_int_equal(value, 32 - SAMPLES);
+	LOAD_32(value, 0x28, channel);
+	assert_int_equal(value, WAVE + 0x10 + SAMPLES);
+
+	int i;
+	for (i = 0; i < SAMPLES; ++i) {
+		assert_int_equal(_right(core, i), (64 * 127) >> 8);
+		assert_int_equal(_left(core, i), (64 * 63) >> 8);
+	}
+	assert_int_equal(_right(core, SAMPLES), 0);
+
+	LOAD_32(value, 0x0, _wram(core, SOUND_INFO));
+	assert_int_equal(value, MP2K_MAGIC);
+	assert_int_equal(cpu->gprs[ARM_SP], STACK + 0x40);
+	assert_int_equal(cpu->gprs[8], 0x1000);
+	assert_int_equal(cpu->gprs[11], 0x1003);
+	assert_int_equal(cpu->gprs[4], 0x1004);
+	assert_int_equal(cpu->gprs[7], 0x1007);
+	assert_int_equal(cpu->executionMode, MODE_THUMB);
+	assert_int_equal(cpu->gprs[ARM_PC], RETURN + 2);
+}
+
+M_TEST_DEFINE(wrapAccumulate) {
+	struct mCore* core = *state;
+	int8_t samples[32];
+	memset(samples, 127, sizeof(samples));
+	_setWave(core, WAVE, samples, sizeof(samples), false, 0);
+	_setChannel(core, 0, 0x80, 0x08, WAVE, 0);
+	_setChannel(core, 1, 0x80, 0x08, WAVE, 0);
+	_channel(core, 0)[0x2] = 0xFF;
+	_channel(core, 1)[0x2] = 0xFF;
+	_callSoundMain(core);
+
+	// Two channels of 126 each overflow the 8-bit mixing buffer
+	assert_int_equal(_channel(core, 0)[0xA], 254);
+	assert_int_equal(_right(core, 0), (int8_t) (((127 * 254) >> 8) * 2));
+}
+
+M_TEST_DEFINE(interpolate) {
+	struct mCore* core = *state;
+	int8_t samples[32];
+	int i;
+	for (i = 0; i < 32; ++i) {
+		samples[i] = (i & 1) ? 64 : 0;
+	}
+	_setWave(core, WAVE, samples, sizeof(samples), false, 0);
+	// Half a sample per output sample
+	_setChannel(core, 0, 0x80, 0x00, WAVE, 0x400000);
+	_channel(core, 0)[0x2] = 0xFF;
+	_callSoundMain(core);
+
+	static const int expected[] = { 0, 32, 64, 32, 0, 32, 64, 32 };
+	for (i = 0; i < 8; ++i) {
+		assert_int_equal(_right(core, i), (expected[i] * 254) >> 8);
+	}
+	uint32_t value;
+	LOAD_32(value, 0x18, _channel(core, 0));
+	assert_int_equal(value, 32 - SAMPLES / 2);
+}
+
+M_TEST_DEFINE(endOneShot) {
+	struct mCore* core = *state;
+	int8_t samples[12];
+	memset(samples, 64, sizeof(samples));
+	uint32_t size;
+	for (size = 4; size <= sizeof(samples); ++size) {
+		_setWave(core, WAVE, samples, size, false, 0);
+		_setChannel(core, 0, 0x80, 0x08, WAVE, 0);
+		_callSoundMain(core);
+
+		// The end is only checked every four samples, and the last one to four are dropped
+		uint32_t played = (size - 1) & ~3;
+		assert_int_equal(_channel(core, 0)[0x0], 0);
+		if (played) {
+			assert_int_not_equal(_right(core, played - 1), 0);
+		}
+		assert_int_equal(_right(core, played), 0);
+	}
+}
+
+M_TEST_DEFINE(loop) {
+	struct mCore* core = *state;
+	int8_t samples[8] = { 0, 0, 0, 0, 16, 32, 48, 64 };
+	_setWave(core, WAVE, samples, sizeof(samples), true, 4);
+	_setChannel(core, 0, 0x80, 0x08, WAVE, 0);
+	_channel(core, 0)[0x2] = 0xFF;
+	_callSoundMain(core);
+
+	assert_int_equal(_channel(core, 0)[0x0], 0x12);
+	int i;
+	for (i = 8; i < SAMPLES; ++i) {
+		assert_int_equal(_right(core, i), (samples[4 + (i & 3)] * 254) >> 8);
+	}
+	uint32_t value;
+	LOAD_32(value, 0x28, _channel(core, 0));
+	assert_int_equal(value, WAVE + 0x10 + 8);
+}
+
+M_TEST_DEFINE(release) {
+	struct mCore* core = *state;
+	int8_t samples[64] = { 0 };
+	_setWave(core, WAVE, samples, sizeof(samples), false, 0);
+	_setChannel(core, 0, 0x80, 0x08, WAVE, 0);
+	_callSoundMain(core);
+	assert_int_equal(_channel(core, 0)[0x0], 0x02);
+
+	// Decay holds at sustain, then release fades out and stops the channel
+	_channel(core, 0)[0x6] = 0x80;
+	_channel(core, 0)[0x5] = 0x80;
+	_callSoundMain(core);
+	assert_int_equal(_channel(core, 0)[0x9], 0x80);
+	assert_int_equal(_channel(core, 0)[0x0], 0x01);
+
+	_channel(core, 0)[0x0] |= 0x40;
+	_channel(core, 0)[0x7] = 0x10;
+	_callSoundMain(core);
+	assert_int_equal(_channel(core, 0)[0x9], 0x08);
+	assert_int_equal(_channel(core, 0)[0x0], 0x41);
+	_callSoundMain(core);
+	assert_int_equal(_channel(core, 0)[0x0], 0);
+}
+
+M_TEST_DEFINE(fallback) {
+	struct mCore* core = *state;
+	struct ARMCore* cpu = core->cpu;
+	STORE_32(0, 0x0, _wram(core, SOUND_INFO));
+	_setChannel(core, 0, 0x80, 0x08, WAVE, 0);
+	_callSoundMain(core);
+
+	// The game's mixer must run instead, with nothing touched
+	assert_int_equal(_channel(core, 0)[0x0], 0x80);
+	assert_int_equal(cpu->gprs[ARM_SP], STACK);
+	assert_int_equal(cpu->gprs[ARM_PC], SOUND_MAIN_RAM + 2);
+	assert_int_equal(cpu->executionMode, MODE_THUMB);
+}
+
+M_TEST_DEFINE(matchesReference) {
+	struct mCore* core = *state;
+	struct ARMCore* cpu = core->cpu;
+	struct GBA* gba = core->board;
+	size_t i;
+	for (i = 0; i < sizeof(_referenceMixer) / sizeof(*_referenceMixer); ++i) {
+		STORE_32(_referenceMixer[i], (SOUND_MAIN_RAM & (SIZE_WORKING_IRAM - 1)) + i * 4, gba->memory.iwram);
+	}
+
+	int8_t samples[0x200];
+	for (i = 0; i < sizeof(samples); ++i) {
+		samples[i] = (i * 37) ^ ((i >> 3) * 11);
+	}
+	_setWave(core, WAVE, samples, 0x200, true, 0x80);
+	_setWave(core, WAVE + 0x400, &samples[0x40], 0x60, false, 0);
+	_setWave(core, WAVE + 0x800, &samples[0x20], 0x95, false, 0);
+
+	uint8_t* info = _wram(core, SOUND_INFO);
+	info[0x5] = 0x50;
+	info[0x6] = 7;
+	info[0x7] = 12;
+	STORE_32(0x100, 0x18, info);
+
+	uint8_t* channel;
+	// Fixed frequency, looping
+	_setChannel(core, 0, 0x80, 0x08, WAVE, 0);
+	// Interpolated, slower than the output rate and still attacking
+	_setChannel(core, 1, 0x80, 0x00, WAVE, 0x5A00);
+	_channel(core, 1)[0x4] = 0x20;
+	// Interpolated, fast enough to run off the end of a one-shot sample
+	_setChannel(core, 2, 0x80, 0x00, WAVE + 0x400, 0x18000);
+	// Already playing and decaying towards sustain
+	_setChannel(core, 3, 0x12, 0x08, WAVE, 0);
+	channel = _channel(core, 3);
+	channel[0x5] = 0xE0;
+	channel[0x6] = 0x40;
+	channel[0x9] = 0xC0;
+	STORE_32(0x1F0, 0x18, channel);
+	STORE_32(WAVE + 0x10 + 0x10, 0x28, channel);
+	// Releasing into an echo that runs out
+	_setChannel(core, 4, 0x41, 0x00, WAVE, 0x9000);
+	channel = _channel(core, 4);
+	channel[0x7] = 0xA0;
+	channel[0x9] = 0x60;
+	channel[0xC] = 0x20;
+	channel[0xD] = 3;
+	STORE_32(0x1000, 0x1C, channel);
+	STORE_32(0x100, 0x18, channel);
+	STORE_32(WAVE + 0x10 + 0x100, 0x28, channel);
+	// Started and stopped before it was ever mixed
+	_setChannel(core, 5, 0xC0, 0x08, WAVE, 0);
+	// Fixed frequency, running off the end of a one-shot sample partway through a word
+	_setChannel(core, 6, 0x80, 0x08, WAVE + 0x800, 0);
+
+	uint8_t* before = malloc(STATE_SIZE);
+	uint8_t* native = malloc(STATE_SIZE);
+	int frame;
+	for (frame = 0; frame < 8; ++frame) {
+		int counter = (frame & 1) + 1;
+		memcpy(before, info, STATE_SIZE);
+		_callSoundMainWith(core, 0x70, counter);
+		assert_int_equal(cpu->gprs[ARM_PC], RETURN + 2);
+		memcpy(native, info, STATE_SIZE);
+		int32_t gprs[16];
+		memcpy(gprs, cpu->gprs, sizeof(gprs));
+
+		memcpy(info, before, STATE_SIZE);
+		_callReference(core, 0x70, counter);
+		for (i = 0; i < STATE_SIZE; ++i) {
+			if (native[i] != info[i]) {
+				fail_msg("Frame %i differs at offset 0x%03zX: native 0x%02X, reference 0x%02X", frame, i, native[i], info[i]);
+			}
+		}
+		for (i = 0; i < 12; ++i) {
+			assert_int_equal(gprs[i], cpu->gprs[i]);
+		}
+		assert_int_equal(gprs[ARM_SP], cpu->gprs[ARM_SP]);
+	}
+	free(before);
+	free(native);
+
+	// Make sure each path was actually taken
+	assert_int_equal(_channel(core, 0)[0x0], 0x11);
+	assert_int_equal(_channel(core, 2)[0x0], 0);
+	assert_int_equal(_channel(core, 3)[0x0], 0x11);
+	assert_int_equal(_channel(core, 4)[0x0], 0);
+	assert_int_equal(_channel(core, 5)[0x0], 0);
+	assert_int_equal(_channel(core, 6)[0x0], 0);
+}
+
+static uint32_t _findHook(const uint16_t* code, size_t length, uint32_t offset) {
+	uint8_t* rom = calloc(1, 0x400);
+	size_t i;
+	for (i = 0; i < length; ++i) {
+		STORE_16(code[i], offset + i * 2, rom);
+	}
+	struct mCore* core = GBACoreCreate();
+	assert_true(core->init(core));
+	assert_true(core->loadROM(core, VFileFromMemory(rom, 0x400)));
+	mCoreInitConfig(core, NULL);
+	mCoreConfigSetIntValue(&core->config, "gba.audioHle", 2);
+	core->reset(core);
+
+	struct GBA* gba = core->board;
+	gba->audio.mixer->engage(gba->audio.mixer, SOUND_INFO);
+	uint32_t address = gba->audio.mixer->hookAddress;
+	if (address) {
+		assert_int_equal(core->busRead16(core, address), 0xDF00 | MP2K_HLE_SWI);
+		assert_int_equal(core->busRead16(core, address - 2), 0x4B02);
+	} else {
+		// Nothing gets patched if the mixer wasn't recognized
+		for (i = 0; i < length; ++i) {
+			assert_int_equal(core->busRead16(core, BASE_CART0 + offset + i * 2), code[i]);
+		}
+	}
+
+	mCoreConfigDeinit(&core->config);
+	core->deinit(core);
+	free(rom);
+	return address;
+}
+
+static const uint16_t _soundMain[] = {
+	0x4809, 0x6800, 0x4A09, 0x6803, 0x429A, 0xD000, 0x4770, 0x3301,
+	0x6003, 0xB5F0, 0x4641, 0x464A, 0x4653, 0x465C, 0xB41F, 0xB086,
+	0x4E01, 0x4B02, 0x4718, 0x46C0, 0x0630, 0x0000, 0x1001, 0x0300,
+};
+
+M_TEST_DEFINE(installHook) {
+	assert_int_equal(_findHook(_soundMain, sizeof(_soundMain) / sizeof(*_soundMain), 0x100), 0x08000124);
+}
+
+M_TEST_DEFINE(findHookOffset) {
+	uint16_t code[sizeof(_soundMain) / sizeof(*_soundMain) + 4];
+	memcpy(code, _soundMain, 16 * 2);
+	// Unrelated code between the prologue and the jump, with the literals moved to match
+	code[16] = 0x2000;
+	code[17] = 0x2100;
+	code[18] = 0x2200;
+	code[19] = 0x2300;
+	code[20] = 0x4E01;
+	code[21] = 0x4B02;
+	code[22] = 0x4718;
+	code[23] = 0x46C0;
+	code[24] = 0x0630;
+	code[25] = 0x0000;
+	code[26] = 0x1001;
+	code[27] = 0x0300;
+	assert_int_equal(_findHook(code, sizeof(code) / sizeof(*code), 0x200), 0x0800022C);
+}
+
+M_TEST_DEFINE(findHookMismatch) {
+	uint16_t code[sizeof(_soundMain) / sizeof(*_soundMain)];
+	memcpy(code, _soundMain, sizeof(code));
+	// push {r4-r6, lr} instead of {r4-r7, lr}
+	code[9] = 0xB570;
+	assert_int_equal(_findHook(code, sizeof(code) / sizeof(*code), 0x100), 0);
+}
+
+M_TEST_DEFINE(findHookBufferSize) {
+	uint16_t code[sizeof(_soundMain) / sizeof(*_soundMain)];
+	memcpy(code, _soundMain, sizeof(code));
+	code[20] = 0x0500;
+	assert_int_equal(_findHook(code, sizeof(code) / sizeof(*code), 0x100), 0);
+}
+
+M_TEST_DEFINE(findHookTarget) {
+	uint16_t code[sizeof(_soundMain) / sizeof(*_soundMain)];
+	memcpy(code, _soundMain, sizeof(code));
+	// SoundMainRAM has to be in IWRAM
+	code[23] = 0x0200;
+	assert_int_equal(_findHook(code, sizeof(code) / sizeof(*code), 0x100), 0);
+}
+
+M_TEST_SUITE_DEFINE(GBAMP2k,
+	cmocka_unit_test(installHook),
+	cmocka_unit_test(findHookOffset),
+	cmocka_unit_test(findHookMismatch),
+	cmocka_unit_test(findHookBufferSize),
+	cmocka_unit_test(findHookTarget),
+	cmocka_unit_test_setup_teardown(attachNative, _setupHle, _teardownHle),
+	cmocka_unit_test_setup_teardown(startFixed, _setupHle, _teardownHle),
+	cmocka_unit_test_setup_teardown(wrapAccumulate, _setupHle, _teardownHle),
+	cmocka_unit_test_setup_teardown(interpolate, _setupHle, _teardownHle),
+	cmocka_unit_test_setup_teardown(endOneShot, _setupHle, _teardownHle),
+	cmocka_unit_test_setup_teardown(loop, _setupHle, _teardownHle),
+	cmocka_unit_test_setup_teardown(release, _setupHle, _teardownHle),
+	cmocka_unit_test_setup_teardown(fallback, _setupHle, _teardownHle),
+	cmocka_unit_test_setup_teardown(matchesReference, _setupHle, _teardownHle))
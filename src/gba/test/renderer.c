@@ -0,0 +1,233 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba/core/interface.h>
+#include <mgba/internal/gba/io.h>
+#include <mgba/internal/gba/memory.h>
+#include <mgba/internal/gba/renderers/video-software.h>
+
+#define RED 0x001F
+#define GREEN 0x03E0
+#define BLUE 0x7C00
+
+// The top byte of 32-bit output pixels holds layer flags
+#ifdef COLOR_16_BIT
+#define PIXEL_MASK 0xFFFF
+#else
+#define PIXEL_MASK 0xFFFFFF
+#endif
+
+struct GBARendererTest {
+	struct GBAVideoSoftwareRenderer renderer;
+	uint16_t palette[512];
+	uint16_t vram[SIZE_VRAM / 2];
+	union GBAOAM oam;
+	color_t buffer[GBA_VIDEO_HORIZONTAL_PIXELS * GBA_VIDEO_VERTICAL_PIXELS];
+};
+
+static void _writePalette(struct GBARendererTest* test, unsigned index, uint16_t color) {
+	test->palette[index] = color;
+	test->renderer.d.writePalette(&test->renderer.d, index * 2, color);
+}
+
+static void _writeSprite(struct GBARendererTest* test, int index, uint16_t a, uint16_t b, uint16_t c) {
+	test->oam.obj[index].a = a;
+	test->oam.obj[index].b = b;
+	test->oam.obj[index].c = c;
+	test->renderer.d.writeOAM(&test->renderer.d, index * 4);
+	test->renderer.d.writeOAM(&test->renderer.d, index * 4 + 1);
+	test->renderer.d.writeOAM(&test->renderer.d, index * 4 + 2);
+}
+
+static void _moveSprite(struct GBARendererTest* test, int index, int y) {
+	_writeSprite(test, index, (test->oam.obj[index].a & ~0xFF) | (y & 0xFF), test->oam.obj[index].b, test->oam.obj[index].c);
+}
+
+static int rendererSetup(void** state) {
+	struct GBARendererTest* test = calloc(1, sizeof(*test));
+	if (!test) {
+		return -1;
+	}
+	GBAVideoSoftwareRendererCreate(&test->renderer);
+	test->renderer.d.palette = test->palette;
+	test->renderer.d.vram = test->vram;
+	test->renderer.d.oam = &test->oam;
+	test->renderer.d.cache = NULL;
+	test->renderer.outputBuffer = test->buffer;
+	test->renderer.outputBufferStride = GBA_VIDEO_HORIZONTAL_PIXELS;
+	test->renderer.d.init(&test->renderer.d);
+	test->renderer.d.reset(&test->renderer.d);
+
+	_writePalette(test, 0, BLUE);
+	_writePalette(test, 0x101, RED);
+	_writePalette(test, 0x111, GREEN);
+
+	// Object tile 0 is solid color 1
+	int i;
+	for (i = 0; i < 16; ++i) {
+		test->vram[0x8000 + i] = 0x1111;
+		test->renderer.d.writeVRAM(&test->renderer.d, 0x10000 + i * 2);
+	}
+
+	// Hide all sprites, then place 8x8 sprites at (20, 10) and (40, 250), the latter wrapping to the top
+	for (i = 0; i < 128; ++i) {
+		_writeSprite(test, i, 0x0200, 0, 0);
+	}
+	_writeSprite(test, 0, 10, 20, 0);
+	_writeSprite(test, 1, 250, 40, 0);
+
+	test->renderer.d.writeVideoRegister(&test->renderer.d, REG_DISPCNT, 0x1040);
+	*state = test;
+	return 0;
+}
+
+static int rendererTeardown(void** state) {
+	struct GBARendererTest* test = *state;
+	test->renderer.d.deinit(&test->renderer.d);
+	free(test);
+	return 0;
+}
+
+static void _drawLines(struct GBARendererTest* test, int start, int end) {
+	int y;
+	for (y = start; y < end; ++y) {
+		test->renderer.d.drawScanline(&test->renderer.d, y);
+	}
+	if (end == GBA_VIDEO_VERTICAL_PIXELS) {
+		test->renderer.d.finishFrame(&test->renderer.d);
+	}
+}
+
+static void _assertColumn(struct GBARendererTest* test, int x, int start, int end, uint16_t color) {
+	int y;
+	for (y = start; y < end; ++y) {
+		assert_int_equal(test->buffer[y * GBA_VIDEO_HORIZONTAL_PIXELS + x] & PIXEL_MASK, mColorFrom555(color));
+	}
+}
+
+M_TEST_DEFINE(spriteLines) {
+	struct GBARendererTest* test = *state;
+	_drawLines(test, 0, GBA_VIDEO_VERTICAL_PIXELS);
+
+	_assertColumn(test, 20, 0, 10, BLUE);
+	_assertColumn(test, 20, 10, 18, RED);
+	_assertColumn(test, 20, 18, GBA_VIDEO_VERTICAL_PIXELS, BLUE);
+	_assertColumn(test, 27, 10, 18, RED);
+	_assertColumn(test, 28, 10, 18, BLUE);
+
+	_assertColumn(test, 40, 0, 2, RED);
+	_assertColumn(test, 40, 2, GBA_VIDEO_VERTICAL_PIXELS, BLUE);
+}
+
+M_TEST_DEFINE(moveSpriteMidFrame) {
+	struct GBARendererTest* test = *state;
+	_drawLines(test, 0, GBA_VIDEO_VERTICAL_PIXELS);
+
+	_drawLines(test, 0, 50);
+	_moveSprite(test, 0, 60);
+	_drawLines(test, 50, GBA_VIDEO_VERTICAL_PIXELS);
+
+	// Lines above the write were already drawn with the old position
+	_assertColumn(test, 20, 10, 18, RED);
+	_assertColumn(test, 20, 50, 60, BLUE);
+	_assertColumn(test, 20, 60, 68, RED);
+	_assertColumn(test, 20, 68, GBA_VIDEO_VERTICAL_PIXELS, BLUE);
+
+	_drawLines(test, 0, GBA_VIDEO_VERTICAL_PIXELS);
+	_assertColumn(test, 20, 0, 60, BLUE);
+	_assertColumn(test, 20, 60, 68, RED);
+
+	// Move it past the bottom so that it wraps to the top
+	_drawLines(test, 0, 100);
+	_moveSprite(test, 0, 253);
+	_drawLines(test, 100, GBA_VIDEO_VERTICAL_PIXELS);
+	_assertColumn(test, 20, 60, 68, RED);
+	_assertColumn(test, 20, 100, GBA_VIDEO_VERTICAL_PIXELS, BLUE);
+
+	_drawLines(test, 0, GBA_VIDEO_VERTICAL_PIXELS);
+	_assertColumn(test, 20, 0, 5, RED);
+	_assertColumn(test, 20, 5, GBA_VIDEO_VERTICAL_PIXELS, BLUE);
+	_assertColumn(test, 40, 0, 2, RED);
+}
+
+M_TEST_DEFINE(spriteOrder) {
+	struct GBARendererTest* test = *state;
+	// A lower OAM index wins on the lines where both sprites overlap
+	_writeSprite(test, 5, 14, 20, 0x1000);
+	_drawLines(test, 0, GBA_VIDEO_VERTICAL_PIXELS);
+	_assertColumn(test, 20, 10, 18, RED);
+	_assertColumn(test, 20, 18, 22, GREEN);
+
+	_writeSprite(test, 0, 14, 20, 0x1000);
+	_writeSprite(test, 5, 10, 20, 0);
+	_drawLines(test, 0, GBA_VIDEO_VERTICAL_PIXELS);
+	_assertColumn(test, 20, 10, 14, RED);
+	_assertColumn(test, 20, 14, 22, GREEN);
+}
+
+M_TEST_DEFINE(disableObjMidFrame) {
+	struct GBARendererTest* test = *state;
+	int frame;
+	for (frame = 0; frame < 2; ++frame) {
+		_drawLines(test, 0, 12);
+		test->renderer.d.writeVideoRegister(&test->renderer.d, REG_DISPCNT, 0x0040);
+		_drawLines(test, 12, 14);
+		test->renderer.d.writeVideoRegister(&test->renderer.d, REG_DISPCNT, 0x1040);
+		_drawLines(test, 14, GBA_VIDEO_VERTICAL_PIXELS);
+
+		_assertColumn(test, 20, 10, 12, RED);
+		_assertColumn(test, 20, 12, 14, BLUE);
+		_assertColumn(test, 20, 14, 18, RED);
+		_assertColumn(test, 20, 18, GBA_VIDEO_VERTICAL_PIXELS, BLUE);
+		_assertColumn(test, 40, 0, 2, RED);
+	}
+
+	// Without the writes, the lines that saw the old value are drawn again
+	_drawLines(test, 0, GBA_VIDEO_VERTICAL_PIXELS);
+	_assertColumn(test, 20, 10, 18, RED);
+}
+
+M_TEST_DEFINE(rewriteSameOAM) {
+	struct GBARendererTest* test = *state;
+	_drawLines(test, 0, GBA_VIDEO_VERTICAL_PIXELS);
+
+	// Games commonly rewrite all of OAM every frame, usually with the same values
+	int i;
+	for (i = 0; i < 128; ++i) {
+		_writeSprite(test, i, test->oam.obj[i].a, test->oam.obj[i].b, test->oam.obj[i].c);
+	}
+	_drawLines(test, 0, GBA_VIDEO_VERTICAL_PIXELS);
+	_assertColumn(test, 20, 0, 10, BLUE);
+	_assertColumn(test, 20, 10, 18, RED);
+	_assertColumn(test, 40, 0, 2, RED);
+
+	// Affine parameters don't touch the index
+	test->oam.raw[3] = 0x1234;
+	test->renderer.d.writeOAM(&test->renderer.d, 3);
+	_drawLines(test, 0, GBA_VIDEO_VERTICAL_PIXELS);
+	_assertColumn(test, 20, 10, 18, RED);
+
+	// Changing only the palette must still be picked up
+	_writeSprite(test, 0, test->oam.obj[0].a, test->oam.obj[0].b, 0x1000);
+	_drawLines(test, 0, GBA_VIDEO_VERTICAL_PIXELS);
+	_assertColumn(test, 20, 0, 10, BLUE);
+	_assertColumn(test, 20, 10, 18, GREEN);
+
+	// After a reset, the index is rebuilt even though the shadow matches
+	test->renderer.d.reset(&test->renderer.d);
+	test->renderer.d.writeVideoRegister(&test->renderer.d, REG_DISPCNT, 0x1040);
+	_drawLines(test, 0, GBA_VIDEO_VERTICAL_PIXELS);
+	_assertColumn(test, 20, 10, 18, GREEN);
+	_assertColumn(test, 40, 0, 2, RED);
+}
+
+M_TEST_SUITE_DEFINE(GBARenderer,
+	cmocka_unit_test_setup_teardown(spriteLines, rendererSetup, rendererTeardown),
+	cmocka_unit_test_setup_teardown(moveSpriteMidFrame, rendererSetup, rendererTeardown),
+	cmocka_unit_test_setup_teardown(spriteOrder, rendererSetup, rendererTeardown),
+	cmocka_unit_test_setup_teardown(disableObjMidFrame, rendererSetup, rendererTeardown),
+	cmocka_unit_test_setup_teardown(rewriteSameOAM, rendererSetup, rendererTeardown))
@@ -0,0 +1,288 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba/core/core.h>
+#include <mgba/core/rewind.h>
+#include <mgba/core/serialize.h>
+#include <mgba/gba/core.h>
+#include <mgba/internal/gba/gba.h>
+#include <mgba/internal/gba/serialize.h>
+#include <mgba-util/memory.h>
+
+#define STATE_PAGE(MEMBER) (offsetof(struct GBASerializedState, MEMBER) >> mSTATE_PAGE_SHIFT)
+
+static bool _isDirty(const uint32_t* dirty, size_t page) {
+	return dirty[page >> 5] & (1U << (page & 31));
+}
+
+static int _setupCore(void** state) {
+	struct mCore* core = GBACoreCreate();
+	if (!core || !core->init(core)) {
+		return -1;
+	}
+	mCoreInitConfig(core, NULL);
+	core->reset(core);
+	*state = core;
+	return 0;
+}
+
+static int _teardownCore(void** state) {
+	struct mCore* core = *state;
+	mCoreConfigDeinit(&core->config);
+	core->deinit(core);
+	return 0;
+}
+
+M_TEST_DEFINE(dirtyPages) {
+	struct mCore* core = *state;
+	size_t size = core->snapshotSize(core);
+	assert_int_equal(size, sizeof(struct GBASerializedState));
+	uint8_t* image = anonymousMemoryMap(size);
+	uint32_t dirty[(sizeof(struct GBASerializedState) >> mSTATE_PAGE_SHIFT) / 32 + 1] = {0};
+	core->snapshotSave(core, image, NULL);
+
+	core->busWrite32(core, BASE_WORKING_RAM | 0x404, 0x12345678);
+	core->busWrite16(core, BASE_WORKING_IRAM | 0x7FFE, 0x5555);
+	core->busWrite16(core, BASE_VRAM | 0x10000, 0x1234);
+	core->snapshotSave(core, image, dirty);
+
+	size_t page;
+	for (page = 0; page < size >> mSTATE_PAGE_SHIFT; ++page) {
+		bool expected = page < STATE_PAGE(vram) ||
+		                page == STATE_PAGE(wram) + 1 ||
+		                page == STATE_PAGE(iwram) + 31 ||
+		                page == STATE_PAGE(vram) + 64;
+		assert_int_equal(_isDirty(dirty, page), expected);
+	}
+	struct GBASerializedState* gbaState = (struct GBASerializedState*) image;
+	assert_int_equal(gbaState->wram[0x404], 0x78);
+	assert_int_equal(gbaState->iwram[0x7FFF], 0x55);
+
+	// Nothing new was written, so only the register block is reported
+	memset(dirty, 0, sizeof(dirty));
+	core->snapshotSave(core, image, dirty);
+	assert_false(_isDirty(dirty, STATE_PAGE(wram) + 1));
+	assert_true(_isDirty(dirty, 0));
+
+	mappedMemoryFree(image, size);
+}
+
+M_TEST_DEFINE(loadMarksChanged) {
+	struct mCore* core = *state;
+	size_t size = core->snapshotSize(core);
+	uint8_t* image = anonymousMemoryMap(size);
+	uint32_t dirty[(sizeof(struct GBASerializedState) >> mSTATE_PAGE_SHIFT) / 32 + 1] = {0};
+	core->snapshotSave(core, image, NULL);
+
+	// A regular state load reports every page it changes, but only those
+	void* savestate = anonymousMemoryMap(core->stateSize(core));
+	core->saveState(core, savestate);
+	core->busWrite32(core, BASE_WORKING_RAM | 0x3FC00, 1);
+	core->busWrite32(core, BASE_WORKING_IRAM | 0x400, 1);
+	core->busWrite16(core, BASE_VRAM, 1);
+	core->snapshotSave(core, image, dirty);
+	memset(dirty, 0, sizeof(dirty));
+
+	assert_true(core->loadState(core, savestate));
+	core->snapshotSave(core, image, dirty);
+	assert_true(_isDirty(dirty, STATE_PAGE(wram) + 255));
+	assert_true(_isDirty(dirty, STATE_PAGE(iwram) + 1));
+	assert_true(_isDirty(dirty, STATE_PAGE(vram)));
+	assert_false(_isDirty(dirty, STATE_PAGE(wram) + 254));
+	assert_false(_isDirty(dirty, STATE_PAGE(iwram)));
+	assert_false(_isDirty(dirty, STATE_PAGE(vram) + 1));
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM | 0x3FC00), 0);
+
+	// Reloading the same state again changes nothing
+	memset(dirty, 0, sizeof(dirty));
+	assert_true(core->loadState(core, savestate));
+	core->snapshotSave(core, image, dirty);
+	assert_false(_isDirty(dirty, STATE_PAGE(wram) + 255));
+	assert_false(_isDirty(dirty, STATE_PAGE(vram)));
+
+	mappedMemoryFree(savestate, core->stateSize(core));
+	mappedMemoryFree(image, size);
+}
+
+M_TEST_DEFINE(restore) {
+	struct mCore* core = *state;
+	struct mCoreRewindContext context = {0};
+	mCoreRewindContextInit(&context, 4, 0, false);
+
+	uint32_t value;
+	for (value = 1; value <= 3; ++value) {
+		core->busWrite32(core, BASE_WORKING_RAM | 0x1000, value);
+		core->busWrite32(core, BASE_WORKING_IRAM | 0x100, value * 2);
+		mCoreRewindAppend(&context, core);
+	}
+	core->busWrite32(core, BASE_WORKING_RAM | 0x1000, 4);
+
+	assert_true(mCoreRewindRestore(&context, core));
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM | 0x1000), 2);
+	assert_int_equal(core->busRead32(core, BASE_WORKING_IRAM | 0x100), 4);
+
+	// Appending after a restore continues from the restored state
+	core->busWrite32(core, BASE_WORKING_RAM | 0x1000, 5);
+	mCoreRewindAppend(&context, core);
+	assert_true(mCoreRewindRestore(&context, core));
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM | 0x1000), 2);
+	assert_true(mCoreRewindRestore(&context, core));
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM | 0x1000), 1);
+	assert_int_equal(core->busRead32(core, BASE_WORKING_IRAM | 0x100), 2);
+	assert_false(mCoreRewindRestore(&context, core));
+
+	mCoreRewindContextDeinit(&context);
+}
+
+M_TEST_DEFINE(restoreWrap) {
+	struct mCore* core = *state;
+	struct mCoreRewindContext context = {0};
+	mCoreRewindContextInit(&context, 2, 0, false);
+
+	uint32_t value;
+	for (value = 1; value <= 5; ++value) {
+		core->busWrite32(core, BASE_WORKING_RAM | 0x2000, value);
+		mCoreRewindAppend(&context, core);
+	}
+
+	assert_true(mCoreRewindRestore(&context, core));
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM | 0x2000), 4);
+	assert_true(mCoreRewindRestore(&context, core));
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM | 0x2000), 3);
+	assert_false(mCoreRewindRestore(&context, core));
+
+	mCoreRewindContextDeinit(&context);
+}
+
+M_TEST_DEFINE(budget) {
+	struct mCore* core = *state;
+	struct mCoreRewindContext context = {0};
+	mCoreRewindContextInit(&context, 64, 0x10000, false);
+	context.keyframeInterval = 0;
+
+	// Noise doesn't compress, so each entry uses about 8 KiB of the budget
+	uint32_t seed = 0x12345678;
+	uint32_t value;
+	for (value = 0; value < 32; ++value) {
+		size_t i;
+		for (i = 0; i < 0x2000; i += 4) {
+			seed = seed * 1103515245 + 12345;
+			core->busWrite32(core, BASE_WORKING_RAM | (((value & 1) * 0x2000) + i), seed);
+		}
+		core->busWrite32(core, BASE_WORKING_IRAM, value);
+		mCoreRewindAppend(&context, core);
+	}
+
+	struct mCoreRewindStats stats;
+	mCoreRewindGetStats(&context, &stats);
+	assert_int_equal(stats.budget, 0x10000);
+	assert_true(stats.bytesUsed <= stats.budget);
+	assert_true(stats.entries > 2);
+	assert_true(stats.entries < 16);
+	assert_true(stats.rawBytes > stats.bytesUsed);
+	assert_int_equal(stats.compressions, 31);
+
+	size_t entries = stats.entries;
+	assert_int_equal(mCoreRewindRestoreSteps(&context, core, 100), entries);
+	assert_int_equal(core->busRead32(core, BASE_WORKING_IRAM), 31 - entries);
+	assert_false(mCoreRewindRestore(&context, core));
+
+	mCoreRewindContextDeinit(&context);
+}
+
+M_TEST_DEFINE(keyframes) {
+	struct mCore* core = *state;
+	struct mCoreRewindContext context = {0};
+	mCoreRewindContextInit(&context, 32, 0, false);
+	context.keyframeInterval = 4;
+
+	uint32_t value;
+	for (value = 0; value < 20; ++value) {
+		core->busWrite32(core, BASE_WORKING_RAM | 0x100, value);
+		core->busWrite32(core, BASE_VRAM | (value * 0x400), value);
+		mCoreRewindAppend(&context, core);
+	}
+
+	struct mCoreRewindStats stats;
+	mCoreRewindGetStats(&context, &stats);
+	assert_int_equal(stats.entries, 19);
+	assert_int_equal(stats.keyframes, 4);
+
+	assert_int_equal(mCoreRewindRestoreSteps(&context, core, 7), 7);
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM | 0x100), 12);
+	assert_int_equal(core->busRead32(core, BASE_VRAM | (13 * 0x400)), 0);
+	assert_int_equal(core->busRead32(core, BASE_VRAM | (12 * 0x400)), 12);
+
+	// Stepping one at a time through a keyframe ends up in the same place
+	core->busWrite32(core, BASE_WORKING_RAM | 0x100, 100);
+	assert_true(mCoreRewindRestore(&context, core));
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM | 0x100), 11);
+	assert_int_equal(mCoreRewindRestoreSteps(&context, core, 6), 6);
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM | 0x100), 5);
+	assert_int_equal(core->busRead32(core, BASE_VRAM | (6 * 0x400)), 0);
+	assert_int_equal(core->busRead32(core, BASE_VRAM | (5 * 0x400)), 5);
+
+	// New entries made after a deep restore continue from the restored state
+	core->busWrite32(core, BASE_WORKING_RAM | 0x100, 200);
+	mCoreRewindAppend(&context, core);
+	core->busWrite32(core, BASE_WORKING_RAM | 0x100, 201);
+	mCoreRewindAppend(&context, core);
+	assert_true(mCoreRewindRestore(&context, core));
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM | 0x100), 200);
+	assert_true(mCoreRewindRestore(&context, core));
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM | 0x100), 5);
+
+	mCoreRewindContextDeinit(&context);
+}
+
+M_TEST_DEFINE(serializedFallback) {
+	struct mCore* core = *state;
+	// Cores without snapshot support go through regular savestates
+	core->snapshotSize = NULL;
+	core->snapshotSave = NULL;
+	core->snapshotLoad = NULL;
+	struct mCoreRewindContext context = {0};
+	mCoreRewindContextInit(&context, 8, 0, false);
+
+	uint32_t value;
+	for (value = 1; value <= 3; ++value) {
+		core->busWrite32(core, BASE_WORKING_RAM | 0x1000, value);
+		mCoreRewindAppend(&context, core);
+	}
+	assert_true(mCoreRewindRestore(&context, core));
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM | 0x1000), 2);
+	assert_true(mCoreRewindRestore(&context, core));
+	assert_int_equal(core->busRead32(core, BASE_WORKING_RAM | 0x1000), 1);
+	assert_false(mCoreRewindRestore(&context, core));
+
+	mCoreRewindContextDeinit(&context);
+}
+
+M_TEST_DEFINE(allocationFailure) {
+	struct mCore* core = *state;
+	struct mCoreRewindContext context = {0};
+	assert_false(mCoreRewindContextInit(&context, 8, SIZE_MAX >> 1, false));
+
+	// An uninitialized context is left inert rather than crashing
+	mCoreRewindAppend(&context, core);
+	assert_false(mCoreRewindRestore(&context, core));
+	mCoreRewindContextDeinit(&context);
+
+	assert_true(mCoreRewindContextInit(&context, 8, 0, false));
+	mCoreRewindAppend(&context, core);
+	mCoreRewindContextDeinit(&context);
+}
+
+M_TEST_SUITE_DEFINE(GBARewind,
+	cmocka_unit_test_setup_teardown(dirtyPages, _setupCore, _teardownCore),
+	cmocka_unit_test_setup_teardown(loadMarksChanged, _setupCore, _teardownCore),
+	cmocka_unit_test_setup_teardown(restore, _setupCore, _teardownCore),
+	cmocka_unit_test_setup_teardown(restoreWrap, _setupCore, _teardownCore),
+	cmocka_unit_test_setup_teardown(budget, _setupCore, _teardownCore),
+	cmocka_unit_test_setup_teardown(keyframes, _setupCore, _teardownCore),
+	cmocka_unit_test_setup_teardown(serializedFallback, _setupCore, _teardownCore),
+	cmocka_unit_test_setup_teardown(allocationFailure, _setupCore, _teardownCore))
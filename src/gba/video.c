@@ -56,6 +56,7 @@ void GBAVideoInit(struct GBAVideo* video) {
 	video->renderer = NULL;
 	video->vram = anonymousMemoryMap(SIZE_VRAM);
 	video->frameskip = 0;
+	video->suppressOutput = false;
 	video->event.name = "GBA Video";
 	video->event.callback = NULL;
 	video->event.context = video;
@@ -171,7 +172,7 @@ void _startHdraw(struct mTiming* timing, void* context, uint32_t cyclesLate) {
 		break;
 	case GBA_VIDEO_VERTICAL_PIXELS:
 		video->p->memory.io[REG_DISPSTAT >> 1] = GBARegisterDISPSTATFillInVblank(dispstat);
-		if (video->frameskipCounter <= 0) {
+		if (video->frameskipCounter <= 0 && !video->suppressOutput) {
 			video->renderer->finishFrame(video->renderer);
 		}
 		GBADMARunVblank(video->p, -cyclesLate);
@@ -179,7 +180,9 @@ void _startHdraw(struct mTiming* timing, void* context, uint32_t cyclesLate) {
 			GBARaiseIRQ(video->p, GBA_IRQ_VBLANK, cyclesLate);
 		}
 		GBAFrameEnded(video->p);
-		mCoreSyncPostFrame(video->p->sync);
+		if (!video->suppressOutput) {
+			mCoreSyncPostFrame(video->p->sync);
+		}
 		--video->frameskipCounter;
 		if (video->frameskipCounter < 0) {
 			video->frameskipCounter = video->frameskip;
@@ -201,7 +204,7 @@ void _startHblank(struct mTiming* timing, void* context, uint32_t cyclesLate) {
 	// Begin Hblank
 	GBARegisterDISPSTAT dispstat = video->p->memory.io[REG_DISPSTAT >> 1];
 	dispstat = GBARegisterDISPSTATFillInHblank(dispstat);
-	if (video->vcount < GBA_VIDEO_VERTICAL_PIXELS && video->frameskipCounter <= 0) {
+	if (video->vcount < GBA_VIDEO_VERTICAL_PIXELS && video->frameskipCounter <= 0 && !video->suppressOutput) {
 		video->renderer->drawScanline(video->renderer, video->vcount);
 	}
 
@@ -326,6 +329,10 @@ static void GBAVideoDummyRendererPutPixels(struct GBAVideoRenderer* renderer, si
 
 void GBAVideoSerialize(const struct GBAVideo* video, struct GBASerializedState* state) {
 	memcpy(state->vram, video->vram, SIZE_VRAM);
+	GBAVideoSerializeRegisters(video, state);
+}
+
+void GBAVideoSerializeRegisters(const struct GBAVideo* video, struct GBASerializedState* state) {
 	memcpy(state->oam, video->oam.raw, SIZE_OAM);
 	memcpy(state->pram, video->palette, SIZE_PALETTE_RAM);
 	STORE_32(video->event.when - mTimingCurrentTime(&video->p->timing), 0, &state->video.nextEvent);
@@ -340,7 +347,7 @@ void GBAVideoSerialize(const struct GBAVideo* video, struct GBASerializedState*
 }
 
 void GBAVideoDeserialize(struct GBAVideo* video, const struct GBASerializedState* state) {
-	memcpy(video->vram, state->vram, SIZE_VRAM);
+	GBAMemoryRestorePages(&video->p->memory, DIRTY_PAGE_VRAM, video->vram, state->vram, SIZE_VRAM);
 	uint16_t value;
 	int i;
 	for (i = 0; i < SIZE_OAM; i += 2) {
@@ -15,3 +15,23 @@ void mappedMemoryFree(void* memory, size_t size) {
 	UNUSED(size);
 	linearFree(memory);
 }
+
+struct SharedMemory* sharedMemoryCreate(size_t size) {
+	UNUSED(size);
+	return NULL;
+}
+
+void sharedMemoryDestroy(struct SharedMemory* shared) {
+	UNUSED(shared);
+}
+
+void* sharedMemoryMap(struct SharedMemory* shared, bool copyOnWrite) {
+	UNUSED(shared);
+	UNUSED(copyOnWrite);
+	return NULL;
+}
+
+void sharedMemoryUnmap(struct SharedMemory* shared, void* memory) {
+	UNUSED(shared);
+	UNUSED(memory);
+}
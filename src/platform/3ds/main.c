@@ -4,6 +4,7 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <mgba/core/audio-resampler.h>
 #include <mgba/core/blip_buf.h>
 #include <mgba/core/core.h>
 #include <mgba/core/serialize.h>
@@ -94,6 +95,7 @@ static size_t audioPos = 0;
 static C3D_Tex outputTexture[2];
 static int activeOutputTexture = 0;
 static ndspWaveBuf dspBuffer[DSP_BUFFERS];
+static struct mAudioResampler audioResampler;
 static int bufferId = 0;
 static bool frameLimiter = true;
 static u32 frameCounter;
@@ -182,6 +184,7 @@ static void _cleanup(void) {
 	}
 
 	if (hasSound == DSP_SUPPORTED) {
+		mAudioResamplerDeinit(&audioResampler);
 		ndspExit();
 	}
 
@@ -196,6 +199,7 @@ static void _map3DSKey(struct mInputMap* map, int ctrKey, int key) {
 }
 
 static void _postAudioBuffer(struct mAVStream* stream, blip_t* left, blip_t* right);
+static void _postAudioResampled(struct mAVStream* stream, struct mAudioResampler* resampler);
 
 static void _drawStart(void) {
 	if (frameStarted) {
@@ -323,6 +327,9 @@ static void _setup(struct mGUIRunner* runner) {
 	frameLimiter = true;
 
 	runner->core->setAudioBufferSize(runner->core, AUDIO_SAMPLES);
+	if (hasSound == DSP_SUPPORTED) {
+		runner->core->setAudioResampler(runner->core, &audioResampler);
+	}
 }
 
 static void _gameLoaded(struct mGUIRunner* runner) {
@@ -358,6 +365,11 @@ static void _gameLoaded(struct mGUIRunner* runner) {
 	}
 	if (hasSound == DSP_SUPPORTED) {
 		memset(audioLeft, 0, AUDIO_SAMPLE_BUFFER * 2 * sizeof(int16_t));
+		unsigned quality;
+		if (mCoreConfigGetUIntValue(&runner->config, "audioResampler", &quality) && quality != audioResampler.quality) {
+			mAudioResamplerSetQuality(&audioResampler, quality);
+		}
+		mAudioResamplerSetOutputRate(&audioResampler, 32768 * ratio);
 	}
 	unsigned mode;
 	if (mCoreConfigGetUIntValue(&runner->config, "screenMode", &mode) && mode < SM_MAX) {
@@ -832,6 +844,24 @@ static void _postAudioBuffer(struct mAVStream* stream, blip_t* left, blip_t* rig
 	}
 }
 
+static void _postAudioResampled(struct mAVStream* stream, struct mAudioResampler* resampler) {
+	UNUSED(stream);
+	int startId = bufferId;
+	while (dspBuffer[bufferId].status == NDSP_WBUF_QUEUED || dspBuffer[bufferId].status == NDSP_WBUF_PLAYING) {
+		bufferId = (bufferId + 1) & (DSP_BUFFERS - 1);
+		if (bufferId == startId) {
+			mAudioResamplerClear(resampler);
+			return;
+		}
+	}
+	void* tmpBuf = dspBuffer[bufferId].data_pcm16;
+	memset(&dspBuffer[bufferId], 0, sizeof(dspBuffer[bufferId]));
+	dspBuffer[bufferId].data_pcm16 = tmpBuf;
+	dspBuffer[bufferId].nsamples = mAudioResamplerRead(resampler, dspBuffer[bufferId].data_pcm16, AUDIO_SAMPLES);
+	DSP_FlushDataCache(dspBuffer[bufferId].data_pcm16, AUDIO_SAMPLES * 2 * sizeof(int16_t));
+	ndspChnWaveBufAdd(0, &dspBuffer[bufferId]);
+}
+
 static enum GUIKeyboardStatus _keyboardRun(struct GUIKeyboardParams* keyboard) {
 	SwkbdState swkbd;
 	swkbdInit(&swkbd, SWKBD_TYPE_NORMAL, 2, keyboard->maxLen);
@@ -862,6 +892,7 @@ int main() {
 	stream.postVideoFrame = 0;
 	stream.postAudioFrame = 0;
 	stream.postAudioBuffer = _postAudioBuffer;
+	stream.postAudioResampled = _postAudioResampled;
 
 	camera.d.startRequestImage = _startRequestImage;
 	camera.d.stopRequestImage = _stopRequestImage;
@@ -885,6 +916,7 @@ int main() {
 		ndspChnSetRate(0, 0x8000);
 		ndspChnWaveBufClear(0);
 		audioLeft = linearMemAlign(AUDIO_SAMPLES * DSP_BUFFERS * 2 * sizeof(int16_t), 0x80);
+		mAudioResamplerInit(&audioResampler, AUDIO_SAMPLES * 4, mAUDIO_RESAMPLER_FAST);
 		memset(dspBuffer, 0, sizeof(dspBuffer));
 		int i;
 		for (i = 0; i < DSP_BUFFERS; ++i) {
@@ -1037,9 +1069,22 @@ int main() {
 					"Outer",
 				},
 				.nStates = 3
+			},
+			{
+				.title = "Audio resampling",
+				.data = GUI_V_S("audioResampler"),
+				.submenu = 0,
+				.state = mAUDIO_RESAMPLER_FAST,
+				.validStates = (const char*[]) {
+					"Linear",
+					"Fast",
+					"Good",
+					"Best",
+				},
+				.nStates = 4
 			}
 		},
-		.nConfigExtra = 4,
+		.nConfigExtra = 5,
 		.setup = _setup,
 		.teardown = 0,
 		.gameLoaded = _gameLoaded,
@@ -17,9 +17,14 @@
 
 #ifndef DISABLE_ANON_MMAP
 #include <sys/mman.h>
+#include <unistd.h>
 
 void* anonymousMemoryMap(size_t size) {
-	return mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	void* memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (memory == MAP_FAILED) {
+		return NULL;
+	}
+	return memory;
 }
 
 void mappedMemoryFree(void* memory, size_t size) {
@@ -35,3 +40,67 @@ void mappedMemoryFree(void* memory, size_t size) {
 	free(memory);
 }
 #endif
+
+#if !defined(DISABLE_ANON_MMAP) && defined(MFD_CLOEXEC)
+struct SharedMemory {
+	int fd;
+	size_t size;
+};
+
+struct SharedMemory* sharedMemoryCreate(size_t size) {
+	int fd = memfd_create("mgba-shared", MFD_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (ftruncate(fd, size) < 0) {
+		close(fd);
+		return NULL;
+	}
+	struct SharedMemory* shared = malloc(sizeof(*shared));
+	if (!shared) {
+		close(fd);
+		return NULL;
+	}
+	shared->fd = fd;
+	shared->size = size;
+	return shared;
+}
+
+void sharedMemoryDestroy(struct SharedMemory* shared) {
+	close(shared->fd);
+	free(shared);
+}
+
+void* sharedMemoryMap(struct SharedMemory* shared, bool copyOnWrite) {
+	void* memory = mmap(0, shared->size, PROT_READ | PROT_WRITE, copyOnWrite ? MAP_PRIVATE : MAP_SHARED, shared->fd, 0);
+	if (memory == MAP_FAILED) {
+		return NULL;
+	}
+	return memory;
+}
+
+void sharedMemoryUnmap(struct SharedMemory* shared, void* memory) {
+	munmap(memory, shared->size);
+}
+#else
+// Without memfd there's no anonymous file to map copy-on-write
+struct SharedMemory* sharedMemoryCreate(size_t size) {
+	UNUSED(size);
+	return NULL;
+}
+
+void sharedMemoryDestroy(struct SharedMemory* shared) {
+	UNUSED(shared);
+}
+
+void* sharedMemoryMap(struct SharedMemory* shared, bool copyOnWrite) {
+	UNUSED(shared);
+	UNUSED(copyOnWrite);
+	return NULL;
+}
+
+void sharedMemoryUnmap(struct SharedMemory* shared, void* memory) {
+	UNUSED(shared);
+	UNUSED(memory);
+}
+#endif
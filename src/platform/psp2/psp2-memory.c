@@ -30,3 +30,23 @@ void mappedMemoryFree(void* memory, size_t size) {
 		sceKernelFreeMemBlock(uid);
 	}
 }
+
+struct SharedMemory* sharedMemoryCreate(size_t size) {
+	UNUSED(size);
+	return NULL;
+}
+
+void sharedMemoryDestroy(struct SharedMemory* shared) {
+	UNUSED(shared);
+}
+
+void* sharedMemoryMap(struct SharedMemory* shared, bool copyOnWrite) {
+	UNUSED(shared);
+	UNUSED(copyOnWrite);
+	return NULL;
+}
+
+void sharedMemoryUnmap(struct SharedMemory* shared, void* memory) {
+	UNUSED(shared);
+	UNUSED(memory);
+}
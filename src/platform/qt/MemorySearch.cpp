@@ -20,6 +20,7 @@ MemorySearch::MemorySearch(std::shared_ptr<CoreController> controller, QWidget*
 	m_ui.setupUi(this);
 
 	mCoreMemorySearchResultsInit(&m_results, 0);
+	mCoreMemorySearchCandidatesInit(&m_candidates);
 	connect(m_ui.search, &QPushButton::clicked, this, &MemorySearch::search);
 	connect(m_ui.value, &QLineEdit::returnPressed, this, &MemorySearch::search); 
 	connect(m_ui.searchWithin, &QPushButton::clicked, this, &MemorySearch::searchWithin);
@@ -33,6 +34,7 @@ MemorySearch::MemorySearch(std::shared_ptr<CoreController> controller, QWidget*
 
 MemorySearch::~MemorySearch() {
 	mCoreMemorySearchResultsDeinit(&m_results);
+	mCoreMemorySearchCandidatesDeinit(&m_candidates);
 }
 
 bool MemorySearch::createParams(mCoreMemorySearchParams* params) {
@@ -142,7 +144,12 @@ void MemorySearch::search() {
 	mCore* core = m_controller->thread()->core;
 
 	if (createParams(&params)) {
-		mCoreMemorySearch(core, &params, &m_results, LIMIT);
+		// Integer searches keep every match, and only the first results get listed
+		if (mCoreMemorySearchCandidatesFind(core, &params, &m_candidates)) {
+			mCoreMemorySearchCandidatesExport(&m_candidates, &m_results, LIMIT);
+		} else {
+			mCoreMemorySearch(core, &params, &m_results, LIMIT);
+		}
 	}
 
 	refresh();
@@ -158,7 +165,13 @@ void MemorySearch::searchWithin() {
 		if (m_ui.opUnknown->isChecked()) {
 			params.op = mCORE_MEMORY_SEARCH_DELTA_ANY;
 		}
-		mCoreMemorySearchRepeat(core, &params, &m_results);
+		if (mCoreMemorySearchCandidatesNarrow(core, &params, &m_candidates)) {
+			mCoreMemorySearchResultsClear(&m_results);
+			mCoreMemorySearchCandidatesExport(&m_candidates, &m_results, LIMIT);
+		} else {
+			mCoreMemorySearchCandidatesClear(&m_candidates);
+			mCoreMemorySearchRepeat(core, &params, &m_results);
+		}
 	}
 
 	refresh();
@@ -249,6 +262,14 @@ void MemorySearch::refresh() {
 		m_ui.opEqual->setChecked(true);
 	}
 	m_ui.results->sortItems(0);
+
+	// Only the first matches are listed, but the candidates remember all of them
+	size_t shown = mCoreMemorySearchResultsSize(&m_results);
+	if (m_candidates.count > shown) {
+		m_ui.matches->setText(tr("Showing %1 of %n match(es)", nullptr, static_cast<int>(m_candidates.count)).arg(shown));
+	} else {
+		m_ui.matches->setText(tr("%n match(es)", nullptr, static_cast<int>(shown)));
+	}
 }
 
 void MemorySearch::openMemory() {
@@ -40,6 +40,7 @@ private:
 	std::shared_ptr<CoreController> m_controller;
 
 	mCoreMemorySearchResults m_results;
+	mCoreMemorySearchCandidates m_candidates;
 	QByteArray m_string;
 };
 
@@ -555,6 +555,7 @@ void SettingsView::updateConfig() {
 	saveState |= m_ui.saveStateScreenshot->isChecked() ? SAVESTATE_SCREENSHOT : 0;
 	saveState |= m_ui.saveStateSave->isChecked() ? SAVESTATE_SAVEDATA : 0;
 	saveState |= m_ui.saveStateCheats->isChecked() ? SAVESTATE_CHEATS : 0;
+	saveState |= m_ui.saveStateCompressed->isChecked() ? SAVESTATE_COMPRESSED : 0;
 	saveSetting("saveStateExtdata", saveState);
 
 	QVariant audioDriver = m_ui.audioDriver->itemData(m_ui.audioDriver->currentIndex());
@@ -782,6 +783,7 @@ void SettingsView::reloadConfig() {
 	m_ui.saveStateScreenshot->setChecked(saveState & SAVESTATE_SCREENSHOT);
 	m_ui.saveStateSave->setChecked(saveState & SAVESTATE_SAVEDATA);
 	m_ui.saveStateCheats->setChecked(saveState & SAVESTATE_CHEATS);
+	m_ui.saveStateCompressed->setChecked(saveState & SAVESTATE_COMPRESSED);
 
 	m_logModel.reset();
 
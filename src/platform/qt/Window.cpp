@@ -1851,6 +1851,16 @@ void Window::setupOptions() {
 		reloadConfig();
 	}, this);
 
+	ConfigOption* rewindBufferBytes = m_config->addOption("rewindBufferBytes");
+	rewindBufferBytes->connect([this](const QVariant&) {
+		reloadConfig();
+	}, this);
+
+	ConfigOption* runAhead = m_config->addOption("runAhead");
+	runAhead->connect([this](const QVariant&) {
+		reloadConfig();
+	}, this);
+
 	ConfigOption* allowOpposingDirections = m_config->addOption("allowOpposingDirections");
 	allowOpposingDirections->connect([this](const QVariant&) {
 		reloadConfig();
@@ -10,11 +10,20 @@
 #include "scripting/ScriptingTextBuffer.h"
 #include "scripting/ScriptingTextBufferModel.h"
 
+#ifdef USE_LUA
+#include <mgba/internal/script/lua.h>
+#endif
+
 using namespace QGBA;
 
 ScriptingController::ScriptingController(QObject* parent)
 	: QObject(parent)
 {
+#ifdef USE_LUA
+	// Keeps compiled scripts around so reloading them doesn't have to parse them again
+	mSCRIPT_ENGINE_LUA->init(mSCRIPT_ENGINE_LUA);
+#endif
+
 	m_logger.p = this;
 	m_logger.log = [](mLogger* log, int, enum mLogLevel level, const char* format, va_list args) {
 		Logger* logger = static_cast<Logger*>(log);
@@ -44,6 +53,9 @@ ScriptingController::ScriptingController(QObject* parent)
 ScriptingController::~ScriptingController() {
 	clearController();
 	mScriptContextDeinit(&m_scriptContext);
+#ifdef USE_LUA
+	mSCRIPT_ENGINE_LUA->deinit(mSCRIPT_ENGINE_LUA);
+#endif
 }
 
 void ScriptingController::setController(std::shared_ptr<CoreController> controller) {
@@ -269,6 +269,7 @@ int mSDLRun(struct mSDLRenderer* renderer, struct mArguments* args) {
 
 	renderer->audio.samples = renderer->core->opts.audioBuffers;
 	renderer->audio.sampleRate = 44100;
+	mCoreConfigGetBoolValue(&renderer->core->config, "audioRateControl", &renderer->audio.rateControl);
 	thread.logger.logger = &_logger.d;
 
 	bool didFail = !mCoreThreadStart(&thread);
@@ -297,6 +298,7 @@ int mSDLRun(struct mSDLRenderer* renderer, struct mArguments* args) {
 			}
 			renderer->runloop(renderer, &thread);
 			mSDLPauseAudio(&renderer->audio);
+			mSDLDetachAudio(&renderer->audio);
 			if (mCoreThreadHasCrashed(&thread)) {
 				didFail = true;
 				printf("The game crashed!\n");
@@ -51,6 +51,19 @@ bool mSDLInitAudio(struct mSDLAudio* context, struct mCoreThread* threadContext)
 		context->core = threadContext->core;
 		context->sync = &threadContext->impl->sync;
 
+		if (context->rateControl && context->obtainedSpec.channels == 2 && context->core->setAudioResampler) {
+			double fauxClock = 1;
+			if (context->sync->fpsTarget > 0) {
+				fauxClock = GBAAudioCalculateRatio(1, context->sync->fpsTarget, 1);
+			}
+			// Keep a few device buffers of headroom; rate control keeps the ring about half full
+			mAudioResamplerInit(&context->resampler, context->obtainedSpec.samples * 4, mAUDIO_RESAMPLER_FAST);
+			mCoreAudioRingInit(&context->ring, context->obtainedSpec.samples * 4, context->obtainedSpec.freq * fauxClock);
+			mCoreSyncSetAudioRing(context->sync, &context->ring);
+			context->core->setAudioResampler(context->core, &context->resampler);
+			context->ringAttached = true;
+		}
+
 #if SDL_VERSION_ATLEAST(2, 0, 0)
 		SDL_PauseAudioDevice(context->deviceId, 0);
 #else
@@ -61,8 +74,21 @@ bool mSDLInitAudio(struct mSDLAudio* context, struct mCoreThread* threadContext)
 	return true;
 }
 
+void mSDLDetachAudio(struct mSDLAudio* context) {
+	if (!context->ringAttached) {
+		return;
+	}
+	// The sync belongs to the core thread, so this must happen before the thread is joined
+	mSDLPauseAudio(context);
+	context->core->setAudioResampler(context->core, NULL);
+	mCoreSyncSetAudioRing(context->sync, NULL);
+	mCoreAudioRingDeinit(&context->ring);
+	mAudioResamplerDeinit(&context->resampler);
+	context->ringAttached = false;
+}
+
 void mSDLDeinitAudio(struct mSDLAudio* context) {
-	UNUSED(context);
+	mSDLDetachAudio(context);
 #if SDL_VERSION_ATLEAST(2, 0, 0)
 	SDL_PauseAudioDevice(context->deviceId, 1);
 	SDL_CloseAudioDevice(context->deviceId);
@@ -97,6 +123,16 @@ static void _mSDLAudioCallback(void* context, Uint8* data, int len) {
 		memset(data, 0, len);
 		return;
 	}
+	if (audioContext->ringAttached) {
+		// Lock-free path: the core thread adjusts its rate to keep the ring filled
+		int frames = len / (sizeof(int16_t) * 2);
+		int read = mCoreAudioRingRead(&audioContext->ring, (int16_t*) data, frames);
+		mCoreSyncConsumeAudioRing(audioContext->sync);
+		if (read < frames) {
+			memset(((int16_t*) data) + read * 2, 0, (frames - read) * 2 * sizeof(int16_t));
+		}
+		return;
+	}
 	blip_t* left = NULL;
 	blip_t* right = NULL;
 	int32_t clockRate = GBA_ARM7TDMI_FREQUENCY;
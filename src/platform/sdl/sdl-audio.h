@@ -10,7 +10,9 @@
 
 CXX_GUARD_START
 
+#include <mgba/core/audio-resampler.h>
 #include <mgba/core/log.h>
+#include <mgba/core/sync.h>
 
 #include <SDL.h>
 // Altivec sometimes defines this
@@ -28,6 +30,7 @@ struct mSDLAudio {
 	// Input
 	size_t samples;
 	unsigned sampleRate;
+	bool rateControl;
 
 	// State
 	SDL_AudioSpec desiredSpec;
@@ -38,10 +41,14 @@ struct mSDLAudio {
 
 	struct mCore* core;
 	struct mCoreSync* sync;
+	struct mAudioResampler resampler;
+	struct mCoreAudioRing ring;
+	bool ringAttached;
 };
 
 struct mCoreThread;
 bool mSDLInitAudio(struct mSDLAudio* context, struct mCoreThread*);
+void mSDLDetachAudio(struct mSDLAudio* context);
 void mSDLDeinitAudio(struct mSDLAudio* context);
 void mSDLPauseAudio(struct mSDLAudio* context);
 void mSDLResumeAudio(struct mSDLAudio* context);
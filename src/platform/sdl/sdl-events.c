@@ -542,11 +542,18 @@ static void _mSDLHandleKeypress(struct mCoreThread* context, struct mSDLPlayer*
 				case SDLK_F6:
 				case SDLK_F7:
 				case SDLK_F8:
-				case SDLK_F9:
+				case SDLK_F9: {
+					int flags = SAVESTATE_SAVEDATA | SAVESTATE_SCREENSHOT | SAVESTATE_RTC;
+					int compress = false;
+					mCoreConfigGetIntValue(&context->core->config, "compressSaveStates", &compress);
+					if (compress) {
+						flags |= SAVESTATE_COMPRESSED;
+					}
 					mCoreThreadInterrupt(context);
-					mCoreSaveState(context->core, event->keysym.sym - SDLK_F1 + 1, SAVESTATE_SAVEDATA | SAVESTATE_SCREENSHOT | SAVESTATE_RTC);
+					mCoreSaveState(context->core, event->keysym.sym - SDLK_F1 + 1, flags);
 					mCoreThreadContinue(context);
 					break;
+				}
 				default:
 					break;
 				}
@@ -7,11 +7,14 @@
 #include <mgba/core/cheats.h>
 #include <mgba/core/config.h>
 #include <mgba/core/core.h>
+#include <mgba/core/movie.h>
 #include <mgba/core/serialize.h>
 #include <mgba/gb/core.h>
 #include <mgba/gba/core.h>
 
 #include <mgba/feature/commandline.h>
+#include <mgba-util/clock.h>
+#include <mgba-util/memory.h>
 #include <mgba-util/socket.h>
 #include <mgba-util/string.h>
 #include <mgba-util/vfs.h>
@@ -42,15 +45,17 @@ size_t romBufferSize;
 #include <inttypes.h>
 #include <sys/time.h>
 
-#define PERF_OPTIONS "DF:L:NPS:T"
+#define PERF_OPTIONS "B:DF:L:M:NPS:T"
 #define PERF_USAGE \
 	"Benchmark options:\n" \
+	"  -B COUNT         Time COUNT savestate save/load round trips before running\n" \
 	"  -F FRAMES        Run for the specified number of FRAMES before exiting\n" \
 	"  -N               Disable video rendering entirely\n" \
 	"  -T               Use threaded video rendering\n" \
 	"  -P               CSV output, useful for parsing\n" \
 	"  -S SEC           Run for SEC in-game seconds before exiting\n" \
 	"  -L FILE          Load a savestate when starting the test\n" \
+	"  -M FILE          Play back an input movie, until it ends unless -F or -S is given\n" \
 	"  -D               Act as a server"
 
 struct PerfOpts {
@@ -60,6 +65,8 @@ struct PerfOpts {
 	unsigned duration;
 	unsigned frames;
 	char* savestate;
+	char* movie;
+	unsigned stateIterations;
 	bool server;
 };
 
@@ -67,8 +74,10 @@ struct PerfOpts {
 TimeType __nx_time_type = TimeType_LocalSystemClock;
 #endif
 
-static void _mPerfRunloop(struct mCore* context, int* frames, bool quiet);
+static void _mPerfRunloop(struct mCore* context, int* frames, bool quiet, const struct mMovie* movie);
+static bool _mPerfBenchmarkStates(struct mCore* core, unsigned iterations);
 static void _mPerfShutdown(int signal);
+static void _mPerfMovieFrame(void* context);
 static bool _parsePerfOpts(struct mSubParser* parser, int option, const char* arg);
 static void _log(struct mLogger*, int, enum mLogLevel, const char*, va_list);
 static bool _mPerfRunCore(const char* fname, const struct mArguments*, const struct PerfOpts*);
@@ -122,7 +131,7 @@ int main(int argc, char** argv) {
 	struct mLogger logger = { .log = _log };
 	mLogSetDefaultLogger(&logger);
 
-	struct PerfOpts perfOpts = { false, false, false, 0, 0, 0, false };
+	struct PerfOpts perfOpts = { false, false, false, 0, 0, 0, 0, 0, false };
 	struct mSubParser subparser = {
 		.usage = PERF_USAGE,
 		.parse = _parsePerfOpts,
@@ -170,6 +179,7 @@ int main(int argc, char** argv) {
 	if (_savestate) {
 		_savestate->close(_savestate);
 	}
+	free(perfOpts.movie);
 	cleanup:
 	mArgumentsDeinit(&args);
 
@@ -227,20 +237,57 @@ bool _mPerfRunCore(const char* fname, const struct mArguments* args, const struc
 		mCoreLoadStateNamed(core, _savestate, 0);
 	}
 
+	struct mMovie movie;
+	mMovieInit(&movie);
+	if (perfOpts->movie) {
+		struct VFile* vf = VFileOpen(perfOpts->movie, O_RDONLY);
+		if (!vf || !mMoviePlay(&movie, core, vf)) {
+			if (vf) {
+				vf->close(vf);
+			}
+			mCoreConfigFreeOpts(&opts);
+			mCoreConfigDeinit(&core->config);
+			core->deinit(core);
+			return false;
+		}
+		struct mCoreCallbacks callbacks = {
+			.videoFrameEnded = _mPerfMovieFrame,
+			.context = &movie
+		};
+		core->addCoreCallbacks(core, &callbacks);
+	}
+
 	core->getGameCode(core, gameCode);
 
 	int frames = perfOpts->frames;
 	if (!frames) {
 		frames = perfOpts->duration * 60;
 	}
+	if (perfOpts->stateIterations) {
+		bool success = _mPerfBenchmarkStates(core, perfOpts->stateIterations);
+		if (!success || (!frames && !perfOpts->movie)) {
+			// Nothing left to run, rather than running until interrupted
+			mMovieDeinit(&movie);
+			mCoreConfigFreeOpts(&opts);
+			mCoreConfigDeinit(&core->config);
+			core->deinit(core);
+			return success;
+		}
+	}
 	struct timeval tv;
 	gettimeofday(&tv, 0);
 	uint64_t start = 1000000LL * tv.tv_sec + tv.tv_usec;
-	_mPerfRunloop(core, &frames, perfOpts->csv);
+	_mPerfRunloop(core, &frames, perfOpts->csv, perfOpts->movie ? &movie : NULL);
 	gettimeofday(&tv, 0);
 	uint64_t end = 1000000LL * tv.tv_sec + tv.tv_usec;
 	uint64_t duration = end - start;
 
+	bool desynced = movie.desyncs > 0;
+	if (desynced) {
+		fprintf(stderr, "Movie desynced %u times, first at frame %u\n", movie.desyncs, movie.firstDesync);
+	}
+	mMovieDeinit(&movie);
+
 	mCoreConfigFreeOpts(&opts);
 	mCoreConfigDeinit(&core->config);
 	core->deinit(core);
@@ -268,10 +315,64 @@ bool _mPerfRunCore(const char* fname, const struct mArguments* args, const struc
 	consoleUpdate(NULL);
 #endif
 
+	return !desynced;
+}
+
+static void _mPerfMovieFrame(void* context) {
+	mMovieFrameEnded(context);
+}
+
+static uint64_t _mPerfTimeStates(struct mCore* core, unsigned iterations, void* buffer, size_t size, struct VFile* vf, int flags) {
+	uint64_t start = currentTimeUsec();
+	unsigned i;
+	for (i = 0; i < iterations; ++i) {
+		if (vf) {
+			if (!mCoreSaveStateNamed(core, vf, flags) || !mCoreLoadStateNamed(core, vf, flags & SAVESTATE_SAVEDATA)) {
+				return 0;
+			}
+		} else if (!mCoreSaveStateInto(core, buffer, size, flags) || !mCoreLoadStateFrom(core, buffer, size, flags)) {
+			return 0;
+		}
+	}
+	uint64_t duration = currentTimeUsec() - start;
+	return duration ? duration : 1;
+}
+
+static bool _mPerfBenchmarkStates(struct mCore* core, unsigned iterations) {
+	size_t size = mCoreStateBufferSize(core, 0);
+	void* buffer = anonymousMemoryMap(size);
+	struct VFile* vf = VFileMemChunk(NULL, 0);
+	if (!buffer || !vf) {
+		if (buffer) {
+			mappedMemoryFree(buffer, size);
+		}
+		if (vf) {
+			vf->close(vf);
+		}
+		return false;
+	}
+
+	uint64_t lean = _mPerfTimeStates(core, iterations, buffer, size, NULL, 0);
+	uint64_t named = _mPerfTimeStates(core, iterations, NULL, 0, vf, SAVESTATE_SAVEDATA | SAVESTATE_METADATA);
+	size_t namedSize = vf->size(vf);
+	uint64_t compressed = _mPerfTimeStates(core, iterations, NULL, 0, vf, SAVESTATE_SAVEDATA | SAVESTATE_METADATA | SAVESTATE_COMPRESSED);
+	size_t compressedSize = vf->size(vf);
+	vf->close(vf);
+	mappedMemoryFree(buffer, size);
+
+	if (!lean || !named || !compressed) {
+		fprintf(stderr, "Savestate round trip failed\n");
+		return false;
+	}
+	printf("%" PRIu64 " save/loads per second in memory, %" PRIu64 " through VFile with extdata (%" PRIz "u bytes), "
+	       "%" PRIu64 " compressed (%" PRIz "u bytes)\n",
+	       (uint64_t) iterations * 1000000 / lean,
+	       (uint64_t) iterations * 1000000 / named, namedSize,
+	       (uint64_t) iterations * 1000000 / compressed, compressedSize);
 	return true;
 }
 
-static void _mPerfRunloop(struct mCore* core, int* frames, bool quiet) {
+static void _mPerfRunloop(struct mCore* core, int* frames, bool quiet, const struct mMovie* movie) {
 	struct timeval lastEcho;
 	gettimeofday(&lastEcho, 0);
 	int duration = *frames;
@@ -301,6 +402,9 @@ static void _mPerfRunloop(struct mCore* core, int* frames, bool quiet) {
 		if (duration > 0 && *frames == duration) {
 			break;
 		}
+		if (duration <= 0 && movie && movie->mode == mMOVIE_FINISHED) {
+			break;
+		}
 	}
 	if (!quiet) {
 		printf("\033[2K\r");
@@ -363,6 +467,9 @@ static bool _parsePerfOpts(struct mSubParser* parser, int option, const char* ar
 	struct PerfOpts* opts = parser->opts;
 	errno = 0;
 	switch (option) {
+	case 'B':
+		opts->stateIterations = strtoul(arg, 0, 10);
+		return !errno;
 	case 'D':
 		opts->server = true;
 		return true;
@@ -384,6 +491,9 @@ static bool _parsePerfOpts(struct mSubParser* parser, int option, const char* ar
 	case 'L':
 		opts->savestate = strdup(arg);
 		return true;
+	case 'M':
+		opts->movie = strdup(arg);
+		return true;
 	default:
 		return false;
 	}
@@ -0,0 +1,172 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include <mgba/internal/arm/debugger/trace.h>
+#include <mgba/internal/arm/decoder.h>
+#include <mgba/internal/debugger/symbols.h>
+#include <mgba-util/vfs.h>
+
+#ifdef _MSC_VER
+#include <mgba-util/platform/windows/getopt.h>
+#else
+#include <getopt.h>
+#endif
+
+#define TRACE_OPTIONS "r:s:vh"
+#define ROM_BASE 0x08000000
+
+static void _usage(const char* arg0) {
+	printf("usage: %s [-r ROM] [-s SYMBOLS] [-v] TRACE\n", arg0);
+	puts("  -r ROM      Read opcodes that weren't recorded from a GBA ROM");
+	puts("  -s SYMBOLS  Load symbols from an ARMIPS symbols file");
+	puts("  -v          Print registers before each instruction");
+}
+
+static bool _fetchOpcode(const struct ARMTraceEntry* entry, const uint8_t* rom, size_t romSize, uint32_t* opcode) {
+	if (entry->hasOpcode) {
+		*opcode = entry->opcode;
+		return true;
+	}
+	if (!rom || entry->address < ROM_BASE) {
+		return false;
+	}
+	uint32_t offset = (entry->address - ROM_BASE) & 0x01FFFFFF;
+	if (offset + 4 > romSize) {
+		return false;
+	}
+	LOAD_32LE(*opcode, offset, rom);
+	return true;
+}
+
+static void _printEntry(const struct ARMTraceEntry* entry, const struct mDebuggerSymbols* symbols, const uint8_t* rom, size_t romSize, bool verbose) {
+	if (symbols) {
+		const char* label = mDebuggerSymbolReverseLookup(symbols, entry->address, -1);
+		if (label) {
+			printf("%s:\n", label);
+		}
+	}
+	if (verbose) {
+		int i;
+		printf("\t");
+		for (i = 0; i < 15; ++i) {
+			printf("%08X ", entry->gprs[i]);
+		}
+		printf("cpsr: %08X\n", entry->cpsr);
+	}
+
+	char disassembly[64] = "";
+	char opcodeText[16] = "";
+	uint32_t opcode;
+	if (_fetchOpcode(entry, rom, romSize, &opcode)) {
+		struct ARMInstructionInfo info;
+		uint32_t pc = entry->gprs[ARM_PC];
+		if (entry->mode == MODE_ARM) {
+			snprintf(opcodeText, sizeof(opcodeText), "%08X", opcode);
+			ARMDecodeARM(opcode, &info);
+		} else {
+			struct ARMInstructionInfo info2;
+			ARMDecodeThumb(opcode, &info);
+			ARMDecodeThumb(opcode >> 16, &info2);
+			if (ARMDecodeThumbCombine(&info, &info2, &info)) {
+				snprintf(opcodeText, sizeof(opcodeText), "%04X%04X", opcode & 0xFFFF, opcode >> 16);
+			} else {
+				snprintf(opcodeText, sizeof(opcodeText), "    %04X", opcode & 0xFFFF);
+			}
+		}
+		ARMDisassemble(&info, NULL, symbols, pc, disassembly, sizeof(disassembly));
+	}
+	printf("%10" PRIu64 " %c %08X: %8s %s\n", entry->index, entry->mode == MODE_THUMB ? 'T' : 'A', entry->address, opcodeText, disassembly);
+
+	size_t i;
+	for (i = 0; i < entry->nAccesses; ++i) {
+		const struct ARMTraceAccess* access = &entry->accesses[i];
+		printf("\t\t%c%-2i [%08X] = %0*X\n", access->write ? 'W' : 'R', access->width * 8, access->address, access->width * 2, access->value);
+	}
+}
+
+int main(int argc, char** argv) {
+	const char* romPath = NULL;
+	const char* symbolsPath = NULL;
+	bool verbose = false;
+	int ch;
+	while ((ch = getopt(argc, argv, TRACE_OPTIONS)) != -1) {
+		switch (ch) {
+		case 'r':
+			romPath = optarg;
+			break;
+		case 's':
+			symbolsPath = optarg;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		case 'h':
+			_usage(argv[0]);
+			return 0;
+		default:
+			_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind + 1 != argc) {
+		_usage(argv[0]);
+		return 1;
+	}
+
+	struct VFile* vf = VFileOpen(argv[optind], O_RDONLY);
+	if (!vf) {
+		fprintf(stderr, "Could not open trace %s\n", argv[optind]);
+		return 1;
+	}
+	struct ARMTraceReader reader;
+	if (!ARMTraceReaderInit(&reader, vf)) {
+		fprintf(stderr, "Not a valid trace: %s\n", argv[optind]);
+		vf->close(vf);
+		return 1;
+	}
+
+	struct VFile* romVf = NULL;
+	uint8_t* rom = NULL;
+	size_t romSize = 0;
+	if (romPath) {
+		romVf = VFileOpen(romPath, O_RDONLY);
+		if (!romVf) {
+			fprintf(stderr, "Could not open ROM %s\n", romPath);
+		} else {
+			romSize = romVf->size(romVf);
+			rom = romVf->map(romVf, romSize, MAP_READ);
+		}
+	}
+
+	struct mDebuggerSymbols* symbols = NULL;
+	if (symbolsPath) {
+		struct VFile* symbolsVf = VFileOpen(symbolsPath, O_RDONLY);
+		if (!symbolsVf) {
+			fprintf(stderr, "Could not open symbols %s\n", symbolsPath);
+		} else {
+			symbols = mDebuggerSymbolTableCreate();
+			mDebuggerLoadARMIPSSymbols(symbols, symbolsVf);
+			symbolsVf->close(symbolsVf);
+		}
+	}
+
+	struct ARMTraceEntry entry;
+	while (ARMTraceReaderNext(&reader, &entry)) {
+		_printEntry(&entry, symbols, rom, romSize, verbose && (reader.flags & ARM_TRACE_REGISTERS));
+	}
+
+	if (symbols) {
+		mDebuggerSymbolTableDestroy(symbols);
+	}
+	if (romVf) {
+		if (rom) {
+			romVf->unmap(romVf, rom, romSize);
+		}
+		romVf->close(romVf);
+	}
+	ARMTraceReaderDeinit(&reader);
+	vf->close(vf);
+	return 0;
+}
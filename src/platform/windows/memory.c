@@ -16,3 +16,37 @@ void mappedMemoryFree(void* memory, size_t size) {
 	// size is not useful here because we're freeing the memory, not decommitting it
 	VirtualFree(memory, 0, MEM_RELEASE);
 }
+
+struct SharedMemory {
+	HANDLE handle;
+	size_t size;
+};
+
+struct SharedMemory* sharedMemoryCreate(size_t size) {
+	HANDLE handle = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD) ((uint64_t) size >> 32), (DWORD) size, NULL);
+	if (!handle) {
+		return NULL;
+	}
+	struct SharedMemory* shared = malloc(sizeof(*shared));
+	if (!shared) {
+		CloseHandle(handle);
+		return NULL;
+	}
+	shared->handle = handle;
+	shared->size = size;
+	return shared;
+}
+
+void sharedMemoryDestroy(struct SharedMemory* shared) {
+	CloseHandle(shared->handle);
+	free(shared);
+}
+
+void* sharedMemoryMap(struct SharedMemory* shared, bool copyOnWrite) {
+	return MapViewOfFile(shared->handle, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_WRITE, 0, 0, shared->size);
+}
+
+void sharedMemoryUnmap(struct SharedMemory* shared, void* memory) {
+	UNUSED(shared);
+	UnmapViewOfFile(memory);
+}
@@ -4,6 +4,8 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 #include <mgba/script/context.h>
+
+#include <mgba/script/macros.h>
 #ifdef USE_LUA
 #include <mgba/internal/script/lua.h>
 #endif
@@ -17,10 +19,18 @@ struct mScriptFileInfo {
 };
 
 struct mScriptCallbackInfo {
-	const char* callback;
+	const char* callback; // NULL for memory callbacks
 	size_t id;
 };
 
+struct mScriptMemoryEventKey {
+	uint32_t cbid;
+	uint32_t address;
+};
+
+DEFINE_VECTOR(mScriptMemoryCallbackList, struct mScriptMemoryCallback);
+DEFINE_VECTOR(mScriptMemoryEventList, struct mScriptMemoryEvent);
+
 static void _engineContextDestroy(void* ctx) {
 	struct mScriptEngineContext* context = ctx;
 	context->destroy(context);
@@ -65,6 +75,11 @@ void mScriptContextInit(struct mScriptContext* context) {
 	HashTableInit(&context->callbacks, 0, (void (*)(void*)) mScriptValueDeref);
 	TableInit(&context->callbackId, 0, free);
 	context->nextCallbackId = 1;
+	mScriptMemoryCallbackListInit(&context->memoryCallbacks, 0);
+	mScriptMemoryEventListInit(&context->instructionEvents, 0);
+	mScriptMemoryEventListInit(&context->frameEvents, 0);
+	HashTableInit(&context->frameEventIndex, 0, NULL);
+	context->memoryHandler = NULL;
 	context->constants = NULL;
 	HashTableInit(&context->docstrings, 0, NULL);
 }
@@ -76,6 +91,14 @@ void mScriptContextDeinit(struct mScriptContext* context) {
 	mScriptListDeinit(&context->refPool);
 	HashTableDeinit(&context->callbacks);
 	TableDeinit(&context->callbackId);
+	size_t i;
+	for (i = 0; i < mScriptMemoryCallbackListSize(&context->memoryCallbacks); ++i) {
+		mScriptValueDeref(mScriptMemoryCallbackListGetPointer(&context->memoryCallbacks, i)->fn);
+	}
+	mScriptMemoryCallbackListDeinit(&context->memoryCallbacks);
+	mScriptMemoryEventListDeinit(&context->instructionEvents);
+	mScriptMemoryEventListDeinit(&context->frameEvents);
+	HashTableDeinit(&context->frameEventIndex);
 	HashTableDeinit(&context->engines);
 	HashTableDeinit(&context->docstrings);
 }
@@ -222,6 +245,47 @@ void mScriptContextTriggerCallback(struct mScriptContext* context, const char* c
 	}
 }
 
+static uint32_t _insertCallbackInfo(struct mScriptContext* context, struct mScriptCallbackInfo* info) {
+	while (true) {
+		uint32_t id = context->nextCallbackId;
+		++context->nextCallbackId;
+		if (!id || TableLookup(&context->callbackId, id)) {
+			continue;
+		}
+		TableInsert(&context->callbackId, id, info);
+		return id;
+	}
+}
+
+static struct mScriptMemoryCallback* _lookupMemoryCallback(struct mScriptContext* context, uint32_t cbid, size_t* index) {
+	size_t i;
+	for (i = 0; i < mScriptMemoryCallbackListSize(&context->memoryCallbacks); ++i) {
+		struct mScriptMemoryCallback* cb = mScriptMemoryCallbackListGetPointer(&context->memoryCallbacks, i);
+		if (cb->id == cbid) {
+			if (index) {
+				*index = i;
+			}
+			return cb;
+		}
+	}
+	return NULL;
+}
+
+static void _removeMemoryCallback(struct mScriptContext* context, uint32_t cbid) {
+	size_t index;
+	struct mScriptMemoryCallback* cb = _lookupMemoryCallback(context, cbid, &index);
+	if (!cb) {
+		return;
+	}
+	if (context->memoryHandler) {
+		context->memoryHandler->remove(context->memoryHandler->context, cb);
+	}
+	mScriptValueDeref(cb->fn);
+	mScriptMemoryCallbackListShift(&context->memoryCallbacks, index, 1);
+	// Events that are still queued are dropped when they find their callback gone
+	TableRemove(&context->callbackId, cbid);
+}
+
 uint32_t mScriptContextAddCallback(struct mScriptContext* context, const char* callback, struct mScriptValue* fn) {
 	if (fn->type->base != mSCRIPT_TYPE_FUNCTION) {
 		return 0;
@@ -238,15 +302,7 @@ uint32_t mScriptContextAddCallback(struct mScriptContext* context, const char* c
 	info->callback = HashTableIteratorGetKey(&context->callbacks, &iter);
 	info->id = mScriptListSize(list->value.list);
 	mScriptValueWrap(fn, mScriptListAppend(list->value.list));
-	while (true) {
-		uint32_t id = context->nextCallbackId;
-		++context->nextCallbackId;
-		if (TableLookup(&context->callbackId, id)) {
-			continue;
-		}
-		TableInsert(&context->callbackId, id, info);
-		return id;
-	}
+	return _insertCallbackInfo(context, info);
 }
 
 void mScriptContextRemoveCallback(struct mScriptContext* context, uint32_t cbid) {
@@ -254,6 +310,10 @@ void mScriptContextRemoveCallback(struct mScriptContext* context, uint32_t cbid)
 	if (!info) {
 		return;
 	}
+	if (!info->callback) {
+		_removeMemoryCallback(context, cbid);
+		return;
+	}
 	struct mScriptValue* list = HashTableLookup(&context->callbacks, info->callback);
 	if (!list) {
 		return;
@@ -266,6 +326,111 @@ void mScriptContextRemoveCallback(struct mScriptContext* context, uint32_t cbid)
 	mScriptListGetPointer(list->value.list, info->id)->type = NULL;
 }
 
+uint32_t mScriptContextAddMemoryCallback(struct mScriptContext* context, enum mScriptMemoryAccessType type, uint32_t address, uint32_t length, enum mScriptCallbackBatch batch, struct mScriptValue* fn) {
+	if (fn->type->base != mSCRIPT_TYPE_FUNCTION || !length) {
+		return 0;
+	}
+	struct mScriptCallbackInfo* info = malloc(sizeof(*info));
+	info->callback = NULL;
+	info->id = 0;
+	uint32_t id = _insertCallbackInfo(context, info);
+
+	struct mScriptMemoryCallback* cb = mScriptMemoryCallbackListAppend(&context->memoryCallbacks);
+	cb->id = id;
+	cb->type = type;
+	cb->address = address;
+	cb->length = length;
+	cb->batch = batch;
+	cb->fn = fn;
+	mScriptValueRef(fn);
+	if (context->memoryHandler) {
+		context->memoryHandler->add(context->memoryHandler->context, cb);
+	}
+	return id;
+}
+
+void mScriptContextSetMemoryCallbackHandler(struct mScriptContext* context, struct mScriptMemoryCallbackHandler* handler) {
+	context->memoryHandler = handler;
+	if (!handler) {
+		return;
+	}
+	size_t i;
+	for (i = 0; i < mScriptMemoryCallbackListSize(&context->memoryCallbacks); ++i) {
+		handler->add(handler->context, mScriptMemoryCallbackListGetPointer(&context->memoryCallbacks, i));
+	}
+}
+
+void mScriptContextReportMemoryAccess(struct mScriptContext* context, enum mScriptMemoryAccessType type, uint32_t address, uint32_t width, uint32_t value) {
+	if (!width) {
+		width = 1;
+	}
+	// The handler only says that something was hit, so every callback overlapping the access gets it
+	size_t i;
+	for (i = 0; i < mScriptMemoryCallbackListSize(&context->memoryCallbacks); ++i) {
+		const struct mScriptMemoryCallback* cb = mScriptMemoryCallbackListGetPointer(&context->memoryCallbacks, i);
+		if (cb->type != type) {
+			continue;
+		}
+		if (address - cb->address >= cb->length && cb->address - address >= width) {
+			continue;
+		}
+		struct mScriptMemoryEvent event = {
+			.cbid = cb->id,
+			.address = address,
+			.value = value
+		};
+		if (cb->batch != mSCRIPT_CALLBACK_BATCH_FRAME) {
+			*mScriptMemoryEventListAppend(&context->instructionEvents) = event;
+			continue;
+		}
+
+		// Hits on the same address are coalesced until the end of the frame, keeping the latest value
+		struct mScriptMemoryEventKey key = {
+			.cbid = cb->id,
+			.address = address
+		};
+		uintptr_t index = (uintptr_t) HashTableLookupBinary(&context->frameEventIndex, &key, sizeof(key));
+		if (index) {
+			mScriptMemoryEventListGetPointer(&context->frameEvents, index - 1)->value = value;
+			continue;
+		}
+		*mScriptMemoryEventListAppend(&context->frameEvents) = event;
+		HashTableInsertBinary(&context->frameEventIndex, &key, sizeof(key), (void*) (uintptr_t) mScriptMemoryEventListSize(&context->frameEvents));
+	}
+}
+
+static void _dispatchMemoryEvents(struct mScriptContext* context, struct mScriptMemoryEventList* events) {
+	size_t i;
+	// Callbacks can add or remove other callbacks, so nothing is held across an invocation
+	for (i = 0; i < mScriptMemoryEventListSize(events); ++i) {
+		struct mScriptMemoryEvent event = *mScriptMemoryEventListGetPointer(events, i);
+		struct mScriptMemoryCallback* cb = _lookupMemoryCallback(context, event.cbid, NULL);
+		if (!cb) {
+			continue;
+		}
+		struct mScriptValue* fn = cb->fn;
+		struct mScriptFrame frame;
+		mScriptFrameInit(&frame);
+		mSCRIPT_PUSH(&frame.arguments, U32, event.address);
+		if (cb->type != mSCRIPT_MEMORY_ACCESS_EXECUTE) {
+			mSCRIPT_PUSH(&frame.arguments, U32, event.value);
+		}
+		mScriptValueRef(fn);
+		mScriptInvoke(fn, &frame);
+		mScriptValueDeref(fn);
+		mScriptFrameDeinit(&frame);
+	}
+	mScriptMemoryEventListClear(events);
+}
+
+void mScriptContextFlushMemoryCallbacks(struct mScriptContext* context, bool frameEnded) {
+	_dispatchMemoryEvents(context, &context->instructionEvents);
+	if (frameEnded) {
+		_dispatchMemoryEvents(context, &context->frameEvents);
+		HashTableClear(&context->frameEventIndex);
+	}
+}
+
 void mScriptContextExportConstants(struct mScriptContext* context, const char* nspace, struct mScriptKVPair* constants) {
 	if (!context->constants) {
 		context->constants = mScriptValueAlloc(mSCRIPT_TYPE_MS_TABLE);
@@ -9,7 +9,9 @@
 #include <mgba/script/context.h>
 #include <mgba/script/macros.h>
 #include <mgba/script/types.h>
+#include <mgba-util/hash.h>
 #include <mgba-util/string.h>
+#include <mgba-util/threading.h>
 
 #include <lualib.h>
 #include <lauxlib.h>
@@ -19,10 +21,13 @@
 #endif
 
 #define MAX_KEY_SIZE 128
+#define MAX_CACHED_CHUNKS 64
 #define LUA_NAME "lua"
 
 #define mSCRIPT_TYPE_MS_LUA_FUNC (&mSTLuaFunc)
 
+static void _luaEngineInit(struct mScriptEngine2*);
+static void _luaEngineDeinit(struct mScriptEngine2*);
 static struct mScriptEngineContext* _luaCreate(struct mScriptEngine2*, struct mScriptContext*);
 
 static void _luaDestroy(struct mScriptEngineContext*);
@@ -220,6 +225,13 @@ static const int _mScriptSocketNumErrors = sizeof(_mScriptSocketErrors) / sizeof
 #if LUA_VERSION_NUM < 502
 #define luaL_traceback(L, M, S, level) lua_pushstring(L, S)
 #define lua_pushglobaltable(L) lua_pushvalue(L, LUA_GLOBALSINDEX)
+#define luaL_loadbufferx(L, B, S, N, M) luaL_loadbuffer(L, B, S, N)
+#endif
+
+#if LUA_VERSION_NUM < 503
+#define _luaDump(L, W, D) lua_dump(L, W, D)
+#else
+#define _luaDump(L, W, D) lua_dump(L, W, D, 0)
 #endif
 
 const struct mScriptType mSTLuaFunc;
@@ -322,7 +334,11 @@ struct mScriptEngineContextLua {
 	lua_State* lua;
 	int func;
 	int require;
+	int methods;
 	char* lastError;
+
+	struct mScriptFrame frame;
+	bool frameInUse;
 };
 
 struct mScriptEngineContextLuaRef {
@@ -330,13 +346,26 @@ struct mScriptEngineContextLuaRef {
 	int ref;
 };
 
+struct mScriptEngineLuaChunk {
+	uint32_t hash;
+	char* source;
+	size_t sourceSize;
+	char* bytecode;
+	size_t bytecodeSize;
+};
+
+// Compiled chunks are kept across contexts so reloading a script after a reset skips the compiler.
+// The cache only exists between init and deinit, which have to be balanced and called from one thread.
 static struct mScriptEngineLua {
 	struct mScriptEngine2 d;
+	int users;
+	Mutex chunkLock;
+	struct Table chunks;
 } _engineLua = {
 	.d = {
 		.name = LUA_NAME,
-		.init = NULL,
-		.deinit = NULL,
+		.init = _luaEngineInit,
+		.deinit = _luaEngineDeinit,
 		.create = _luaCreate
 	}
 };
@@ -365,6 +394,31 @@ static const luaL_Reg _mSTList[] = {
 	{ NULL, NULL }
 };
 
+static void _luaChunkFree(void* value) {
+	struct mScriptEngineLuaChunk* chunk = value;
+	free(chunk->source);
+	free(chunk->bytecode);
+	free(chunk);
+}
+
+void _luaEngineInit(struct mScriptEngine2* engine) {
+	struct mScriptEngineLua* lua = (struct mScriptEngineLua*) engine;
+	if (lua->users++) {
+		return;
+	}
+	MutexInit(&lua->chunkLock);
+	HashTableInit(&lua->chunks, 0, _luaChunkFree);
+}
+
+void _luaEngineDeinit(struct mScriptEngine2* engine) {
+	struct mScriptEngineLua* lua = (struct mScriptEngineLua*) engine;
+	if (!lua->users || --lua->users) {
+		return;
+	}
+	HashTableDeinit(&lua->chunks);
+	MutexDeinit(&lua->chunkLock);
+}
+
 struct mScriptEngineContext* _luaCreate(struct mScriptEngine2* engine, struct mScriptContext* context) {
 	struct mScriptEngineContextLua* luaContext = calloc(1, sizeof(*luaContext));
 	luaContext->d = (struct mScriptEngineContext) {
@@ -381,9 +435,13 @@ struct mScriptEngineContext* _luaCreate(struct mScriptEngine2* engine, struct mS
 	};
 	luaContext->lua = luaL_newstate();
 	luaContext->func = -1;
+	mScriptFrameInit(&luaContext->frame);
 
 	luaL_openlibs(luaContext->lua);
 
+	lua_newtable(luaContext->lua);
+	luaContext->methods = luaL_ref(luaContext->lua, LUA_REGISTRYINDEX);
+
 	luaL_newmetatable(luaContext->lua, "mSTStruct");
 #if LUA_VERSION_NUM < 502
 	luaL_register(luaContext->lua, NULL, _mSTStruct);
@@ -477,7 +535,11 @@ void _luaDestroy(struct mScriptEngineContext* ctx) {
 	if (luaContext->require > 0) {
 		luaL_unref(luaContext->lua, LUA_REGISTRYINDEX, luaContext->require);
 	}
+	if (luaContext->methods > 0) {
+		luaL_unref(luaContext->lua, LUA_REGISTRYINDEX, luaContext->methods);
+	}
 	lua_close(luaContext->lua);
+	mScriptFrameDeinit(&luaContext->frame);
 
 	HashTableDeinit(&luaContext->d.docroot);
 	free(luaContext);
@@ -621,6 +683,36 @@ struct mScriptValue* _luaCoerceTable(struct mScriptEngineContextLua* luaContext)
 	return list;
 }
 
+static bool _luaCoercePrimitive(struct mScriptEngineContextLua* luaContext, struct mScriptValue* out) {
+#if LUA_VERSION_NUM < 503
+	lua_Number number;
+#endif
+	switch (lua_type(luaContext->lua, -1)) {
+	case LUA_TNUMBER:
+#if LUA_VERSION_NUM >= 503
+		if (lua_isinteger(luaContext->lua, -1)) {
+			*out = mSCRIPT_MAKE_S64(lua_tointeger(luaContext->lua, -1));
+			return true;
+		}
+		*out = mSCRIPT_MAKE_F64(lua_tonumber(luaContext->lua, -1));
+#else
+		// Lua 5.1 and LuaJIT only have doubles, so whole numbers are treated as integers instead
+		number = lua_tonumber(luaContext->lua, -1);
+		if (number >= -9223372036854775808.0 && number < 9223372036854775808.0 && number == (int64_t) number) {
+			*out = mSCRIPT_MAKE_S64(number);
+		} else {
+			*out = mSCRIPT_MAKE_F64(number);
+		}
+#endif
+		return true;
+	case LUA_TBOOLEAN:
+		*out = mSCRIPT_MAKE_BOOL(lua_toboolean(luaContext->lua, -1));
+		return true;
+	default:
+		return false;
+	}
+}
+
 struct mScriptValue* _luaCoerce(struct mScriptEngineContextLua* luaContext, bool pop) {
 	if (lua_isnone(luaContext->lua, -1)) {
 		lua_pop(luaContext->lua, 1);
@@ -629,25 +721,19 @@ struct mScriptValue* _luaCoerce(struct mScriptEngineContextLua* luaContext, bool
 
 	size_t size;
 	const void* buffer;
+	struct mScriptValue primitive;
 	struct mScriptValue* value = NULL;
 	switch (lua_type(luaContext->lua, -1)) {
 	case LUA_TNIL:
 		value = &mScriptValueNull;
 		break;
 	case LUA_TNUMBER:
-#if LUA_VERSION_NUM >= 503
-		if (lua_isinteger(luaContext->lua, -1)) {
-			value = mScriptValueAlloc(mSCRIPT_TYPE_MS_S64);
-			value->value.s64 = lua_tointeger(luaContext->lua, -1);
+	case LUA_TBOOLEAN:
+		if (!_luaCoercePrimitive(luaContext, &primitive)) {
 			break;
 		}
-#endif
-		value = mScriptValueAlloc(mSCRIPT_TYPE_MS_F64);
-		value->value.f64 = lua_tonumber(luaContext->lua, -1);
-		break;
-	case LUA_TBOOLEAN:
-		value = mScriptValueAlloc(mSCRIPT_TYPE_MS_BOOL);
-		value->value.u32 = lua_toboolean(luaContext->lua, -1);
+		value = mScriptValueAlloc(primitive.type);
+		value->value = primitive.value;
 		break;
 	case LUA_TSTRING:
 		buffer = lua_tolstring(luaContext->lua, -1, &size);
@@ -810,6 +896,113 @@ static const char* _reader(lua_State* lua, void* context, size_t* size) {
 	return reader->block;
 }
 
+struct mScriptEngineLuaWriter {
+	char* buffer;
+	size_t size;
+	size_t capacity;
+};
+
+static int _writer(lua_State* lua, const void* data, size_t size, void* context) {
+	UNUSED(lua);
+	struct mScriptEngineLuaWriter* writer = context;
+	if (writer->size + size > writer->capacity) {
+		size_t capacity = writer->capacity ? writer->capacity : LUA_BLOCKSIZE;
+		while (writer->size + size > capacity) {
+			capacity *= 2;
+		}
+		char* buffer = realloc(writer->buffer, capacity);
+		if (!buffer) {
+			return 1;
+		}
+		writer->buffer = buffer;
+		writer->capacity = capacity;
+	}
+	memcpy(&writer->buffer[writer->size], data, size);
+	writer->size += size;
+	return 0;
+}
+
+static char* _luaReadSource(struct VFile* vf, size_t* size) {
+	// Leave room past the end so hitting EOF doesn't need a reallocation
+	ssize_t capacity = vf->size(vf) + 1;
+	if (capacity < LUA_BLOCKSIZE) {
+		capacity = LUA_BLOCKSIZE;
+	}
+	char* source = malloc(capacity);
+	*size = 0;
+	while (true) {
+		if ((ssize_t) *size == capacity) {
+			capacity *= 2;
+			char* newSource = realloc(source, capacity);
+			if (!newSource) {
+				break;
+			}
+			source = newSource;
+		}
+		ssize_t s = vf->read(vf, &source[*size], capacity - *size);
+		if (s < 0) {
+			break;
+		}
+		if (!s) {
+			return source;
+		}
+		*size += s;
+	}
+	free(source);
+	return NULL;
+}
+
+static int _luaLoadCached(struct mScriptEngineContextLua* luaContext, const char* chunkname, struct VFile* vf) {
+	size_t size;
+	char* source = _luaReadSource(vf, &size);
+	if (!source) {
+		lua_pushliteral(luaContext->lua, "Could not read script");
+		return LUA_ERRSYNTAX;
+	}
+	uint32_t hash = hash32(source, size, 0);
+
+	int ret;
+	MutexLock(&_engineLua.chunkLock);
+	struct mScriptEngineLuaChunk* chunk = HashTableLookup(&_engineLua.chunks, chunkname);
+	if (chunk && chunk->hash == hash && chunk->sourceSize == size && memcmp(chunk->source, source, size) == 0) {
+		ret = luaL_loadbufferx(luaContext->lua, chunk->bytecode, chunk->bytecodeSize, chunkname, "b");
+		if (ret == LUA_OK) {
+			MutexUnlock(&_engineLua.chunkLock);
+			free(source);
+			return ret;
+		}
+		lua_pop(luaContext->lua, 1);
+	}
+	MutexUnlock(&_engineLua.chunkLock);
+
+	ret = luaL_loadbufferx(luaContext->lua, source, size, chunkname, "t");
+	if (ret != LUA_OK) {
+		free(source);
+		return ret;
+	}
+
+	struct mScriptEngineLuaWriter writer = {0};
+	if (_luaDump(luaContext->lua, _writer, &writer) != 0) {
+		free(writer.buffer);
+		free(source);
+		return ret;
+	}
+	chunk = malloc(sizeof(*chunk));
+	chunk->hash = hash;
+	chunk->source = source;
+	chunk->sourceSize = size;
+	chunk->bytecode = writer.buffer;
+	chunk->bytecodeSize = writer.size;
+
+	MutexLock(&_engineLua.chunkLock);
+	if (HashTableSize(&_engineLua.chunks) >= MAX_CACHED_CHUNKS && !HashTableLookup(&_engineLua.chunks, chunkname)) {
+		HashTableClear(&_engineLua.chunks);
+	}
+	HashTableInsert(&_engineLua.chunks, chunkname, chunk);
+	MutexUnlock(&_engineLua.chunkLock);
+	return ret;
+}
+
 void _luaError(struct mScriptEngineContextLua* luaContext) {
 	struct mScriptValue* console = mScriptContextGetGlobal(luaContext->d.context, "console");
 	struct mScriptValue error = {0};
@@ -845,6 +1038,7 @@ bool _luaLoad(struct mScriptEngineContext* ctx, const char* filename, struct VFi
 	}
 	char name[PATH_MAX + 1];
 	char dirname[PATH_MAX] = {0};
+	bool cacheable = false;
 	if (filename) {
 		if (*filename == '*') {
 			snprintf(name, sizeof(name), "=%s", filename + 1);
@@ -862,18 +1056,29 @@ bool _luaLoad(struct mScriptEngineContext* ctx, const char* filename, struct VFi
 				strncpy(dirname, filename, lastSlash - filename);
 			}
 			snprintf(name, sizeof(name), "@%s", filename);
+			// Code typed into the console is rarely run twice, but files are reloaded often
+			cacheable = _engineLua.users > 0;
 		}
 		filename = name;
 	}
+	int ret;
+	if (cacheable) {
+		ret = _luaLoadCached(luaContext, filename, vf);
+	} else {
 #if LUA_VERSION_NUM >= 502
-	int ret = lua_load(luaContext->lua, _reader, &data, filename, "t");
+		ret = lua_load(luaContext->lua, _reader, &data, filename, "t");
 #else
-	int ret = lua_load(luaContext->lua, _reader, &data, filename);
+		ret = lua_load(luaContext->lua, _reader, &data, filename);
 #endif
+	}
 	switch (ret) {
 	case LUA_OK:
 		if (dirname[0]) {
+#if LUA_VERSION_NUM >= 502
 			lua_getupvalue(luaContext->lua, -1, 1);
+#else
+			lua_getfenv(luaContext->lua, -1);
+#endif
 			lua_pushliteral(luaContext->lua, "require");
 			lua_pushstring(luaContext->lua, dirname);
 			lua_pushcclosure(luaContext->lua, _luaRequireShim, 1);
@@ -933,6 +1138,13 @@ bool _luaPopFrame(struct mScriptEngineContextLua* luaContext, struct mScriptList
 	if (frame) {
 		int i;
 		for (i = 0; i < count; ++i) {
+			struct mScriptValue primitive;
+			if (_luaCoercePrimitive(luaContext, &primitive)) {
+				// Numbers and booleans are stored inline in the frame, so there's no need to box them
+				memcpy(mScriptListAppend(frame), &primitive, sizeof(primitive));
+				lua_pop(luaContext->lua, 1);
+				continue;
+			}
 			struct mScriptValue* value = _luaCoerce(luaContext, true);
 			if (!value) {
 				ok = false;
@@ -1039,35 +1251,103 @@ static struct mScriptEngineContextLua* _luaGetContext(lua_State* lua) {
 	return luaContext;
 }
 
+static struct mScriptFrame* _luaAcquireFrame(struct mScriptEngineContextLua* luaContext, struct mScriptFrame* fallback) {
+	if (luaContext->frameInUse) {
+		// The function being called has called back into Lua, which is calling another function
+		mScriptFrameInit(fallback);
+		return fallback;
+	}
+	luaContext->frameInUse = true;
+	return &luaContext->frame;
+}
+
+static void _luaReleaseFrame(struct mScriptEngineContextLua* luaContext, struct mScriptFrame* frame) {
+	if (frame != &luaContext->frame) {
+		mScriptFrameDeinit(frame);
+		return;
+	}
+	mScriptListClear(&frame->arguments);
+	mScriptListClear(&frame->returnValues);
+	luaContext->frameInUse = false;
+}
+
 int _luaThunk(lua_State* lua) {
 	struct mScriptEngineContextLua* luaContext = _luaGetContext(lua);
-	struct mScriptFrame frame;
-	mScriptFrameInit(&frame);
-	if (!_luaPopFrame(luaContext, &frame.arguments)) {
+	struct mScriptFrame fallback;
+	struct mScriptFrame* frame = _luaAcquireFrame(luaContext, &fallback);
+	if (!_luaPopFrame(luaContext, &frame->arguments)) {
 		mScriptContextDrainPool(luaContext->d.context);
-		mScriptFrameDeinit(&frame);
+		_luaReleaseFrame(luaContext, frame);
 		luaL_traceback(lua, lua, "Error calling function (translating arguments into runtime)", 1);
 		return lua_error(lua);
 	}
 
 	struct mScriptValue* fn = lua_touserdata(lua, lua_upvalueindex(1));
-	if (!fn || !mScriptInvoke(fn, &frame)) {
-		mScriptFrameDeinit(&frame);
+	if (!fn || !mScriptInvoke(fn, frame)) {
+		_luaReleaseFrame(luaContext, frame);
 		luaL_traceback(lua, lua, "Error calling function (invoking failed)", 1);
 		return lua_error(lua);
 	}
 
-	if (!_luaPushFrame(luaContext, &frame.returnValues, true)) {
-		mScriptFrameDeinit(&frame);
+	if (!_luaPushFrame(luaContext, &frame->returnValues, true)) {
+		_luaReleaseFrame(luaContext, frame);
 		luaL_traceback(lua, lua, "Error calling function (translating return values from runtime)", 1);
 		return lua_error(lua);
 	}
 	mScriptContextDrainPool(luaContext->d.context);
-	mScriptFrameDeinit(&frame);
+	_luaReleaseFrame(luaContext, frame);
 
 	return lua_gettop(luaContext->lua);
 }
 
+static struct mScriptTypeClass* _luaGetClass(struct mScriptValue* obj) {
+	if (obj->type->base == mSCRIPT_TYPE_WRAPPER) {
+		obj = mScriptValueUnwrap(obj);
+	}
+	if (obj->type->base != mSCRIPT_TYPE_OBJECT) {
+		return NULL;
+	}
+	return obj->type->details.cls;
+}
+
+// Bound functions don't capture the object they were looked up on, so the closure made the first time
+// a class member is looked up can be reused for every later lookup of that member on the class.
+// Expects the key on the top of the stack, and on a hit leaves the cached closure above it.
+static bool _luaGetCachedMethod(struct mScriptEngineContextLua* luaContext, struct mScriptTypeClass* cls) {
+	lua_rawgeti(luaContext->lua, LUA_REGISTRYINDEX, luaContext->methods);
+	lua_pushlightuserdata(luaContext->lua, cls);
+	lua_rawget(luaContext->lua, -2);
+	if (lua_type(luaContext->lua, -1) != LUA_TTABLE) {
+		lua_pop(luaContext->lua, 2);
+		return false;
+	}
+	lua_pushvalue(luaContext->lua, -3);
+	lua_rawget(luaContext->lua, -2);
+	if (lua_type(luaContext->lua, -1) != LUA_TFUNCTION) {
+		lua_pop(luaContext->lua, 3);
+		return false;
+	}
+	return true;
+}
+
+// Expects the closure on the top of the stack, and leaves it there
+static void _luaCacheMethod(struct mScriptEngineContextLua* luaContext, struct mScriptTypeClass* cls, const char* key) {
+	lua_rawgeti(luaContext->lua, LUA_REGISTRYINDEX, luaContext->methods);
+	lua_pushlightuserdata(luaContext->lua, cls);
+	lua_rawget(luaContext->lua, -2);
+	if (lua_type(luaContext->lua, -1) != LUA_TTABLE) {
+		lua_pop(luaContext->lua, 1);
+		lua_newtable(luaContext->lua);
+		lua_pushlightuserdata(luaContext->lua, cls);
+		lua_pushvalue(luaContext->lua, -2);
+		lua_rawset(luaContext->lua, -4);
+	}
+	lua_pushstring(luaContext->lua, key);
+	lua_pushvalue(luaContext->lua, -4);
+	lua_rawset(luaContext->lua, -3);
+	lua_pop(luaContext->lua, 2);
+}
+
 int _luaGetObject(lua_State* lua) {
 	struct mScriptEngineContextLua* luaContext = _luaGetContext(lua);
 	char key[MAX_KEY_SIZE];
@@ -1080,15 +1360,21 @@ int _luaGetObject(lua_State* lua) {
 		luaL_traceback(lua, lua, "Invalid key", 1);
 		return lua_error(lua);
 	}
-	strlcpy(key, keyPtr, sizeof(key));
-	lua_pop(lua, 2);
 
 	obj = mScriptContextAccessWeakref(luaContext->d.context, obj);
 	if (!obj) {
+		lua_pop(lua, 2);
 		luaL_traceback(lua, lua, "Invalid object", 1);
 		return lua_error(lua);
 	}
 
+	struct mScriptTypeClass* cls = _luaGetClass(obj);
+	if (cls && _luaGetCachedMethod(luaContext, cls)) {
+		return 1;
+	}
+	strlcpy(key, keyPtr, sizeof(key));
+	lua_pop(lua, 2);
+
 	if (!mScriptObjectGet(obj, key, &val)) {
 		char error[MAX_KEY_SIZE + 16];
 		snprintf(error, sizeof(error), "Invalid key '%s'", key);
@@ -1096,10 +1382,19 @@ int _luaGetObject(lua_State* lua) {
 		return lua_error(lua);
 	}
 
+	const struct mScriptValue* fn = &val;
+	if (val.type->base == mSCRIPT_TYPE_WRAPPER) {
+		fn = mScriptValueUnwrapConst(&val);
+	}
+	bool isMethod = fn->type->base == mSCRIPT_TYPE_FUNCTION && fn->type->alloc;
+
 	if (!_luaWrap(luaContext, &val)) {
 		luaL_traceback(lua, lua, "Error translating value from runtime", 1);
 		return lua_error(lua);
 	}
+	if (cls && isMethod) {
+		_luaCacheMethod(luaContext, cls, key);
+	}
 	return 1;
 }
 
@@ -1203,7 +1498,7 @@ int _luaGetTable(lua_State* lua) {
 
 int _luaLenTable(lua_State* lua) {
 	struct mScriptEngineContextLua* luaContext = _luaGetContext(lua);
-	struct mScriptValue* obj = lua_touserdata(lua, -1);
+	struct mScriptValue* obj = lua_touserdata(lua, 1);
 	lua_pop(lua, 1);
 
 	obj = mScriptContextAccessWeakref(luaContext->d.context, obj);
@@ -1323,7 +1618,7 @@ int _luaGetList(lua_State* lua) {
 
 static int _luaLenList(lua_State* lua) {
 	struct mScriptEngineContextLua* luaContext = _luaGetContext(lua);
-	struct mScriptValue* obj = lua_touserdata(lua, -1);
+	struct mScriptValue* obj = lua_touserdata(lua, 1);
 	lua_pop(lua, 1);
 
 	obj = mScriptContextAccessWeakref(luaContext->d.context, obj);
@@ -32,9 +32,36 @@ static void _mScriptCallbackRemove(struct mScriptCallbackManager* adapter, uint3
 	mScriptContextRemoveCallback(adapter->context, id);
 }
 
+static uint32_t _mScriptCallbackAddMemory(struct mScriptCallbackManager* adapter, enum mScriptMemoryAccessType type, uint32_t address, uint32_t length, struct mScriptValue* fn, uint32_t batch) {
+	if (fn->type->base == mSCRIPT_TYPE_WRAPPER) {
+		fn = mScriptValueUnwrap(fn);
+	}
+	uint32_t id = 0;
+	if (batch <= mSCRIPT_CALLBACK_BATCH_FRAME) {
+		id = mScriptContextAddMemoryCallback(adapter->context, type, address, length, batch, fn);
+	}
+	mScriptValueDeref(fn);
+	return id;
+}
+
+static uint32_t _mScriptCallbackOnRead(struct mScriptCallbackManager* adapter, uint32_t address, uint32_t length, struct mScriptValue* fn, uint32_t batch) {
+	return _mScriptCallbackAddMemory(adapter, mSCRIPT_MEMORY_ACCESS_READ, address, length, fn, batch);
+}
+
+static uint32_t _mScriptCallbackOnWrite(struct mScriptCallbackManager* adapter, uint32_t address, uint32_t length, struct mScriptValue* fn, uint32_t batch) {
+	return _mScriptCallbackAddMemory(adapter, mSCRIPT_MEMORY_ACCESS_WRITE, address, length, fn, batch);
+}
+
+static uint32_t _mScriptCallbackOnExecute(struct mScriptCallbackManager* adapter, uint32_t address, uint32_t length, struct mScriptValue* fn, uint32_t batch) {
+	return _mScriptCallbackAddMemory(adapter, mSCRIPT_MEMORY_ACCESS_EXECUTE, address, length, fn, batch);
+}
+
 mSCRIPT_DECLARE_STRUCT(mScriptCallbackManager);
 mSCRIPT_DECLARE_STRUCT_METHOD(mScriptCallbackManager, U32, add, _mScriptCallbackAdd, 2, STR, callback, WRAPPER, function);
 mSCRIPT_DECLARE_STRUCT_VOID_METHOD(mScriptCallbackManager, remove, _mScriptCallbackRemove, 1, U32, cbid);
+mSCRIPT_DECLARE_STRUCT_METHOD_WITH_DEFAULTS(mScriptCallbackManager, U32, onRead, _mScriptCallbackOnRead, 4, U32, address, U32, length, WRAPPER, function, U32, batch);
+mSCRIPT_DECLARE_STRUCT_METHOD_WITH_DEFAULTS(mScriptCallbackManager, U32, onWrite, _mScriptCallbackOnWrite, 4, U32, address, U32, length, WRAPPER, function, U32, batch);
+mSCRIPT_DECLARE_STRUCT_METHOD_WITH_DEFAULTS(mScriptCallbackManager, U32, onExecute, _mScriptCallbackOnExecute, 4, U32, address, U32, length, WRAPPER, function, U32, batch);
 
 static uint64_t mScriptMakeBitmask(struct mScriptList* list) {
 	size_t i;
@@ -68,6 +95,27 @@ static struct mScriptValue* mScriptExpandBitmask(uint64_t mask) {
 mSCRIPT_BIND_FUNCTION(mScriptMakeBitmask_Binding, U64, mScriptMakeBitmask, 1, LIST, bits);
 mSCRIPT_BIND_FUNCTION(mScriptExpandBitmask_Binding, WLIST, mScriptExpandBitmask, 1, U64, mask);
 
+mSCRIPT_DEFINE_STRUCT_BINDING_DEFAULTS(mScriptCallbackManager, onRead)
+	mSCRIPT_NO_DEFAULT,
+	mSCRIPT_NO_DEFAULT,
+	mSCRIPT_NO_DEFAULT,
+	mSCRIPT_U32(mSCRIPT_CALLBACK_BATCH_INSTRUCTION)
+mSCRIPT_DEFINE_DEFAULTS_END;
+
+mSCRIPT_DEFINE_STRUCT_BINDING_DEFAULTS(mScriptCallbackManager, onWrite)
+	mSCRIPT_NO_DEFAULT,
+	mSCRIPT_NO_DEFAULT,
+	mSCRIPT_NO_DEFAULT,
+	mSCRIPT_U32(mSCRIPT_CALLBACK_BATCH_INSTRUCTION)
+mSCRIPT_DEFINE_DEFAULTS_END;
+
+mSCRIPT_DEFINE_STRUCT_BINDING_DEFAULTS(mScriptCallbackManager, onExecute)
+	mSCRIPT_NO_DEFAULT,
+	mSCRIPT_NO_DEFAULT,
+	mSCRIPT_NO_DEFAULT,
+	mSCRIPT_U32(mSCRIPT_CALLBACK_BATCH_INSTRUCTION)
+mSCRIPT_DEFINE_DEFAULTS_END;
+
 mSCRIPT_DEFINE_STRUCT(mScriptCallbackManager)
 	mSCRIPT_DEFINE_CLASS_DOCSTRING(
 		"A global singleton object `callbacks` used for managing callbacks. The following callbacks are defined:\n\n"
@@ -86,6 +134,20 @@ mSCRIPT_DEFINE_STRUCT(mScriptCallbackManager)
 	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptCallbackManager, add)
 	mSCRIPT_DEFINE_DOCSTRING("Remove a callback with the previously retuned id")
 	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptCallbackManager, remove)
+	mSCRIPT_DEFINE_DOCSTRING(
+		"Call a function whenever the emulated CPU reads from the given range of the bus. "
+		"The function is passed the address and value of the read. By default it is called "
+		"right after the instruction doing the read; passing C.CALLBACK_BATCH.FRAME instead "
+		"defers it to the end of the frame, with repeated reads of one address merged into a "
+		"single call carrying the latest value. Adding one of these callbacks turns off "
+		"run-ahead until the core is detached from the script. The returned id can be passed "
+		"to `remove`"
+	)
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptCallbackManager, onRead)
+	mSCRIPT_DEFINE_DOCSTRING("Call a function whenever the emulated CPU writes to the given range of the bus. This works like `onRead`, but the value passed is the one being written")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptCallbackManager, onWrite)
+	mSCRIPT_DEFINE_DOCSTRING("Call a function whenever the emulated CPU is about to execute an instruction in the given range of the bus. The function is only passed the address. This works like `onRead` otherwise")
+	mSCRIPT_DEFINE_STRUCT_METHOD(mScriptCallbackManager, onExecute)
 mSCRIPT_DEFINE_END;
 
 void mScriptContextAttachStdlib(struct mScriptContext* context) {
@@ -109,6 +171,11 @@ void mScriptContextAttachStdlib(struct mScriptContext* context) {
 		mSCRIPT_CONSTANT_PAIR(SAVESTATE, ALL),
 		mSCRIPT_KV_SENTINEL
 	});
+	mScriptContextExportConstants(context, "CALLBACK_BATCH", (struct mScriptKVPair[]) {
+		mSCRIPT_CONSTANT_PAIR(mSCRIPT_CALLBACK_BATCH, INSTRUCTION),
+		mSCRIPT_CONSTANT_PAIR(mSCRIPT_CALLBACK_BATCH, FRAME),
+		mSCRIPT_KV_SENTINEL
+	});
 	mScriptContextExportConstants(context, "PLATFORM", (struct mScriptKVPair[]) {
 		mSCRIPT_CONSTANT_PAIR(mPLATFORM, NONE),
 		mSCRIPT_CONSTANT_PAIR(mPLATFORM, GBA),
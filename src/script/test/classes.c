@@ -37,6 +37,7 @@ struct TestD {
 };
 
 struct TestE {
+	int32_t offset;
 };
 
 struct TestF {
@@ -72,8 +73,7 @@ static void testAv2(struct TestA* a, int b, int c) {
 }
 
 static int32_t testGet(struct TestE* e, const char* name) {
-	UNUSED(e);
-	return name[0];
+	return name[0] + e->offset;
 }
 
 static void testDeinit(struct TestF* f) {
@@ -931,17 +931,18 @@ M_TEST_DEFINE(testEGet) {
 	struct mScriptTypeClass* cls = mSCRIPT_TYPE_MS_S(TestE)->details.cls;
 
 	struct TestE s = {
+		.offset = 0x100
 	};
 
 	struct mScriptValue sval = mSCRIPT_MAKE_S(TestE, &s);
 	struct mScriptValue val;
 	struct mScriptValue compare;
 
-	compare = mSCRIPT_MAKE_S32('a');
+	compare = mSCRIPT_MAKE_S32('a' + 0x100);
 	assert_true(mScriptObjectGet(&sval, "a", &val));
 	assert_true(compare.type->equal(&compare, &val));
 
-	compare = mSCRIPT_MAKE_S32('b');
+	compare = mSCRIPT_MAKE_S32('b' + 0x100);
 	assert_true(mScriptObjectGet(&sval, "b", &val));
 	assert_true(compare.type->equal(&compare, &val));
 
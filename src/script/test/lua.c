@@ -585,6 +585,74 @@ M_TEST_DEFINE(globalStructMethods) {
 	mScriptContextDeinit(&context);
 }
 
+M_TEST_DEFINE(globalStructMethodsShared) {
+	SETUP_LUA;
+
+	struct Test s = {
+		.i = 1,
+	};
+	struct Test t = {
+		.i = 2,
+	};
+	struct mScriptValue a = mSCRIPT_MAKE_S(Test, &s);
+	struct mScriptValue b = mSCRIPT_MAKE_S(Test, &t);
+	assert_true(lua->setGlobal(lua, "a", &a));
+	assert_true(lua->setGlobal(lua, "b", &b));
+
+	// Looking up the same method again, even on another object, must not bind it to the first one
+	TEST_PROGRAM("assert(a.i0 == b.i0)");
+	TEST_PROGRAM("assert(a:i0() == 1)");
+	TEST_PROGRAM("assert(b:i0() == 2)");
+	TEST_PROGRAM("assert(a.i0(b) == 2)");
+	TEST_PROGRAM("a:v1(b:i1(3))");
+	assert_int_equal(s.i, 6);
+	assert_int_equal(t.i, 2);
+
+	mScriptContextDeinit(&context);
+}
+
+M_TEST_DEFINE(loadCached) {
+	const char* program = "a = 1\nb = a + 1\n";
+	const char* changed = "a = 3\nb = a + 1\n";
+	const char* failing = "a = 1\nerror('line two')\n";
+	struct mScriptValue* val;
+	int i;
+
+	for (i = 0; i < 2; ++i) {
+		// The second load of the same file in a new context comes out of the chunk cache
+		SETUP_LUA;
+		struct VFile* vf = VFileFromConstMemory(program, strlen(program));
+		assert_true(lua->load(lua, "cached.lua", vf));
+		vf->close(vf);
+		assert_true(lua->run(lua));
+		val = lua->getGlobal(lua, "b");
+		assert_non_null(val);
+		assert_int_equal(val->value.s32, 2);
+		mScriptValueDeref(val);
+		mScriptContextDeinit(&context);
+	}
+
+	SETUP_LUA;
+	struct VFile* vf = VFileFromConstMemory(changed, strlen(changed));
+	assert_true(lua->load(lua, "cached.lua", vf));
+	vf->close(vf);
+	assert_true(lua->run(lua));
+	val = lua->getGlobal(lua, "b");
+	assert_non_null(val);
+	assert_int_equal(val->value.s32, 4);
+	mScriptValueDeref(val);
+
+	for (i = 0; i < 2; ++i) {
+		vf = VFileFromConstMemory(failing, strlen(failing));
+		assert_true(lua->load(lua, "failing.lua", vf));
+		vf->close(vf);
+		assert_false(lua->run(lua));
+		assert_non_null(strstr(lua->getError(lua), "failing.lua:2:"));
+	}
+
+	mScriptContextDeinit(&context);
+}
+
 M_TEST_DEFINE(errorReporting) {
 	SETUP_LUA;
 
@@ -721,6 +789,8 @@ M_TEST_SUITE_DEFINE_SETUP_TEARDOWN(mScriptLua,
 	cmocka_unit_test(globalStructFieldGet),
 	cmocka_unit_test(globalStructFieldSet),
 	cmocka_unit_test(globalStructMethods),
+	cmocka_unit_test(globalStructMethodsShared),
+	cmocka_unit_test(loadCached),
 	cmocka_unit_test(errorReporting),
 	cmocka_unit_test(tableLookup),
 	cmocka_unit_test(tableIterate),
@@ -29,12 +29,14 @@ static void _destroyBreakpoint(struct mBreakpoint* breakpoint) {
 	if (breakpoint->condition) {
 		parseFree(breakpoint->condition);
 	}
+	parseProgramFree(breakpoint->compiledCondition);
 }
 
 static void _destroyWatchpoint(struct mWatchpoint* watchpoint) {
 	if (watchpoint->condition) {
 		parseFree(watchpoint->condition);
 	}
+	parseProgramFree(watchpoint->compiledCondition);
 }
 
 static void SM83DebuggerCheckBreakpoints(struct mDebuggerPlatform* d) {
@@ -46,7 +48,7 @@ static void SM83DebuggerCheckBreakpoints(struct mDebuggerPlatform* d) {
 	if (breakpoint->condition) {
 		int32_t value;
 		int segment;
-		if (!mDebuggerEvaluateParseTree(d->p, breakpoint->condition, &value, &segment) || !(value || segment >= 0)) {
+		if (!breakpoint->compiledCondition || !mDebuggerEvaluateProgram(d->p, breakpoint->compiledCondition, &value, &segment) || !(value || segment >= 0)) {
 			return;
 		}
 	}
@@ -70,6 +72,7 @@ static void SM83DebuggerListWatchpoints(struct mDebuggerPlatform*, struct mWatch
 static void SM83DebuggerCheckBreakpoints(struct mDebuggerPlatform*);
 static bool SM83DebuggerHasBreakpoints(struct mDebuggerPlatform*);
 static void SM83DebuggerTrace(struct mDebuggerPlatform*, char* out, size_t* length);
+static uint32_t SM83DebuggerCurrentAddress(struct mDebuggerPlatform*, const char** mode);
 
 struct mDebuggerPlatform* SM83DebuggerPlatformCreate(void) {
 	struct SM83Debugger* platform = malloc(sizeof(struct SM83Debugger));
@@ -83,10 +86,13 @@ struct mDebuggerPlatform* SM83DebuggerPlatformCreate(void) {
 	platform->d.listWatchpoints = SM83DebuggerListWatchpoints;
 	platform->d.checkBreakpoints = SM83DebuggerCheckBreakpoints;
 	platform->d.hasBreakpoints = SM83DebuggerHasBreakpoints;
+	platform->d.runLoop = NULL;
 	platform->d.trace = SM83DebuggerTrace;
 	platform->d.getStackTraceMode = NULL;
 	platform->d.setStackTraceMode = NULL;
 	platform->d.updateStackTrace = NULL;
+	platform->d.registerPointer = NULL;
+	platform->d.currentAddress = SM83DebuggerCurrentAddress;
 	platform->printStatus = NULL;
 	return &platform->d;
 }
@@ -130,6 +136,7 @@ static ssize_t SM83DebuggerSetBreakpoint(struct mDebuggerPlatform* d, const stru
 	struct SM83Debugger* debugger = (struct SM83Debugger*) d;
 	struct mBreakpoint* breakpoint = mBreakpointListAppend(&debugger->breakpoints);
 	*breakpoint = *info;
+	breakpoint->compiledCondition = parseCompile(d->p, info->condition);
 	breakpoint->id = debugger->nextId;
 	++debugger->nextId;
 	return breakpoint->id;
@@ -177,6 +184,7 @@ static ssize_t SM83DebuggerSetWatchpoint(struct mDebuggerPlatform* d, const stru
 	}
 	struct mWatchpoint* watchpoint = mWatchpointListAppend(&debugger->watchpoints);
 	*watchpoint = *info;
+	watchpoint->compiledCondition = parseCompile(d->p, info->condition);
 	watchpoint->id = debugger->nextId;
 	++debugger->nextId;
 	return watchpoint->id;
@@ -221,3 +229,11 @@ static void SM83DebuggerTrace(struct mDebuggerPlatform* d, char* out, size_t* le
 		               cpu->d, cpu->e, cpu->h, cpu->l,
 		               cpu->sp, cpu->memory.currentSegment(cpu, cpu->pc), cpu->pc, disassembly);
 }
+
+static uint32_t SM83DebuggerCurrentAddress(struct mDebuggerPlatform* d, const char** mode) {
+	struct SM83Debugger* debugger = (struct SM83Debugger*) d;
+	if (mode) {
+		*mode = NULL;
+	}
+	return debugger->cpu->pc;
+}
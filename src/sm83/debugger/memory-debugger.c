@@ -47,11 +47,11 @@ static bool _checkWatchpoints(struct SM83Debugger* debugger, uint16_t address, s
 	size_t i;
 	for (i = 0; i < mWatchpointListSize(&debugger->watchpoints); ++i) {
 		watchpoint = mWatchpointListGetPointer(&debugger->watchpoints, i);
-		if (watchpoint->address == address && (watchpoint->segment < 0 || watchpoint->segment == debugger->originalMemory.currentSegment(debugger->cpu, address)) && watchpoint->type & type) {
+		if (address - watchpoint->address < (watchpoint->size ? watchpoint->size : 1) && (watchpoint->segment < 0 || watchpoint->segment == debugger->originalMemory.currentSegment(debugger->cpu, address)) && watchpoint->type & type) {
 			if (watchpoint->condition) {
 				int32_t value;
 				int segment;
-				if (!mDebuggerEvaluateParseTree(debugger->d.p, watchpoint->condition, &value, &segment) || !(value || segment >= 0)) {
+				if (!watchpoint->compiledCondition || !mDebuggerEvaluateProgram(debugger->d.p, watchpoint->compiledCondition, &value, &segment) || !(value || segment >= 0)) {
 					continue;
 				}
 			}
@@ -64,6 +64,7 @@ static bool _checkWatchpoints(struct SM83Debugger* debugger, uint16_t address, s
 			info->address = address;
 			info->type.wp.watchType = watchpoint->type;
 			info->type.wp.accessType = type;
+			info->type.wp.width = 1;
 			info->pointId = watchpoint->id;
 			return true;
 		}
@@ -0,0 +1,22 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include <mgba-util/clock.h>
+
+uint64_t currentTimeUsec(void) {
+#ifndef _MSC_VER
+	struct timeval tv;
+	if (gettimeofday(&tv, 0)) {
+		return 0;
+	}
+	return tv.tv_usec + tv.tv_sec * 1000000LL;
+#else
+	struct timespec ts;
+	if (!timespec_get(&ts, TIME_UTC)) {
+		return 0;
+	}
+	return ts.tv_nsec / 1000 + ts.tv_sec * 1000000LL;
+#endif
+}
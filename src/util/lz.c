@@ -0,0 +1,181 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include <mgba-util/lz.h>
+
+// Each sequence is a token (literal length << 4 | match length - LZ_MIN_MATCH),
+// extra length bytes for either nibble that is saturated, the literals, then a
+// 16-bit little endian match offset. The final sequence carries only literals.
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 0xFFFF
+#define LZ_TAIL 5
+#define LZ_HASH_BITS 12
+
+static inline uint32_t _read32(const uint8_t* p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint32_t _hash(uint32_t value) {
+	return (value * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t* _writeLength(uint8_t* op, size_t length) {
+	while (length >= 0xFF) {
+		*op++ = 0xFF;
+		length -= 0xFF;
+	}
+	*op++ = length;
+	return op;
+}
+
+static uint8_t* _writeSequence(uint8_t* op, const uint8_t* oend, const uint8_t* literals, size_t nLiterals, size_t offset, size_t matchLength) {
+	// Worst case: token, both length extensions, literals and offset
+	if ((size_t) (oend - op) < 1 + nLiterals + nLiterals / 0xFF + 1 + matchLength / 0xFF + 1 + 2) {
+		return NULL;
+	}
+	uint8_t* token = op++;
+	*token = 0;
+	if (nLiterals >= 0xF) {
+		*token = 0xF0;
+		op = _writeLength(op, nLiterals - 0xF);
+	} else {
+		*token = nLiterals << 4;
+	}
+	memcpy(op, literals, nLiterals);
+	op += nLiterals;
+	if (!matchLength) {
+		return op;
+	}
+	*op++ = offset;
+	*op++ = offset >> 8;
+	matchLength -= LZ_MIN_MATCH;
+	if (matchLength >= 0xF) {
+		*token |= 0xF;
+		op = _writeLength(op, matchLength - 0xF);
+	} else {
+		*token |= matchLength;
+	}
+	return op;
+}
+
+size_t lzCompressBound(size_t size) {
+	return size + size / 0xFF + 16;
+}
+
+size_t lzCompress(const void* input, size_t inputSize, void* output, size_t outputSize) {
+	const uint8_t* in = input;
+	const uint8_t* ip = in;
+	const uint8_t* anchor = in;
+	const uint8_t* iend = in + inputSize;
+	uint8_t* op = output;
+	const uint8_t* oend = op + outputSize;
+	uint32_t table[1 << LZ_HASH_BITS] = {0};
+
+	if (inputSize > LZ_MIN_MATCH + LZ_TAIL) {
+		const uint8_t* matchLimit = iend - LZ_TAIL;
+		while (ip + LZ_MIN_MATCH <= matchLimit) {
+			uint32_t sequence = _read32(ip);
+			uint32_t hash = _hash(sequence);
+			const uint8_t* ref = &in[table[hash]];
+			table[hash] = ip - in;
+			if (ref >= ip || ip - ref > LZ_MAX_OFFSET || _read32(ref) != sequence) {
+				// Skip ahead faster through data that isn't matching
+				ip += 1 + ((ip - anchor) >> 6);
+				continue;
+			}
+			const uint8_t* mp = ip + LZ_MIN_MATCH;
+			ref += LZ_MIN_MATCH;
+			while (mp < matchLimit && *mp == *ref) {
+				++mp;
+				++ref;
+			}
+			op = _writeSequence(op, oend, anchor, ip - anchor, mp - ref, mp - ip);
+			if (!op) {
+				return 0;
+			}
+			ip = mp;
+			anchor = ip;
+		}
+	}
+	op = _writeSequence(op, oend, anchor, iend - anchor, 0, 0);
+	if (!op) {
+		return 0;
+	}
+	return op - (uint8_t*) output;
+}
+
+static bool _readLength(const uint8_t** ip, const uint8_t* iend, size_t* length) {
+	uint8_t byte;
+	do {
+		if (*ip >= iend) {
+			return false;
+		}
+		byte = *(*ip)++;
+		*length += byte;
+	} while (byte == 0xFF);
+	return true;
+}
+
+size_t lzDecompress(const void* input, size_t inputSize, void* output, size_t outputSize) {
+	const uint8_t* ip = input;
+	const uint8_t* iend = ip + inputSize;
+	uint8_t* out = output;
+	uint8_t* op = out;
+	const uint8_t* oend = out + outputSize;
+
+	while (ip < iend) {
+		uint8_t token = *ip++;
+		size_t length = token >> 4;
+		if (length == 0xF && !_readLength(&ip, iend, &length)) {
+			return 0;
+		}
+		if ((size_t) (iend - ip) < length || (size_t) (oend - op) < length) {
+			return 0;
+		}
+		memcpy(op, ip, length);
+		ip += length;
+		op += length;
+		if (ip == iend) {
+			break;
+		}
+
+		if (iend - ip < 2) {
+			return 0;
+		}
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (!offset || offset > (size_t) (op - out)) {
+			return 0;
+		}
+		length = token & 0xF;
+		if (length == 0xF && !_readLength(&ip, iend, &length)) {
+			return 0;
+		}
+		length += LZ_MIN_MATCH;
+		if ((size_t) (oend - op) < length) {
+			return 0;
+		}
+		const uint8_t* ref = op - offset;
+		if (offset >= length) {
+			memcpy(op, ref, length);
+			op += length;
+		} else {
+			// Overlapping copies repeat the last offset bytes. Every pass doubles the
+			// length of the repeated run, so long runs take a handful of memcpys.
+			while (length) {
+				size_t chunk = op - ref;
+				if (chunk > length) {
+					chunk = length;
+				}
+				memcpy(op, ref, chunk);
+				op += chunk;
+				length -= chunk;
+			}
+		}
+	}
+	return op - out;
+}
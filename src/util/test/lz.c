@@ -0,0 +1,104 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include "util/test/suite.h"
+
+#include <mgba-util/lz.h>
+
+#define SIZE 0x10000
+
+static void _roundTrip(const uint8_t* data, size_t size, size_t* compressedSize) {
+	size_t bound = lzCompressBound(size);
+	uint8_t* compressed = malloc(bound);
+	uint8_t* decompressed = malloc(size + 1);
+	size_t csize = lzCompress(data, size, compressed, bound);
+	assert_true(csize > 0);
+	assert_true(csize <= bound);
+	assert_int_equal(lzDecompress(compressed, csize, decompressed, size + 1), size);
+	assert_memory_equal(data, decompressed, size);
+	if (compressedSize) {
+		*compressedSize = csize;
+	}
+	free(compressed);
+	free(decompressed);
+}
+
+M_TEST_DEFINE(zeroes) {
+	uint8_t* data = calloc(SIZE, 1);
+	size_t csize;
+	_roundTrip(data, SIZE, &csize);
+	assert_true(csize < SIZE / 100);
+	free(data);
+}
+
+M_TEST_DEFINE(noise) {
+	uint8_t* data = malloc(SIZE);
+	uint32_t seed = 0x12345678;
+	size_t i;
+	for (i = 0; i < SIZE; ++i) {
+		seed = seed * 1103515245 + 12345;
+		data[i] = seed >> 24;
+	}
+	_roundTrip(data, SIZE, NULL);
+	free(data);
+}
+
+M_TEST_DEFINE(mixed) {
+	uint8_t* data = malloc(SIZE);
+	uint32_t seed = 0x87654321;
+	size_t i;
+	for (i = 0; i < SIZE; ++i) {
+		seed = seed * 1103515245 + 12345;
+		// Runs of repeated short patterns broken up by noise
+		if ((i >> 9) & 1) {
+			data[i] = seed >> 24;
+		} else {
+			data[i] = "pokemon"[i % 7];
+		}
+	}
+	size_t csize;
+	_roundTrip(data, SIZE, &csize);
+	assert_true(csize < SIZE * 3 / 4);
+	free(data);
+}
+
+M_TEST_DEFINE(small) {
+	static const uint8_t data[] = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+	size_t size;
+	for (size = 1; size < sizeof(data); ++size) {
+		_roundTrip(data, size, NULL);
+	}
+}
+
+M_TEST_DEFINE(overflow) {
+	uint8_t data[256] = {0};
+	uint8_t compressed[4];
+	assert_int_equal(lzCompress(data, sizeof(data), compressed, sizeof(compressed)), 0);
+
+	uint8_t output[16];
+	size_t csize;
+	uint8_t buffer[64];
+	csize = lzCompress(data, 32, buffer, sizeof(buffer));
+	assert_true(csize > 0);
+	assert_int_equal(lzDecompress(buffer, csize, output, sizeof(output)), 0);
+}
+
+M_TEST_DEFINE(malformed) {
+	// Match offset reaching before the start of the output
+	static const uint8_t badOffset[] = { 0x10, 'a', 0x02, 0x00, 0x00 };
+	// Literal length running past the end of the input
+	static const uint8_t badLength[] = { 0xF0, 0xFF };
+	uint8_t output[64];
+	assert_int_equal(lzDecompress(badOffset, sizeof(badOffset), output, sizeof(output)), 0);
+	assert_int_equal(lzDecompress(badLength, sizeof(badLength), output, sizeof(output)), 0);
+}
+
+M_TEST_SUITE_DEFINE(LZ,
+	cmocka_unit_test(zeroes),
+	cmocka_unit_test(noise),
+	cmocka_unit_test(mixed),
+	cmocka_unit_test(small),
+	cmocka_unit_test(overflow),
+	cmocka_unit_test(malformed))
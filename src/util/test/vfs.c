@@ -5,6 +5,7 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 #include "util/test/suite.h"
 
+#include <mgba-util/crc32.h>
 #include <mgba-util/vfs.h>
 
 #if !defined(MINIMAL_CORE) || MINIMAL_CORE < 2
@@ -145,6 +146,234 @@ M_TEST_DEFINE(mapMemChunk) {
 	vf->close(vf);
 }
 
+M_TEST_DEFINE(writebackSectors) {
+	uint8_t disk[0x3000];
+	memset(disk, 0x11, sizeof(disk));
+	struct VFile* vf = VFileWriteback(VFileFromMemory(disk, sizeof(disk)), NULL, NULL);
+	assert_non_null(vf);
+	assert_int_equal(vf->size(vf), sizeof(disk));
+
+	uint8_t* mem = vf->map(vf, sizeof(disk), MAP_WRITE);
+	assert_non_null(mem);
+	assert_int_equal(mem[0x2FFF], 0x11);
+	mem[0x2010] = 0x22;
+	vf->unmap(vf, mem, sizeof(disk));
+
+	// Nothing reaches the backing file until it's synced
+	assert_int_equal(disk[0x2010], 0x11);
+
+	// Sectors that didn't change aren't rewritten, so this survives the writeback
+	disk[0x10] = 0x33;
+	assert_true(vf->sync(vf, NULL, 0));
+	vf->close(vf);
+	assert_int_equal(disk[0x2010], 0x22);
+	assert_int_equal(disk[0x10], 0x33);
+}
+
+// A directory that can only hold the journal, kept in memory so tests can look at it after
+// the writeback has closed it
+static struct {
+	uint8_t* contents;
+	size_t size;
+	bool exists;
+	int created;
+	int closed;
+} _journal;
+
+static bool (*_journalFileClose)(struct VFile*);
+
+static bool _journalFileStore(struct VFile* vf) {
+	ssize_t size = vf->size(vf);
+	free(_journal.contents);
+	_journal.contents = malloc(size ? size : 1);
+	_journal.size = size;
+	vf->seek(vf, 0, SEEK_SET);
+	vf->read(vf, _journal.contents, size);
+	return _journalFileClose(vf);
+}
+
+static struct VFile* _journalOpenFile(struct VDir* vd, const char* name, int mode) {
+	UNUSED(vd);
+	assert_string_equal(name, "game.sav.journal");
+	if (!_journal.exists) {
+		if (!(mode & O_CREAT)) {
+			return NULL;
+		}
+		_journal.exists = true;
+		_journal.size = 0;
+		++_journal.created;
+	}
+	if (mode & O_TRUNC) {
+		_journal.size = 0;
+	}
+	struct VFile* vf = VFileMemChunk(_journal.contents, _journal.size);
+	_journalFileClose = vf->close;
+	vf->close = _journalFileStore;
+	return vf;
+}
+
+static bool _journalDeleteFile(struct VDir* vd, const char* name) {
+	UNUSED(vd);
+	assert_string_equal(name, "game.sav.journal");
+	_journal.exists = false;
+	return true;
+}
+
+static bool _journalClose(struct VDir* vd) {
+	++_journal.closed;
+	free(vd);
+	return true;
+}
+
+static struct VDir* _openJournalDir(void) {
+	struct VDir* vd = calloc(1, sizeof(*vd));
+	vd->openFile = _journalOpenFile;
+	vd->deleteFile = _journalDeleteFile;
+	vd->close = _journalClose;
+	return vd;
+}
+
+static struct VDir* _journalDir(void) {
+	free(_journal.contents);
+	memset(&_journal, 0, sizeof(_journal));
+	return _openJournalDir();
+}
+
+static struct VDir* _makeJournal(uint32_t size, uint32_t sector, uint8_t fill, bool torn) {
+	struct VDir* vd = _journalDir();
+	uint8_t journal[12 + 4 + 0x1000 + 4];
+	STORE_32LE(0x4A42574D, 0, journal);
+	STORE_32LE(size, 4, journal);
+	STORE_32LE(1, 8, journal);
+	STORE_32LE(sector, 12, journal);
+	memset(&journal[16], fill, 0x1000);
+	uint32_t crc = crc32(0, journal, sizeof(journal) - 4);
+	if (torn) {
+		crc ^= 1;
+	}
+	STORE_32LE(crc, sizeof(journal) - 4, journal);
+	_journal.contents = malloc(sizeof(journal));
+	memcpy(_journal.contents, journal, sizeof(journal));
+	_journal.size = sizeof(journal);
+	_journal.exists = true;
+	return vd;
+}
+
+M_TEST_DEFINE(writebackJournalReplay) {
+	uint8_t disk[0x2000];
+	memset(disk, 0x11, sizeof(disk));
+	struct VFile* vf = VFileWriteback(VFileFromMemory(disk, sizeof(disk)), _makeJournal(sizeof(disk), 1, 0x44, false), "game.sav.journal");
+	assert_non_null(vf);
+	assert_int_equal(disk[0xFFF], 0x11);
+	assert_int_equal(disk[0x1000], 0x44);
+	assert_int_equal(disk[0x1FFF], 0x44);
+	assert_false(_journal.exists);
+
+	uint8_t byte;
+	vf->seek(vf, 0x1800, SEEK_SET);
+	assert_int_equal(vf->read(vf, &byte, 1), 1);
+	assert_int_equal(byte, 0x44);
+	vf->close(vf);
+	assert_int_equal(_journal.closed, 1);
+}
+
+M_TEST_DEFINE(writebackJournalTorn) {
+	uint8_t disk[0x2000];
+	memset(disk, 0x11, sizeof(disk));
+	struct VFile* vf = VFileWriteback(VFileFromMemory(disk, sizeof(disk)), _makeJournal(sizeof(disk), 1, 0x44, true), "game.sav.journal");
+	assert_non_null(vf);
+	assert_int_equal(disk[0x1000], 0x11);
+	assert_false(_journal.exists);
+
+	// Later writebacks still go through the journal normally
+	vf->seek(vf, 0, SEEK_SET);
+	assert_int_equal(vf->write(vf, "\x55", 1), 1);
+	vf->close(vf);
+	assert_int_equal(disk[0], 0x55);
+	assert_int_equal(disk[0x1000], 0x11);
+	assert_int_equal(_journal.created, 1);
+	assert_false(_journal.exists);
+}
+
+M_TEST_DEFINE(writebackJournalOnDemand) {
+	uint8_t disk[0x2000];
+	memset(disk, 0x11, sizeof(disk));
+	struct VFile* vf = VFileWriteback(VFileFromMemory(disk, sizeof(disk)), _journalDir(), "game.sav.journal");
+	assert_non_null(vf);
+
+	// Loading and syncing unchanged savedata never creates a journal
+	assert_true(vf->sync(vf, NULL, 0));
+	vf->close(vf);
+	assert_int_equal(_journal.created, 0);
+	assert_false(_journal.exists);
+
+	vf = VFileWriteback(VFileFromMemory(disk, sizeof(disk)), _journalDir(), "game.sav.journal");
+	vf->seek(vf, 0x1000, SEEK_SET);
+	assert_int_equal(vf->write(vf, "\x55", 1), 1);
+	vf->close(vf);
+	assert_int_equal(disk[0x1000], 0x55);
+	assert_int_equal(_journal.created, 1);
+	assert_false(_journal.exists);
+}
+
+static ssize_t _failWrite(struct VFile* vf, const void* buffer, size_t size) {
+	UNUSED(vf);
+	UNUSED(buffer);
+	UNUSED(size);
+	return -1;
+}
+
+M_TEST_DEFINE(writebackJournalKept) {
+	uint8_t disk[0x2000];
+	memset(disk, 0x11, sizeof(disk));
+	struct VFile* backing = VFileFromMemory(disk, sizeof(disk));
+	backing->write = _failWrite;
+	struct VFile* vf = VFileWriteback(backing, _journalDir(), "game.sav.journal");
+	assert_non_null(vf);
+	vf->seek(vf, 0x1000, SEEK_SET);
+	assert_int_equal(vf->write(vf, "\x55", 1), 1);
+	assert_false(vf->close(vf));
+	assert_int_equal(disk[0x1000], 0x11);
+
+	// The write never finished, so the journal stays around for the next open to replay
+	assert_true(_journal.exists);
+	vf = VFileWriteback(VFileFromMemory(disk, sizeof(disk)), _openJournalDir(), "game.sav.journal");
+	assert_non_null(vf);
+	assert_int_equal(disk[0x1000], 0x55);
+	assert_int_equal(disk[0x1001], 0x11);
+	assert_false(_journal.exists);
+	vf->close(vf);
+}
+
+static bool (*_trackedClose)(struct VFile*);
+static int _closed;
+
+static bool _trackClose(struct VFile* vf) {
+	++_closed;
+	return _trackedClose(vf);
+}
+
+static ssize_t _oversize(struct VFile* vf) {
+	UNUSED(vf);
+	return 0x2000;
+}
+
+M_TEST_DEFINE(writebackFailureCloses) {
+	// The backing file claims to be bigger than it is, so reading it in comes up short
+	uint8_t disk[0x1000] = {0};
+	struct VFile* backing = VFileMemChunk(disk, sizeof(disk));
+	_trackedClose = backing->close;
+	backing->close = _trackClose;
+	backing->size = _oversize;
+	_closed = 0;
+	assert_null(VFileWriteback(backing, _journalDir(), "game.sav.journal"));
+	assert_int_equal(_closed, 1);
+	assert_int_equal(_journal.closed, 1);
+
+	assert_null(VFileWriteback(NULL, _journalDir(), "game.sav.journal"));
+	assert_int_equal(_journal.closed, 1);
+}
+
 M_TEST_SUITE_DEFINE(VFS,
 #if !defined(MINIMAL_CORE) || MINIMAL_CORE < 2
 	cmocka_unit_test(openNullPathR),
@@ -164,4 +393,10 @@ M_TEST_SUITE_DEFINE(VFS,
 	cmocka_unit_test(resizeMemChunk),
 	cmocka_unit_test(mapMem),
 	cmocka_unit_test(mapConstMem),
-	cmocka_unit_test(mapMemChunk))
+	cmocka_unit_test(mapMemChunk),
+	cmocka_unit_test(writebackSectors),
+	cmocka_unit_test(writebackJournalReplay),
+	cmocka_unit_test(writebackJournalTorn),
+	cmocka_unit_test(writebackJournalOnDemand),
+	cmocka_unit_test(writebackJournalKept),
+	cmocka_unit_test(writebackFailureCloses))
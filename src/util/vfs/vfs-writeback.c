@@ -0,0 +1,487 @@
+/* Copyright (c) 2013-2023 Jeffrey Pfau
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+#include <mgba-util/vfs.h>
+
+#include <mgba-util/crc32.h>
+#include <mgba-util/threading.h>
+
+#define SECTOR_SIZE 0x1000
+#define JOURNAL_MAGIC 0x4A42574D
+#define JOURNAL_HEADER_SIZE 12
+
+struct VFileWriteback {
+	struct VFile d;
+	struct VFile* live;
+	struct VFile* backing;
+	struct VDir* journalDir;
+	char* journalName;
+
+	// What the backing file is known to contain
+	uint8_t* shadow;
+	size_t shadowSize;
+	size_t shadowCapacity;
+
+	// The most recent snapshot that hasn't been written yet
+	uint8_t* pending;
+	size_t pendingSize;
+	size_t pendingCapacity;
+	bool dirty;
+
+	uint8_t* working;
+	size_t workingSize;
+	size_t workingCapacity;
+
+	bool failed;
+
+#ifndef DISABLE_THREADING
+	bool onThread;
+	Thread thread;
+	Mutex mutex;
+	Condition cond;
+#endif
+};
+
+static bool _vfwClose(struct VFile* vf);
+static off_t _vfwSeek(struct VFile* vf, off_t offset, int whence);
+static ssize_t _vfwRead(struct VFile* vf, void* buffer, size_t size);
+static ssize_t _vfwWrite(struct VFile* vf, const void* buffer, size_t size);
+static void* _vfwMap(struct VFile* vf, size_t size, int flags);
+static void _vfwUnmap(struct VFile* vf, void* memory, size_t size);
+static void _vfwTruncate(struct VFile* vf, size_t size);
+static ssize_t _vfwSize(struct VFile* vf);
+static bool _vfwSync(struct VFile* vf, void* buffer, size_t size);
+
+#ifndef DISABLE_THREADING
+static THREAD_ENTRY _vfwThread(void* context);
+#endif
+
+static bool _reserve(uint8_t** buffer, size_t* capacity, size_t size) {
+	if (size <= *capacity) {
+		return true;
+	}
+	uint8_t* newBuffer = realloc(*buffer, size);
+	if (!newBuffer) {
+		return false;
+	}
+	*buffer = newBuffer;
+	*capacity = size;
+	return true;
+}
+
+static size_t _sectorLength(size_t offset, size_t size) {
+	size -= offset;
+	return size < SECTOR_SIZE ? size : SECTOR_SIZE;
+}
+
+static bool _writeFully(struct VFile* vf, const void* buffer, size_t size) {
+	return vf->write(vf, buffer, size) == (ssize_t) size;
+}
+
+// Applies a journal left behind by an interrupted writeback. A journal that is incomplete
+// was never committed, so the backing file wasn't touched yet and the journal is dropped.
+static void _replayJournal(struct VFile* backing, struct VFile* journal) {
+	ssize_t journalSize = journal->size(journal);
+	if (journalSize < JOURNAL_HEADER_SIZE + 4) {
+		return;
+	}
+	uint8_t* buffer = malloc(journalSize);
+	if (!buffer) {
+		return;
+	}
+	journal->seek(journal, 0, SEEK_SET);
+	if (journal->read(journal, buffer, journalSize) != journalSize) {
+		free(buffer);
+		return;
+	}
+
+	uint32_t magic;
+	uint32_t size;
+	uint32_t count;
+	LOAD_32LE(magic, 0, buffer);
+	LOAD_32LE(size, 4, buffer);
+	LOAD_32LE(count, 8, buffer);
+	if (magic != JOURNAL_MAGIC) {
+		free(buffer);
+		return;
+	}
+
+	size_t position = JOURNAL_HEADER_SIZE;
+	uint32_t i;
+	for (i = 0; i < count; ++i) {
+		uint32_t sector;
+		if (position + 4 > (size_t) journalSize - 4) {
+			break;
+		}
+		LOAD_32LE(sector, position, buffer);
+		size_t offset = (size_t) sector * SECTOR_SIZE;
+		if (offset >= size) {
+			break;
+		}
+		position += 4 + _sectorLength(offset, size);
+		if (position > (size_t) journalSize - 4) {
+			break;
+		}
+	}
+	uint32_t expected;
+	if (i == count && position <= (size_t) journalSize - 4) {
+		LOAD_32LE(expected, position, buffer);
+		if (expected == crc32(0, buffer, position)) {
+			backing->truncate(backing, size);
+			position = JOURNAL_HEADER_SIZE;
+			for (i = 0; i < count; ++i) {
+				uint32_t sector;
+				LOAD_32LE(sector, position, buffer);
+				size_t offset = (size_t) sector * SECTOR_SIZE;
+				size_t length = _sectorLength(offset, size);
+				backing->seek(backing, offset, SEEK_SET);
+				backing->write(backing, &buffer[position + 4], length);
+				position += 4 + length;
+			}
+			backing->sync(backing, NULL, 0);
+		}
+	}
+	free(buffer);
+}
+
+static bool _writeJournal(struct VFile* journal, const uint8_t* data, size_t size, const uint32_t* sectors, size_t count) {
+	uint8_t header[JOURNAL_HEADER_SIZE];
+	STORE_32LE(JOURNAL_MAGIC, 0, header);
+	STORE_32LE(size, 4, header);
+	STORE_32LE(count, 8, header);
+
+	if (!_writeFully(journal, header, sizeof(header))) {
+		return false;
+	}
+	uint32_t crc = crc32(0, header, sizeof(header));
+	size_t i;
+	for (i = 0; i < count; ++i) {
+		size_t offset = (size_t) sectors[i] * SECTOR_SIZE;
+		size_t length = _sectorLength(offset, size);
+		uint8_t index[4];
+		STORE_32LE(sectors[i], 0, index);
+		if (!_writeFully(journal, index, sizeof(index)) || !_writeFully(journal, &data[offset], length)) {
+			return false;
+		}
+		crc = crc32(crc, index, sizeof(index));
+		crc = crc32(crc, &data[offset], length);
+	}
+	uint8_t trailer[4];
+	STORE_32LE(crc, 0, trailer);
+	if (!_writeFully(journal, trailer, sizeof(trailer))) {
+		return false;
+	}
+	return journal->sync(journal, NULL, 0);
+}
+
+// Writes the sectors of a snapshot that differ from what's already on disk. With a journal
+// the changed sectors are made durable there first, so a write interrupted partway through
+// can always be finished the next time the file is opened. The journal only exists while a
+// commit is in flight: it's created here and deleted again once the backing file is synced.
+static bool _commit(struct VFileWriteback* vfw, const uint8_t* data, size_t size) {
+	size_t nSectors = (size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	uint32_t* sectors = malloc(sizeof(*sectors) * (nSectors ? nSectors : 1));
+	if (!sectors) {
+		return false;
+	}
+	size_t count = 0;
+	size_t offset;
+	for (offset = 0; offset < size; offset += SECTOR_SIZE) {
+		size_t length = _sectorLength(offset, size);
+		if (offset + length > vfw->shadowSize || memcmp(&data[offset], &vfw->shadow[offset], length) != 0) {
+			sectors[count] = offset / SECTOR_SIZE;
+			++count;
+		}
+	}
+	if (!count && size == vfw->shadowSize) {
+		free(sectors);
+		return true;
+	}
+
+	bool success = true;
+	struct VFile* journal = NULL;
+	if (vfw->journalDir) {
+		journal = vfw->journalDir->openFile(vfw->journalDir, vfw->journalName, O_CREAT | O_TRUNC | O_RDWR);
+		if (!journal || !_writeJournal(journal, data, size, sectors, count)) {
+			// Without a committed journal the only safe thing is to leave the file alone
+			if (journal) {
+				journal->close(journal);
+				vfw->journalDir->deleteFile(vfw->journalDir, vfw->journalName);
+			}
+			free(sectors);
+			return false;
+		}
+	}
+	if (size != vfw->shadowSize) {
+		vfw->backing->truncate(vfw->backing, size);
+	}
+	size_t i;
+	for (i = 0; i < count; ++i) {
+		offset = (size_t) sectors[i] * SECTOR_SIZE;
+		size_t length = _sectorLength(offset, size);
+		vfw->backing->seek(vfw->backing, offset, SEEK_SET);
+		if (!_writeFully(vfw->backing, &data[offset], length)) {
+			success = false;
+		}
+	}
+	if (!vfw->backing->sync(vfw->backing, NULL, 0)) {
+		success = false;
+	}
+	free(sectors);
+	if (journal) {
+		journal->close(journal);
+	}
+	if (!success) {
+		// Keep the journal so the next open can finish the job
+		return false;
+	}
+	if (journal) {
+		vfw->journalDir->deleteFile(vfw->journalDir, vfw->journalName);
+	}
+
+	if (_reserve(&vfw->shadow, &vfw->shadowCapacity, size)) {
+		memcpy(vfw->shadow, data, size);
+		vfw->shadowSize = size;
+	} else {
+		vfw->shadowSize = 0;
+	}
+	return true;
+}
+
+// Takes the pending snapshot and writes it out. Must be called with the lock held if there
+// is one; the writer thread drops it during the write itself.
+static void _flushPending(struct VFileWriteback* vfw, bool unlock) {
+	uint8_t* buffer = vfw->working;
+	size_t capacity = vfw->workingCapacity;
+	vfw->working = vfw->pending;
+	vfw->workingSize = vfw->pendingSize;
+	vfw->workingCapacity = vfw->pendingCapacity;
+	vfw->pending = buffer;
+	vfw->pendingCapacity = capacity;
+	vfw->dirty = false;
+
+#ifndef DISABLE_THREADING
+	if (unlock) {
+		MutexUnlock(&vfw->mutex);
+	}
+#else
+	UNUSED(unlock);
+#endif
+	bool success = _commit(vfw, vfw->working, vfw->workingSize);
+#ifndef DISABLE_THREADING
+	if (unlock) {
+		MutexLock(&vfw->mutex);
+	}
+#endif
+	vfw->failed = !success;
+}
+
+// Ownership of the backing file and the journal directory has been taken by this point, so
+// they're closed on failure too
+static struct VFile* _vfwAbandon(struct VFileWriteback* vfw, struct VFile* backing, struct VDir* journalDir) {
+	if (vfw) {
+		free(vfw->shadow);
+		free(vfw->journalName);
+		free(vfw);
+	}
+	if (backing) {
+		backing->close(backing);
+	}
+	if (journalDir) {
+		journalDir->close(journalDir);
+	}
+	return NULL;
+}
+
+struct VFile* VFileWriteback(struct VFile* backing, struct VDir* journalDir, const char* journalName) {
+	if (!backing || (journalDir && !journalName)) {
+		return _vfwAbandon(NULL, backing, journalDir);
+	}
+
+	struct VFileWriteback* vfw = calloc(1, sizeof(*vfw));
+	if (!vfw) {
+		return _vfwAbandon(NULL, backing, journalDir);
+	}
+
+	if (journalDir) {
+		vfw->journalName = strdup(journalName);
+		if (!vfw->journalName) {
+			return _vfwAbandon(vfw, backing, journalDir);
+		}
+		// Only an interrupted writeback leaves a journal behind
+		struct VFile* journal = journalDir->openFile(journalDir, journalName, O_RDWR);
+		if (journal) {
+			_replayJournal(backing, journal);
+			journal->close(journal);
+			journalDir->deleteFile(journalDir, journalName);
+		}
+	}
+
+	ssize_t size = backing->size(backing);
+	if (size < 0) {
+		size = 0;
+	}
+	if (!_reserve(&vfw->shadow, &vfw->shadowCapacity, size ? size : 1)) {
+		return _vfwAbandon(vfw, backing, journalDir);
+	}
+	backing->seek(backing, 0, SEEK_SET);
+	if (size && backing->read(backing, vfw->shadow, size) != size) {
+		return _vfwAbandon(vfw, backing, journalDir);
+	}
+	vfw->shadowSize = size;
+	vfw->live = VFileMemChunk(vfw->shadow, size);
+	if (!vfw->live) {
+		return _vfwAbandon(vfw, backing, journalDir);
+	}
+	vfw->backing = backing;
+	vfw->journalDir = journalDir;
+
+	vfw->d.close = _vfwClose;
+	vfw->d.seek = _vfwSeek;
+	vfw->d.read = _vfwRead;
+	vfw->d.readline = VFileReadline;
+	vfw->d.write = _vfwWrite;
+	vfw->d.map = _vfwMap;
+	vfw->d.unmap = _vfwUnmap;
+	vfw->d.truncate = _vfwTruncate;
+	vfw->d.size = _vfwSize;
+	vfw->d.sync = _vfwSync;
+
+#ifndef DISABLE_THREADING
+	vfw->onThread = true;
+	MutexInit(&vfw->mutex);
+	ConditionInit(&vfw->cond);
+	ThreadCreate(&vfw->thread, _vfwThread, vfw);
+#endif
+
+	return &vfw->d;
+}
+
+static bool _vfwClose(struct VFile* vf) {
+	struct VFileWriteback* vfw = (struct VFileWriteback*) vf;
+	_vfwSync(vf, NULL, 0);
+#ifndef DISABLE_THREADING
+	MutexLock(&vfw->mutex);
+	vfw->onThread = false;
+	ConditionWake(&vfw->cond);
+	MutexUnlock(&vfw->mutex);
+	ThreadJoin(&vfw->thread);
+	MutexDeinit(&vfw->mutex);
+	ConditionDeinit(&vfw->cond);
+#endif
+	bool success = !vfw->failed;
+	vfw->live->close(vfw->live);
+	if (!vfw->backing->close(vfw->backing)) {
+		success = false;
+	}
+	if (vfw->journalDir) {
+		vfw->journalDir->close(vfw->journalDir);
+	}
+	free(vfw->journalName);
+	free(vfw->shadow);
+	free(vfw->pending);
+	free(vfw->working);
+	free(vfw);
+	return success;
+}
+
+static off_t _vfwSeek(struct VFile* vf, off_t offset, int whence) {
+	struct VFileWriteback* vfw = (struct VFileWriteback*) vf;
+	return vfw->live->seek(vfw->live, offset, whence);
+}
+
+static ssize_t _vfwRead(struct VFile* vf, void* buffer, size_t size) {
+	struct VFileWriteback* vfw = (struct VFileWriteback*) vf;
+	return vfw->live->read(vfw->live, buffer, size);
+}
+
+static ssize_t _vfwWrite(struct VFile* vf, const void* buffer, size_t size) {
+	struct VFileWriteback* vfw = (struct VFileWriteback*) vf;
+	return vfw->live->write(vfw->live, buffer, size);
+}
+
+static void* _vfwMap(struct VFile* vf, size_t size, int flags) {
+	struct VFileWriteback* vfw = (struct VFileWriteback*) vf;
+	return vfw->live->map(vfw->live, size, flags);
+}
+
+static void _vfwUnmap(struct VFile* vf, void* memory, size_t size) {
+	struct VFileWriteback* vfw = (struct VFileWriteback*) vf;
+	vfw->live->unmap(vfw->live, memory, size);
+}
+
+static void _vfwTruncate(struct VFile* vf, size_t size) {
+	struct VFileWriteback* vfw = (struct VFileWriteback*) vf;
+	vfw->live->truncate(vfw->live, size);
+}
+
+static ssize_t _vfwSize(struct VFile* vf) {
+	struct VFileWriteback* vfw = (struct VFileWriteback*) vf;
+	return vfw->live->size(vfw->live);
+}
+
+// Snapshots the current contents and hands them to the writer. Snapshots that arrive while
+// an earlier one is still waiting replace it, so a burst of syncs turns into a single write.
+static bool _vfwSync(struct VFile* vf, void* buffer, size_t size) {
+	UNUSED(buffer);
+	UNUSED(size);
+	struct VFileWriteback* vfw = (struct VFileWriteback*) vf;
+	ssize_t liveSize = vfw->live->size(vfw->live);
+	const uint8_t* contents = NULL;
+	if (liveSize > 0) {
+		contents = vfw->live->map(vfw->live, liveSize, MAP_READ);
+	}
+
+#ifndef DISABLE_THREADING
+	MutexLock(&vfw->mutex);
+#endif
+	bool success = !vfw->failed;
+	if (_reserve(&vfw->pending, &vfw->pendingCapacity, liveSize > 0 ? liveSize : 1)) {
+		if (contents) {
+			memcpy(vfw->pending, contents, liveSize);
+		}
+		vfw->pendingSize = liveSize > 0 ? liveSize : 0;
+		vfw->dirty = true;
+	} else {
+		success = false;
+	}
+#ifndef DISABLE_THREADING
+	if (vfw->onThread) {
+		ConditionWake(&vfw->cond);
+	} else if (vfw->dirty) {
+		_flushPending(vfw, false);
+		success = !vfw->failed;
+	}
+	MutexUnlock(&vfw->mutex);
+#else
+	if (vfw->dirty) {
+		_flushPending(vfw, false);
+		success = !vfw->failed;
+	}
+#endif
+	if (contents) {
+		vfw->live->unmap(vfw->live, (void*) contents, liveSize);
+	}
+	return success;
+}
+
+#ifndef DISABLE_THREADING
+static THREAD_ENTRY _vfwThread(void* context) {
+	struct VFileWriteback* vfw = context;
+	ThreadSetName("Savedata Writeback");
+	MutexLock(&vfw->mutex);
+	while (true) {
+		while (!vfw->dirty && vfw->onThread) {
+			ConditionWait(&vfw->cond, &vfw->mutex);
+		}
+		if (!vfw->dirty) {
+			break;
+		}
+		_flushPending(vfw, true);
+	}
+	MutexUnlock(&vfw->mutex);
+	THREAD_EXIT(0);
+}
+#endif